@@ -168,6 +168,7 @@ int getrec(char **pbuf, int *pbufsize, int isrecord)	/* get next input record */
 			return 1;
 		}
 		/* EOF arrived on this file; set up next */
+		rbclose(infile);
 		if (infile != stdin)
 			fclose(infile);
 		infile = NULL;
@@ -181,39 +182,127 @@ int getrec(char **pbuf, int *pbufsize, int isrecord)	/* get next input record */
 
 void nextfile(void)
 {
+	if (infile != NULL)
+		rbclose(infile);
 	if (infile != NULL && infile != stdin)
 		fclose(infile);
 	infile = NULL;
 	argno++;
 }
 
+/*
+ * Input for readrec is taken from the file descriptor in large blocks
+ * rather than through getc(), so that finding the end of a record is a
+ * memchr() over the block instead of a function call per character.
+ * One Rbuf is kept per input FILE; it must be released with rbclose()
+ * whenever that FILE is closed.
+ */
+
+#define	RBUFSIZE	(64 * 1024)
+
+typedef struct Rbuf {
+	FILE	*fp;		/* stream this buffer stands in for */
+	char	*buf;
+	int	off;		/* next unread byte */
+	int	len;		/* end of valid data */
+	struct Rbuf *next;
+} Rbuf;
+
+static Rbuf *rbufs = NULL;
+
+static Rbuf *rbget(FILE *fp)	/* find or make the buffer for fp */
+{
+	Rbuf *rb;
+
+	for (rb = rbufs; rb != NULL; rb = rb->next)
+		if (rb->fp == fp)
+			return rb;
+	if ((rb = (Rbuf *) malloc(sizeof(Rbuf))) == NULL)
+		FATAL("out of memory in rbget");
+	if ((rb->buf = (char *) malloc(RBUFSIZE)) == NULL)
+		FATAL("out of memory in rbget");
+	rb->fp = fp;
+	rb->off = rb->len = 0;
+	rb->next = rbufs;
+	rbufs = rb;
+	return rb;
+}
+
+static int rbfill(Rbuf *rb)	/* refill an empty buffer; 0 at EOF */
+{
+	ssize_t n;
+
+	rb->off = rb->len = 0;
+	while ((n = read(fileno(rb->fp), rb->buf, RBUFSIZE)) == -1 &&
+	    errno == EINTR)
+		;
+	if (n == -1) {		/* treated like EOF, as getc() did */
+		clearerr(rb->fp);
+		return 0;
+	}
+	rb->len = n;
+	return n;
+}
+
+#define	rbgetc(rb)	((rb)->off < (rb)->len || rbfill(rb) > 0 ? \
+			    (uschar) (rb)->buf[(rb)->off++] : EOF)
+
+void rbclose(FILE *fp)	/* discard any buffered input for fp */
+{
+	Rbuf *rb, **prb;
+
+	for (prb = &rbufs; (rb = *prb) != NULL; prb = &rb->next)
+		if (rb->fp == fp) {
+			*prb = rb->next;
+			free(rb->buf);
+			free(rb);
+			return;
+		}
+}
+
 int readrec(char **pbuf, int *pbufsize, FILE *inf)	/* read one record into buf */
 {
-	int sep, c;
-	char *rr, *buf = *pbuf;
+	int sep, c, n;
+	char *rr, *buf = *pbuf, *p, *q;
 	int bufsize = *pbufsize;
+	Rbuf *rb;
 
 	if (strlen(*FS) >= sizeof(inputFS))
 		FATAL("field separator %.10s... is too long", *FS);
 	/*fflush(stdout); avoids some buffering problem but makes it 25% slower*/
 	strlcpy(inputFS, *FS, sizeof inputFS);	/* for subsequent field splitting */
+	rb = rbget(inf);
 	if ((sep = **RS) == 0) {
 		sep = '\n';
-		while ((c=getc(inf)) == '\n' && c != EOF)	/* skip leading \n's */
+		while ((c=rbgetc(rb)) == '\n' && c != EOF)	/* skip leading \n's */
 			;
 		if (c != EOF)
-			ungetc(c, inf);
+			rb->off--;	/* the byte is still in the buffer */
 	}
 	for (rr = buf; ; ) {
-		for (; (c=getc(inf)) != sep && c != EOF; ) {
-			if (rr-buf+1 > bufsize)
-				if (!adjbuf(&buf, &bufsize, 1+rr-buf, recsize, &rr, "readrec 1"))
-					FATAL("input record `%.30s...' too long", buf);
-			*rr++ = c;
+		for (;;) {	/* copy up to the next sep, a block at a time */
+			if (rb->off >= rb->len && rbfill(rb) == 0) {
+				c = EOF;
+				break;
+			}
+			p = rb->buf + rb->off;
+			n = rb->len - rb->off;
+			if ((q = memchr(p, sep, n)) != NULL)
+				n = q - p;
+			if (!adjbuf(&buf, &bufsize, 1+n+rr-buf, recsize, &rr, "readrec 1"))
+				FATAL("input record `%.30s...' too long", buf);
+			memcpy(rr, p, n);
+			rr += n;
+			rb->off += n;
+			if (q != NULL) {
+				rb->off++;	/* skip the separator itself */
+				c = sep;
+				break;
+			}
 		}
 		if (**RS == sep || c == EOF)
 			break;
-		if ((c = getc(inf)) == '\n' || c == EOF) /* 2 in a row */
+		if ((c = rbgetc(rb)) == '\n' || c == EOF) /* 2 in a row */
 			break;
 		if (!adjbuf(&buf, &bufsize, 2+rr-buf, recsize, &rr, "readrec 2"))
 			FATAL("input record `%.30s...' too long", buf);
@@ -120,6 +120,7 @@ extern	void	growfldtab(int n);
 extern	int	getrec(char **, int *, int);
 extern	void	nextfile(void);
 extern	int	readrec(char **buf, int *bufsize, FILE *inf);
+extern	void	rbclose(FILE *);
 extern	char	*getargv(int);
 extern	void	setclvar(char *);
 extern	void	fldbld(void);
@@ -42,6 +42,8 @@
 #include <unistd.h>
 #include <wchar.h>
 
+#include <lbuf.h>
+
 #define	TAB	8
 
 void usage(void);
@@ -49,8 +51,9 @@ void usage(void);
 int
 main(int argc, char *argv[])
 {
+	struct lbuf lb;
 	char	 *line, *p;
-	ssize_t	  linesz;
+	size_t	  linesz;
 	wchar_t	  wc;
 	u_long	  column, newcol, start, stop;
 	int	  ch, len, width;
@@ -90,16 +93,14 @@ main(int argc, char *argv[])
 	if (stop && start > stop)
 		err(1, "illegal start and stop columns");
 
-	line = NULL;
-	while (getline(&line, &linesz, stdin) != -1) {
+	if (lbuf_init(&lb, STDIN_FILENO, '\n') == -1)
+		err(1, NULL);
+	while ((line = lbuf_next(&lb, &linesz)) != NULL) {
 		column = 0;
 		width = 0;
 		for (p = line; *p != '\0'; p += len) {
 			len = 1;
 			switch (*p) {
-			case '\n':
-				putchar('\n');
-				continue;
 			case '\b':
 				/*
 				 * Pass it through if the previous character
@@ -173,8 +174,10 @@ main(int argc, char *argv[])
 
 			column += width;
 		}
+		if (lb.delimited)
+			putchar('\n');
 	}
-	if (ferror(stdin))
+	if (lb.error)
 		err(1, "stdin");
 	if (ferror(stdout))
 		err(1, "stdout");
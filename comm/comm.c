@@ -34,6 +34,7 @@
  */
 
 #include <err.h>
+#include <fcntl.h>
 #include <limits.h>
 #include <locale.h>
 #include <stdio.h>
@@ -41,12 +42,13 @@
 #include <string.h>
 #include <unistd.h>
 
-#define	MAXLINELEN	(LINE_MAX + 1)
+#include <lbuf.h>
 
 char *tabs[] = { "", "\t", "\t\t" };
 
-FILE   *file(const char *);
-void	show(FILE *, char *, char *);
+void	file(struct lbuf *, const char *);
+int	put(char *, char *, size_t, int);
+void	show(struct lbuf *, char *, char *, size_t);
 void	usage(void);
 
 int
@@ -54,9 +56,10 @@ main(int argc, char *argv[])
 {
 	int comp, file1done, file2done, read1, read2;
 	int ch, flag1, flag2, flag3;
-	FILE *fp1, *fp2;
+	struct lbuf lb1, lb2;
 	char *col1, *col2, *col3;
-	char **p, line1[MAXLINELEN], line2[MAXLINELEN];
+	char **p, *line1, *line2;
+	size_t len1, len2;
 	int (*compare)(const char * ,const char *);
 
 	setlocale(LC_ALL, "");
@@ -89,9 +92,11 @@ main(int argc, char *argv[])
 
 	if (argc != 2)
 		usage();
+	if (!strcmp(argv[0], "-") && !strcmp(argv[1], "-"))
+		errx(1, "only one file may be the standard input");
 
-	fp1 = file(argv[0]);
-	fp2 = file(argv[1]);
+	file(&lb1, argv[0]);
+	file(&lb2, argv[1]);
 
 	/* for each column printed, add another tab offset */
 	p = tabs;
@@ -106,19 +111,19 @@ main(int argc, char *argv[])
 	for (read1 = read2 = 1;;) {
 		/* read next line, check for EOF */
 		if (read1)
-			file1done = !fgets(line1, MAXLINELEN, fp1);
+			file1done = (line1 = lbuf_next(&lb1, &len1)) == NULL;
 		if (read2)
-			file2done = !fgets(line2, MAXLINELEN, fp2);
+			file2done = (line2 = lbuf_next(&lb2, &len2)) == NULL;
 
 		/* if one file done, display the rest of the other file */
 		if (file1done) {
 			if (!file2done && col2)
-				show(fp2, col2, line2);
+				show(&lb2, col2, line2, len2);
 			break;
 		}
 		if (file2done) {
 			if (!file1done && col1)
-				show(fp1, col1, line1);
+				show(&lb1, col1, line1, len1);
 			break;
 		}
 
@@ -126,7 +131,7 @@ main(int argc, char *argv[])
 		if (!(comp = compare(line1, line2))) {
 			read1 = read2 = 1;
 			if (col3)
-				if (printf("%s%s", col3, line1) < 0)
+				if (put(col3, line1, len1, lb1.delimited) < 0)
 					break;
 			continue;
 		}
@@ -136,40 +141,56 @@ main(int argc, char *argv[])
 			read1 = 1;
 			read2 = 0;
 			if (col1)
-				if (printf("%s%s", col1, line1) < 0)
+				if (put(col1, line1, len1, lb1.delimited) < 0)
 					break;
 		} else {
 			read1 = 0;
 			read2 = 1;
 			if (col2)
-				if (printf("%s%s", col2, line2) < 0)
+				if (put(col2, line2, len2, lb2.delimited) < 0)
 					break;
 		}
 	}
 
+	if (lb1.error)
+		err(1, "%s", argv[0]);
+	if (lb2.error)
+		err(1, "%s", argv[1]);
 	if (ferror (stdout) || fclose (stdout) == EOF)
 		err(1, "stdout");
 
 	exit(0);
 }
 
+int
+put(char *offset, char *buf, size_t len, int nl)
+{
+	if (fputs(offset, stdout) == EOF ||
+	    fwrite(buf, 1, len, stdout) != len ||
+	    (nl && putchar('\n') == EOF))
+		return (-1);
+	return (0);
+}
+
 void
-show(FILE *fp, char *offset, char *buf)
+show(struct lbuf *lb, char *offset, char *buf, size_t len)
 {
-	while (printf("%s%s", offset, buf) >= 0 && fgets(buf, MAXLINELEN, fp))
+	while (put(offset, buf, len, lb->delimited) == 0 &&
+	    (buf = lbuf_next(lb, &len)) != NULL)
 		;
 }
 
-FILE *
-file(const char *name)
+void
+file(struct lbuf *lb, const char *name)
 {
-	FILE *fp;
+	int fd;
 
 	if (!strcmp(name, "-"))
-		return (stdin);
-	if ((fp = fopen(name, "r")) == NULL)
+		fd = STDIN_FILENO;
+	else if ((fd = open(name, O_RDONLY)) == -1)
 		err(1, "%s", name);
-	return (fp);
+	if (lbuf_init(lb, fd, '\n') == -1)
+		err(1, NULL);
 }
 
 void
@@ -37,6 +37,32 @@ struct z_info {
 	u_int64_t total_out;	/* # bytes out */
 };
 
+/*
+ * random access index of a gzip file, see gzindex.c
+ */
+struct gz_point {
+	u_int64_t out;		/* offset in the uncompressed data */
+	u_int64_t in;		/* offset in the .gz file */
+	int	  bits;		/* # bits of the byte before in still unused */
+	u_int32_t wsize;	/* # bytes of preceding output in window */
+	u_int32_t wlen;		/* length of the compressed window */
+	u_char	 *window;
+};
+
+struct gz_index {
+	u_int64_t size;		/* size of the .gz file */
+	int64_t	  mtime;	/* modification time of the .gz file */
+	long	  mtimensec;	/* and its nanoseconds */
+	u_int64_t total;	/* # bytes uncompressed */
+	u_int32_t crc;		/* crc32 of the uncompressed data */
+	struct gz_point *pt;
+	size_t	  npt;
+	size_t	  maxpt;
+};
+
+#define GZ_SPAN		(4 * 1024 * 1024)	/* distance between points */
+#define GZ_WINSIZE	32768
+
 /*
  * making it any bigger does not affect perfomance very much.
  * actually this value is just a little bit better than 8192.
@@ -72,6 +98,18 @@ extern int gz_read(void *, char *, int);
 extern int gz_write(void *, const char *, int);
 extern int gz_close(void *, struct z_info *, const char *, struct stat *);
 extern int gz_flush(void *, int);
+extern int gz_mkindex(void *);
+extern int gz_saveindex(void *, const char *, struct stat *);
+extern int gz_useindex(void *, const char *, struct stat *);
+extern int gz_njobs;
+
+extern struct gz_index *gzi_alloc(void);
+extern void gzi_free(struct gz_index *);
+extern int gzi_add(struct gz_index *, u_int64_t, u_int64_t, int,
+    const u_char *, size_t);
+extern int gzi_window(const struct gz_point *, u_char *);
+extern int gzi_save(const struct gz_index *, const char *);
+extern struct gz_index *gzi_load(const char *, const struct stat *);
 
 extern void *null_ropen(int, char *, int);
 extern void *null_wopen(int, char *, int, u_int32_t);
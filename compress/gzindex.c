@@ -0,0 +1,255 @@
+/*
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <sys/stat.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../libz/zlib.h"
+#include "compress.h"
+
+/*
+ * Random access index for gzip files, after the zran example that comes
+ * with zlib.  While a deflate stream is inflated, a checkpoint is taken
+ * at a block boundary every GZ_SPAN bytes of output.  A checkpoint holds
+ * the offsets in both streams, the number of bits of the previous byte
+ * that belong to the next block, and the 32KB of output before it, which
+ * is all inflate needs to start from there.
+ *
+ * On disk, all integers are little endian:
+ *
+ *	magic "GZI\2", .gz size (8), .gz mtime (8) and nanoseconds (4),
+ *	uncompressed size (8), crc32 (4), number of checkpoints (4), then
+ *	for each checkpoint:
+ *	output offset (8), input offset (8), bits (4), window size (4),
+ *	compressed window size (4), window compressed with compress2().
+ */
+
+#define GZI_MAGIC	"GZI\2"
+#define GZI_HDRSIZE	40
+
+struct gz_index *
+gzi_alloc(void)
+{
+	return calloc(1, sizeof(struct gz_index));
+}
+
+void
+gzi_free(struct gz_index *idx)
+{
+	size_t i;
+
+	if (idx == NULL)
+		return;
+	for (i = 0; i < idx->npt; i++)
+		free(idx->pt[i].window);
+	free(idx->pt);
+	free(idx);
+}
+
+static struct gz_point *
+gzi_next(struct gz_index *idx)
+{
+	struct gz_point *pt;
+	size_t n;
+
+	if (idx->npt == idx->maxpt) {
+		n = idx->maxpt ? idx->maxpt * 2 : 64;
+		if ((pt = reallocarray(idx->pt, n, sizeof(*pt))) == NULL)
+			return NULL;
+		idx->pt = pt;
+		idx->maxpt = n;
+	}
+	pt = &idx->pt[idx->npt];
+	memset(pt, 0, sizeof(*pt));
+	return pt;
+}
+
+int
+gzi_add(struct gz_index *idx, u_int64_t out, u_int64_t in, int bits,
+    const u_char *window, size_t wsize)
+{
+	struct gz_point *pt;
+	uLongf wlen;
+
+	if ((pt = gzi_next(idx)) == NULL)
+		return (-1);
+	pt->out = out;
+	pt->in = in;
+	pt->bits = bits;
+	if (wsize != 0) {
+		wlen = compressBound(wsize);
+		if ((pt->window = malloc(wlen)) == NULL)
+			return (-1);
+		if (compress2(pt->window, &wlen, window, wsize,
+		    Z_BEST_COMPRESSION) != Z_OK) {
+			free(pt->window);
+			errno = ENOMEM;
+			return (-1);
+		}
+		pt->wlen = wlen;
+		pt->wsize = wsize;
+	}
+	idx->npt++;
+	return (0);
+}
+
+/*
+ * Expand the window of a checkpoint into buf, which has room for
+ * GZ_WINSIZE bytes.  Safe to call from several threads at once.
+ */
+int
+gzi_window(const struct gz_point *pt, u_char *buf)
+{
+	uLongf len = GZ_WINSIZE;
+
+	if (pt->wsize == 0)
+		return (0);
+	if (uncompress(buf, &len, pt->window, pt->wlen) != Z_OK ||
+	    len != pt->wsize) {
+		errno = EINVAL;
+		return (-1);
+	}
+	return (len);
+}
+
+static void
+put32(u_char *p, u_int32_t x)
+{
+	p[0] = x;
+	p[1] = x >> 8;
+	p[2] = x >> 16;
+	p[3] = x >> 24;
+}
+
+static void
+put64(u_char *p, u_int64_t x)
+{
+	put32(p, x);
+	put32(p + 4, x >> 32);
+}
+
+static u_int32_t
+get32(const u_char *p)
+{
+	return (p[0] | p[1] << 8 | p[2] << 16 | (u_int32_t)p[3] << 24);
+}
+
+static u_int64_t
+get64(const u_char *p)
+{
+	return (get32(p) | (u_int64_t)get32(p + 4) << 32);
+}
+
+int
+gzi_save(const struct gz_index *idx, const char *path)
+{
+	const struct gz_point *pt;
+	u_char buf[GZI_HDRSIZE];
+	FILE *fp;
+	size_t i;
+
+	if ((fp = fopen(path, "w")) == NULL)
+		return (-1);
+	memcpy(buf, GZI_MAGIC, 4);
+	put64(buf + 4, idx->size);
+	put64(buf + 12, idx->mtime);
+	put32(buf + 20, idx->mtimensec);
+	put64(buf + 24, idx->total);
+	put32(buf + 32, idx->crc);
+	put32(buf + 36, idx->npt);
+	fwrite(buf, GZI_HDRSIZE, 1, fp);
+	for (i = 0; i < idx->npt; i++) {
+		pt = &idx->pt[i];
+		put64(buf, pt->out);
+		put64(buf + 8, pt->in);
+		put32(buf + 16, pt->bits);
+		put32(buf + 20, pt->wsize);
+		put32(buf + 24, pt->wlen);
+		fwrite(buf, 28, 1, fp);
+		fwrite(pt->window, 1, pt->wlen, fp);
+	}
+	if (ferror(fp) | fclose(fp)) {
+		(void)unlink(path);
+		return (-1);
+	}
+	return (0);
+}
+
+/*
+ * Load the index at path, provided it still describes the gzip file
+ * whose status is in sb.  Anything out of place makes the whole index
+ * unusable rather than risk inflating from a bad checkpoint.
+ */
+struct gz_index *
+gzi_load(const char *path, const struct stat *sb)
+{
+	struct gz_index *idx;
+	struct gz_point *pt;
+	u_char buf[GZI_HDRSIZE];
+	u_int32_t n;
+	FILE *fp;
+
+	if ((fp = fopen(path, "r")) == NULL)
+		return (NULL);
+	if ((idx = gzi_alloc()) == NULL)
+		goto bad;
+	if (fread(buf, GZI_HDRSIZE, 1, fp) != 1 ||
+	    memcmp(buf, GZI_MAGIC, 4) != 0)
+		goto bad;
+	idx->size = get64(buf + 4);
+	idx->mtime = get64(buf + 12);
+	idx->mtimensec = get32(buf + 20);
+	idx->total = get64(buf + 24);
+	idx->crc = get32(buf + 32);
+	n = get32(buf + 36);
+	if (idx->size != sb->st_size || idx->mtime != sb->st_mtim.tv_sec ||
+	    idx->mtimensec != sb->st_mtim.tv_nsec || n == 0)
+		goto bad;
+	while (n-- > 0) {
+		if ((pt = gzi_next(idx)) == NULL || fread(buf, 28, 1, fp) != 1)
+			goto bad;
+		pt->out = get64(buf);
+		pt->in = get64(buf + 8);
+		pt->bits = get32(buf + 16);
+		pt->wsize = get32(buf + 20);
+		pt->wlen = get32(buf + 24);
+		if (pt->bits > 7 || pt->wsize > GZ_WINSIZE ||
+		    pt->wlen > compressBound(GZ_WINSIZE) ||
+		    pt->in >= idx->size || pt->out > idx->total ||
+		    (idx->npt == 0 ? pt->out != 0 :
+		    pt->out <= pt[-1].out || pt->in <= pt[-1].in))
+			goto bad;
+		if (pt->wlen != 0) {
+			if ((pt->window = malloc(pt->wlen)) == NULL)
+				goto bad;
+			idx->npt++;
+			if (fread(pt->window, pt->wlen, 1, fp) != 1)
+				goto bad;
+		} else
+			idx->npt++;
+	}
+	if (getc(fp) != EOF)
+		goto bad;
+	fclose(fp);
+	return (idx);
+bad:
+	gzi_free(idx);
+	fclose(fp);
+	return (NULL);
+}
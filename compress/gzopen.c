@@ -66,6 +66,9 @@
 #include <errno.h>
 #include <unistd.h>
 #include <limits.h>
+#ifndef SMALL
+#include <pthread.h>
+#endif
 #include "../libz/zlib.h"
 #include "compress.h"
 
@@ -80,6 +83,86 @@
 #define DEF_MEM_LEVEL 8
 #define OS_CODE 0x03 /* unix */
 
+#ifndef SMALL
+/*
+ * With more than one job, the input is cut into blocks that are deflated
+ * by a pool of threads.  Each block is primed with the last 32KB of the
+ * block before it, ends on a byte boundary with a sync flush (the last
+ * one with a final block instead), and the results are written in order,
+ * so that together they form a single ordinary deflate stream.
+ */
+#define GZ_BLOCKSIZE	(128 * 1024)
+#define GZ_DICTSIZE	(32 * 1024)
+
+#define MINIMUM(a, b)	(((a) < (b)) ? (a) : (b))
+
+struct gz_block {
+	u_char	*in;		/* dictionary followed by the block data */
+	size_t	 dictlen;
+	size_t	 len;
+	u_char	*out;		/* deflated data */
+	size_t	 outlen;
+	size_t	 outsize;
+	u_int32_t crc;		/* crc32 of the block data */
+	int	 last;		/* block finishes the stream */
+	int	 done;
+	int	 error;
+};
+
+struct gz_pool {
+	pthread_mutex_t	 mtx;
+	pthread_cond_t	 work;	/* signalled when a block is queued */
+	pthread_cond_t	 done;	/* signalled when a block is deflated */
+	pthread_t	*thr;
+	int		 nthr;
+	struct gz_block	*blk;	/* ring of blocks, indexed by sequence */
+	int		 nblk;
+	u_int64_t	 nsent;	/* blocks queued */
+	u_int64_t	 ntaken; /* blocks picked up by a thread */
+	u_int64_t	 nwritten; /* blocks written out */
+	int		 level;
+	int		 quit;
+	int		 failed;
+};
+
+/*
+ * Given an up to date index, inflating fans out the same way: each
+ * thread inflates the data between two checkpoints, and the segments
+ * are handed to the reader in order.
+ */
+#define GZ_RBUFSIZE	(4 * Z_BUFSIZE)
+
+struct gz_seg {
+	size_t	 k;		/* checkpoint the segment starts at */
+	u_char	*out;		/* inflated data */
+	size_t	 len;
+	size_t	 size;		/* size of out */
+	u_int32_t crc;		/* crc32 of the inflated data */
+	u_int64_t end;		/* end of the deflate data, last segment */
+	int	 done;
+	int	 error;		/* errno, if inflating failed */
+};
+
+struct gz_rpool {
+	pthread_mutex_t	 mtx;
+	pthread_cond_t	 work;	/* signalled when a segment is queued */
+	pthread_cond_t	 done;	/* signalled when a segment is inflated */
+	pthread_t	*thr;
+	int		 nthr;
+	int		 fd;
+	struct gz_index	*idx;
+	struct gz_seg	*seg;	/* ring of segments, indexed by sequence */
+	int		 nseg;
+	size_t		 nsent;	/* segments queued */
+	size_t		 ntaken; /* segments picked up by a thread */
+	size_t		 nread;	/* segments handed to the reader */
+	size_t		 pos;	/* read offset in segment nread */
+	int		 quit;
+};
+
+int gz_njobs = 1;
+#endif
+
 typedef
 struct gz_stream {
 	int	z_fd;		/* .gz file */
@@ -92,6 +175,15 @@ struct gz_stream {
 	u_int32_t z_hlen;	/* length of the gz header */
 	u_int64_t z_total_in;	/* # bytes in */
 	u_int64_t z_total_out;	/* # bytes out */
+#ifndef SMALL
+	struct gz_pool *z_pool;	/* parallel deflate, if any */
+	struct gz_rpool *z_rpool; /* parallel inflate, if any */
+	struct gz_index *z_index; /* index being built */
+	u_char	*z_win;		/* last GZ_WINSIZE bytes of output */
+	u_int64_t z_last;	/* output offset of the last checkpoint */
+	int	z_idxerr;	/* errno if indexing failed, -1 if not single */
+	int	z_idxdone;	/* indexed to the end of the stream */
+#endif
 } gz_stream;
 
 static const u_char gz_magic[2] = {0x1f, 0x8b}; /* gzip magic header */
@@ -99,6 +191,11 @@ static const u_char gz_magic[2] = {0x1f, 0x8b}; /* gzip magic header */
 static u_int32_t get_int32(gz_stream *);
 static int get_header(gz_stream *, char *, int);
 static int get_byte(gz_stream *);
+#ifndef SMALL
+static void gz_indexpoint(gz_stream *, u_char *);
+static int gz_rpoolread(gz_stream *, char *, int);
+static void gz_rpoolend(gz_stream *);
+#endif
 
 void *
 gz_ropen(int fd, char *name, int gotmagic)
@@ -262,6 +359,12 @@ gz_read(void *cookie, char *buf, int len)
 	gz_stream *s = (gz_stream*)cookie;
 	u_char *start = buf; /* starting point for crc computation */
 	int error = Z_OK;
+#ifndef SMALL
+	u_char *from;
+
+	if (s->z_rpool != NULL)
+		return gz_rpoolread(s, buf, len);
+#endif
 
 	s->z_stream.next_out = buf;
 	s->z_stream.avail_out = len;
@@ -278,6 +381,16 @@ gz_read(void *cookie, char *buf, int len)
 			s->z_stream.next_in = s->z_buf;
 		}
 
+#ifndef SMALL
+		if (s->z_index != NULL) {
+			/* stop at block boundaries for checkpoints */
+			from = s->z_stream.next_out;
+			error = inflate(&(s->z_stream), Z_BLOCK);
+			gz_indexpoint(s, from);
+			if (error == Z_BUF_ERROR && s->z_stream.avail_in != 0)
+				error = Z_OK;
+		} else
+#endif
 		error = inflate(&(s->z_stream), Z_NO_FLUSH);
 
 		if (error == Z_DATA_ERROR) {
@@ -308,11 +421,22 @@ gz_read(void *cookie, char *buf, int len)
 			s->z_total_in += s->z_stream.total_in;
 			s->z_total_out += s->z_stream.total_out;
 
+#ifndef SMALL
+			s->z_idxdone = 1;
+#endif
 			/* Check for the existence of an appended file. */
 			if (get_header(s, NULL, 0) != 0) {
 				s->z_eof = 1;
 				break;
 			}
+#ifndef SMALL
+			/* checkpoints only cover a single member */
+			if (s->z_index != NULL) {
+				gzi_free(s->z_index);
+				s->z_index = NULL;
+				s->z_idxerr = -1;
+			}
+#endif
 			inflateReset(&(s->z_stream));
 			s->z_crc = crc32(0L, Z_NULL, 0);
 			error = Z_OK;
@@ -331,6 +455,342 @@ bad:
 }
 
 #ifndef SMALL
+/*
+ * Start building an index while reading.  Must be called before the
+ * first gz_read().
+ */
+int
+gz_mkindex(void *cookie)
+{
+	gz_stream *s = (gz_stream*)cookie;
+
+	if ((s->z_index = gzi_alloc()) == NULL ||
+	    (s->z_win = malloc(GZ_WINSIZE)) == NULL ||
+	    gzi_add(s->z_index, 0, s->z_hlen, 0, NULL, 0) == -1) {
+		gzi_free(s->z_index);
+		s->z_index = NULL;
+		return (-1);
+	}
+	return (0);
+}
+
+/*
+ * Keep the last GZ_WINSIZE bytes of output, from ``from'' up to next_out,
+ * and take a checkpoint if inflate stopped at a block boundary far enough
+ * from the last one.
+ */
+static void
+gz_indexpoint(gz_stream *s, u_char *from)
+{
+	z_stream *zs = &s->z_stream;
+	u_char window[GZ_WINSIZE];
+	size_t len, n, pos;
+
+	if (s->z_index == NULL)
+		return;
+
+	len = zs->next_out - from;
+	if (len > GZ_WINSIZE) {
+		from += len - GZ_WINSIZE;
+		len = GZ_WINSIZE;
+	}
+	pos = (zs->total_out - len) % GZ_WINSIZE;
+	n = MINIMUM(len, GZ_WINSIZE - pos);
+	memcpy(s->z_win + pos, from, n);
+	memcpy(s->z_win, from + n, len - n);
+
+	if ((zs->data_type & 128) == 0 || (zs->data_type & 64) != 0 ||
+	    zs->total_out - s->z_last < GZ_SPAN)
+		return;
+
+	pos = zs->total_out % GZ_WINSIZE;
+	if (zs->total_out >= GZ_WINSIZE) {
+		memcpy(window, s->z_win + pos, GZ_WINSIZE - pos);
+		memcpy(window + GZ_WINSIZE - pos, s->z_win, pos);
+		len = GZ_WINSIZE;
+	} else {
+		memcpy(window, s->z_win, pos);
+		len = pos;
+	}
+	if (gzi_add(s->z_index, zs->total_out, s->z_hlen + zs->total_in,
+	    zs->data_type & 7, window, len) == -1) {
+		s->z_idxerr = errno;
+		gzi_free(s->z_index);
+		s->z_index = NULL;
+	}
+	s->z_last = zs->total_out;
+}
+
+/*
+ * Write the index built while reading to path.  Returns 1 if the file
+ * holds more than one member and cannot be indexed.
+ */
+int
+gz_saveindex(void *cookie, const char *path, struct stat *sb)
+{
+	gz_stream *s = (gz_stream*)cookie;
+	struct gz_index *idx = s->z_index;
+
+	if (s->z_idxerr == -1)
+		return (1);
+	if (idx == NULL || !s->z_idxdone) {
+		errno = s->z_idxerr ? s->z_idxerr : EINVAL;
+		return (-1);
+	}
+	idx->size = sb->st_size;
+	idx->mtime = sb->st_mtim.tv_sec;
+	idx->mtimensec = sb->st_mtim.tv_nsec;
+	idx->total = s->z_total_out;
+	idx->crc = s->z_crc;
+	return (gzi_save(idx, path));
+}
+
+static int
+gz_rseg(struct gz_rpool *p, struct gz_seg *g, z_stream *zs, u_char *in,
+    u_char *win)
+{
+	const struct gz_point *pt = &p->idx->pt[g->k];
+	int last = g->k + 1 == p->idx->npt;
+	ssize_t nr;
+	off_t off;
+	int r;
+
+	if (g->size < g->len + 1) {
+		free(g->out);
+		if ((g->out = malloc(g->len + 1)) == NULL) {
+			g->size = 0;
+			return (ENOMEM);
+		}
+		g->size = g->len + 1;
+	}
+	if (inflateReset(zs) != Z_OK)
+		return (ENOMEM);
+	off = pt->in;
+	if (pt->bits != 0) {
+		if (pread(p->fd, in, 1, off - 1) != 1)
+			return (EIO);
+		(void)inflatePrime(zs, pt->bits, in[0] >> (8 - pt->bits));
+	}
+	if ((r = gzi_window(pt, win)) == -1 ||
+	    (r > 0 && inflateSetDictionary(zs, win, r) != Z_OK))
+		return (EINVAL);
+
+	/* the last segment gets a spare byte to run into the end */
+	zs->next_out = g->out;
+	zs->avail_out = g->len + last;
+	zs->avail_in = 0;
+	do {
+		if (zs->avail_in == 0) {
+			if ((nr = pread(p->fd, in, GZ_RBUFSIZE, off)) <= 0)
+				return (EIO);
+			off += nr;
+			zs->next_in = in;
+			zs->avail_in = nr;
+		}
+		r = inflate(zs, Z_NO_FLUSH);
+		if (r == Z_STREAM_END) {
+			if (!last || zs->avail_out != 1)
+				return (EINVAL);
+			g->end = off - zs->avail_in;
+			return (0);
+		}
+		if (r != Z_OK)
+			return (EINVAL);
+	} while (zs->avail_out != 0);
+	return (last ? EINVAL : 0);
+}
+
+static void *
+gz_rworker(void *arg)
+{
+	struct gz_rpool *p = arg;
+	struct gz_seg *g;
+	z_stream zs;
+	u_char *in, *win;
+	int error;
+
+	memset(&zs, 0, sizeof(zs));
+	in = malloc(GZ_RBUFSIZE);
+	win = malloc(GZ_WINSIZE);
+	error = in == NULL || win == NULL ||
+	    inflateInit2(&zs, -MAX_WBITS) != Z_OK;
+
+	pthread_mutex_lock(&p->mtx);
+	for (;;) {
+		while (p->ntaken == p->nsent && !p->quit)
+			pthread_cond_wait(&p->work, &p->mtx);
+		if (p->ntaken == p->nsent)
+			break;
+		g = &p->seg[p->ntaken++ % p->nseg];
+		pthread_mutex_unlock(&p->mtx);
+
+		g->error = error ? ENOMEM : gz_rseg(p, g, &zs, in, win);
+		if (!g->error)
+			g->crc = crc32(crc32(0L, Z_NULL, 0), g->out, g->len);
+
+		pthread_mutex_lock(&p->mtx);
+		g->done = 1;
+		pthread_cond_broadcast(&p->done);
+	}
+	pthread_mutex_unlock(&p->mtx);
+
+	if (!error)
+		(void)inflateEnd(&zs);
+	free(win);
+	free(in);
+	return (NULL);
+}
+
+/*
+ * Queue the next segment, if any, in the slot it maps to.
+ */
+static void
+gz_rpoolqueue(struct gz_rpool *p)
+{
+	const struct gz_index *idx = p->idx;
+	struct gz_seg *g;
+
+	if (p->nsent == idx->npt)
+		return;
+	g = &p->seg[p->nsent % p->nseg];
+	g->k = p->nsent;
+	g->len = (g->k + 1 < idx->npt ? idx->pt[g->k + 1].out : idx->total) -
+	    idx->pt[g->k].out;
+	g->done = 0;
+	pthread_mutex_lock(&p->mtx);
+	p->nsent++;
+	pthread_cond_signal(&p->work);
+	pthread_mutex_unlock(&p->mtx);
+}
+
+/*
+ * Read the rest of the stream from the index at path, if there is one
+ * that matches the file, inflating between checkpoints concurrently.
+ */
+int
+gz_useindex(void *cookie, const char *path, struct stat *sb)
+{
+	gz_stream *s = (gz_stream*)cookie;
+	struct gz_index *idx;
+	struct gz_rpool *p;
+	int i;
+
+	if ((idx = gzi_load(path, sb)) == NULL)
+		return (-1);
+	if (idx->npt < 2 || idx->pt[0].in != s->z_hlen ||
+	    (p = calloc(1, sizeof(*p))) == NULL) {
+		gzi_free(idx);
+		return (-1);
+	}
+	p->idx = idx;
+	p->fd = s->z_fd;
+	p->nseg = 2 * gz_njobs;
+	if ((p->thr = calloc(gz_njobs, sizeof(*p->thr))) == NULL ||
+	    (p->seg = calloc(p->nseg, sizeof(*p->seg))) == NULL) {
+		free(p->thr);
+		free(p);
+		gzi_free(idx);
+		return (-1);
+	}
+	pthread_mutex_init(&p->mtx, NULL);
+	pthread_cond_init(&p->work, NULL);
+	pthread_cond_init(&p->done, NULL);
+	s->z_rpool = p;
+	for (i = 0; i < gz_njobs; i++) {
+		if (pthread_create(&p->thr[i], NULL, gz_rworker, p) != 0)
+			break;
+		p->nthr++;
+	}
+	if (p->nthr == 0) {
+		gz_rpoolend(s);
+		return (-1);
+	}
+	for (i = 0; i < p->nseg; i++)
+		gz_rpoolqueue(p);
+	return (0);
+}
+
+static int
+gz_rpoolread(gz_stream *s, char *buf, int len)
+{
+	struct gz_rpool *p = s->z_rpool;
+	struct gz_seg *g;
+	u_char trailer[8];
+	size_t n;
+	int have;
+
+	for (have = 0; have < len && p->nread < p->idx->npt;) {
+		g = &p->seg[p->nread % p->nseg];
+		pthread_mutex_lock(&p->mtx);
+		while (!g->done)
+			pthread_cond_wait(&p->done, &p->mtx);
+		pthread_mutex_unlock(&p->mtx);
+		if (g->error) {
+			errno = g->error;
+			return (-1);
+		}
+
+		n = MINIMUM(len - have, g->len - p->pos);
+		memcpy(buf + have, g->out + p->pos, n);
+		have += n;
+		p->pos += n;
+		if (p->pos < g->len)
+			break;
+
+		s->z_crc = crc32_combine(s->z_crc, g->crc, g->len);
+		s->z_total_out += g->len;
+		if (g->k + 1 == p->idx->npt) {
+			/* Check CRC and original size */
+			if (pread(s->z_fd, trailer, sizeof(trailer), g->end) !=
+			    sizeof(trailer)) {
+				errno = EIO;
+				return (-1);
+			}
+			if (le32toh(*(u_int32_t *)trailer) != s->z_crc) {
+				errno = EINVAL;
+				return (-1);
+			}
+			if (le32toh(*(u_int32_t *)(trailer + 4)) !=
+			    (u_int32_t)s->z_total_out) {
+				errno = EIO;
+				return (-1);
+			}
+			s->z_hlen += sizeof(trailer);
+			s->z_total_in = g->end - p->idx->pt[0].in;
+			s->z_eof = 1;
+		}
+		p->nread++;
+		p->pos = 0;
+		gz_rpoolqueue(p);
+	}
+	return (have);
+}
+
+static void
+gz_rpoolend(gz_stream *s)
+{
+	struct gz_rpool *p = s->z_rpool;
+	int i;
+
+	pthread_mutex_lock(&p->mtx);
+	p->quit = 1;
+	pthread_cond_broadcast(&p->work);
+	pthread_mutex_unlock(&p->mtx);
+	for (i = 0; i < p->nthr; i++)
+		pthread_join(p->thr[i], NULL);
+
+	pthread_cond_destroy(&p->done);
+	pthread_cond_destroy(&p->work);
+	pthread_mutex_destroy(&p->mtx);
+	for (i = 0; i < p->nseg; i++)
+		free(p->seg[i].out);
+	free(p->seg);
+	free(p->thr);
+	gzi_free(p->idx);
+	free(p);
+	s->z_rpool = NULL;
+}
+
 static int
 put_int32(gz_stream *s, u_int32_t x)
 {
@@ -371,6 +831,243 @@ put_header(gz_stream *s, char *name, u_int32_t mtime, int bits)
 	return (0);
 }
 
+static void *
+gz_worker(void *arg)
+{
+	struct gz_pool *p = arg;
+	struct gz_block *b;
+	z_stream zs;
+	u_char *out;
+	size_t used;
+	int error, r;
+
+	memset(&zs, 0, sizeof(zs));
+	error = deflateInit2(&zs, p->level, Z_DEFLATED, -MAX_WBITS,
+	    DEF_MEM_LEVEL, 0) != Z_OK;
+
+	pthread_mutex_lock(&p->mtx);
+	for (;;) {
+		while (p->ntaken == p->nsent && !p->quit)
+			pthread_cond_wait(&p->work, &p->mtx);
+		if (p->ntaken == p->nsent)
+			break;
+		b = &p->blk[p->ntaken++ % p->nblk];
+		pthread_mutex_unlock(&p->mtx);
+
+		b->error = error;
+		if (!b->error && (deflateReset(&zs) != Z_OK || (b->dictlen &&
+		    deflateSetDictionary(&zs, b->in, b->dictlen) != Z_OK)))
+			b->error = 1;
+		zs.next_in = b->in + b->dictlen;
+		zs.avail_in = b->len;
+		zs.next_out = b->out;
+		zs.avail_out = b->outsize;
+		while (!b->error) {
+			r = deflate(&zs, b->last ? Z_FINISH : Z_SYNC_FLUSH);
+			if (r == Z_STREAM_ERROR)
+				b->error = 1;
+			else if (b->last ? r == Z_STREAM_END :
+			    zs.avail_out != 0)
+				break;
+			else {
+				/* ran out of room, grow the output buffer */
+				used = b->outsize - zs.avail_out;
+				if ((out = reallocarray(b->out, b->outsize,
+				    2)) == NULL) {
+					b->error = 1;
+					break;
+				}
+				b->out = out;
+				b->outsize *= 2;
+				zs.next_out = b->out + used;
+				zs.avail_out = b->outsize - used;
+			}
+		}
+		b->outlen = b->outsize - zs.avail_out;
+		b->crc = crc32(crc32(0L, Z_NULL, 0), b->in + b->dictlen,
+		    b->len);
+
+		pthread_mutex_lock(&p->mtx);
+		b->done = 1;
+		pthread_cond_broadcast(&p->done);
+	}
+	pthread_mutex_unlock(&p->mtx);
+
+	if (!error)
+		(void)deflateEnd(&zs);
+	return (NULL);
+}
+
+static int
+gz_poolstart(gz_stream *s, int level)
+{
+	struct gz_pool *p;
+	int i;
+
+	if ((p = calloc(1, sizeof(*p))) == NULL)
+		return (-1);
+	p->level = level;
+	p->nthr = gz_njobs;
+	p->nblk = 2 * gz_njobs + 1;
+	if ((p->thr = calloc(p->nthr, sizeof(*p->thr))) == NULL ||
+	    (p->blk = calloc(p->nblk, sizeof(*p->blk))) == NULL)
+		goto bad;
+	for (i = 0; i < p->nblk; i++) {
+		p->blk[i].outsize = GZ_BLOCKSIZE + GZ_BLOCKSIZE / 8;
+		if ((p->blk[i].in = malloc(GZ_DICTSIZE + GZ_BLOCKSIZE)) ==
+		    NULL || (p->blk[i].out = malloc(p->blk[i].outsize)) == NULL)
+			goto bad;
+	}
+	pthread_mutex_init(&p->mtx, NULL);
+	pthread_cond_init(&p->work, NULL);
+	pthread_cond_init(&p->done, NULL);
+	for (i = 0; i < p->nthr; i++)
+		if ((errno = pthread_create(&p->thr[i], NULL, gz_worker,
+		    p)) != 0) {
+			p->nthr = i;
+			p->failed = 1;
+			s->z_pool = p;
+			return (-1);
+		}
+	s->z_pool = p;
+	return (0);
+bad:
+	if (p->blk != NULL)
+		for (i = 0; i < p->nblk; i++) {
+			free(p->blk[i].in);
+			free(p->blk[i].out);
+		}
+	free(p->blk);
+	free(p->thr);
+	free(p);
+	return (-1);
+}
+
+/*
+ * Write out deflated blocks in order.  Wait until fewer than ``keep''
+ * blocks are still outstanding.
+ */
+static int
+gz_pooldrain(gz_stream *s, u_int64_t keep)
+{
+	struct gz_pool *p = s->z_pool;
+	struct gz_block *b;
+
+	pthread_mutex_lock(&p->mtx);
+	while (p->nwritten < p->nsent) {
+		b = &p->blk[p->nwritten % p->nblk];
+		if (!b->done) {
+			if (p->nsent - p->nwritten < keep)
+				break;
+			pthread_cond_wait(&p->done, &p->mtx);
+			continue;
+		}
+		pthread_mutex_unlock(&p->mtx);
+		if (!p->failed) {
+			if (b->error) {
+				errno = ENOMEM;
+				p->failed = 1;
+			} else if (write(s->z_fd, b->out, b->outlen) !=
+			    b->outlen)
+				p->failed = 1;
+			else {
+				s->z_crc = crc32_combine(s->z_crc, b->crc,
+				    b->len);
+				s->z_total_in += b->len;
+				s->z_total_out += b->outlen;
+			}
+		}
+		pthread_mutex_lock(&p->mtx);
+		b->done = 0;
+		p->nwritten++;
+	}
+	pthread_mutex_unlock(&p->mtx);
+	return (p->failed ? -1 : 0);
+}
+
+/*
+ * Queue the block being filled and start on the next one, priming it
+ * with the tail of this one.
+ */
+static int
+gz_poolsend(gz_stream *s, int last)
+{
+	struct gz_pool *p = s->z_pool;
+	struct gz_block *b, *nb;
+
+	b = &p->blk[p->nsent % p->nblk];
+	b->last = last;
+	pthread_mutex_lock(&p->mtx);
+	p->nsent++;
+	pthread_cond_signal(&p->work);
+	pthread_mutex_unlock(&p->mtx);
+	if (last)
+		return (gz_pooldrain(s, 1));
+
+	if (gz_pooldrain(s, p->nblk) == -1)
+		return (-1);
+	nb = &p->blk[p->nsent % p->nblk];
+	nb->dictlen = MINIMUM(b->len, GZ_DICTSIZE);
+	memcpy(nb->in, b->in + b->dictlen + b->len - nb->dictlen,
+	    nb->dictlen);
+	nb->len = 0;
+	return (0);
+}
+
+static int
+gz_poolwrite(gz_stream *s, const char *buf, int len)
+{
+	struct gz_pool *p = s->z_pool;
+	struct gz_block *b;
+	size_t n;
+	int left;
+
+	for (left = len; left > 0; left -= n, buf += n) {
+		b = &p->blk[p->nsent % p->nblk];
+		if (b->len == GZ_BLOCKSIZE && gz_poolsend(s, 0) == -1)
+			break;
+		b = &p->blk[p->nsent % p->nblk];
+		n = MINIMUM(left, GZ_BLOCKSIZE - b->len);
+		memcpy(b->in + b->dictlen + b->len, buf, n);
+		b->len += n;
+	}
+	return (len - left);
+}
+
+static int
+gz_poolend(gz_stream *s)
+{
+	struct gz_pool *p = s->z_pool;
+	int error, i;
+
+	if (p->failed)
+		error = gz_pooldrain(s, 1);
+	else
+		error = gz_poolsend(s, 1);
+
+	pthread_mutex_lock(&p->mtx);
+	p->quit = 1;
+	pthread_cond_broadcast(&p->work);
+	pthread_mutex_unlock(&p->mtx);
+	for (i = 0; i < p->nthr; i++)
+		pthread_join(p->thr[i], NULL);
+
+	pthread_cond_destroy(&p->done);
+	pthread_cond_destroy(&p->work);
+	pthread_mutex_destroy(&p->mtx);
+	for (i = 0; i < p->nblk; i++) {
+		free(p->blk[i].in);
+		free(p->blk[i].out);
+	}
+	free(p->blk);
+	free(p->thr);
+	free(p);
+	s->z_pool = NULL;
+	s->z_stream.total_in = s->z_total_in;
+	s->z_stream.total_out = s->z_total_out;
+	return (error);
+}
+
 void *
 gz_wopen(int fd, char *name, int bits, u_int32_t mtime)
 {
@@ -401,11 +1098,19 @@ gz_wopen(int fd, char *name, int bits, u_int32_t mtime)
 	s->z_crc = crc32(0L, Z_NULL, 0);
 	s->z_mode = 'w';
 
-	/* windowBits is passed < 0 to suppress zlib header */
-	if (deflateInit2(&(s->z_stream), bits, Z_DEFLATED,
-			 -MAX_WBITS, DEF_MEM_LEVEL, 0) != Z_OK) {
-		free (s);
-		return NULL;
+	if (gz_njobs > 1) {
+		/* the deflate streams belong to the pool's threads */
+		if (gz_poolstart(s, bits) == -1 && s->z_pool == NULL) {
+			free(s);
+			return NULL;
+		}
+	} else {
+		/* windowBits is passed < 0 to suppress zlib header */
+		if (deflateInit2(&(s->z_stream), bits, Z_DEFLATED,
+				 -MAX_WBITS, DEF_MEM_LEVEL, 0) != Z_OK) {
+			free (s);
+			return NULL;
+		}
 	}
 	s->z_stream.next_out = s->z_buf;
 	s->z_stream.avail_out = Z_BUFSIZE;
@@ -413,6 +1118,11 @@ gz_wopen(int fd, char *name, int bits, u_int32_t mtime)
 	errno = 0;
 	s->z_fd = fd;
 
+	if (s->z_pool != NULL && s->z_pool->failed) {
+		gz_close(s, NULL, NULL, NULL);
+		return NULL;
+	}
+
 	/* write the .gz header */
 	if (put_header(s, name, mtime, bits) != 0) {
 		gz_close(s, NULL, NULL, NULL);
@@ -426,6 +1136,9 @@ gz_write(void *cookie, const char *buf, int len)
 {
 	gz_stream *s = (gz_stream*)cookie;
 
+	if (s->z_pool != NULL)
+		return gz_poolwrite(s, buf, len);
+
 	s->z_stream.next_in = (char *)buf;
 	s->z_stream.avail_in = len;
 
@@ -493,13 +1206,25 @@ gz_close(void *cookie, struct z_info *info, const char *name, struct stat *sb)
 		return -1;
 
 #ifndef SMALL
-	if (s->z_mode == 'w' && (err = gz_flush (s, Z_FINISH)) == Z_OK) {
+	if (s->z_pool != NULL) {
+		if ((err = gz_poolend(s)) == 0 &&
+		    (err = put_int32 (s, s->z_crc)) == Z_OK) {
+			s->z_hlen += sizeof(int32_t);
+			if ((err = put_int32 (s, s->z_total_in)) == Z_OK)
+				s->z_hlen += sizeof(int32_t);
+		}
+	} else if (s->z_mode == 'w' &&
+	    (err = gz_flush (s, Z_FINISH)) == Z_OK) {
 		if ((err = put_int32 (s, s->z_crc)) == Z_OK) {
 			s->z_hlen += sizeof(int32_t);
 			if ((err = put_int32 (s, s->z_stream.total_in)) == Z_OK)
 				s->z_hlen += sizeof(int32_t);
 		}
 	}
+	if (s->z_rpool != NULL)
+		gz_rpoolend(s);
+	gzi_free(s->z_index);
+	free(s->z_win);
 #endif
 	if (!err && s->z_stream.state != NULL) {
 		if (s->z_mode == 'w')
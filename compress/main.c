@@ -52,6 +52,7 @@
 #define min(a,b) ((a) < (b)? (a) : (b))
 
 int cat, decomp, pipin, force, verbose, testmode, list, recurse, storename;
+int mkindex;
 extern char *__progname;
 
 const struct compressor {
@@ -74,7 +75,7 @@ const struct compressor {
 		"deflate",
 		".gz",
 		"\037\213",
-		"123456789ab:cdfhLlNnOo:qrS:tVv",
+		"123456789ab:cdfhij:LlNnOo:qrS:tVv",
 		"cfhLlNno:qrtVv",
 		"fhqr",
 		gz_ropen,
@@ -140,6 +141,8 @@ const struct option longopts[] = {
 	{ "uncompress",	no_argument,		0, 'd' },
 	{ "force",	no_argument,		0, 'f' },
 	{ "help",	no_argument,		0, 'h' },
+	{ "index",	no_argument,		0, 'i' },
+	{ "jobs",	required_argument,	0, 'j' },
 	{ "list",	no_argument,		0, 'l' },
 	{ "license",	no_argument,		0, 'L' },
 	{ "no-name",	no_argument,		0, 'n' },
@@ -162,7 +165,7 @@ main(int argc, char *argv[])
 	FTS *ftsp;
 	FTSENT *entry;
 	const struct compressor *method;
-	const char *optstr, *s;
+	const char *errstr, *optstr, *s;
 	char *p, *infile;
 	char outfile[PATH_MAX], _infile[PATH_MAX], suffix[16];
 	int bits, ch, error, rc, cflag, oflag;
@@ -275,6 +278,17 @@ main(int argc, char *argv[])
 			strlcpy(suffix, method->suffix, sizeof(suffix));
 			bits = 6;
 			break;
+#ifndef SMALL
+		case 'i':
+			mkindex = 1;
+			break;
+		case 'j':
+			gz_njobs = strtonum(optarg, 1, INT_MAX, &errstr);
+			if (errstr != NULL)
+				errx(1, "number of jobs is %s: %s", errstr,
+				    optarg);
+			break;
+#endif /* SMALL */
 		case 'l':
 			list++;
 			testmode = 1;
@@ -332,8 +346,12 @@ main(int argc, char *argv[])
 	argc -= optind;
 	argv += optind;
 
+	if (mkindex && !decomp)
+		errx(1, "-i may only be used when decompressing");
+
 	if (cflag || testmode || (!oflag && argc == 0))
-		if (pledge("stdio rpath", NULL) == -1)
+		if (pledge(mkindex ? "stdio rpath wpath cpath" : "stdio rpath",
+		    NULL) == -1)
 			err(1, "pledge");
 
 	if (argc == 0) {
@@ -622,7 +640,7 @@ dodecompress(const char *in, char *out, struct stat *sb)
 {
 	const struct compressor *method;
 	u_char buf[Z_BUFSIZE];
-	char oldname[PATH_MAX];
+	char oldname[PATH_MAX], idxname[PATH_MAX];
 	int error, oreg, ifd, ofd;
 	void *cookie;
 	ssize_t nr;
@@ -677,6 +695,22 @@ dodecompress(const char *in, char *out, struct stat *sb)
 		cat = 0;			/* XXX should -c override? */
 	}
 
+#ifndef SMALL
+	/* index files live next to the file they describe */
+	idxname[0] = '\0';
+	if (method == M_DEFLATE && !pipin && (mkindex || gz_njobs > 1) &&
+	    snprintf(idxname, sizeof(idxname), "%s.gzi", in) >=
+	    sizeof(idxname))
+		idxname[0] = '\0';
+	if (idxname[0] != '\0') {
+		if (mkindex) {
+			if (gz_mkindex(cookie) == -1 && verbose >= 0)
+				warn("%s", idxname);
+		} else
+			(void)gz_useindex(cookie, idxname, sb);
+	}
+#endif
+
 	if (testmode)
 		ofd = -1;
 	else {
@@ -716,6 +750,22 @@ dodecompress(const char *in, char *out, struct stat *sb)
 		error = errno == EINVAL ? WARNING : FAILURE;
 	}
 
+#ifndef SMALL
+	if (!error && mkindex && idxname[0] != '\0') {
+		switch (gz_saveindex(cookie, idxname, sb)) {
+		case -1:
+			if (verbose >= 0)
+				warn("%s", idxname);
+			break;
+		case 1:
+			if (verbose >= 0)
+				warnx("%s: more than one member, not indexed",
+				    in);
+			break;
+		}
+	}
+#endif
+
 	if (method->close(cookie, &info, NULL, NULL)) {
 		if (!error && verbose >= 0)
 			warnx("%s", in);
@@ -944,15 +994,16 @@ usage(int status)
 	switch (pmode) {
 	case MODE_COMP:
 		fprintf(stderr, "usage: %s [-123456789cdf%sh%slNnOqrt%sv] "
-		    "[-b bits] [-o filename] [-S suffix]\n"
-		    "       %*s [file ...]\n", __progname,
+		    "[-b bits]%s [-o filename]\n"
+		    "       %*s [-S suffix] [file ...]\n", __progname,
 		    !gzip ? "g" : "", gzip ? "L" : "", gzip ? "V" : "",
-		    (int)strlen(__progname), "");
+		    gzip ? " [-j jobs]" : "", (int)strlen(__progname), "");
 		break;
 	case MODE_DECOMP:
-		fprintf(stderr, "usage: %s [-cfh%slNnqrt%sv] [-o filename] "
+		fprintf(stderr, "usage: %s [-cfh%s%slNnqrt%sv]%s [-o filename] "
 		    "[file ...]\n", __progname,
-		    gzip ? "L" : "", gzip ? "V" : "");
+		    gzip ? "i" : "", gzip ? "L" : "", gzip ? "V" : "",
+		    gzip ? " [-j jobs]" : "");
 		break;
 	case MODE_CAT:
 		fprintf(stderr, "usage: %s [-f%shqr] [file ...]\n",
@@ -37,6 +37,7 @@
 #include <ctype.h>
 #include <err.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <limits.h>
 #include <locale.h>
 #include <stdio.h>
@@ -44,6 +45,8 @@
 #include <string.h>
 #include <unistd.h>
 
+#include <lbuf.h>
+
 char	dchar[5];
 int	dlen;
 
@@ -54,18 +57,17 @@ int	fflag;
 int	nflag;
 int	sflag;
 
-void	b_cut(FILE *, char *);
-void	c_cut(FILE *, char *);
-void	f_cut(FILE *, char *);
+void	b_cut(struct lbuf *, char *);
+void	c_cut(struct lbuf *, char *);
+void	cut(int, char *);
+void	f_cut(struct lbuf *, char *);
 void	get_list(char *);
 void	usage(void);
 
 int
 main(int argc, char *argv[])
 {
-	FILE *fp;
-	void (*fcn)(FILE *, char *);
-	int ch, rval;
+	int ch, fd, rval;
 
 	setlocale(LC_CTYPE, "");
 
@@ -124,17 +126,15 @@ main(int argc, char *argv[])
 		}
 	}
 
-	fcn = fflag ? f_cut : (cflag || nflag) ? c_cut : b_cut;
-
 	rval = 0;
 	if (*argv)
 		for (; *argv; ++argv) {
 			if (strcmp(*argv, "-") == 0)
-				fcn(stdin, "stdin");
+				cut(STDIN_FILENO, "stdin");
 			else {
-				if ((fp = fopen(*argv, "r"))) {
-					fcn(fp, *argv);
-					(void)fclose(fp);
+				if ((fd = open(*argv, O_RDONLY)) != -1) {
+					cut(fd, *argv);
+					(void)close(fd);
 				} else {
 					rval = 1;
 					warn("%s", *argv);
@@ -145,11 +145,29 @@ main(int argc, char *argv[])
 		if (pledge("stdio", NULL) == -1)
 			err(1, "pledge");
 
-		fcn(stdin, "stdin");
+		cut(STDIN_FILENO, "stdin");
 	}
 	exit(rval);
 }
 
+void
+cut(int fd, char *fname)
+{
+	struct lbuf lb;
+
+	if (lbuf_init(&lb, fd, '\n') == -1)
+		err(1, NULL);
+	if (fflag)
+		f_cut(&lb, fname);
+	else if (cflag || nflag)
+		c_cut(&lb, fname);
+	else
+		b_cut(&lb, fname);
+	if (lb.error)
+		err(1, "%s", fname);
+	lbuf_free(&lb);
+}
+
 int autostart, autostop, maxval;
 
 char positions[_POSIX2_LINE_MAX + 1];
@@ -230,46 +248,36 @@ get_list(char *list)
 
 /* ARGSUSED */
 void
-b_cut(FILE *fp, char *fname)
+b_cut(struct lbuf *lb, char *fname)
 {
-	int ch, col;
-	char *pos;
-
-	for (;;) {
-		pos = positions + 1;
-		for (col = maxval; col; --col) {
-			if ((ch = getc(fp)) == EOF)
-				return;
-			if (ch == '\n')
-				break;
-			if (*pos++)
-				(void)putchar(ch);
-		}
-		if (ch != '\n') {
-			if (autostop)
-				while ((ch = getc(fp)) != EOF && ch != '\n')
-					(void)putchar(ch);
-			else
-				while ((ch = getc(fp)) != EOF && ch != '\n')
-					;
+	size_t col, len, n, start;
+	char *line, *pos;
+
+	pos = positions + 1;
+	while ((line = lbuf_next(lb, &len)) != NULL) {
+		n = len < maxval ? len : maxval;
+		/* Write each run of selected bytes at once. */
+		for (col = 0; col < n; col++) {
+			if (!pos[col])
+				continue;
+			for (start = col; col + 1 < n && pos[col + 1]; col++)
+				;
+			(void)fwrite(line + start, 1, col + 1 - start, stdout);
 		}
+		if (autostop && len > n)
+			(void)fwrite(line + n, 1, len - n, stdout);
 		(void)putchar('\n');
 	}
 }
 
 void
-c_cut(FILE *fp, char *fname)
+c_cut(struct lbuf *lb, char *fname)
 {
-	static char	*line = NULL;
-	static size_t	 linesz = 0;
-	ssize_t		 linelen;
-	char		*cp, *pos, *maxpos;
+	char		*line, *cp, *pos, *maxpos;
+	size_t		 linelen;
 	int		 len;
 
-	while ((linelen = getline(&line, &linesz, fp)) != -1) {
-		if (line[linelen - 1] == '\n')
-			line[linelen - 1] = '\0';
-
+	while ((line = lbuf_next(lb, &linelen)) != NULL) {
 		cp = line;
 		pos = positions + 1;
 		maxpos = pos + maxval;
@@ -292,18 +300,13 @@ c_cut(FILE *fp, char *fname)
 }
 
 void
-f_cut(FILE *fp, char *fname)
+f_cut(struct lbuf *lb, char *fname)
 {
-	static char	*line = NULL;
-	static size_t	 linesz = 0;
-	ssize_t		 linelen;
-	char		*sp, *ep, *pos, *maxpos;
+	char		*line, *sp, *ep, *pos, *maxpos;
+	size_t		 linelen;
 	int		 output;
 
-	while ((linelen = getline(&line, &linesz, fp)) != -1) {
-		if (line[linelen - 1] == '\n')
-			line[linelen - 1] = '\0';
-
+	while ((line = lbuf_next(lb, &linelen)) != NULL) {
 		if ((ep = strstr(line, dchar)) == NULL) {
 			if (!sflag)
 				puts(line);
@@ -244,7 +244,7 @@ cvs_annotate_local(struct cvs_file *cf)
 
 		if (line->l_needsfree)
 			free(line->l_line);
-		free(line);
+		cvs_line_free(line);
 	}
 
 	free(alines);
@@ -1001,7 +1001,7 @@ rcs_patch_lines(struct rcs_lines *dlines, struct rcs_lines *plines,
 					alines[dlp->l_lineno_orig - 1] =
 						dlp;
 				} else
-					free(dlp);
+					cvs_line_free(dlp);
 				dlp = ndlp;
 				/* last line is gone - reset dlp */
 				if (dlp == NULL) {
@@ -1883,7 +1883,7 @@ done:
 			nline = TAILQ_NEXT(line, l_list);
 			TAILQ_REMOVE(&(dlines->l_lines), line, l_list);
 			if (line->l_line == NULL) {
-				free(line);
+				cvs_line_free(line);
 				continue;
 			}
 
@@ -1930,7 +1930,7 @@ rcs_annotate_getlines(RCSFILE *rfp, RCSNUM *frev, struct rcs_line ***alines)
 	 */
 	dlines = xcalloc(1, sizeof(*dlines));
 	TAILQ_INIT(&(dlines->l_lines));
-	line = xcalloc(1, sizeof(*line));
+	line = cvs_line_alloc();
 	TAILQ_INSERT_TAIL(&(dlines->l_lines), line, l_list);
 
 	for (i = 0; (*alines)[i] != NULL; i++) {
@@ -2426,7 +2426,7 @@ rcs_kwexp_line(char *rcsfile, struct rcs_delta *rdp, struct rcs_lines *lines,
 					fatal("rcs_kwexp_line: string "
 					    "truncated");
 
-				lp = xcalloc(1, sizeof(*lp));
+				lp = cvs_line_alloc();
 				xasprintf((char **)&(lp->l_line), "%s%s\n",
 				    prefix, linebuf);
 				lp->l_len = strlen(lp->l_line);
@@ -2438,7 +2438,7 @@ rcs_kwexp_line(char *rcsfile, struct rcs_delta *rdp, struct rcs_lines *lines,
 				q = logp;
 				while ((l_line = strsep(&q, "\n")) != NULL &&
 				    q != NULL) {
-					lp = xcalloc(1, sizeof(*lp));
+					lp = cvs_line_alloc();
 
 					if (l_line[0] == '\0') {
 						xasprintf((char **)&(lp->l_line),
@@ -2462,7 +2462,7 @@ rcs_kwexp_line(char *rcsfile, struct rcs_delta *rdp, struct rcs_lines *lines,
 				 * But that's not enough, we have to strip all
 				 * trailing whitespaces of our prefix.
 				 */
-				lp = xcalloc(1, sizeof(*lp));
+				lp = cvs_line_alloc();
 				xasprintf((char **)&lp->l_line, "%s%s",
 				    sprefix, end);
 				lp->l_len = strlen(lp->l_line);
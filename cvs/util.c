@@ -30,6 +30,7 @@
 #include <sys/types.h>
 #include <sys/wait.h>
 
+#include <arena.h>
 #include <atomicio.h>
 #include <errno.h>
 #include <fcntl.h>
@@ -46,6 +47,14 @@ extern int print_stdout;
 extern int build_dirs;
 extern int disable_fast_checkout;
 
+/*
+ * A checkout or annotate of a file with a long history makes and throws
+ * away a struct rcs_line for every line of every revision on the way, so
+ * they come from a pool instead of one malloc each.
+ */
+static struct arena line_arena;
+static struct pool line_pool;
+
 /* letter -> mode type map */
 static const int cvs_modetypes[26] = {
 	-1, -1, -1, -1, -1, -1,  1, -1, -1, -1, -1, -1, -1,
@@ -696,6 +705,27 @@ cvs_mkdir(const char *path, mode_t mode)
 	free(dir);
 }
 
+struct rcs_line *
+cvs_line_alloc(void)
+{
+	struct rcs_line *lp;
+
+	if (line_pool.arena == NULL) {
+		arena_init(&line_arena, 0);
+		pool_init(&line_pool, &line_arena, sizeof(*lp));
+	}
+	if ((lp = pool_get(&line_pool)) == NULL)
+		fatal("cvs_line_alloc: %s", strerror(errno));
+	memset(lp, 0, sizeof(*lp));
+	return (lp);
+}
+
+void
+cvs_line_free(struct rcs_line *lp)
+{
+	pool_put(&line_pool, lp);
+}
+
 /*
  * Split the contents of a file into a list of lines.
  */
@@ -710,14 +740,14 @@ cvs_splitlines(u_char *data, size_t len)
 	lines = xcalloc(1, sizeof(*lines));
 	TAILQ_INIT(&(lines->l_lines));
 
-	lp = xcalloc(1, sizeof(*lp));
+	lp = cvs_line_alloc();
 	TAILQ_INSERT_TAIL(&(lines->l_lines), lp, l_list);
 
 	p = c = data;
 	for (i = 0; i < len; i++) {
 		if (*p == '\n' || (i == len - 1)) {
 			tlen = p - c + 1;
-			lp = xcalloc(1, sizeof(*lp));
+			lp = cvs_line_alloc();
 			lp->l_line = c;
 			lp->l_len = tlen;
 			lp->l_lineno = ++(lines->l_nblines);
@@ -739,7 +769,7 @@ cvs_freelines(struct rcs_lines *lines)
 		TAILQ_REMOVE(&(lines->l_lines), lp, l_list);
 		if (lp->l_needsfree == 1)
 			free(lp->l_line);
-		free(lp);
+		cvs_line_free(lp);
 	}
 
 	free(lines);
@@ -66,6 +66,8 @@ struct cvs_argvector {
 	char **argv;
 };
 
+struct rcs_line		*cvs_line_alloc(void);
+void			cvs_line_free(struct rcs_line *);
 struct rcs_lines	*cvs_splitlines(u_char *, size_t);
 void			cvs_freelines(struct rcs_lines *);
 struct cvs_argvector	*cvs_strsplit(char *, const char *);
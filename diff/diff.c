@@ -37,14 +37,22 @@
 #include "xmalloc.h"
 
 int	 Nflag, Pflag, rflag, sflag, Tflag;
+int	 njobs = 1;
 int	 diff_format, diff_context, status;
 char	*start, *ifdefname, *diffargs, *label[2], *ignore_pats;
+char	*cachefile;
 struct stat stb1, stb2;
 struct excludes *excludes_list;
 regex_t	 ignore_re;
 
-#define	OPTIONS	"0123456789abC:cdD:efhI:iL:lnNPpqrS:sTtU:uwX:x:"
+enum {
+	OPT_ALGORITHM = CHAR_MAX + 1,
+	OPT_CACHE
+};
+
+#define	OPTIONS	"0123456789abC:cdD:efhI:ij:L:lnNPpqrS:sTtU:uwX:x:"
 static struct option longopts[] = {
+	{ "algorithm",			required_argument,	0,	OPT_ALGORITHM },
 	{ "text",			no_argument,		0,	'a' },
 	{ "ignore-space-change",	no_argument,		0,	'b' },
 	{ "context",			optional_argument,	0,	'C' },
@@ -54,12 +62,14 @@ static struct option longopts[] = {
 	{ "forward-ed",			no_argument,		0,	'f' },
 	{ "ignore-matching-lines",	required_argument,	0,	'I' },
 	{ "ignore-case",		no_argument,		0,	'i' },
+	{ "jobs",			required_argument,	0,	'j' },
 	{ "label",			required_argument,	0,	'L' },
 	{ "new-file",			no_argument,		0,	'N' },
 	{ "rcs",			no_argument,		0,	'n' },
 	{ "unidirectional-new-file",	no_argument,		0,	'P' },
 	{ "show-c-function",		no_argument,		0,	'p' },
 	{ "brief",			no_argument,		0,	'q' },
+	{ "cache",			required_argument,	0,	OPT_CACHE },
 	{ "recursive",			no_argument,		0,	'r' },
 	{ "report-identical-files",	no_argument,		0,	's' },
 	{ "starting-file",		required_argument,	0,	'S' },
@@ -81,6 +91,7 @@ void set_argstr(char **, char **);
 int
 main(int argc, char **argv)
 {
+	const char *errstr;
 	char *ep, **oargv;
 	long  l;
 	int   ch, dflags, lastch, gotstdin, prevoptind, newarg;
@@ -142,6 +153,12 @@ main(int argc, char **argv)
 		case 'i':
 			dflags |= D_IGNORECASE;
 			break;
+		case 'j':
+			njobs = strtonum(optarg, 1, INT_MAX, &errstr);
+			if (errstr != NULL)
+				errx(2, "number of jobs is %s: %s", errstr,
+				    optarg);
+			break;
 		case 'L':
 			if (label[0] == NULL)
 				label[0] = optarg;
@@ -200,6 +217,18 @@ main(int argc, char **argv)
 		case 'x':
 			push_excludes(optarg);
 			break;
+		case OPT_ALGORITHM:
+			dflags &= ~(D_MYERS | D_HISTOGRAM);
+			if (strcmp(optarg, "myers") == 0)
+				dflags |= D_MYERS;
+			else if (strcmp(optarg, "histogram") == 0)
+				dflags |= D_HISTOGRAM;
+			else if (strcmp(optarg, "stone") != 0)
+				errx(2, "unknown algorithm: %s", optarg);
+			break;
+		case OPT_CACHE:
+			cachefile = optarg;
+			break;
 		default:
 			usage();
 			break;
@@ -211,7 +240,12 @@ main(int argc, char **argv)
 	argc -= optind;
 	argv += optind;
 
-	if (pledge("stdio rpath tmppath", NULL) == -1)
+	if (cachefile != NULL) {
+		if (pledge(njobs > 1 ? "stdio rpath wpath cpath tmppath proc" :
+		    "stdio rpath wpath cpath tmppath", NULL) == -1)
+			err(2, "pledge");
+	} else if (pledge(njobs > 1 ? "stdio rpath tmppath proc" :
+	    "stdio rpath tmppath", NULL) == -1)
 		err(2, "pledge");
 
 	/*
@@ -249,7 +283,16 @@ main(int argc, char **argv)
 	if (S_ISDIR(stb1.st_mode) && S_ISDIR(stb2.st_mode)) {
 		if (diff_format == D_IFDEF)
 			errx(2, "-D option not supported with directories");
-		diffdir(argv[0], argv[1], dflags);
+		if (cachefile != NULL)
+			cache_load();
+		if (njobs > 1) {
+			jobstart();
+			diffdir(argv[0], argv[1], dflags);
+			jobfinish();
+		} else
+			diffdir(argv[0], argv[1], dflags);
+		if (cachefile != NULL)
+			cache_save();
 	} else {
 		if (S_ISDIR(stb1.st_mode)) {
 			argv[0] = openbsd_splice(argv[0], argv[1]);
@@ -395,7 +438,8 @@ usage(void)
 	    "       diff [-abditw] [-I pattern] -D string file1 file2\n"
 	    "       diff [-abdipTtw] [-I pattern] [-L label] -U number file1 file2\n"
 	    "       diff [-abdiNPprsTtw] [-c | -e | -f | -n | -q | -u] [-I pattern]\n"
-	    "            [-L label] [-S name] [-X file] [-x pattern] dir1 dir2\n");
+	    "            [-j jobs] [-L label] [-S name] [-X file] [-x pattern]\n"
+	    "            dir1 dir2\n");
 
 	exit(2);
 }
@@ -33,6 +33,7 @@
 
 #include <sys/types.h>
 #include <regex.h>
+#include <stdint.h>
 
 /*
  * Output format options
@@ -64,6 +65,8 @@
 #define D_PROTOTYPE	0x080	/* Display C function prototype */
 #define D_EXPANDTABS	0x100	/* Expand tabs to spaces */
 #define D_IGNOREBLANKS	0x200	/* Ignore white space changes */
+#define D_MYERS		0x400	/* Use the Myers algorithm */
+#define D_HISTOGRAM	0x800	/* Use histogram diff */
 
 /*
  * Status values for print_status() and diffreg() return values
@@ -76,23 +79,46 @@
 #define	D_SKIPPED1	5	/* path1 was a special file */
 #define	D_SKIPPED2	6	/* path2 was a special file */
 
+/*
+ * A --cache entry; dev and ino are the key and must stay together.
+ */
+#define CACHE_DIGEST_LENGTH	16
+
+struct cachent {
+	uint64_t dev;
+	uint64_t ino;
+	int64_t	size;
+	int64_t	sec;
+	int64_t	nsec;
+	u_char	digest[CACHE_DIGEST_LENGTH];
+};
+
 struct excludes {
 	char *pattern;
 	struct excludes *next;
 };
 
 extern int	Nflag, Pflag, rflag, sflag, Tflag;
+extern int	njobs;
 extern int	diff_format, diff_context, status;
 extern char	*start, *ifdefname, *diffargs, *label[2], *ignore_pats;
+extern char	*cachefile;
 extern struct	stat stb1, stb2;
 extern struct	excludes *excludes_list;
 extern regex_t	ignore_re;
 
 char	*openbsd_splice(char *, char *);
+int	cache_fresh(struct cachent *);
+int	cache_same(char *, struct stat *, char *, struct stat *, int);
+void	cache_add(struct cachent *);
+void	cache_load(void);
+void	cache_save(void);
 int	diffreg(char *, char *, int);
 int	easprintf(char **, const char *, ...);
 void	*emalloc(size_t);
 void	*erealloc(void *, size_t);
 void	diffdir(char *, char *, int);
+void	jobstart(void);
+void	jobfinish(void);
 void	print_only(const char *, size_t, const char *);
 void	print_status(int, char *, char *, char *);
@@ -0,0 +1,360 @@
+/*
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <sys/stat.h>
+
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <htab.h>
+
+#include "diff.h"
+#include "xmalloc.h"
+
+/*
+ * A persistent cache of file content digests for --cache.  Entries are
+ * keyed by device and inode and are only trusted while the size and
+ * modification time still match, so a file is read again as soon as it
+ * changes.  When both files of a pair have the same size and a valid
+ * digest, comparing the digests is enough to tell whether they differ.
+ *
+ * The cache is a text file with one entry per line:
+ *
+ *	dev ino size mtime-sec mtime-nsec digest
+ *
+ * The digest is MurmurHash3 x64/128, which is not cryptographic; the
+ * cache guards against accidental collisions, not malicious ones.
+ *
+ * In memory the entries are kept whole in an htab keyed by the device
+ * and inode at the head of each.
+ */
+
+#define CACHE_MAGIC	"# diff cache 1"
+
+#define CACHE_KEY(ce)	(&(ce)->dev)
+#define CACHE_KEYLEN	(2 * sizeof(uint64_t))
+
+static struct htab cache;
+static int cachedirty;
+static struct cachent fresh[2];	/* computed by the last cache_same() */
+static int nfresh;
+
+static int	 cache_digest(const char *, struct stat *, struct cachent *,
+		    int);
+static void	 cache_put(const struct cachent *);
+static int	 murmur3_file(int, u_char *);
+
+/*
+ * Store ce, replacing any entry for the same file.
+ */
+static void
+cache_put(const struct cachent *ce)
+{
+	struct cachent *p;
+
+	if ((p = htab_insert(&cache, CACHE_KEY(ce), CACHE_KEYLEN,
+	    NULL)) == NULL)
+		err(2, "cache");
+	*p = *ce;
+}
+
+void
+cache_load(void)
+{
+	struct cachent ce;
+	unsigned long long dev, ino;
+	long long size, sec, nsec;
+	char *line, hex[2 * CACHE_DIGEST_LENGTH + 1];
+	size_t linesize;
+	ssize_t linelen;
+	unsigned int i, x;
+	FILE *fp;
+
+	htab_init(&cache, sizeof(struct cachent));
+	if ((fp = fopen(cachefile, "r")) == NULL) {
+		if (errno != ENOENT)
+			warn("%s", cachefile);
+		return;
+	}
+	line = NULL;
+	linesize = 0;
+	while ((linelen = getline(&line, &linesize, fp)) != -1) {
+		if (line[0] == '#')
+			continue;
+		if (sscanf(line, "%llu %llu %lld %lld %lld %32s", &dev, &ino,
+		    &size, &sec, &nsec, hex) != 6 ||
+		    strlen(hex) != 2 * CACHE_DIGEST_LENGTH)
+			continue;
+		memset(&ce, 0, sizeof(ce));
+		ce.dev = dev;
+		ce.ino = ino;
+		ce.size = size;
+		ce.sec = sec;
+		ce.nsec = nsec;
+		for (i = 0; i < CACHE_DIGEST_LENGTH; i++) {
+			if (sscanf(hex + 2 * i, "%2x", &x) != 1)
+				break;
+			ce.digest[i] = x;
+		}
+		if (i != CACHE_DIGEST_LENGTH)
+			continue;
+		cache_put(&ce);
+	}
+	free(line);
+	fclose(fp);
+}
+
+/*
+ * Write the cache back if anything changed, replacing the old one
+ * atomically.
+ */
+void
+cache_save(void)
+{
+	struct cachent *p;
+	char *tmp;
+	size_t pos;
+	int fd, i;
+	FILE *fp;
+
+	if (!cachedirty)
+		return;
+	xasprintf(&tmp, "%s.XXXXXXXXXX", cachefile);
+	if ((fd = mkstemp(tmp)) == -1 || (fp = fdopen(fd, "w")) == NULL) {
+		warn("%s", tmp);
+		if (fd != -1) {
+			close(fd);
+			unlink(tmp);
+		}
+		free(tmp);
+		return;
+	}
+	fprintf(fp, "%s\n", CACHE_MAGIC);
+	pos = 0;
+	while ((p = htab_next(&cache, &pos, NULL, NULL)) != NULL) {
+		fprintf(fp, "%llu %llu %lld %lld %lld ",
+		    (unsigned long long)p->dev, (unsigned long long)p->ino,
+		    (long long)p->size, (long long)p->sec, (long long)p->nsec);
+		for (i = 0; i < CACHE_DIGEST_LENGTH; i++)
+			fprintf(fp, "%02x", p->digest[i]);
+		fputc('\n', fp);
+	}
+	if (fflush(fp) == EOF || ferror(fp) || rename(tmp, cachefile) == -1) {
+		warn("%s", cachefile);
+		unlink(tmp);
+	}
+	fclose(fp);
+	free(tmp);
+	cachedirty = 0;
+}
+
+/*
+ * Enter an entry computed elsewhere, e.g. by a -j worker.
+ */
+void
+cache_add(struct cachent *ce)
+{
+	cache_put(ce);
+	cachedirty = 1;
+}
+
+/*
+ * Return the entries that the last call to cache_same() had to compute.
+ */
+int
+cache_fresh(struct cachent *ce)
+{
+	memcpy(ce, fresh, nfresh * sizeof(*ce));
+	return (nfresh);
+}
+
+/*
+ * Find the digest of path in the cache or, if compute is set, by
+ * reading it.  Returns 0 if no digest is to be had.
+ */
+static int
+cache_digest(const char *path, struct stat *sb, struct cachent *ce,
+    int compute)
+{
+	struct cachent *p;
+	int fd, rval;
+
+	memset(ce, 0, sizeof(*ce));
+	ce->dev = sb->st_dev;
+	ce->ino = sb->st_ino;
+	ce->size = sb->st_size;
+	ce->sec = sb->st_mtim.tv_sec;
+	ce->nsec = sb->st_mtim.tv_nsec;
+
+	if ((p = htab_find(&cache, CACHE_KEY(ce), CACHE_KEYLEN)) != NULL &&
+	    p->size == ce->size && p->sec == ce->sec && p->nsec == ce->nsec) {
+		memcpy(ce->digest, p->digest, sizeof(ce->digest));
+		return (1);
+	}
+	if (!compute)
+		return (0);
+
+	if ((fd = open(path, O_RDONLY)) == -1)
+		return (0);
+	rval = murmur3_file(fd, ce->digest);
+	close(fd);
+	if (!rval)
+		return (0);
+	cache_put(ce);
+	cachedirty = 1;
+	fresh[nfresh++] = *ce;
+	return (1);
+}
+
+/*
+ * Return 1 if the regular files path1 and path2 are known to have the
+ * same contents, reading them to fill in the cache if compute is set.
+ * Returns 0 if they differ or we cannot tell.
+ */
+int
+cache_same(char *path1, struct stat *sb1, char *path2, struct stat *sb2,
+    int compute)
+{
+	struct cachent c1, c2;
+
+	nfresh = 0;
+	if (!S_ISREG(sb1->st_mode) || !S_ISREG(sb2->st_mode) ||
+	    sb1->st_size != sb2->st_size)
+		return (0);
+	if (sb1->st_dev == sb2->st_dev && sb1->st_ino == sb2->st_ino)
+		return (1);
+	if (!cache_digest(path1, sb1, &c1, compute) ||
+	    !cache_digest(path2, sb2, &c2, compute))
+		return (0);
+	return (memcmp(c1.digest, c2.digest, sizeof(c1.digest)) == 0);
+}
+
+/*
+ * MurmurHash3 x64/128, by Austin Appleby, who placed it in the
+ * public domain.
+ */
+#define ROTL64(x, r)	(((x) << (r)) | ((x) >> (64 - (r))))
+
+static uint64_t
+le64(const u_char *p)
+{
+	return ((uint64_t)p[0] | (uint64_t)p[1] << 8 |
+	    (uint64_t)p[2] << 16 | (uint64_t)p[3] << 24 |
+	    (uint64_t)p[4] << 32 | (uint64_t)p[5] << 40 |
+	    (uint64_t)p[6] << 48 | (uint64_t)p[7] << 56);
+}
+
+static uint64_t
+fmix64(uint64_t k)
+{
+	k ^= k >> 33;
+	k *= 0xff51afd7ed558ccdULL;
+	k ^= k >> 33;
+	k *= 0xc4ceb9fe1a85ec53ULL;
+	k ^= k >> 33;
+	return (k);
+}
+
+static int
+murmur3_file(int fd, u_char *digest)
+{
+	const uint64_t c1 = 0x87c37b91114253d5ULL;
+	const uint64_t c2 = 0x4cf5ad432745937fULL;
+	u_char buf[MAXBSIZE], tail[16];
+	uint64_t h1, h2, k1, k2, total;
+	size_t len, off;
+	ssize_t n;
+	int i;
+
+	h1 = h2 = 0;
+	total = 0;
+	len = 0;
+	for (;;) {
+		/* fill the buffer so only the last one has a partial block */
+		for (; len < sizeof(buf); len += n) {
+			if ((n = read(fd, buf + len, sizeof(buf) - len)) == -1) {
+				if (errno == EINTR) {
+					n = 0;
+					continue;
+				}
+				return (0);
+			}
+			if (n == 0)
+				break;
+		}
+		total += len;
+		for (off = 0; off + 16 <= len; off += 16) {
+			k1 = le64(buf + off);
+			k2 = le64(buf + off + 8);
+
+			k1 *= c1;
+			k1 = ROTL64(k1, 31);
+			k1 *= c2;
+			h1 ^= k1;
+			h1 = ROTL64(h1, 27);
+			h1 += h2;
+			h1 = h1 * 5 + 0x52dce729;
+
+			k2 *= c2;
+			k2 = ROTL64(k2, 33);
+			k2 *= c1;
+			h2 ^= k2;
+			h2 = ROTL64(h2, 31);
+			h2 += h1;
+			h2 = h2 * 5 + 0x38495ab5;
+		}
+		if (len < sizeof(buf))
+			break;
+		len = 0;
+	}
+
+	if ((len -= off) > 0) {
+		memset(tail, 0, sizeof(tail));
+		memcpy(tail, buf + off, len);
+		if (len > 8) {
+			k2 = le64(tail + 8);
+			k2 *= c2;
+			k2 = ROTL64(k2, 33);
+			k2 *= c1;
+			h2 ^= k2;
+		}
+		k1 = le64(tail);
+		k1 *= c1;
+		k1 = ROTL64(k1, 31);
+		k1 *= c2;
+		h1 ^= k1;
+	}
+
+	h1 ^= total;
+	h2 ^= total;
+	h1 += h2;
+	h2 += h1;
+	h1 = fmix64(h1);
+	h2 = fmix64(h2);
+	h1 += h2;
+	h2 += h1;
+	for (i = 0; i < 8; i++) {
+		digest[i] = h1 >> (8 * i);
+		digest[8 + i] = h2 >> (8 * i);
+	}
+	return (1);
+}
@@ -21,6 +21,7 @@
  */
 
 #include <sys/stat.h>
+#include <sys/wait.h>
 
 #include <dirent.h>
 #include <err.h>
@@ -28,6 +29,7 @@
 #include <fcntl.h>
 #include <fnmatch.h>
 #include <paths.h>
+#include <poll.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -39,9 +41,13 @@
 
 static int selectfile(const struct dirent *);
 static void diffit(struct dirent *, char *, size_t, char *, size_t, int);
+static void diffjob(char *, char *, int);
+static int diffpair(char *, char *, int, int);
 
 #define d_status	d_type		/* we need to store status for -l */
 
+#define MINIMUM(a, b)	(((a) < (b)) ? (a) : (b))
+
 /*
  * Diff directory traversal. Will be called recursively if -r was specified.
  */
@@ -206,11 +212,28 @@ diffit(struct dirent *dp, char *path1, size_t plen1, char *path2, size_t plen2,
 		dp->d_status = D_SKIPPED1;
 	else if (!S_ISREG(stb2.st_mode) && !S_ISDIR(stb2.st_mode))
 		dp->d_status = D_SKIPPED2;
-	else
-		dp->d_status = diffreg(path1, path2, flags);
+	else if (njobs > 1 && (cachefile == NULL ||
+	    (flags & (D_EMPTY1|D_EMPTY2)) ||
+	    !cache_same(path1, &stb1, path2, &stb2, 0))) {
+		diffjob(path1, path2, flags);
+		return;
+	} else
+		dp->d_status = diffpair(path1, path2, flags, 1);
 	print_status(dp->d_status, path1, path2, "");
 }
 
+/*
+ * Compare two regular files, unless the --cache says they are the same.
+ */
+static int
+diffpair(char *path1, char *path2, int flags, int compute)
+{
+	if (cachefile != NULL && (flags & (D_EMPTY1|D_EMPTY2)) == 0 &&
+	    cache_same(path1, &stb1, path2, &stb2, compute))
+		return (D_SAME);
+	return (diffreg(path1, path2, flags));
+}
+
 /*
  * Returns 1 if the directory entry should be included in the
  * diff, else 0.  Checks the excludes list.
@@ -235,3 +258,374 @@ selectfile(const struct dirent *dp)
 
 	return (1);
 }
+
+/*
+ * With -j, pairs of regular files are diffed by a pool of worker
+ * processes, each with its own copy of diffreg()'s state.  A worker
+ * writes to a temporary file of its own and reports back where the
+ * output for each pair begins and ends.  The parent's own output
+ * ("Only in ...", etc.) is diverted to a temporary file too, and
+ * everything is copied to the real standard output in the order a
+ * serial run would have produced it.  Since diffreg() starts with
+ * files_differ(), identical files are weeded out in parallel as well.
+ */
+struct job {
+	int	 fd;		/* file holding the output */
+	off_t	 start;		/* where the output begins */
+	off_t	 end;		/* and ends */
+	int	 done;
+	int	 closefd;	/* last job of a dead worker: close fd */
+	struct job *next;
+};
+
+struct jobreq {
+	int	 flags;
+	size_t	 len1;
+	size_t	 len2;
+	struct stat st1;
+	struct stat st2;
+};
+
+struct jobres {
+	off_t	 start;
+	off_t	 end;
+	int	 status;
+	int	 nfresh;	/* new --cache entries */
+	struct cachent fresh[2];
+};
+
+static struct worker {
+	pid_t	 pid;
+	int	 cmdfd;		/* requests to the worker */
+	int	 resfd;		/* results from the worker */
+	int	 outfd;		/* the worker's standard output */
+	struct job *job;	/* the job it is working on */
+} *workers;
+
+static struct job *jobhead, **jobtail = &jobhead;
+static int realout = -1;	/* the real standard output */
+static off_t outmark;		/* parent output already queued */
+
+static void jobspawn(struct worker *);
+static void jobwait(void);
+static void jobflush(void);
+static void jobmark(void);
+static __dead void jobserve(int, int);
+
+static size_t
+readall(int fd, void *buf, size_t len)
+{
+	size_t off;
+	ssize_t n;
+
+	for (off = 0; off < len; off += n) {
+		if ((n = read(fd, (char *)buf + off, len - off)) == -1) {
+			if (errno == EINTR) {
+				n = 0;
+				continue;
+			}
+			err(2, "read");
+		}
+		if (n == 0)
+			break;
+	}
+	return (off);
+}
+
+static void
+writeall(int fd, const void *buf, size_t len)
+{
+	size_t off;
+	ssize_t n;
+
+	for (off = 0; off < len; off += n) {
+		if ((n = write(fd, (const char *)buf + off, len - off)) == -1) {
+			if (errno == EINTR) {
+				n = 0;
+				continue;
+			}
+			err(2, "write");
+		}
+	}
+}
+
+void
+jobstart(void)
+{
+	FILE *fp;
+	int i;
+
+	fflush(stdout);
+	if ((realout = dup(STDOUT_FILENO)) == -1)
+		err(2, "dup");
+	if ((fp = tmpfile()) == NULL)
+		err(2, "tmpfile");
+	if (dup2(fileno(fp), STDOUT_FILENO) == -1)
+		err(2, "dup2");
+	fclose(fp);
+	outmark = 0;
+
+	workers = xcalloc(njobs, sizeof(*workers));
+	for (i = 0; i < njobs; i++)
+		workers[i].pid = -1;
+	for (i = 0; i < njobs; i++)
+		jobspawn(&workers[i]);
+}
+
+void
+jobfinish(void)
+{
+	struct worker *w;
+	int i;
+
+	jobmark();
+	while (jobhead != NULL)
+		jobwait();
+	for (i = 0; i < njobs; i++) {
+		w = &workers[i];
+		close(w->cmdfd);
+		close(w->resfd);
+		close(w->outfd);
+		while (waitpid(w->pid, NULL, 0) == -1 && errno == EINTR)
+			;
+	}
+	free(workers);
+	workers = NULL;
+
+	fflush(stdout);
+	if (dup2(realout, STDOUT_FILENO) == -1)
+		err(2, "dup2");
+	close(realout);
+	realout = -1;
+}
+
+static void
+jobspawn(struct worker *w)
+{
+	FILE *fp;
+	int cmd[2], res[2], i;
+
+	if ((fp = tmpfile()) == NULL)
+		err(2, "tmpfile");
+	if ((w->outfd = dup(fileno(fp))) == -1)
+		err(2, "dup");
+	fclose(fp);
+	if (pipe(cmd) == -1 || pipe(res) == -1)
+		err(2, "pipe");
+	fflush(stdout);
+	switch (w->pid = fork()) {
+	case -1:
+		err(2, "fork");
+	case 0:
+		/* don't hold the other workers' pipes open */
+		for (i = 0; i < njobs; i++) {
+			if (&workers[i] == w || workers[i].pid == -1)
+				continue;
+			close(workers[i].cmdfd);
+			close(workers[i].resfd);
+			close(workers[i].outfd);
+		}
+		close(cmd[1]);
+		close(res[0]);
+		close(realout);
+		if (dup2(w->outfd, STDOUT_FILENO) == -1)
+			err(2, "dup2");
+		close(w->outfd);
+		jobserve(cmd[0], res[1]);
+	}
+	close(cmd[0]);
+	close(res[1]);
+	w->cmdfd = cmd[1];
+	w->resfd = res[0];
+	w->job = NULL;
+}
+
+/*
+ * The worker side: diff the pairs of files we are sent until the
+ * parent closes the pipe.
+ */
+static __dead void
+jobserve(int cmdfd, int resfd)
+{
+	char path1[PATH_MAX], path2[PATH_MAX];
+	struct jobreq req;
+	struct jobres res;
+
+	if (pledge("stdio rpath tmppath", NULL) == -1)
+		err(2, "pledge");
+	while (readall(cmdfd, &req, sizeof(req)) == sizeof(req)) {
+		if (req.len1 >= sizeof(path1) || req.len2 >= sizeof(path2) ||
+		    readall(cmdfd, path1, req.len1) != req.len1 ||
+		    readall(cmdfd, path2, req.len2) != req.len2)
+			errx(2, "short request");
+		path1[req.len1] = '\0';
+		path2[req.len2] = '\0';
+		stb1 = req.st1;
+		stb2 = req.st2;
+
+		fflush(stdout);
+		res.start = lseek(STDOUT_FILENO, 0, SEEK_CUR);
+		status = 0;
+		print_status(diffpair(path1, path2, req.flags, 1), path1,
+		    path2, "");
+		fflush(stdout);
+		res.end = lseek(STDOUT_FILENO, 0, SEEK_CUR);
+		res.status = status;
+		res.nfresh = cachefile != NULL ? cache_fresh(res.fresh) : 0;
+		writeall(resfd, &res, sizeof(res));
+	}
+	_exit(0);
+}
+
+/*
+ * Queue up whatever the parent itself has printed since last time.
+ */
+static void
+jobmark(void)
+{
+	struct job *j;
+	off_t off;
+
+	fflush(stdout);
+	if ((off = lseek(STDOUT_FILENO, 0, SEEK_CUR)) <= outmark)
+		return;
+	j = xmalloc(sizeof(*j));
+	j->fd = STDOUT_FILENO;
+	j->start = outmark;
+	j->end = outmark = off;
+	j->done = 1;
+	j->closefd = 0;
+	j->next = NULL;
+	*jobtail = j;
+	jobtail = &j->next;
+}
+
+/*
+ * Hand path1 and path2 to an idle worker, waiting for one if need be.
+ */
+static void
+diffjob(char *path1, char *path2, int flags)
+{
+	struct worker *w;
+	struct jobreq req;
+	struct job *j;
+	int i;
+
+	jobmark();
+	for (w = NULL; w == NULL;) {
+		for (i = 0; i < njobs; i++)
+			if (workers[i].job == NULL) {
+				w = &workers[i];
+				break;
+			}
+		if (w == NULL)
+			jobwait();
+	}
+
+	j = xmalloc(sizeof(*j));
+	j->fd = w->outfd;
+	j->start = j->end = 0;
+	j->done = 0;
+	j->closefd = 0;
+	j->next = NULL;
+	*jobtail = j;
+	jobtail = &j->next;
+	w->job = j;
+
+	memset(&req, 0, sizeof(req));
+	req.flags = flags;
+	req.len1 = strlen(path1);
+	req.len2 = strlen(path2);
+	req.st1 = stb1;
+	req.st2 = stb2;
+	writeall(w->cmdfd, &req, sizeof(req));
+	writeall(w->cmdfd, path1, req.len1);
+	writeall(w->cmdfd, path2, req.len2);
+}
+
+/*
+ * Wait for at least one worker to finish its job and copy out any
+ * output that is now in order.  A worker that died (diffreg() can
+ * exit on fatal errors) is replaced and its job counts as trouble.
+ */
+static void
+jobwait(void)
+{
+	struct pollfd *pfd;
+	struct worker *w;
+	struct jobres res;
+	int i, n;
+
+	pfd = xcalloc(njobs, sizeof(*pfd));
+	for (i = n = 0; i < njobs; i++) {
+		pfd[i].fd = workers[i].job != NULL ? workers[i].resfd : -1;
+		pfd[i].events = POLLIN;
+		if (workers[i].job != NULL)
+			n++;
+	}
+	while (n > 0 && poll(pfd, njobs, -1) == -1)
+		if (errno != EINTR)
+			err(2, "poll");
+	for (i = 0; i < njobs; i++) {
+		if ((pfd[i].revents & (POLLIN|POLLHUP)) == 0)
+			continue;
+		w = &workers[i];
+		if (readall(w->resfd, &res, sizeof(res)) != sizeof(res)) {
+			close(w->cmdfd);
+			close(w->resfd);
+			while (waitpid(w->pid, NULL, 0) == -1 && errno == EINTR)
+				;
+			/*
+			 * w->outfd stays open for the jobs still in the
+			 * queue; this one is the last of them.
+			 */
+			w->job->done = 1;
+			w->job->closefd = 1;
+			w->job = NULL;
+			status |= 2;
+			w->pid = -1;
+			jobspawn(w);
+			continue;
+		}
+		w->job->start = res.start;
+		w->job->end = res.end;
+		w->job->done = 1;
+		w->job = NULL;
+		status |= res.status;
+		while (res.nfresh > 0)
+			cache_add(&res.fresh[--res.nfresh]);
+	}
+	free(pfd);
+	jobflush();
+}
+
+/*
+ * Copy the output of the finished jobs at the head of the queue.
+ */
+static void
+jobflush(void)
+{
+	char buf[MAXBSIZE];
+	struct job *j;
+	off_t off;
+	ssize_t n;
+
+	while ((j = jobhead) != NULL && j->done) {
+		for (off = j->start; off < j->end; off += n) {
+			n = pread(j->fd, buf, MINIMUM(sizeof(buf),
+			    (size_t)(j->end - off)), off);
+			if (n == -1 && errno == EINTR) {
+				n = 0;
+				continue;
+			}
+			if (n <= 0)
+				err(2, "pread");
+			writeall(realout, buf, n);
+		}
+		if (j->closefd)
+			close(j->fd);
+		if ((jobhead = j->next) == NULL)
+			jobtail = &jobhead;
+		free(j);
+	}
+}
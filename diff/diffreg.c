@@ -64,6 +64,7 @@
  *	@(#)diffreg.c   8.1 (Berkeley) 6/6/93
  */
 
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/wait.h>
 
@@ -162,9 +163,32 @@ struct cand {
 
 struct line {
 	int	serial;
-	int	value;
+	uint64_t value;
 } *file[2];
 
+/*
+ * The contents of each file, mapped (or, failing that, read) into memory
+ * once by slurp().  prepare() hashes the lines from here and records
+ * where each one ends in ixold/ixnew, after which check() and the
+ * ignore pattern matching in change() work from memory too.
+ */
+struct fbuf {
+	char	*base;
+	size_t	 size;
+	int	 mapped;
+} fbuf[2];
+
+/*
+ * A diagonal run of matching lines, a[x..u) against b[y..v), as found
+ * by myers_split() and histogram().
+ */
+struct snake {
+	int	x;
+	int	y;
+	int	u;
+	int	v;
+};
+
 /*
  * The following struct is used to record change information when
  * doing a "context" or "unified" diff.  (see routine "change" to
@@ -180,15 +204,22 @@ struct context_vec {
 #define	diff_output	printf
 static FILE	*opentemp(const char *);
 static void	 output(char *, FILE *, char *, FILE *, int);
-static void	 check(FILE *, FILE *, int);
+static void	 check(int);
 static void	 range(int, int, char *);
 static void	 uni_range(int, int);
 static void	 dump_context_vec(FILE *, FILE *, int);
 static void	 dump_unified_vec(FILE *, FILE *, int);
-static void	 prepare(int, FILE *, off_t, int);
+static void	 prepare(int, int);
+static void	 slurp(int, FILE *);
+static void	 unslurp(int);
 static void	 prune(void);
 static void	 equiv(struct line *, int, struct line *, int, int *);
 static void	 unravel(int);
+static void	 lcsmatch(int);
+static void	 myers(int, int, int, int);
+static void	 myers_split(int, int, int, int, struct snake *);
+static void	 histogram(int, int, int, int);
+static int	 histslot(uint64_t, int);
 static void	 unsort(struct line *, int, int *);
 static void	 change(char *, FILE *, char *, FILE *, int, int, int, int, int *);
 static void	 sort(struct line *, int);
@@ -198,13 +229,14 @@ static int	 asciifile(FILE *);
 static int	 fetch(long *, int, int, FILE *, int, int, int);
 static int	 newcand(int, int, int);
 static int	 search(int *, int, int);
-static int	 skipline(FILE *);
+static int	 linematch(const char *, const char *, const char *,
+		    const char *, int);
 static int	 isqrt(int);
 static int	 stone(int *, int, int *, int *, int);
-static int	 readhash(FILE *, int);
+static uint64_t hashline(const char *, const char *, int, int);
 static int	 files_differ(FILE *, FILE *, int);
 static char	*match_function(const long *, int, FILE *);
-static char	*preadline(int, size_t, off_t);
+static char	*copyline(int, int);
 
 static int  *J;			/* will be overlaid on class */
 static int  *class;		/* will be overlaid on file[0] */
@@ -216,8 +248,8 @@ static int   len[2];
 static int   pref, suff;	/* length of prefix and suffix */
 static int   slen[2];
 static int   anychange;
-static long *ixnew;		/* will be overlaid on file[1] */
-static long *ixold;		/* will be overlaid on klist */
+static long *ixnew;		/* end offset of each line of file[1] */
+static long *ixold;		/* end offset of each line of file[0] */
 static struct cand *clist;	/* merely a free storage pot for candidates */
 static int   clistlen;		/* the length of clist */
 static struct line *sfile[2];	/* shortened by pruning common prefix/suffix */
@@ -370,39 +402,48 @@ diffreg(char *file1, char *file2, int flags)
 		status |= 1;
 		goto closem;
 	}
-	prepare(0, f1, stb1.st_size, flags);
-	prepare(1, f2, stb2.st_size, flags);
+	slurp(0, f1);
+	slurp(1, f2);
+	prepare(0, flags);
+	prepare(1, flags);
 
 	prune();
-	sort(sfile[0], slen[0]);
-	sort(sfile[1], slen[1]);
-
-	member = (int *)file[1];
-	equiv(sfile[0], slen[0], sfile[1], slen[1], member);
-	member = xreallocarray(member, slen[1] + 2, sizeof(*member));
-
-	class = (int *)file[0];
-	unsort(sfile[0], slen[0], class);
-	class = xreallocarray(class, slen[0] + 2, sizeof(*class));
-
-	klist = xcalloc(slen[0] + 2, sizeof(*klist));
-	clen = 0;
-	clistlen = 100;
-	clist = xcalloc(clistlen, sizeof(*clist));
-	i = stone(class, slen[0], member, klist, flags);
-	free(member);
-	free(class);
-
-	J = xreallocarray(J, len[0] + 2, sizeof(*J));
-	unravel(klist[i]);
-	free(clist);
-	free(klist);
-
-	ixold = xreallocarray(ixold, len[0] + 2, sizeof(*ixold));
-	ixnew = xreallocarray(ixnew, len[1] + 2, sizeof(*ixnew));
-	check(f1, f2, flags);
+	if (flags & (D_MYERS | D_HISTOGRAM)) {
+		J = xreallocarray(J, len[0] + 2, sizeof(*J));
+		lcsmatch(flags);
+		free(file[0]);
+		free(file[1]);
+	} else {
+		sort(sfile[0], slen[0]);
+		sort(sfile[1], slen[1]);
+
+		member = (int *)file[1];
+		equiv(sfile[0], slen[0], sfile[1], slen[1], member);
+		member = xreallocarray(member, slen[1] + 2, sizeof(*member));
+
+		class = (int *)file[0];
+		unsort(sfile[0], slen[0], class);
+		class = xreallocarray(class, slen[0] + 2, sizeof(*class));
+
+		klist = xcalloc(slen[0] + 2, sizeof(*klist));
+		clen = 0;
+		clistlen = 100;
+		clist = xcalloc(clistlen, sizeof(*clist));
+		i = stone(class, slen[0], member, klist, flags);
+		free(member);
+		free(class);
+
+		J = xreallocarray(J, len[0] + 2, sizeof(*J));
+		unravel(klist[i]);
+		free(clist);
+		free(klist);
+	}
+
+	check(flags);
 	output(file1, f1, file2, f2, flags);
 closem:
+	unslurp(0);
+	unslurp(1);
 	if (anychange) {
 		status |= 1;
 		if (rval == D_SAME)
@@ -492,29 +533,104 @@ openbsd_splice(char *dir, char *file)
 	return (buf);
 }
 
+/*
+ * Bring the contents of f into fbuf[i], by mapping them if f is a
+ * regular file and reading them otherwise.
+ */
+static void
+slurp(int i, FILE *f)
+{
+	struct fbuf *fb = &fbuf[i];
+	struct stat sb;
+	size_t sz, n;
+	void *p;
+
+	fb->base = NULL;
+	fb->size = 0;
+	fb->mapped = 0;
+	if (fstat(fileno(f), &sb) == 0 && S_ISREG(sb.st_mode) &&
+	    sb.st_size > 0 && (uintmax_t)sb.st_size <= SIZE_MAX) {
+		p = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE,
+		    fileno(f), 0);
+		if (p != MAP_FAILED) {
+			(void)madvise(p, sb.st_size, MADV_SEQUENTIAL);
+			fb->base = p;
+			fb->size = sb.st_size;
+			fb->mapped = 1;
+			return;
+		}
+	}
+
+	rewind(f);
+	for (sz = 0;;) {
+		if (fb->size == sz) {
+			sz = sz == 0 ? MAXBSIZE : sz * 2;
+			fb->base = xreallocarray(fb->base, sz, 1);
+		}
+		if ((n = fread(fb->base + fb->size, 1, sz - fb->size, f)) == 0)
+			break;
+		fb->size += n;
+	}
+	if (ferror(f))
+		err(2, "read");
+}
+
 static void
-prepare(int i, FILE *fd, off_t filesize, int flags)
+unslurp(int i)
+{
+	struct fbuf *fb = &fbuf[i];
+
+	if (fb->mapped)
+		munmap(fb->base, fb->size);
+	else
+		free(fb->base);
+	fb->base = NULL;
+	fb->size = 0;
+	fb->mapped = 0;
+}
+
+static void
+prepare(int i, int flags)
 {
 	struct line *p;
-	int j, h;
+	long *ix;
+	char *cp, *ep, *nl;
+	uint64_t h;
 	size_t sz;
+	int j;
 
-	rewind(fd);
-
-	sz = (filesize <= SIZE_MAX ? filesize : SIZE_MAX) / 25;
+	sz = fbuf[i].size / 25;
 	if (sz < 100)
 		sz = 100;
 
 	p = xcalloc(sz + 3, sizeof(*p));
-	for (j = 0; (h = readhash(fd, flags));) {
+	ix = xreallocarray(i == 0 ? ixold : ixnew, sz + 3, sizeof(*ix));
+	ix[0] = 0;
+	cp = fbuf[i].base;
+	ep = cp + fbuf[i].size;
+	for (j = 0; cp < ep;) {
+		if ((nl = memchr(cp, '\n', ep - cp)) == NULL)
+			nl = ep;
+		if ((h = hashline(cp, nl, nl == ep, flags)) == 0)
+			break;
 		if (j == sz) {
 			sz = sz * 3 / 2;
 			p = xreallocarray(p, sz + 3, sizeof(*p));
+			ix = xreallocarray(ix, sz + 3, sizeof(*ix));
 		}
 		p[++j].value = h;
+		/* an unterminated last line ends one past EOF, see fetch() */
+		ix[j] = nl - fbuf[i].base + 1;
+		if (nl == ep)
+			break;
+		cp = nl + 1;
 	}
 	len[i] = j;
 	file[i] = p;
+	if (i == 0)
+		ixold = ix;
+	else
+		ixnew = ix;
 }
 
 static void
@@ -687,112 +803,417 @@ unravel(int p)
 }
 
 /*
- * Check does double duty:
- *  1.	ferret out any fortuitous correspondences due
- *	to confounding by hashing (which result in "jackpot")
- *  2.  collect random access indexes to the two files
+ * Alternatives to stone() selected by --algorithm.  Both work on the
+ * hash values of the pruned files and fill in J directly, leaving it to
+ * check() to break any matches that are only due to hash collisions.
+ *
+ * myers() is E. Myers' O(ND) algorithm ("An O(ND) Difference Algorithm
+ * and Its Variations", Algorithmica 1986) in its linear space form: it
+ * looks for the middle snake of an optimal edit path by searching from
+ * both ends at once and then recurses on either side of it.  Unless -d
+ * was given, a search that runs past lcsbound edits is cut short at the
+ * furthest point reached so far, which keeps the worst case bounded
+ * without giving up on the rest of the file the way stone() does.
+ *
+ * histogram() first anchors on the rarest lines that the two sides have
+ * in common, which lines up function boundaries and the like instead of
+ * blank lines and braces, and hands whatever it cannot anchor to myers().
  */
+#define HISTMAXOCC	64	/* lines more common than this never anchor */
+
+#define LCSMATCH(x, y)	(J[pref + 1 + (x)] = pref + 1 + (y))
+
+static uint64_t *lcsa, *lcsb;	/* hash values of sfile[0] and sfile[1] */
+static int  *fdiag, *bdiag;	/* furthest x reached on each diagonal */
+static int   lcsbound;		/* edit cost at which myers_split() gives up */
+static int  *hhead, *hcount;	/* histogram() table, indexed by hash slot */
+static int  *hnext;		/* next occurrence of the same line in lcsa */
+
 static void
-check(FILE *f1, FILE *f2, int flags)
+lcsmatch(int flags)
 {
-	int i, j, jackpot, c, d;
-	long ctold, ctnew;
+	int i, n, m, hsize;
 
-	rewind(f1);
-	rewind(f2);
-	j = 1;
-	ixold[0] = ixnew[0] = 0;
-	jackpot = 0;
-	ctold = ctnew = 0;
-	for (i = 1; i <= len[0]; i++) {
-		if (J[i] == 0) {
-			ixold[i] = ctold += skipline(f1);
+	n = slen[0];
+	m = slen[1];
+	for (i = 0; i <= len[0]; i++)
+		J[i] = i <= pref ? i :
+		    i > len[0] - suff ? i + len[1] - len[0] : 0;
+	lcsa = xcalloc(n + 1, sizeof(*lcsa));
+	lcsb = xcalloc(m + 1, sizeof(*lcsb));
+	for (i = 0; i < n; i++)
+		lcsa[i] = sfile[0][i + 1].value;
+	for (i = 0; i < m; i++)
+		lcsb[i] = sfile[1][i + 1].value;
+	/* diagonals run from -m - 1 to n + 1 */
+	fdiag = xcalloc(n + m + 3, sizeof(*fdiag));
+	bdiag = xcalloc(n + m + 3, sizeof(*bdiag));
+	if (flags & D_MINIMAL)
+		lcsbound = INT_MAX;
+	else
+		lcsbound = MAXIMUM(1024, isqrt(n + m) * 4);
+
+	if (flags & D_HISTOGRAM) {
+		for (hsize = 1; hsize < 2 * n; hsize <<= 1)
+			;
+		hhead = xcalloc(hsize, sizeof(*hhead));
+		hcount = xcalloc(hsize, sizeof(*hcount));
+		hnext = xcalloc(n + 1, sizeof(*hnext));
+		histogram(0, n, 0, m);
+		free(hhead);
+		free(hcount);
+		free(hnext);
+	} else
+		myers(0, n, 0, m);
+
+	free(fdiag);
+	free(bdiag);
+	free(lcsa);
+	free(lcsb);
+}
+
+/*
+ * Match up lcsa[xoff..xlim) against lcsb[yoff..ylim).  The smaller half
+ * left over by each split is done recursively and the larger one by
+ * looping, so the stack stays logarithmic in the size of the input.
+ */
+static void
+myers(int xoff, int xlim, int yoff, int ylim)
+{
+	struct snake s;
+	int i;
+
+	for (;;) {
+		while (xoff < xlim && yoff < ylim &&
+		    lcsa[xoff] == lcsb[yoff]) {
+			LCSMATCH(xoff, yoff);
+			xoff++;
+			yoff++;
+		}
+		while (xoff < xlim && yoff < ylim &&
+		    lcsa[xlim - 1] == lcsb[ylim - 1]) {
+			xlim--;
+			ylim--;
+			LCSMATCH(xlim, ylim);
+		}
+		if (xoff == xlim || yoff == ylim)
+			return;
+
+		myers_split(xoff, xlim, yoff, ylim, &s);
+		for (i = s.x; i < s.u; i++)
+			LCSMATCH(i, s.y + i - s.x);
+		if (s.x - xoff + s.y - yoff < xlim - s.u + ylim - s.v) {
+			myers(xoff, s.x, yoff, s.y);
+			xoff = s.u;
+			yoff = s.v;
+		} else {
+			myers(s.u, xlim, s.v, ylim);
+			xlim = s.x;
+			ylim = s.y;
+		}
+	}
+}
+
+/*
+ * Find the middle snake of a shortest edit script for lcsa[xoff..xlim)
+ * and lcsb[yoff..ylim), whose first and last lines must differ.
+ * Diagonal k holds the points with x - y == k; fd[k] is the furthest x
+ * reached on it by the forward search and bd[k] the smallest x reached
+ * by the backward one, with -1 and INT_MAX meaning not reached at all.
+ */
+static void
+myers_split(int xoff, int xlim, int yoff, int ylim, struct snake *sp)
+{
+	int *fd, *bd;
+	int dmin, dmax, fmid, bmid, odd;
+	int c, k, lo, hi, x, y, xs, ys, best;
+
+	fd = fdiag + slen[1] + 1;
+	bd = bdiag + slen[1] + 1;
+	dmin = xoff - ylim;
+	dmax = xlim - yoff;
+	fmid = xoff - yoff;
+	bmid = xlim - ylim;
+	odd = (fmid - bmid) & 1;
+	for (k = dmin - 1; k <= dmax + 1; k++) {
+		fd[k] = -1;
+		bd[k] = INT_MAX;
+	}
+
+	for (c = 0;; c++) {
+		/* forward, from the top left corner */
+		lo = MAXIMUM(fmid - c, dmin);
+		hi = MINIMUM(fmid + c, dmax);
+		if ((lo - fmid + c) & 1)
+			lo++;
+		if ((hi - fmid + c) & 1)
+			hi--;
+		for (k = lo; k <= hi; k += 2) {
+			if (c == 0)
+				x = xoff;
+			else {
+				x = -1;
+				if (fd[k + 1] >= 0 && fd[k + 1] - k <= ylim)
+					x = fd[k + 1];
+				if (fd[k - 1] >= 0 && fd[k - 1] < xlim &&
+				    fd[k - 1] + 1 > x)
+					x = fd[k - 1] + 1;
+				if (x < 0) {
+					fd[k] = -1;
+					continue;
+				}
+			}
+			y = x - k;
+			xs = x;
+			ys = y;
+			while (x < xlim && y < ylim && lcsa[x] == lcsb[y]) {
+				x++;
+				y++;
+			}
+			fd[k] = x;
+			if (odd && bd[k] <= x) {
+				sp->x = xs;
+				sp->y = ys;
+				sp->u = x;
+				sp->v = y;
+				return;
+			}
+		}
+
+		/* backward, from the bottom right corner */
+		lo = MAXIMUM(bmid - c, dmin);
+		hi = MINIMUM(bmid + c, dmax);
+		if ((lo - bmid + c) & 1)
+			lo++;
+		if ((hi - bmid + c) & 1)
+			hi--;
+		for (k = lo; k <= hi; k += 2) {
+			if (c == 0)
+				x = xlim;
+			else {
+				x = INT_MAX;
+				if (bd[k - 1] != INT_MAX && bd[k - 1] - k >= yoff)
+					x = bd[k - 1];
+				if (bd[k + 1] != INT_MAX && bd[k + 1] > xoff &&
+				    bd[k + 1] - 1 < x)
+					x = bd[k + 1] - 1;
+				if (x == INT_MAX) {
+					bd[k] = INT_MAX;
+					continue;
+				}
+			}
+			y = x - k;
+			xs = x;
+			ys = y;
+			while (x > xoff && y > yoff &&
+			    lcsa[x - 1] == lcsb[y - 1]) {
+				x--;
+				y--;
+			}
+			bd[k] = x;
+			if (!odd && fd[k] >= x) {
+				sp->x = x;
+				sp->y = y;
+				sp->u = xs;
+				sp->v = ys;
+				return;
+			}
+		}
+
+		if (c < lcsbound)
 			continue;
+		/*
+		 * Too expensive: split at the forward point that got
+		 * furthest and let the recursion sort out both halves.
+		 */
+		best = -1;
+		sp->x = sp->u = xoff;
+		sp->y = sp->v = yoff;
+		for (k = dmin; k <= dmax; k++)
+			if (fd[k] >= 0 && fd[k] * 2 - k > best) {
+				best = fd[k] * 2 - k;
+				sp->x = sp->u = fd[k];
+				sp->y = sp->v = fd[k] - k;
+			}
+		return;
+	}
+}
+
+/*
+ * Look up the occurrence list of line value v in the histogram table.
+ */
+static int
+histslot(uint64_t v, int mask)
+{
+	u_int h;
+
+	h = ((u_int)(v ^ v >> 32) * 2654435761U) & mask;
+	while (hcount[h] != 0 && lcsa[hhead[h]] != v)
+		h = (h + 1) & mask;
+	return (h);
+}
+
+static void
+histogram(int xoff, int xlim, int yoff, int ylim)
+{
+	struct snake s;
+	int i, j, h, mask, cnt, bestcnt, x, y, u, v, next;
+
+	for (;;) {
+		while (xoff < xlim && yoff < ylim &&
+		    lcsa[xoff] == lcsb[yoff]) {
+			LCSMATCH(xoff, yoff);
+			xoff++;
+			yoff++;
 		}
-		while (j < J[i]) {
-			ixnew[j] = ctnew += skipline(f2);
-			j++;
+		while (xoff < xlim && yoff < ylim &&
+		    lcsa[xlim - 1] == lcsb[ylim - 1]) {
+			xlim--;
+			ylim--;
+			LCSMATCH(xlim, ylim);
 		}
-		if (flags & (D_FOLDBLANKS|D_IGNOREBLANKS|D_IGNORECASE)) {
-			for (;;) {
-				c = getc(f1);
-				d = getc(f2);
-				/*
-				 * GNU diff ignores a missing newline
-				 * in one file for -b or -w.
-				 */
-				if (flags & (D_FOLDBLANKS|D_IGNOREBLANKS)) {
-					if (c == EOF && d == '\n') {
-						ctnew++;
-						break;
-					} else if (c == '\n' && d == EOF) {
-						ctold++;
-						break;
-					}
+		if (xoff == xlim || yoff == ylim)
+			return;
+
+		/* count the lines of a, chaining equal ones together */
+		for (mask = 1; mask < 2 * (xlim - xoff); mask <<= 1)
+			;
+		mask--;
+		memset(hcount, 0, (mask + 1) * sizeof(*hcount));
+		for (i = xlim - 1; i >= xoff; i--) {
+			h = histslot(lcsa[i], mask);
+			hnext[i] = hcount[h] != 0 ? hhead[h] : -1;
+			hhead[h] = i;
+			hcount[h]++;
+		}
+
+		/*
+		 * Find the longest common run around the rarest line of
+		 * b that also occurs in a.
+		 */
+		bestcnt = HISTMAXOCC + 1;
+		s.x = s.u = s.y = s.v = 0;
+		for (j = yoff; j < ylim; j = next) {
+			next = j + 1;
+			h = histslot(lcsb[j], mask);
+			if ((cnt = hcount[h]) == 0 || cnt > bestcnt)
+				continue;
+			for (i = hhead[h]; i >= 0; i = hnext[i]) {
+				x = i;
+				y = j;
+				while (x > xoff && y > yoff &&
+				    lcsa[x - 1] == lcsb[y - 1]) {
+					x--;
+					y--;
 				}
-				ctold++;
-				ctnew++;
-				if ((flags & D_FOLDBLANKS) && isspace(c) &&
-				    isspace(d)) {
-					do {
-						if (c == '\n')
-							break;
-						ctold++;
-					} while (isspace(c = getc(f1)));
-					do {
-						if (d == '\n')
-							break;
-						ctnew++;
-					} while (isspace(d = getc(f2)));
-				} else if ((flags & D_IGNOREBLANKS)) {
-					while (isspace(c) && c != '\n') {
-						c = getc(f1);
-						ctold++;
-					}
-					while (isspace(d) && d != '\n') {
-						d = getc(f2);
-						ctnew++;
-					}
+				u = i + 1;
+				v = j + 1;
+				while (u < xlim && v < ylim &&
+				    lcsa[u] == lcsb[v]) {
+					u++;
+					v++;
 				}
-				if (chrtran[c] != chrtran[d]) {
-					jackpot++;
-					J[i] = 0;
-					if (c != '\n' && c != EOF)
-						ctold += skipline(f1);
-					if (d != '\n' && c != EOF)
-						ctnew += skipline(f2);
-					break;
+				if (v > next)
+					next = v;
+				if (cnt < bestcnt || u - x > s.u - s.x) {
+					bestcnt = cnt;
+					s.x = x;
+					s.y = y;
+					s.u = u;
+					s.v = v;
 				}
-				if (c == '\n' || c == EOF)
-					break;
 			}
+		}
+		if (bestcnt > HISTMAXOCC) {
+			myers(xoff, xlim, yoff, ylim);
+			return;
+		}
+
+		for (i = s.x; i < s.u; i++)
+			LCSMATCH(i, s.y + i - s.x);
+		if (s.x - xoff + s.y - yoff < xlim - s.u + ylim - s.v) {
+			histogram(xoff, s.x, yoff, s.y);
+			xoff = s.u;
+			yoff = s.v;
 		} else {
-			for (;;) {
-				ctold++;
-				ctnew++;
-				if ((c = getc(f1)) != (d = getc(f2))) {
-					/* jackpot++; */
-					J[i] = 0;
-					if (c != '\n' && c != EOF)
-						ctold += skipline(f1);
-					if (d != '\n' && c != EOF)
-						ctnew += skipline(f2);
+			histogram(s.u, xlim, s.v, ylim);
+			xlim = s.x;
+			ylim = s.y;
+		}
+	}
+}
+
+/*
+ * Ferret out any fortuitous correspondences due to confounding by
+ * hashing, comparing each pair of lines in J for real.
+ */
+static void
+check(int flags)
+{
+	const char *p1, *p2;
+	int i, j;
+
+	for (i = 1; i <= len[0]; i++) {
+		if ((j = J[i]) == 0)
+			continue;
+		p1 = fbuf[0].base;
+		p2 = fbuf[1].base;
+		if (!linematch(p1 + ixold[i - 1],
+		    p1 + MINIMUM(ixold[i], (long)fbuf[0].size),
+		    p2 + ixnew[j - 1],
+		    p2 + MINIMUM(ixnew[j], (long)fbuf[1].size), flags))
+			J[i] = 0;
+	}
+}
+
+#define LGETC(p, e)	((p) < (e) ? *(const u_char *)(p)++ : EOF)
+
+/*
+ * Compare the lines [p1, e1) and [p2, e2), each including its newline
+ * if it has one, taking -b, -i and -w into account.
+ */
+static int
+linematch(const char *p1, const char *e1, const char *p2, const char *e2,
+    int flags)
+{
+	int c, d;
+
+	if ((flags & (D_FOLDBLANKS|D_IGNOREBLANKS|D_IGNORECASE)) == 0)
+		return (e1 - p1 == e2 - p2 && memcmp(p1, p2, e1 - p1) == 0);
+
+	for (;;) {
+		c = LGETC(p1, e1);
+		d = LGETC(p2, e2);
+		/*
+		 * GNU diff ignores a missing newline
+		 * in one file for -b or -w.
+		 */
+		if (flags & (D_FOLDBLANKS|D_IGNOREBLANKS)) {
+			if ((c == EOF && d == '\n') || (c == '\n' && d == EOF))
+				return (1);
+		}
+		if ((flags & D_FOLDBLANKS) && isspace(c) && isspace(d)) {
+			do {
+				if (c == '\n')
 					break;
-				}
-				if (c == '\n' || c == EOF)
+			} while (isspace(c = LGETC(p1, e1)));
+			do {
+				if (d == '\n')
 					break;
-			}
+			} while (isspace(d = LGETC(p2, e2)));
+		} else if ((flags & D_IGNOREBLANKS)) {
+			while (isspace(c) && c != '\n')
+				c = LGETC(p1, e1);
+			while (isspace(d) && d != '\n')
+				d = LGETC(p2, e2);
 		}
-		ixold[i] = ctold;
-		ixnew[j] = ctnew;
-		j++;
+		if (c == EOF || d == EOF)
+			return (c == d);
+		if (chrtran[c] != chrtran[d])
+			return (0);
+		if (c == '\n')
+			return (1);
 	}
-	for (; j <= len[1]; j++)
-		ixnew[j] = ctnew += skipline(f2);
-	/*
-	 * if (jackpot)
-	 *	fprintf(stderr, "jackpot\n");
-	 */
 }
 
 /* shellsort CACM #201 */
@@ -841,16 +1262,6 @@ unsort(struct line *f, int l, int *b)
 	free(a);
 }
 
-static int
-skipline(FILE *f)
-{
-	int i, c;
-
-	for (i = 1; (c = getc(f)) != '\n' && c != EOF; i++)
-		continue;
-	return (i);
-}
-
 static void
 output(char *file1, FILE *f1, char *file2, FILE *f2, int flags)
 {
@@ -924,15 +1335,19 @@ uni_range(int a, int b)
 		diff_output("%d,0", b);
 }
 
+/*
+ * Return a copy of line n of file i, without its newline.
+ */
 static char *
-preadline(int fd, size_t rlen, off_t off)
+copyline(int i, int n)
 {
+	long *ix = i == 0 ? ixold : ixnew;
 	char *line;
-	ssize_t nr;
+	size_t nr;
 
-	line = xmalloc(rlen + 1);
-	if ((nr = pread(fd, line, rlen, off)) == -1)
-		err(2, "preadline");
+	nr = MINIMUM(ix[n], (long)fbuf[i].size) - ix[n - 1];
+	line = xmalloc(nr + 1);
+	memcpy(line, fbuf[i].base + ix[n - 1], nr);
 	if (nr > 0 && line[nr-1] == '\n')
 		nr--;
 	line[nr] = '\0';
@@ -975,16 +1390,14 @@ restart:
 		 */
 		if (a <= b) {		/* Changes and deletes. */
 			for (i = a; i <= b; i++) {
-				line = preadline(fileno(f1),
-				    ixold[i] - ixold[i - 1], ixold[i - 1]);
+				line = copyline(0, i);
 				if (!ignoreline(line))
 					goto proceed;
 			}
 		}
 		if (a > b || c <= d) {	/* Changes and inserts. */
 			for (i = c; i <= d; i++) {
-				line = preadline(fileno(f2),
-				    ixnew[i] - ixnew[i - 1], ixnew[i - 1]);
+				line = copyline(1, i);
 				if (!ignoreline(line))
 					goto proceed;
 			}
@@ -1168,68 +1581,64 @@ fetch(long *f, int a, int b, FILE *lb, int ch, int oldfile, int flags)
 }
 
 /*
- * Hash function taken from Robert Sedgewick, Algorithms in C, 3d ed., p 578.
+ * Line hashes: a multiply and fold a word at a time for exact lines,
+ * FNV-1a a byte at a time when characters are to be skipped or folded.
  */
-static int
-readhash(FILE *f, int flags)
+#define HASHMUL		0x9e3779b97f4a7c15ULL	/* 2^64 / golden ratio */
+#define FNVBASIS	0xcbf29ce484222325ULL
+#define FNVPRIME	0x100000001b3ULL
+
+/*
+ * Hash the line [cp, ep), not including its newline.  Lines are hashed
+ * a word at a time unless -b, -i or -w means looking at each character.
+ * With -b or -w, a last line with no newline that is all blanks is
+ * not counted as a line at all, which is signalled by returning 0.
+ */
+static uint64_t
+hashline(const char *cp, const char *ep, int last, int flags)
 {
-	int i, t, space;
-	int sum;
-
-	sum = 1;
-	space = 0;
-	if ((flags & (D_FOLDBLANKS|D_IGNOREBLANKS)) == 0) {
-		if (flags & D_IGNORECASE)
-			for (i = 0; (t = getc(f)) != '\n'; i++) {
-				if (t == EOF) {
-					if (i == 0)
-						return (0);
-					break;
-				}
-				sum = sum * 127 + chrtran[t];
-			}
-		else
-			for (i = 0; (t = getc(f)) != '\n'; i++) {
-				if (t == EOF) {
-					if (i == 0)
-						return (0);
-					break;
-				}
-				sum = sum * 127 + t;
-			}
+	uint64_t h, w;
+	size_t n;
+	int c, space, seen;
+
+	if ((flags & (D_FOLDBLANKS|D_IGNOREBLANKS|D_IGNORECASE)) == 0) {
+		n = ep - cp;
+		h = n * HASHMUL;
+		for (; n >= sizeof(w); n -= sizeof(w), cp += sizeof(w)) {
+			memcpy(&w, cp, sizeof(w));
+			h = (h ^ w) * HASHMUL;
+			h ^= h >> 32;
+		}
+		if (n > 0) {
+			w = 0;
+			memcpy(&w, cp, n);
+			h = (h ^ w) * HASHMUL;
+			h ^= h >> 32;
+		}
 	} else {
-		for (i = 0;;) {
-			switch (t = getc(f)) {
-			case '\t':
-			case '\r':
-			case '\v':
-			case '\f':
-			case ' ':
-				space++;
+		h = FNVBASIS;
+		space = seen = 0;
+		for (; cp < ep; cp++) {
+			c = *(const u_char *)cp;
+			if ((flags & (D_FOLDBLANKS|D_IGNOREBLANKS)) &&
+			    (c == ' ' || c == '\t' || c == '\r' || c == '\v' ||
+			    c == '\f')) {
+				space = 1;
 				continue;
-			default:
-				if (space && (flags & D_IGNOREBLANKS) == 0) {
-					i++;
-					space = 0;
-				}
-				sum = sum * 127 + chrtran[t];
-				i++;
-				continue;
-			case EOF:
-				if (i == 0)
-					return (0);
-				/* FALLTHROUGH */
-			case '\n':
-				break;
 			}
-			break;
+			if (space && (flags & D_IGNOREBLANKS) == 0)
+				h = (h ^ ' ') * FNVPRIME;
+			space = 0;
+			seen = 1;
+			h = (h ^ chrtran[c]) * FNVPRIME;
 		}
+		if (!seen && last && (flags & (D_FOLDBLANKS|D_IGNOREBLANKS)))
+			return (0);
 	}
 	/*
-	 * There is a remote possibility that we end up with a zero sum.
-	 * Zero is used as an EOF marker, so return 1 instead.
+	 * Zero is used as an EOF marker, so never return it for a line.
 	 */
-	return (sum == 0 ? 1 : sum);
+	return (h == 0 ? 1 : h);
 }
 
 static int
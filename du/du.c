@@ -46,6 +46,7 @@
 #include <string.h>
 #include <unistd.h>
 
+#include <../libopenbsd/arena.h>
 #include <../libopenbsd/tree.h>
 
 
@@ -216,7 +217,6 @@ main(int argc, char *argv[])
 
 struct links_entry {
 	RB_ENTRY(links_entry) entry;
-	struct links_entry *fnext;
 	int	 links;
 	dev_t	 dev;
 	ino_t	 ino;
@@ -239,11 +239,14 @@ RB_HEAD(ltree, links_entry) links = RB_INITIALIZER(&links);
 
 RB_GENERATE_STATIC(ltree, links_entry, entry, links_cmp);
 
+/* Entries are recycled through a pool rather than malloc'ed one by one. */
+static struct arena links_arena;
+static struct pool links_pool;
+
 
 int
 linkchk(FTSENT *p)
 {
-	static struct links_entry *free_list = NULL;
 	static int stop_allocating = 0;
 	struct links_entry ltmp, *le;
 	struct stat *st;
@@ -261,13 +264,7 @@ linkchk(FTSENT *p)
 		 */
 		if (--le->links <= 0) {
 			RB_REMOVE(ltree, &links, le);
-			/* Recycle this node through the free list */
-			if (stop_allocating) {
-				free(le);
-			} else {
-				le->fnext = free_list;
-				free_list = le;
-			}
+			pool_put(&links_pool, le);
 		}
 		return (1);
 	}
@@ -276,15 +273,11 @@ linkchk(FTSENT *p)
 		return (0);
 
 	/* Add this entry to the links cache. */
-	if (free_list != NULL) {
-		/* Pull a node from the free list if we can. */
-		le = free_list;
-		free_list = le->fnext;
-	} else
-		/* Malloc one if we have to. */
-		le = malloc(sizeof(struct links_entry));
-
-	if (le == NULL) {
+	if (links_pool.arena == NULL) {
+		arena_init(&links_arena, 0);
+		pool_init(&links_pool, &links_arena, sizeof(struct links_entry));
+	}
+	if ((le = pool_get(&links_pool)) == NULL) {
 		stop_allocating = 1;
 		warnx("No more memory for tracking hard links");
 		return (0);
@@ -293,7 +286,6 @@ linkchk(FTSENT *p)
 	le->dev = st->st_dev;
 	le->ino = st->st_ino;
 	le->links = st->st_nlink - 1;
-	le->fnext = NULL;
 
 	RB_INSERT(ltree, &links, le);
 
@@ -33,23 +33,29 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <ctype.h>
+#include <fcntl.h>
 #include <unistd.h>
 #include <err.h>
 
+#include <lbuf.h>
+
 /*
  * expand - expand tabs to equivalent spaces
  */
 int	nstops;
 int	tabstops[100];
 
+static void expand(char *, size_t);
 static void getstops(char *);
 static void usage(void);
 
 int
 main(int argc, char *argv[])
 {
-	int c, column;
-	int n;
+	struct lbuf lb;
+	char *line, *name;
+	size_t len;
+	int c, fd;
 
 	if (pledge("stdio rpath", NULL) == -1)
 		err(1, "pledge");
@@ -76,63 +82,88 @@ main(int argc, char *argv[])
 	argv += optind;
 
 	do {
+		fd = STDIN_FILENO;
+		name = "stdin";
 		if (argc > 0) {
-			if (freopen(argv[0], "r", stdin) == NULL)
+			if ((fd = open(argv[0], O_RDONLY)) == -1)
 				err(1, "%s", argv[0]);
+			name = argv[0];
 			argc--, argv++;
 		}
-		column = 0;
-		while ((c = getchar()) != EOF) {
-			switch (c) {
-			case '\t':
-				if (nstops == 0) {
-					do {
-						putchar(' ');
-						column++;
-					} while (column & 07);
-					continue;
-				}
-				if (nstops == 1) {
-					do {
-						putchar(' ');
-						column++;
-					} while (((column - 1) %
-					    tabstops[0]) != (tabstops[0] - 1));
-					continue;
-				}
-				for (n = 0; n < nstops; n++)
-					if (tabstops[n] > column)
-						break;
-				if (n == nstops) {
+		if (lbuf_init(&lb, fd, '\n') == -1)
+			err(1, NULL);
+		while ((line = lbuf_next(&lb, &len)) != NULL) {
+			expand(line, len);
+			if (lb.delimited)
+				putchar('\n');
+		}
+		if (lb.error)
+			err(1, "%s", name);
+		if (fd != STDIN_FILENO)
+			(void)close(fd);
+		lbuf_free(&lb);
+	} while (argc > 0);
+	exit(0);
+}
+
+/*
+ * Expand the tabs in a line, writing the runs of other characters
+ * between them as they are.
+ */
+static void
+expand(char *line, size_t len)
+{
+	char *p, *q, *ep;
+	int column, n;
+
+	column = 0;
+	for (p = line, ep = line + len; p < ep; p++) {
+		switch (*p) {
+		case '\t':
+			if (nstops == 0) {
+				do {
 					putchar(' ');
 					column++;
-					continue;
-				}
-				while (column < tabstops[n]) {
+				} while (column & 07);
+				continue;
+			}
+			if (nstops == 1) {
+				do {
 					putchar(' ');
 					column++;
-				}
+				} while (((column - 1) %
+				    tabstops[0]) != (tabstops[0] - 1));
 				continue;
-
-			case '\b':
-				if (column)
-					column--;
-				putchar('\b');
-				continue;
-
-			default:
-				putchar(c);
+			}
+			for (n = 0; n < nstops; n++)
+				if (tabstops[n] > column)
+					break;
+			if (n == nstops) {
+				putchar(' ');
 				column++;
 				continue;
-
-			case '\n':
-				putchar(c);
-				column = 0;
-				continue;
 			}
+			while (column < tabstops[n]) {
+				putchar(' ');
+				column++;
+			}
+			continue;
+
+		case '\b':
+			if (column)
+				column--;
+			putchar('\b');
+			continue;
+
+		default:
+			for (q = p + 1; q < ep && *q != '\t' && *q != '\b'; q++)
+				;
+			fwrite(p, 1, q - p, stdout);
+			column += q - p;
+			p = q - 1;
+			continue;
 		}
-	} while (argc > 0);
-	exit(0);
+	}
 }
 
 static void
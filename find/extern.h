@@ -36,12 +36,23 @@ void	*ereallocarray(void *, size_t, size_t);
 PLAN	*find_create(char ***);
 int	 find_execute(PLAN *, char **);
 PLAN	*find_formplan(char **);
+int	 find_set(FTSENT *, int);
 int	find_traverse(PLAN *, int (*)(PLAN *, void *), void *);
+int	 idx_close(IDX *);
+IDX	*idx_open(char *, char **);
+FTSENT	*idx_read(IDX *);
+int	 idx_set(IDX *, FTSENT *, int);
+int	 idx_token(enum ntype);
+int	 idx_update(char *, char **);
 PLAN	*not_squish(PLAN *);
 OPTION	*option(char *);
 PLAN	*or_squish(PLAN *);
 PLAN	*paren_squish(PLAN *);
 int	plan_cleanup(PLAN *, void *);
+int	 plan_cost(PLAN *);
+int	 plan_lazy(PLAN *);
+PLAN	*plan_order(PLAN *);
+PLAN	*plan_stat(PLAN *);
 struct stat;
 void	 printlong(char *, char *, struct stat *);
 int	 queryuser(char **);
@@ -63,6 +74,7 @@ PLAN	*c_follow(char *, char ***, int);
 PLAN	*c_fstype(char *, char ***, int);
 PLAN	*c_group(char *, char ***, int);
 PLAN	*c_iname(char *, char ***, int);
+PLAN	*c_index(char *, char ***, int);
 PLAN	*c_inum(char *, char ***, int);
 PLAN	*c_links(char *, char ***, int);
 PLAN	*c_ls(char *, char ***, int);
@@ -79,6 +91,7 @@ PLAN	*c_print(char *, char ***, int);
 PLAN	*c_print0(char *, char ***, int);
 PLAN	*c_prune(char *, char ***, int);
 PLAN	*c_size(char *, char ***, int);
+PLAN	*c_stat(char *, char ***, int);
 PLAN	*c_type(char *, char ***, int);
 PLAN	*c_user(char *, char ***, int);
 PLAN	*c_xdev(char *, char ***, int);
@@ -88,5 +101,7 @@ PLAN	*c_mtime(char *, char ***, int);
 PLAN	*c_not(char *, char ***, int);
 PLAN	*c_or(char *, char ***, int);
 
-extern int ftsoptions, isdelete, isdepth, isoutput, isxargs;
+extern int ftsoptions, isdelete, isdepth, isexecdir, isoutput, isxargs;
+extern int jobs;
+extern char *indexfile, *noindex;
 extern int mayexecve;
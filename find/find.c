@@ -38,6 +38,7 @@
 #include <err.h>
 #include <errno.h>
 #include <fts.h>
+#include <pfts.h>
 #include <signal.h>
 #include <stdio.h>
 #include <string.h>
@@ -134,10 +135,130 @@ find_formplan(char **argv)
 	plan = paren_squish(plan);		/* ()'s */
 	plan = not_squish(plan);		/* !'s */
 	plan = or_squish(plan);			/* -o's */
+
+	/*
+	 * Finally, let the cheap tests in each part of the plan run first,
+	 * so that the dear ones only see files that got past them.
+	 */
+	plan = plan_order(plan);		/* by cost */
 	return (plan);
 }
  
 FTS *tree;			/* pointer to top of FTS hierarchy */
+PFTS *ptree;			/* the same, with -j */
+IDX *itree;			/* the same, with -index */
+
+static PLAN *fplan;		/* the plan... */
+static PLAN *frest;		/* ...and what is left once find_filter() ran */
+
+#define	BADCH	" \t\n\\'\""
+
+/*
+ * find_safe --
+ *	can p be evaluated on any thread?  It can if it has no side effects
+ *	and keeps no state, and neither does anything under it.
+ */
+static int
+find_safe(PLAN *p)
+{
+	PLAN *q;
+	int i;
+
+	switch (p->type) {
+	case N_AMIN:
+	case N_ANEWER:
+	case N_ATIME:
+	case N_CMIN:
+	case N_CNEWER:
+	case N_CTIME:
+	case N_DEPTH:
+	case N_EMPTY:
+	case N_FLAGS:
+	case N_FOLLOW:
+	case N_GROUP:
+	case N_INAME:
+	case N_INUM:
+	case N_LINKS:
+	case N_MINDEPTH:
+	case N_MMIN:
+	case N_MTIME:
+	case N_NAME:
+	case N_NEWER:
+	case N_PATH:
+	case N_PERM:
+	case N_SIZE:
+	case N_TYPE:
+	case N_USER:
+	case N_XDEV:
+		return (1);
+	case N_EXPR:
+	case N_NOT:
+	case N_OR:
+		for (i = 0; i < 2; i++)
+			for (q = p->p_data[i]; q != NULL; q = q->next)
+				if (!find_safe(q))
+					return (0);
+		return (1);
+	default:
+		return (0);
+	}
+}
+
+/*
+ * find_filter --
+ *	with -j, called on the reader threads for every file that is not a
+ *	directory.  Evaluate as much of the plan as is safe there: a file
+ *	that fails it is dropped, one that passes is marked so that
+ *	find_execute() carries on from frest.
+ */
+static int
+find_filter(FTSENT *entry)
+{
+	PLAN *p;
+
+	switch (entry->fts_info) {
+	case FTS_DEFAULT:
+	case FTS_F:
+	case FTS_NSOK:
+	case FTS_SL:
+	case FTS_SLNONE:
+		break;
+	default:
+		return (1);
+	}
+	if (isxargs && strpbrk(entry->fts_path, BADCH))
+		return (1);
+	for (p = fplan; p != frest; p = p->next)
+		if (!(p->eval)(p, entry))
+			return (0);
+	entry->fts_number = 1;
+	return (1);
+}
+
+/*
+ * find_read --
+ *	the next entry, from fts, pfts or an index
+ */
+static FTSENT *
+find_read(void)
+{
+	if (itree != NULL)
+		return (idx_read(itree));
+	return (ptree != NULL ? pfts_read(ptree) : fts_read(tree));
+}
+
+/*
+ * find_set --
+ *	fts_set(), pfts_set() or idx_set() as the case may be
+ */
+int
+find_set(FTSENT *entry, int instr)
+{
+	if (itree != NULL)
+		return (idx_set(itree, entry, instr));
+	return (ptree != NULL ? pfts_set(ptree, entry, instr) :
+	    fts_set(tree, entry, instr));
+}
 
 /*
  * find_execute --
@@ -175,18 +296,60 @@ find_execute(PLAN *plan,	/* search plan */
 	}
 
 	rval = 0;
-    
-	if (!(tree = fts_open(paths, ftsoptions, NULL)))
-		err(1, "fts_open");
+
+	/*
+	 * With -j, walk the tree on that many threads, unless the plan
+	 * needs fts to change directory for it (-delete, -execdir).  The
+	 * threads also evaluate the leading part of the plan that is safe
+	 * to run anywhere, so everything else, output included, still
+	 * happens on this thread and in the usual order.
+	 */
+	if (indexfile != NULL) {
+		if (noindex != NULL)
+			errx(1, "-index: %s: not in an index", noindex);
+		if (ftsoptions & (FTS_COMFOLLOW|FTS_LOGICAL|FTS_XDEV))
+			errx(1, "-index: -H, -L and -x need the file system");
+		if (!(itree = idx_open(indexfile, paths)))
+			err(1, "%s", indexfile);
+	} else if (jobs > 1 && !isdelete && !isexecdir) {
+		if (!(ptree = pfts_open(paths, ftsoptions | PFTS_ORDERED,
+		    NULL, jobs)))
+			err(1, "pfts_open");
+		for (frest = plan; frest && find_safe(frest);
+		    frest = frest->next)
+			;
+		if (frest != plan) {
+			fplan = plan;
+			(void)pfts_filter(ptree, find_filter);
+		}
+		for (p = plan; p && plan_cost(p) <= COST_TYPE; p = p->next)
+			;
+		if (p == NULL && !(ftsoptions & FTS_NOSTAT))
+			(void)pfts_statmask(ptree, FTS_ST_TYPE);
+	} else {
+		if (!(tree = fts_open(paths, ftsoptions, NULL)))
+			err(1, "fts_open");
+
+		/*
+		 * If the plan starts with a test on names or types, have
+		 * fts take the types from the directory entries and stat a
+		 * file only once the plan gets to something that needs it.
+		 */
+		if (!(ftsoptions & FTS_NOSTAT) && plan_lazy(plan)) {
+			plan = plan_stat(plan);
+			(void)fts_statmask(tree, FTS_ST_TYPE);
+		}
+	}
 
 	sigfillset(&fullset);
 	for (;;) {
 		(void)sigprocmask(SIG_BLOCK, &fullset, &oset);
-		entry = fts_read(tree);
+		entry = find_read();
 		(void)sigprocmask(SIG_SETMASK, &oset, NULL);
 		if (entry == NULL) {
 			if (errno)
-				err(1, "fts_read");
+				err(1, itree ? "idx_read" :
+				    ptree ? "pfts_read" : "fts_read");
 			break;
 		}
 
@@ -207,7 +370,6 @@ find_execute(PLAN *plan,	/* search plan */
 			rval = 1;
 			continue;
 		}
-#define	BADCH	" \t\n\\'\""
 		if (isxargs && strpbrk(entry->fts_path, BADCH)) {
 			(void)fflush(stdout);
 			warnx("%s: illegal path", entry->fts_path);
@@ -220,10 +382,16 @@ find_execute(PLAN *plan,	/* search plan */
 		 * false or all have been executed.  This is where we do all
 		 * the work specified by the user on the command line.
 		 */
-		for (p = plan; p && (p->eval)(p, entry); p = p->next)
+		p = ptree && entry->fts_number ? frest : plan;
+		for (; p && (p->eval)(p, entry); p = p->next)
 		    ;
 	}
-	(void)fts_close(tree);
+	if (itree != NULL)
+		(void)idx_close(itree);
+	else if (ptree != NULL)
+		(void)pfts_close(ptree);
+	else
+		(void)fts_close(tree);
 
 	/*
 	 * Cleanup any plans with leftover state.
@@ -253,7 +421,8 @@ find_traverse(PLAN *plan, int (*func)(PLAN *, void *), void *arg)
 	for (p = plan; p; p = p->next) {
 		if ((r = func(p, arg)) != 0)
 			rval = r;
-		if (p->type == N_EXPR || p->type == N_OR) {
+		if (p->type == N_EXPR || p->type == N_NOT ||
+		    p->type == N_OR) {
 			if (p->p_data[0])
 				if ((r = find_traverse(p->p_data[0],
 					    func, arg)) != 0)
@@ -38,11 +38,12 @@ enum ntype {
 	N_AND = 1, 				/* must start > 0 */
 	N_AMIN, N_ANEWER, N_ATIME, N_CLOSEPAREN, N_CMIN, N_CNEWER, N_CTIME,
 	N_DELETE, N_DEPTH, N_EMPTY, N_EXEC, N_EXECDIR, N_EXPR,
-	N_FLAGS, N_FOLLOW, N_FSTYPE, N_GROUP, N_INAME, N_INUM, N_LINKS, N_LS,
+	N_FLAGS, N_FOLLOW, N_FSTYPE, N_GROUP, N_INAME, N_INDEX, N_INUM, N_LINKS,
+	N_LS,
 	N_MMIN, N_MAXDEPTH,
 	N_MINDEPTH, N_MTIME, N_NAME, N_NEWER, N_NOGROUP, N_NOT, N_NOUSER,
 	N_OK, N_OPENPAREN, N_OR, N_PATH, N_PERM, N_PRINT, N_PRINT0, N_PRUNE,
-	N_SIZE, N_TYPE, N_USER, N_XDEV
+	N_SIZE, N_STAT, N_TYPE, N_USER, N_XDEV
 };
 
 /* node definition */
@@ -122,6 +123,8 @@ typedef struct _plandata {
 #define	ep_narg		p_un.ex._ep_narg
 #define	ep_rval		p_un.ex._ep_rval
 
+typedef struct _idx IDX;			/* an index, see index.c */
+
 typedef struct _option {
 	char *name;				/* option name */
 	enum ntype token;			/* token type */
@@ -133,6 +136,12 @@ typedef struct _option {
 	int flags;
 } OPTION;
 
+/* what a node needs to know about a file, cheapest first; see plan_cost() */
+#define	COST_NAME	0			/* its name and depth */
+#define	COST_TYPE	1			/* its type */
+#define	COST_STAT	2			/* the rest of its stat(2) */
+#define	COST_IO		3			/* more I/O than that */
+
 #define	SECSPERDAY	(24 * 60 * 60)
 #define	SIXMONTHS	(SECSPERDAY * 365 / 2)
 
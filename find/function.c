@@ -71,6 +71,7 @@
 static PLAN *palloc(enum ntype, int (*)(PLAN *, FTSENT *));
 static long long find_parsenum(PLAN *plan, char *option, char *vp, char *endch);
 static void run_f_exec(PLAN *plan);
+static int wait_f_exec(PLAN *plan);
 static PLAN *palloc(enum ntype t, int (*f)(PLAN *, FTSENT *));
 
 int	f_amin(PLAN *, FTSENT *);
@@ -105,6 +106,7 @@ int	f_print(PLAN *, FTSENT *);
 int	f_print0(PLAN *, FTSENT *);
 int	f_prune(PLAN *, FTSENT *);
 int	f_size(PLAN *, FTSENT *);
+int	f_stat(PLAN *, FTSENT *);
 int	f_type(PLAN *, FTSENT *);
 int	f_user(PLAN *, FTSENT *);
 int	f_expr(PLAN *, FTSENT *);
@@ -113,7 +115,6 @@ int	f_or(PLAN *, FTSENT *);
 
 extern int dotfd;
 extern time_t now;
-extern FTS *tree;
 
 /*
  * find_parsenum --
@@ -482,11 +483,20 @@ f_exec(PLAN *plan, FTSENT *entry)
 	}
 }
 
+/*
+ * -exec ... {} + batches still running; with -j, up to that many of them
+ * run while find carries on.
+ */
+static struct exrun {
+	pid_t	 pid;
+	PLAN	*plan;
+} *exrun;
+static int nexrun;
+
 static void
 run_f_exec(PLAN *plan)
 {
 	pid_t pid;
-	int rval, status;
 
 	/* Ensure arg list is null terminated. */
 	plan->ep_bxp[plan->ep_narg] = NULL;
@@ -495,6 +505,9 @@ run_f_exec(PLAN *plan)
  	fflush(stdout);
  	fflush(stderr);
 
+	if (exrun == NULL)
+		exrun = ereallocarray(NULL, jobs, sizeof(*exrun));
+
 	switch (pid = vfork()) {
 	case -1:
 		err(1, "vfork");
@@ -509,14 +522,49 @@ run_f_exec(PLAN *plan)
 		_exit(1);
 	}
 
-	/* Clear out the argument list. */
+	/*
+	 * The child has its own copy of the arguments by now, so clear
+	 * out the argument list.
+	 */
 	plan->ep_narg = 0;
 	plan->ep_bxp[plan->ep_narg] = NULL;
 	/* As well as the argument buffer. */
 	plan->ep_p = plan->ep_bbp;
 	*plan->ep_p = '\0';
 
-	pid = waitpid(pid, &status, 0);
+	exrun[nexrun].pid = pid;
+	exrun[nexrun].plan = plan;
+	for (nexrun++; nexrun == jobs;)
+		(void)wait_f_exec(NULL);
+}
+
+/*
+ * wait_f_exec --
+ *	wait for a batch to finish: one run for plan, or any one if plan is
+ *	NULL.  Return 0 if there was none to wait for.
+ */
+static int
+wait_f_exec(PLAN *plan)
+{
+	pid_t pid;
+	int i, rval, status;
+
+	for (i = 0; i < nexrun; i++)
+		if (plan == NULL || exrun[i].plan == plan)
+			break;
+	if (i == nexrun)
+		return (0);
+	do {
+		pid = waitpid(plan == NULL ? -1 : exrun[i].pid, &status, 0);
+	} while (pid == -1 && errno == EINTR);
+	if (pid == -1)
+		err(1, "waitpid");
+	for (i = 0; i < nexrun; i++)
+		if (exrun[i].pid == pid)
+			break;
+	if (i == nexrun)
+		return (1);
+
 	if (WIFEXITED(status))
 		rval = WEXITSTATUS(status);
 	else
@@ -527,7 +575,9 @@ run_f_exec(PLAN *plan)
 	 * later exit with it.
 	 */
 	if (rval)
-		plan->ep_rval = rval;
+		exrun[i].plan->ep_rval = rval;
+	exrun[i] = exrun[--nexrun];
+	return (1);
 }
  
 /*
@@ -727,6 +777,7 @@ c_execdir(char *ignored, char ***argvp, int unused)
 	char **argv, **ap, *p;
 
 	ftsoptions &= ~FTS_NOSTAT;
+	isexecdir = 1;
 	isoutput = 1;
     
 	new = palloc(N_EXECDIR, f_execdir);
@@ -959,6 +1010,20 @@ c_group(char *gname, char ***ignored, int unused)
 	return (new);
 }
 
+/*
+ * -index file functions --
+ *
+ *	Always true, causes find to take the files from the index file,
+ *	made by -I, instead of the file system.
+ */
+PLAN *
+c_index(char *file, char ***ignored, int unused)
+{
+	indexfile = file;
+
+	return (palloc(N_INDEX, f_always_true));
+}
+ 
 /*
  * -inum n functions --
  *
@@ -1045,7 +1110,7 @@ f_maxdepth(PLAN *plan, FTSENT *entry)
 {
 
 	if (entry->fts_level >= plan->max_data)
-		fts_set(tree, entry, FTS_SKIP);
+		find_set(entry, FTS_SKIP);
 	return (entry->fts_level <= plan->max_data);
 }
 
@@ -1433,7 +1498,7 @@ int
 f_prune(PLAN *plan, FTSENT *entry)
 {
 
-	if (fts_set(tree, entry, FTS_SKIP))
+	if (find_set(entry, FTS_SKIP))
 		err(1, "%s", entry->fts_path);
 	return (1);
 }
@@ -1480,6 +1545,39 @@ c_size(char *arg, char ***ignored, int unused)
 	return (new);
 }
  
+/*
+ * stat functions --
+ *
+ *	Not a primary: plan_stat() puts these in front of the nodes that
+ *	need more than a file's type when the walk gives only that.  Stat
+ *	the file the first time one is reached.
+ */
+int
+f_stat(PLAN *plan, FTSENT *entry)
+{
+	int flag;
+
+	if (entry->fts_number)
+		return (entry->fts_number > 0);
+	flag = entry->fts_info == FTS_SL || entry->fts_info == FTS_SLNONE ?
+	    AT_SYMLINK_NOFOLLOW : 0;
+	if (fstatat(AT_FDCWD, entry->fts_accpath, entry->fts_statp,
+	    flag) == -1) {
+		warn("%s", entry->fts_path);
+		entry->fts_number = -1;
+		plan->ep_rval = 1;
+		return (0);
+	}
+	entry->fts_number = 1;
+	return (1);
+}
+
+PLAN *
+c_stat(char *ignore, char ***ignored, int unused)
+{
+	return (palloc(N_STAT, f_stat));
+}
+ 
 /*
  * -type c functions --
  *
@@ -1680,6 +1778,9 @@ plan_cleanup(PLAN *plan, void *arg)
 {
 	if (plan->type==N_EXEC && plan->ep_narg)
 		run_f_exec(plan);
+	if (plan->type==N_EXEC)
+		while (wait_f_exec(plan))
+			;
 
 	return plan->ep_rval;		/* Passed save exit-status up chain */
 }
@@ -0,0 +1,739 @@
+/*
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <dirent.h>
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <fts.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "find.h"
+#include "extern.h"
+
+/*
+ * Indexes, for -I and -index.
+ *
+ * An index holds, for each path given to -I, the path and everything
+ * under it in preorder, the entries of each directory sorted by name.
+ * After an 8 byte magic number each file is one record:
+ *
+ *	level		its depth below the path given to -I
+ *	shared		bytes of its path that are the same as the last one's
+ *	length		the bytes that follow
+ *	the rest of its path
+ *	st_mode, st_size, st_mtim.tv_sec, st_mtim.tv_nsec, st_uid, st_gid
+ *
+ * all numbers unsigned LEB128, the seconds zigzag encoded first.  With
+ * the entries sorted, "shared" covers most of each path.
+ *
+ * -I rewrites the index from the file system, but it only reads the
+ * directories whose modification time has changed since the last run;
+ * for any other directory it keeps the entries it had and only lstat(2)s
+ * the subdirectories, to check their times in turn.
+ */
+
+#define	IDX_MAGIC	"FINDIDX1"
+#define	IDX_MAGICLEN	8
+
+/* an index, mapped, and the record last read from it */
+struct idxfile {
+	const char	*name;
+	u_char		*base;
+	size_t		 size;
+	u_char		*p;		/* next record */
+	int		 eof;		/* there was none */
+	char		*path;		/* last record: */
+	size_t		 pathlen;
+	size_t		 pathsize;
+	int		 level;
+	struct stat	 sb;
+};
+
+/* a directory -index has returned in preorder but not yet in postorder */
+struct idxdir {
+	size_t		 pathlen;
+	int		 level;
+	struct stat	 sb;
+};
+
+struct _idx {
+	struct idxfile	 f;
+	char		**paths;	/* paths still to do */
+	char		*qpath;		/* the one being done, as given */
+	size_t		 qlen;		/* ...what of it to append to */
+	char		*npath;		/* ...as in the index */
+	size_t		 nlen;
+	int		 inpath;	/* returning what is under it */
+	int		 base;		/* its level in the index */
+	int		 skip;		/* FTS_SKIP on the last directory */
+	struct idxdir	*dirs;
+	int		 ndirs;
+	int		 dirsize;
+	FTSENT		*ent;
+	size_t		 namemax;	/* room in ent->fts_name */
+	char		*opath;		/* fts_path */
+	size_t		 opathsize;
+	struct stat	 sb;
+};
+
+/* state of -I */
+struct idxupd {
+	FILE		*fp;
+	struct idxfile	*old;		/* last index, or NULL */
+	char		*path;		/* path being looked at */
+	size_t		 pathsize;
+	char		*prev;		/* path last written */
+	size_t		 prevlen;
+	size_t		 prevsize;
+	int		 rval;
+};
+
+static void	 grow(char **, size_t *, size_t);
+static size_t	 normalize(const char *);
+static int	 pathcmp(const char *, const char *);
+
+static int	 if_map(struct idxfile *, const char *);
+static void	 if_unmap(struct idxfile *);
+static int	 if_next(struct idxfile *);
+static int	 if_peek(struct idxfile *);
+static void	 if_rewind(struct idxfile *);
+static uint64_t	 if_num(struct idxfile *);
+
+static FTSENT	*idx_entry(IDX *, size_t, int, int, struct stat *);
+
+static void	 upd_put(struct idxupd *, uint64_t);
+static void	 upd_emit(struct idxupd *, const char *, size_t, int,
+		    struct stat *);
+static void	 upd_scan(struct idxupd *, size_t, int, struct stat *);
+
+/*
+ * Make *bufp at least len bytes.
+ */
+static void
+grow(char **bufp, size_t *sizep, size_t len)
+{
+	size_t size;
+
+	if (len <= *sizep)
+		return;
+	for (size = *sizep ? *sizep : 256; size < len; size *= 2)
+		;
+	if ((*bufp = realloc(*bufp, size)) == NULL)
+		err(1, NULL);
+	*sizep = size;
+}
+
+/*
+ * The length of path without trailing slashes, but keeping a lone "/".
+ */
+static size_t
+normalize(const char *path)
+{
+	size_t len;
+
+	for (len = strlen(path); len > 1 && path[len - 1] == '/'; len--)
+		;
+	return (len);
+}
+
+/*
+ * strcmp(3) for paths in preorder: "a/b" comes before "a.c".
+ */
+static int
+pathcmp(const char *a, const char *b)
+{
+	int ca, cb;
+
+	for (; *a == *b; a++, b++)
+		if (*a == '\0')
+			return (0);
+	ca = *a == '/' ? 1 : *a == '\0' ? 0 : (u_char)*a + 1;
+	cb = *b == '/' ? 1 : *b == '\0' ? 0 : (u_char)*b + 1;
+	return (ca - cb);
+}
+
+/*
+ * Map the index name.  Return -1 with errno set if it cannot be opened,
+ * and exit if it is not an index.
+ */
+static int
+if_map(struct idxfile *f, const char *name)
+{
+	struct stat sb;
+	int fd;
+
+	memset(f, 0, sizeof(*f));
+	f->name = name;
+	if ((fd = open(name, O_RDONLY)) == -1)
+		return (-1);
+	if (fstat(fd, &sb) == -1)
+		err(1, "%s", name);
+	if (sb.st_size < IDX_MAGICLEN || (uintmax_t)sb.st_size > SIZE_MAX)
+		errx(1, "%s: not an index", name);
+	f->size = sb.st_size;
+	f->base = mmap(NULL, f->size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (f->base == MAP_FAILED)
+		err(1, "%s", name);
+	(void)close(fd);
+	if (memcmp(f->base, IDX_MAGIC, IDX_MAGICLEN) != 0)
+		errx(1, "%s: not an index", name);
+	(void)madvise(f->base, f->size, MADV_SEQUENTIAL);
+	if_rewind(f);
+	return (0);
+}
+
+static void
+if_unmap(struct idxfile *f)
+{
+	(void)munmap(f->base, f->size);
+	free(f->path);
+}
+
+static void
+if_rewind(struct idxfile *f)
+{
+	f->p = f->base + IDX_MAGICLEN;
+	f->eof = 0;
+	f->pathlen = 0;
+}
+
+static uint64_t
+if_num(struct idxfile *f)
+{
+	uint64_t n;
+	int shift;
+
+	for (n = 0, shift = 0; f->p < f->base + f->size && shift < 64;
+	    shift += 7) {
+		n |= (uint64_t)(*f->p & 0x7f) << shift;
+		if (!(*f->p++ & 0x80))
+			return (n);
+	}
+	errx(1, "%s: index is corrupt", f->name);
+}
+
+/*
+ * The level of the next record, or -1 if there is none.
+ */
+static int
+if_peek(struct idxfile *f)
+{
+	u_char *p;
+	int level;
+
+	if (f->p == f->base + f->size)
+		return (-1);
+	p = f->p;
+	level = if_num(f);
+	f->p = p;
+	return (level);
+}
+
+/*
+ * Read the next record.  Return 0 at the end of the index.
+ */
+static int
+if_next(struct idxfile *f)
+{
+	uint64_t shared, len, sec;
+
+	if (f->p == f->base + f->size) {
+		f->eof = 1;
+		return (0);
+	}
+	f->level = if_num(f);
+	shared = if_num(f);
+	len = if_num(f);
+	if (shared > f->pathlen || len > (size_t)(f->base + f->size - f->p))
+		errx(1, "%s: index is corrupt", f->name);
+	grow(&f->path, &f->pathsize, shared + len + 1);
+	memcpy(f->path + shared, f->p, len);
+	f->p += len;
+	f->pathlen = shared + len;
+	f->path[f->pathlen] = '\0';
+
+	memset(&f->sb, 0, sizeof(f->sb));
+	f->sb.st_mode = if_num(f);
+	f->sb.st_size = if_num(f);
+	sec = if_num(f);
+	f->sb.st_mtim.tv_sec = (int64_t)(sec >> 1) ^ -(int64_t)(sec & 1);
+	f->sb.st_mtim.tv_nsec = if_num(f);
+	f->sb.st_uid = if_num(f);
+	f->sb.st_gid = if_num(f);
+	return (1);
+}
+
+/*
+ * idx_token --
+ *	whether a primary looks at no more than an index has
+ */
+int
+idx_token(enum ntype t)
+{
+	switch (t) {
+	case N_AND:
+	case N_CLOSEPAREN:
+	case N_DEPTH:
+	case N_EXEC:
+	case N_GROUP:
+	case N_INAME:
+	case N_INDEX:
+	case N_MAXDEPTH:
+	case N_MINDEPTH:
+	case N_MMIN:
+	case N_MTIME:
+	case N_NAME:
+	case N_NEWER:
+	case N_NOGROUP:
+	case N_NOT:
+	case N_NOUSER:
+	case N_OK:
+	case N_OPENPAREN:
+	case N_OR:
+	case N_PATH:
+	case N_PERM:
+	case N_PRINT:
+	case N_PRINT0:
+	case N_PRUNE:
+	case N_SIZE:
+	case N_TYPE:
+	case N_USER:
+		return (1);
+	default:
+		return (0);
+	}
+}
+
+/*
+ * idx_open --
+ *	as fts_open(3), but return the files under paths as the index name
+ *	has them
+ */
+IDX *
+idx_open(char *name, char **paths)
+{
+	IDX *ip;
+	size_t len, max;
+	char **p;
+
+	if ((ip = calloc(1, sizeof(*ip))) == NULL)
+		return (NULL);
+	if (if_map(&ip->f, name) == -1) {
+		free(ip);
+		return (NULL);
+	}
+	ip->paths = paths;
+	for (max = NAME_MAX, p = paths; *p != NULL; p++)
+		if ((len = strlen(*p)) > max)
+			max = len;
+	if ((ip->ent = calloc(1, sizeof(FTSENT) + max + 1)) == NULL)
+		err(1, NULL);
+	ip->ent->fts_statp = &ip->sb;
+	ip->namemax = max;
+	return (ip);
+}
+
+/*
+ * Make ip->ent the file at the first pathlen bytes of the last path read
+ * from the index.
+ */
+static FTSENT *
+idx_entry(IDX *ip, size_t pathlen, int level, int info, struct stat *sb)
+{
+	FTSENT *p = ip->ent;
+	const char *name, *rest;
+	size_t len;
+
+	if (pathlen == ip->nlen) {
+		len = strlen(ip->qpath);
+		grow(&ip->opath, &ip->opathsize, len + 1);
+		memcpy(ip->opath, ip->qpath, len + 1);
+		/* a root is named after its last component, as by fts(3) */
+		name = ip->qpath;
+		if ((rest = strrchr(name, '/')) != NULL &&
+		    (rest != name || rest[1]))
+			name = rest + 1;
+	} else {
+		rest = ip->f.path + ip->nlen;
+		len = ip->qlen + (*rest != '/') + pathlen - ip->nlen;
+		grow(&ip->opath, &ip->opathsize, len + 1);
+		memcpy(ip->opath, ip->qpath, ip->qlen);
+		if (*rest != '/')
+			ip->opath[ip->qlen] = '/';
+		memcpy(ip->opath + len - (pathlen - ip->nlen), rest,
+		    pathlen - ip->nlen);
+		ip->opath[len] = '\0';
+		for (name = ip->opath + len; name[-1] != '/'; name--)
+			;
+	}
+	p->fts_path = p->fts_accpath = ip->opath;
+	p->fts_pathlen = len;
+	if ((p->fts_namelen = strlen(name)) > ip->namemax)
+		errx(1, "%s: index is corrupt", ip->f.name);
+	memmove(p->fts_name, name, p->fts_namelen + 1);
+	p->fts_level = level;
+	p->fts_info = info;
+	p->fts_errno = 0;
+	p->fts_number = 0;
+	p->fts_instr = FTS_NOINSTR;
+	ip->sb = *sb;
+	return (p);
+}
+
+/*
+ * idx_read --
+ *	as fts_read(3)
+ */
+FTSENT *
+idx_read(IDX *ip)
+{
+	struct idxfile *f = &ip->f;
+	struct idxdir *dp;
+	int info, level;
+
+	for (;;) {
+		if (!ip->inpath) {
+			if ((ip->qpath = *ip->paths) == NULL) {
+				errno = 0;
+				return (NULL);
+			}
+			ip->paths++;
+			ip->nlen = normalize(ip->qpath);
+			ip->qlen = strlen(ip->qpath);
+			if (ip->qlen > 0 && ip->qpath[ip->qlen - 1] == '/')
+				ip->qlen--;
+			free(ip->npath);
+			if ((ip->npath = strndup(ip->qpath, ip->nlen)) == NULL)
+				err(1, NULL);
+
+			if_rewind(f);
+			while (if_next(f))
+				if (f->pathlen == ip->nlen &&
+				    memcmp(f->path, ip->npath, ip->nlen) == 0)
+					break;
+			if (f->eof) {
+				memset(&ip->sb, 0, sizeof(ip->sb));
+				(void)idx_entry(ip, ip->nlen, FTS_ROOTLEVEL,
+				    FTS_NS, &ip->sb);
+				ip->ent->fts_errno = ENOENT;
+				return (ip->ent);
+			}
+			ip->base = f->level;
+			ip->inpath = 1;
+			level = FTS_ROOTLEVEL;
+		} else {
+			level = if_peek(f);
+			if (ip->skip) {
+				ip->skip = 0;
+				while (level > ip->base +
+				    ip->dirs[ip->ndirs - 1].level) {
+					(void)if_next(f);
+					level = if_peek(f);
+				}
+			}
+
+			/*
+			 * Past everything under the last directory: return
+			 * it in postorder.
+			 */
+			if (ip->ndirs > 0 && (level == -1 || level - ip->base <=
+			    ip->dirs[ip->ndirs - 1].level)) {
+				dp = &ip->dirs[--ip->ndirs];
+				return (idx_entry(ip, dp->pathlen, dp->level,
+				    FTS_DP, &dp->sb));
+			}
+			if (level == -1 || level <= ip->base) {
+				ip->inpath = 0;
+				continue;
+			}
+			(void)if_next(f);
+			level -= ip->base;
+		}
+
+		if (S_ISDIR(f->sb.st_mode)) {
+			if (ip->ndirs == ip->dirsize) {
+				ip->dirsize = ip->dirsize ? ip->dirsize * 2 : 16;
+				ip->dirs = ereallocarray(ip->dirs, ip->dirsize,
+				    sizeof(*ip->dirs));
+			}
+			dp = &ip->dirs[ip->ndirs++];
+			dp->pathlen = f->pathlen;
+			dp->level = level;
+			dp->sb = f->sb;
+			info = FTS_D;
+		} else if (S_ISLNK(f->sb.st_mode))
+			info = FTS_SL;
+		else if (S_ISREG(f->sb.st_mode))
+			info = FTS_F;
+		else
+			info = FTS_DEFAULT;
+		return (idx_entry(ip, f->pathlen, level, info, &f->sb));
+	}
+}
+
+/*
+ * idx_set --
+ *	as fts_set(3); only FTS_SKIP means anything
+ */
+int
+idx_set(IDX *ip, FTSENT *p, int instr)
+{
+	if (instr == FTS_SKIP && p == ip->ent && p->fts_info == FTS_D)
+		ip->skip = 1;
+	return (0);
+}
+
+int
+idx_close(IDX *ip)
+{
+	if_unmap(&ip->f);
+	free(ip->npath);
+	free(ip->dirs);
+	free(ip->opath);
+	free(ip->ent);
+	free(ip);
+	return (0);
+}
+
+static void
+upd_put(struct idxupd *u, uint64_t n)
+{
+	for (; n >= 0x80; n >>= 7)
+		(void)putc((n & 0x7f) | 0x80, u->fp);
+	(void)putc(n, u->fp);
+}
+
+/*
+ * Write the record for a file.
+ */
+static void
+upd_emit(struct idxupd *u, const char *path, size_t len, int level,
+    struct stat *sb)
+{
+	uint64_t sec;
+	size_t n;
+
+	for (n = 0; n < len && n < u->prevlen && path[n] == u->prev[n]; n++)
+		;
+	upd_put(u, level);
+	upd_put(u, n);
+	upd_put(u, len - n);
+	(void)fwrite(path + n, 1, len - n, u->fp);
+
+	sec = sb->st_mtim.tv_sec;
+	upd_put(u, sb->st_mode);
+	upd_put(u, sb->st_size);
+	upd_put(u, (sec << 1) ^ -(sec >> 63));
+	upd_put(u, sb->st_mtim.tv_nsec);
+	upd_put(u, sb->st_uid);
+	upd_put(u, sb->st_gid);
+
+	grow(&u->prev, &u->prevsize, len);
+	memcpy(u->prev + n, path + n, len - n);
+	u->prevlen = len;
+}
+
+static int
+namecmp(const void *a, const void *b)
+{
+	return (strcmp(*(char * const *)a, *(char * const *)b));
+}
+
+/*
+ * Write what is under the directory at the first len bytes of u->path,
+ * which is at level and has been written with sb.
+ */
+static void
+upd_scan(struct idxupd *u, size_t len, int level, struct stat *sb)
+{
+	struct idxfile *o = u->old;
+	struct stat csb;
+	struct dirent *dp;
+	DIR *dirp;
+	char **names;
+	size_t clen, n, nnames, namesize;
+	int olevel;
+
+	/* Line the old index up with this directory. */
+	u->path[len] = '\0';
+	if (o != NULL)
+		while (!o->eof && pathcmp(o->path, u->path) < 0)
+			(void)if_next(o);
+
+	if (o != NULL && !o->eof && strcmp(o->path, u->path) == 0 &&
+	    S_ISDIR(o->sb.st_mode) &&
+	    o->sb.st_mtim.tv_sec == sb->st_mtim.tv_sec &&
+	    o->sb.st_mtim.tv_nsec == sb->st_mtim.tv_nsec) {
+		/*
+		 * Unchanged: keep the entries it had, looking again only
+		 * at the directories among them.
+		 */
+		olevel = o->level;
+		(void)if_next(o);
+		while (!o->eof && o->level > olevel) {
+			if (!S_ISDIR(o->sb.st_mode)) {
+				upd_emit(u, o->path, o->pathlen, level + 1,
+				    &o->sb);
+				(void)if_next(o);
+				continue;
+			}
+			clen = o->pathlen;
+			grow(&u->path, &u->pathsize, clen + 1);
+			memcpy(u->path, o->path, clen + 1);
+			if (lstat(u->path, &csb) == -1) {
+				warn("%s", u->path);
+				u->rval = 1;
+			} else {
+				upd_emit(u, u->path, clen, level + 1, &csb);
+				if (S_ISDIR(csb.st_mode))
+					upd_scan(u, clen, level + 1, &csb);
+			}
+			/* Drop whatever of it the scan did not use. */
+			if (!o->eof && strcmp(o->path, u->path) == 0)
+				(void)if_next(o);
+			while (!o->eof && o->level > olevel + 1)
+				(void)if_next(o);
+		}
+		u->path[len] = '\0';
+		return;
+	}
+
+	if (o != NULL && !o->eof && strcmp(o->path, u->path) == 0)
+		(void)if_next(o);
+	if ((dirp = opendir(u->path)) == NULL) {
+		warn("%s", u->path);
+		u->rval = 1;
+		return;
+	}
+	names = NULL;
+	nnames = namesize = 0;
+	while ((dp = readdir(dirp)) != NULL) {
+		if (dp->d_name[0] == '.' && (dp->d_name[1] == '\0' ||
+		    (dp->d_name[1] == '.' && dp->d_name[2] == '\0')))
+			continue;
+		if (nnames == namesize) {
+			namesize = namesize ? namesize * 2 : 64;
+			names = ereallocarray(names, namesize, sizeof(*names));
+		}
+		if ((names[nnames++] = strdup(dp->d_name)) == NULL)
+			err(1, NULL);
+	}
+	(void)closedir(dirp);
+	qsort(names, nnames, sizeof(*names), namecmp);
+
+	for (n = 0; n < nnames; n++) {
+		clen = len + (u->path[len - 1] != '/') + strlen(names[n]);
+		grow(&u->path, &u->pathsize, clen + 1);
+		if (u->path[len - 1] != '/')
+			u->path[len] = '/';
+		(void)strlcpy(u->path + clen - strlen(names[n]), names[n],
+		    strlen(names[n]) + 1);
+		free(names[n]);
+		if (lstat(u->path, &csb) == -1) {
+			warn("%s", u->path);
+			u->rval = 1;
+			continue;
+		}
+		upd_emit(u, u->path, clen, level + 1, &csb);
+		if (S_ISDIR(csb.st_mode))
+			upd_scan(u, clen, level + 1, &csb);
+	}
+	free(names);
+	u->path[len] = '\0';
+}
+
+/*
+ * idx_update --
+ *	write the index name for paths, reading as little of the file
+ *	system as the last index allows
+ */
+int
+idx_update(char *name, char **paths)
+{
+	struct idxfile old;
+	struct idxupd u;
+	struct stat sb;
+	char *tmp;
+	size_t len;
+	mode_t mask;
+	int fd;
+
+	memset(&u, 0, sizeof(u));
+	if (if_map(&old, name) == 0)
+		u.old = &old;
+	else if (errno != ENOENT)
+		err(1, "%s", name);
+
+	if (asprintf(&tmp, "%s.XXXXXXXXXX", name) == -1)
+		err(1, NULL);
+	if ((fd = mkstemp(tmp)) == -1)
+		err(1, "%s", tmp);
+	mask = umask(0);
+	(void)umask(mask);
+	(void)fchmod(fd, 0666 & ~mask);
+	if ((u.fp = fdopen(fd, "w")) == NULL)
+		err(1, "%s", tmp);
+	(void)fwrite(IDX_MAGIC, 1, IDX_MAGICLEN, u.fp);
+
+	for (; *paths != NULL; paths++) {
+		len = normalize(*paths);
+		grow(&u.path, &u.pathsize, len + 1);
+		memcpy(u.path, *paths, len);
+		u.path[len] = '\0';
+		if (lstat(u.path, &sb) == -1) {
+			warn("%s", *paths);
+			u.rval = 1;
+			continue;
+		}
+
+		/* Find the path in the old index, if it is there. */
+		if (u.old != NULL) {
+			if_rewind(u.old);
+			while (if_next(u.old))
+				if (u.old->level == 0 &&
+				    strcmp(u.old->path, u.path) == 0)
+					break;
+		}
+		upd_emit(&u, u.path, len, 0, &sb);
+		if (S_ISDIR(sb.st_mode))
+			upd_scan(&u, len, 0, &sb);
+	}
+
+	if (fflush(u.fp) == EOF || ferror(u.fp) || fclose(u.fp) == EOF) {
+		warn("%s", tmp);
+		(void)unlink(tmp);
+		return (1);
+	}
+	if (rename(tmp, name) == -1) {
+		warn("%s", name);
+		(void)unlink(tmp);
+		return (1);
+	}
+	if (u.old != NULL)
+		if_unmap(u.old);
+	free(u.path);
+	free(u.prev);
+	free(tmp);
+	return (u.rval);
+}
@@ -50,8 +50,12 @@ int dotfd;			/* starting directory; may be -1 */
 int ftsoptions;			/* options for the fts_open(3) call */
 int isdelete;			/* user specified -delete operator */
 int isdepth;			/* do directories on post-order visit */
+int isexecdir;			/* user specified -execdir operator */
 int isoutput;			/* user specified output operator */
 int isxargs;			/* don't permit xargs delimiting chars */
+char *indexfile;		/* -index file */
+char *noindex;			/* a primary an index cannot answer */
+int jobs = 1;			/* threads to walk on, -exec + batches */
 
 __dead static void usage(void);
 
@@ -60,6 +64,8 @@ main(int argc, char *argv[])
 {
 	struct sigaction sa;
 	char **p, **paths, **paths2;
+	char *update = NULL;
+	const char *errstr;
 	int ch;
 
 	memset(&sa, 0, sizeof sa);
@@ -73,7 +79,7 @@ main(int argc, char *argv[])
 	sigaction(SIGINFO, &sa, NULL);
 
 	ftsoptions = FTS_NOSTAT|FTS_PHYSICAL;
-	while ((ch = getopt(argc, argv, "Hdf:hLXx")) != -1)
+	while ((ch = getopt(argc, argv, "HdI:f:hj:LXx")) != -1)
 		switch(ch) {
 		case 'H':
 			ftsoptions |= FTS_COMFOLLOW;
@@ -86,6 +92,15 @@ main(int argc, char *argv[])
 		case 'f':
 			*p++ = optarg;
 			break;
+		case 'I':
+			update = optarg;
+			break;
+		case 'j':
+			jobs = strtonum(optarg, 1, 64, &errstr);
+			if (errstr)
+				errx(1, "number of jobs is %s: %s", errstr,
+				    optarg);
+			break;
 		case 'h':
 		case 'L':
 			ftsoptions &= ~FTS_COMFOLLOW;
@@ -126,6 +141,12 @@ main(int argc, char *argv[])
 		err(1, NULL);
 	paths = paths2;
 
+	if (update != NULL) {
+		if (*argv != NULL)
+			usage();
+		exit(idx_update(update, paths));
+	}
+
 	dotfd = open(".", O_RDONLY, 0);
 
 	exit(find_execute(find_formplan(argv), paths));
@@ -135,6 +156,8 @@ static void
 usage(void)
 {
 	(void)fprintf(stderr,
-	    "usage: find [-dHhLXx] [-f path] path ... [expression]\n");
+	    "usage: find [-dHhLXx] [-f path] [-j jobs] path ... "
+	    "[expression]\n"
+	    "       find -I index [-f path] path ...\n");
 	exit(1);
 }
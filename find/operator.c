@@ -261,3 +261,186 @@ or_squish(PLAN *plan)		/* plan with ors to be squished */
 	}
 	return (result);
 }
+ 
+/*
+ * plan_cost --
+ *	what evaluating a node needs to know about a file: one of the COST_
+ *	values.  An expression costs as much as its dearest part.
+ */
+int
+plan_cost(PLAN *plan)
+{
+	PLAN *p;
+	int cost, i;
+
+	switch (plan->type) {
+	case N_DEPTH:
+	case N_EXEC:
+	case N_FOLLOW:
+	case N_INAME:
+	case N_INDEX:
+	case N_MAXDEPTH:
+	case N_MINDEPTH:
+	case N_NAME:
+	case N_OK:
+	case N_PRINT:
+	case N_PRINT0:
+	case N_PRUNE:
+	case N_XDEV:
+		return (COST_NAME);
+	case N_TYPE:
+		return (COST_TYPE);
+	case N_EMPTY:
+	case N_FSTYPE:
+		return (COST_IO);
+	case N_EXPR:
+	case N_NOT:
+	case N_OR:
+		cost = COST_NAME;
+		for (i = 0; i < 2; i++)
+			for (p = plan->p_data[i]; p != NULL; p = p->next)
+				if (plan_cost(p) > cost)
+					cost = plan_cost(p);
+		return (cost);
+	default:
+		return (COST_STAT);
+	}
+}
+
+/*
+ * plan_pure --
+ *	whether a node can be evaluated in any order with its neighbours:
+ *	it has no side effects and does not change the walk.
+ */
+static int
+plan_pure(PLAN *plan)
+{
+	PLAN *p;
+	int i;
+
+	switch (plan->type) {
+	case N_DELETE:
+	case N_EXEC:
+	case N_EXECDIR:
+	case N_LS:
+	case N_MAXDEPTH:
+	case N_OK:
+	case N_PRINT:
+	case N_PRINT0:
+	case N_PRUNE:
+		return (0);
+	case N_EXPR:
+	case N_NOT:
+	case N_OR:
+		for (i = 0; i < 2; i++)
+			for (p = plan->p_data[i]; p != NULL; p = p->next)
+				if (!plan_pure(p))
+					return (0);
+		return (1);
+	default:
+		return (1);
+	}
+}
+
+/*
+ * plan_order --
+ *	sort each run of side effect free nodes in a list of ANDed nodes so
+ *	that the cheap ones come first, e.g.
+ *
+ *	[-size +1G]--> [-name *.log]--> [-print]
+ *
+ *	becomes
+ *
+ *	[-name *.log]--> [-size +1G]--> [-print]
+ *
+ *	Nodes of equal cost keep their order, nothing moves across a node
+ *	with side effects (-exec, -print, -prune...), and the operands of
+ *	-o and ! are only sorted among themselves.
+ */
+PLAN *
+plan_order(PLAN *plan)
+{
+	PLAN *next;	/* next node being processed */
+	PLAN **run;	/* start of the run of pure nodes in the result */
+	PLAN **pp;
+	PLAN *result;		/* pointer to head of result plan */
+
+	result = NULL;
+	run = &result;
+
+	while ((next = yanknode(&plan)) != NULL) {
+		if (next->type == N_EXPR || next->type == N_NOT ||
+		    next->type == N_OR) {
+			next->p_data[0] = plan_order(next->p_data[0]);
+			if (next->p_data[1])
+				next->p_data[1] = plan_order(next->p_data[1]);
+		}
+
+		/*
+		 * a pure node goes in front of the first dearer one in the
+		 * current run; anything else ends the run.
+		 */
+		for (pp = run; *pp != NULL; pp = &(*pp)->next)
+			if (plan_pure(next) &&
+			    plan_cost(*pp) > plan_cost(next))
+				break;
+		next->next = *pp;
+		*pp = next;
+		if (!plan_pure(next))
+			run = &next->next;
+	}
+	return (result);
+}
+
+/*
+ * plan_lazy --
+ *	whether it pays to stat(2) files only as the plan needs it: whether
+ *	the plan starts by looking at something cheaper than a stat, which
+ *	may rule the file out.
+ */
+int
+plan_lazy(PLAN *plan)
+{
+	switch (plan->type) {
+	case N_DEPTH:
+	case N_FOLLOW:
+	case N_INDEX:
+	case N_XDEV:
+		/* always true */
+		return (plan->next != NULL && plan_lazy(plan->next));
+	case N_EXPR:
+	case N_NOT:
+	case N_OR:
+		return (plan_lazy(plan->p_data[0]));
+	default:
+		return (plan_cost(plan) < COST_STAT);
+	}
+}
+
+/*
+ * plan_stat --
+ *	for a walk that gives only file types, put a stat node in front of
+ *	the first node of each list that needs more.
+ */
+PLAN *
+plan_stat(PLAN *plan)
+{
+	PLAN *next, *new, **pp;
+
+	for (pp = &plan; (next = *pp) != NULL; pp = &next->next) {
+		if (plan_cost(next) < COST_STAT)
+			continue;
+		if (next->type == N_EXPR || next->type == N_NOT ||
+		    next->type == N_OR) {
+			next->p_data[0] = plan_stat(next->p_data[0]);
+			if (next->p_data[1])
+				next->p_data[1] = plan_stat(next->p_data[1]);
+			continue;
+		}
+		new = c_stat(NULL, NULL, 0);
+		new->next = next;
+		*pp = new;
+		break;
+	}
+	return (plan);
+}
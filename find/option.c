@@ -69,6 +69,7 @@ static OPTION options[] = {
 	{ "-fstype",	N_FSTYPE,	c_fstype,	O_ARGV },
 	{ "-group",	N_GROUP,	c_group,	O_ARGV },
 	{ "-iname",	N_INAME,	c_iname,	O_ARGV },
+	{ "-index",	N_INDEX,	c_index,	O_ARGV },
 	{ "-inum",	N_INUM,		c_inum,		O_ARGV },
 	{ "-links",	N_LINKS,	c_links,	O_ARGV },
 	{ "-ls",	N_LS,		c_ls,		O_ZERO },
@@ -115,6 +116,8 @@ find_create(char ***argvp)
 
 	if ((p = option(*argv)) == NULL)
 		errx(1, "%s: unknown option", *argv);
+	if (noindex == NULL && !idx_token(p->token))
+		noindex = p->name;
 	++argv;
 	if (p->flags & (O_ARGV|O_ARGVP) && !*argv)
 		errx(1, "%s: requires additional arguments", *--argv);
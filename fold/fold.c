@@ -35,6 +35,7 @@
 
 #include <ctype.h>
 #include <err.h>
+#include <fcntl.h>
 #include <limits.h>
 #include <locale.h>
 #include <stdio.h>
@@ -43,10 +44,11 @@
 #include <unistd.h>
 #include <wchar.h>
 
+#include <lbuf.h>
+
 #define	DEFLINEWIDTH	80
 
-static void fold(unsigned int);
-static int isu8cont(unsigned char);
+static void fold(int, const char *, unsigned int);
 static __dead void usage(void);
 
 int count_bytes = 0;
@@ -55,7 +57,7 @@ int split_words = 0;
 int
 main(int argc, char *argv[])
 {
-	int ch, lastch, newarg, prevoptind;
+	int ch, fd, lastch, newarg, prevoptind;
 	unsigned int width;
 	const char *errstr;
 
@@ -110,86 +112,59 @@ main(int argc, char *argv[])
 	if (!*argv) {
 		if (pledge("stdio", NULL) == -1)
 			err(1, "pledge");
-		fold(width);
+		fold(STDIN_FILENO, "stdin", width);
 	} else {
 		for (; *argv; ++argv) {
-			if (!freopen(*argv, "r", stdin))
+			if ((fd = open(*argv, O_RDONLY)) == -1)
 				err(1, "%s", *argv);
-			else
-				fold(width);
+			fold(fd, *argv, width);
+			(void)close(fd);
 		}
 	}
 	return 0;
 }
 
 /*
- * Fold the contents of standard input to fit within WIDTH columns
- * (or bytes) and write to standard output.
+ * Fold the contents of fd to fit within WIDTH columns (or bytes) and
+ * write to standard output.
  *
- * If split_words is set, split the line at the last space character
- * on the line.  This flag necessitates storing the line in a buffer
- * until the current column > width, or a newline or EOF is read.
+ * Each line is folded where it lies in the input buffer: whatever of it
+ * has not been written yet runs from bp to cp.  If split_words is set,
+ * split the line at the last space character before cp.
  *
- * The buffer can grow larger than WIDTH due to backspaces and carriage
- * returns embedded in the input stream.
+ * The columns can go back by backspaces and carriage returns embedded
+ * in the line, so a piece can be longer than WIDTH bytes.
  */
 static void
-fold(unsigned int max_width)
+fold(int fd, const char *name, unsigned int max_width)
 {
-	static char	*buf = NULL;
-	static size_t	 bufsz = 2048;
+	struct lbuf	 lb;
+	char		*line;	/* Line being folded. */
+	char		*bp;	/* Start of what is left to write. */
 	char		*cp;	/* Current mb character. */
-	char		*np;	/* Next mb character. */
+	char		*ep;	/* End of the line. */
 	char		*sp;	/* To search for the last space. */
-	char		*nbuf;	/* For buffer reallocation. */
+	size_t		 n;	/* Bytes in the line. */
 	wchar_t		 wc;	/* Current wide character. */
-	int		 ch;	/* Last byte read. */
 	int		 len;	/* Bytes in the current mb character. */
 	unsigned int	 col;	/* Current display position. */
 	int		 width; /* Display width of wc. */
 
-	if (buf == NULL && (buf = malloc(bufsz)) == NULL)
+	if (lbuf_init(&lb, fd, '\n') == -1)
 		err(1, NULL);
 
-	np = cp = buf;
-	ch = 0;
-	col = 0;
-
-	while (ch != EOF) {  /* Loop on input characters. */
-		while ((ch = getchar()) != EOF) {  /* Loop on input bytes. */
-			if (np + 1 == buf + bufsz) {
-				nbuf = reallocarray(buf, 2, bufsz);
-				if (nbuf == NULL)
-					err(1, NULL);
-				bufsz *= 2;
-				cp = nbuf + (cp - buf);
-				np = nbuf + (np - buf);
-				buf = nbuf;
-			}
-			*np++ = ch;
-
-			/*
-			 * Read up to and including the first byte of
-			 * the next character, such that we are sure
-			 * to have a complete character in the buffer.
-			 * There is no need to read more than five bytes
-			 * ahead, since UTF-8 characters are four bytes
-			 * long at most.
-			 */
-
-			if (np - cp > 4 || (np - cp > 1 && !isu8cont(ch)))
-				break;
-		}
+	while ((line = lbuf_next(&lb, &n)) != NULL) {
+		bp = cp = line;
+		ep = line + n;
+		col = 0;
 
-		while (cp < np) {  /* Loop on output characters. */
+		while (cp < ep) {  /* Loop on characters. */
 
-			/* Handle end of line and backspace. */
+			/* Handle carriage return and backspace. */
 
-			if (*cp == '\n' || (*cp == '\r' && !count_bytes)) {
-				fwrite(buf, 1, ++cp - buf, stdout);
-				memmove(buf, cp, np - cp);
-				np = buf + (np - cp);
-				cp = buf;
+			if (*cp == '\r' && !count_bytes) {
+				fwrite(bp, 1, ++cp - bp, stdout);
+				bp = cp;
 				col = 0;
 				continue;
 			}
@@ -200,69 +175,50 @@ fold(unsigned int max_width)
 				continue;
 			}
 
-			/*
-			 * Measure display width.
-			 * Process the last byte only if
-			 * end of file was reached.
-			 */
+			/* Measure display width. */
+
+			len = 1;
+			width = 1;
 
-			if (np - cp > (ch != EOF)) {
+			if (*cp == '\t') {
+				if (count_bytes == 0)
+					width = 8 - (col & 7);
+			} else if ((len = mbtowc(&wc, cp, ep - cp)) < 1)
 				len = 1;
+			else if (count_bytes)
+				width = len;
+			else if ((width = wcwidth(wc)) < 0)
 				width = 1;
 
-				if (*cp == '\t') {
-					if (count_bytes == 0)
-						width = 8 - (col & 7);
-				} else if ((len = mbtowc(&wc, cp,
-				    np - cp)) < 1)
-					len = 1;
-				else if (count_bytes)
-					width = len;
-				else if ((width = wcwidth(wc)) < 0)
-					width = 1;
-
-				col += width;
-				if (col <= max_width || cp == buf) {
-					cp += len;
-					continue;
-				}
+			col += width;
+			if (col <= max_width || cp == bp) {
+				cp += len;
+				continue;
 			}
 
 			/* Line break required. */
 
-			if (col > max_width) {
-				if (split_words) {
-					for (sp = cp; sp > buf; sp--) {
-						if (sp[-1] == ' ') {
-							cp = sp;
-							break;
-						}
+			if (split_words) {
+				for (sp = cp; sp > bp; sp--) {
+					if (sp[-1] == ' ') {
+						cp = sp;
+						break;
 					}
 				}
-				fwrite(buf, 1, cp - buf, stdout);
-				putchar('\n');
-				memmove(buf, cp, np - cp);
-				np = buf + (np - cp);
-				cp = buf;
-				col = 0;
-				continue;
 			}
-
-			/* Need more input. */
-
-			break;
+			fwrite(bp, 1, cp - bp, stdout);
+			putchar('\n');
+			bp = cp;
+			col = 0;
 		}
+		fwrite(bp, 1, ep - bp, stdout);
+		if (lb.delimited)
+			putchar('\n');
 	}
-	fwrite(buf, 1, np - buf, stdout);
 
-	if (ferror(stdin))
-		err(1, NULL);
-}
-
-static int
-isu8cont(unsigned char c)
-{
-	return MB_CUR_MAX > 1 && (c & (0x80 | 0x40)) == 0x80;
+	if (lb.error)
+		err(1, "%s", name);
+	lbuf_free(&lb);
 }
 
 static __dead void
@@ -35,6 +35,7 @@
 
 #include <err.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <limits.h>
 #include <locale.h>
 #include <stdio.h>
@@ -43,6 +44,8 @@
 #include <unistd.h>
 #include <wchar.h>
 
+#include <lbuf.h>
+
 #define MAXIMUM(a, b)	(((a) > (b)) ? (a) : (b))
 
 /*
@@ -60,7 +63,7 @@ typedef struct {
 } LINE;
 
 typedef struct {
-	FILE *fp;			/* file descriptor */
+	int fd;				/* file descriptor */
 	u_long joinf;			/* join field (-1, -2, -j) */
 	int unpair;			/* output unpairable lines (-a) */
 	u_long number;			/* 1 for file 1, 2 for file 2 */
@@ -69,9 +72,10 @@ typedef struct {
 	u_long pushback;		/* line on the stack */
 	u_long setcnt;			/* set count */
 	u_long setalloc;		/* set allocated count */
+	struct lbuf lb;			/* input buffer */
 } INPUT;
-INPUT input1 = { NULL, 0, 0, 1, NULL, 0, 0, 0, 0 },
-      input2 = { NULL, 0, 0, 2, NULL, 0, 0, 0, 0 };
+INPUT input1 = { STDIN_FILENO, 0, 0, 1, NULL, 0, 0, 0, 0 },
+      input2 = { STDIN_FILENO, 0, 0, 2, NULL, 0, 0, 0, 0 };
 
 typedef struct {
 	u_long	filenum;	/* file number */
@@ -204,17 +208,16 @@ main(int argc, char *argv[])
 		usage();
 
 	/* Open the files; "-" means stdin. */
-	if (!strcmp(*argv, "-"))
-		F1->fp = stdin;
-	else if ((F1->fp = fopen(*argv, "r")) == NULL)
+	if (strcmp(*argv, "-") && (F1->fd = open(*argv, O_RDONLY)) == -1)
 		err(1, "%s", *argv);
 	++argv;
-	if (!strcmp(*argv, "-"))
-		F2->fp = stdin;
-	else if ((F2->fp = fopen(*argv, "r")) == NULL)
+	if (strcmp(*argv, "-") && (F2->fd = open(*argv, O_RDONLY)) == -1)
 		err(1, "%s", *argv);
-	if (F1->fp == stdin && F2->fp == stdin)
+	if (F1->fd == STDIN_FILENO && F2->fd == STDIN_FILENO)
 		errx(1, "only one input file may be stdin");
+	if (lbuf_init(&F1->lb, F1->fd, '\n') == -1 ||
+	    lbuf_init(&F2->lb, F2->fd, '\n') == -1)
+		err(1, NULL);
 
 	if (pledge("stdio", NULL) == -1)
 		err(1, "pledge");
@@ -270,8 +273,7 @@ void
 slurp(INPUT *F)
 {
 	LINE *lp, *lastlp, tmp;
-	ssize_t len;
-	size_t linesize;
+	size_t len;
 	u_long cnt;
 	char *bp, *fieldp, *line;
 
@@ -281,8 +283,6 @@ slurp(INPUT *F)
 	 */
 
 	F->setcnt = 0;
-	line = NULL;
-	linesize = 0;
 	for (lastlp = NULL; ; ++F->setcnt) {
 		/*
 		 * If we're out of space to hold line structures, allocate
@@ -320,12 +320,13 @@ slurp(INPUT *F)
 			F->pushbool = 0;
 			continue;
 		}
-		if ((len = getline(&line, &linesize, F->fp)) == -1)
+		if ((line = lbuf_next(&F->lb, &len)) == NULL) {
+			if (F->lb.error)
+				err(1, NULL);
 			break;
+		}
 
-		/* Remove trailing newline, if it exists, and copy line. */
-		if (line[len - 1] == '\n')
-			len--;
+		/* Copy the line, which the next read may overwrite. */
 		if (lp->linealloc <= len + 1) {
 			char *p;
 			u_long newsize = lp->linealloc +
@@ -363,7 +364,6 @@ slurp(INPUT *F)
 			break;
 		}
 	}
-	free(line);
 }
 
 char *
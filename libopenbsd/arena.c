@@ -0,0 +1,232 @@
+/*
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+
+#include "openbsd.h"
+
+/* Good enough for any object we are asked for. */
+#define	ARENA_ALIGN	16
+
+struct _arena_block {
+	struct _arena_block	*next;
+	size_t			 size;		/* of data */
+	size_t			 used;
+	char			*data;
+};
+
+void
+arena_init(struct arena *a, size_t blocksize)
+{
+	memset(a, 0, sizeof(*a));
+	a->blocksize = blocksize ? blocksize : ARENA_BLOCKSIZE;
+}
+
+static struct _arena_block *
+arena_block(struct arena *a, size_t size)
+{
+	struct _arena_block *b;
+
+	if (size > SIZE_MAX - sizeof(*b) - ARENA_ALIGN) {
+		errno = ENOMEM;
+		return (NULL);
+	}
+	if ((b = malloc(sizeof(*b) + size + ARENA_ALIGN)) == NULL)
+		return (NULL);
+	b->data = (char *)(((uintptr_t)(b + 1) + ARENA_ALIGN - 1) &
+	    ~(uintptr_t)(ARENA_ALIGN - 1));
+	b->size = size;
+	b->used = 0;
+	a->reserved += sizeof(*b) + size + ARENA_ALIGN;
+	if (a->reserved > a->peak)
+		a->peak = a->reserved;
+	return (b);
+}
+
+static void *
+arena_get(struct arena *a, size_t size, size_t align)
+{
+	struct _arena_block *b;
+	size_t off;
+
+	if ((b = a->cur) != NULL) {
+		off = (b->used + align - 1) & ~(align - 1);
+		if (off <= b->size && b->size - off >= size) {
+			b->used = off + size;
+			goto done;
+		}
+	}
+
+	/* Big requests get a block of their own, kept off to the side. */
+	if (size > a->blocksize / 4) {
+		if ((b = arena_block(a, size)) == NULL)
+			return (NULL);
+		b->used = off = size;
+		if (a->cur != NULL) {
+			b->next = a->full;
+			a->full = b;
+		} else {
+			b->next = NULL;
+			a->cur = b;
+		}
+		goto done;
+	}
+
+	if ((b = arena_block(a, a->blocksize)) == NULL)
+		return (NULL);
+	if (a->cur != NULL) {
+		a->cur->next = a->full;
+		a->full = a->cur;
+	}
+	b->next = NULL;
+	a->cur = b;
+	off = 0;
+	b->used = size;
+done:
+	a->nalloc++;
+	a->inuse += size;
+	return (b->data + off);
+}
+
+void *
+arena_alloc(struct arena *a, size_t size)
+{
+	return (arena_get(a, size, ARENA_ALIGN));
+}
+
+void *
+arena_calloc(struct arena *a, size_t nmemb, size_t size)
+{
+	void *p;
+
+	if (size != 0 && nmemb > SIZE_MAX / size) {
+		errno = ENOMEM;
+		return (NULL);
+	}
+	if ((p = arena_get(a, nmemb * size, ARENA_ALIGN)) != NULL)
+		memset(p, 0, nmemb * size);
+	return (p);
+}
+
+char *
+arena_strdup(struct arena *a, const char *s)
+{
+	return (arena_strndup(a, s, strlen(s)));
+}
+
+/*
+ * Copy exactly len bytes of s and a terminating NUL; unlike strndup(3)
+ * this does not stop at a NUL in s.
+ */
+char *
+arena_strndup(struct arena *a, const char *s, size_t len)
+{
+	char *p;
+
+	if (len == SIZE_MAX) {
+		errno = ENOMEM;
+		return (NULL);
+	}
+	if ((p = arena_get(a, len + 1, 1)) == NULL)
+		return (NULL);
+	memcpy(p, s, len);
+	p[len] = '\0';
+	return (p);
+}
+
+/*
+ * Give back everything but the current block, which is kept for reuse
+ * if it is an ordinary one.
+ */
+void
+arena_reset(struct arena *a)
+{
+	struct _arena_block *b, *keep;
+
+	keep = a->cur;
+	if (keep != NULL && keep->size != a->blocksize) {
+		keep->next = a->full;
+		a->full = keep;
+		keep = NULL;
+	}
+	while ((b = a->full) != NULL) {
+		a->full = b->next;
+		a->reserved -= sizeof(*b) + b->size + ARENA_ALIGN;
+		free(b);
+	}
+	if ((a->cur = keep) != NULL)
+		keep->used = 0;
+	a->nalloc = a->inuse = 0;
+}
+
+void
+arena_free(struct arena *a)
+{
+	arena_reset(a);
+	if (a->cur != NULL) {
+		a->reserved -= sizeof(*a->cur) + a->cur->size + ARENA_ALIGN;
+		free(a->cur);
+		a->cur = NULL;
+	}
+}
+
+void
+pool_init(struct pool *p, struct arena *a, size_t size)
+{
+	memset(p, 0, sizeof(*p));
+	p->arena = a;
+	if (size < sizeof(void *))
+		size = sizeof(void *);
+	p->size = (size + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+	/* Objects are only as aligned as their size needs. */
+	for (p->align = ARENA_ALIGN; p->size % p->align != 0; p->align /= 2)
+		;
+}
+
+void *
+pool_get(struct pool *p)
+{
+	void *o;
+
+	if ((o = p->free) != NULL)
+		memcpy(&p->free, o, sizeof(p->free));
+	else if ((o = arena_get(p->arena, p->size, p->align)) == NULL)
+		return (NULL);
+	if (++p->inuse > p->peak)
+		p->peak = p->inuse;
+	return (o);
+}
+
+void
+pool_put(struct pool *p, void *o)
+{
+	if (o == NULL)
+		return;
+	memcpy(o, &p->free, sizeof(p->free));
+	p->free = o;
+	p->inuse--;
+}
+
+void
+pool_reset(struct pool *p)
+{
+	p->free = NULL;
+	p->inuse = 0;
+}
@@ -0,0 +1,75 @@
+/*
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef	_ARENA_H_
+#define	_ARENA_H_
+
+#include <stddef.h>
+
+/*
+ * Region allocation for objects that all die together.
+ *
+ * An arena hands out memory by bumping a pointer through blocks it gets
+ * from malloc(3); nothing is given back until arena_reset() or
+ * arena_free() releases all of it at once.  Memory from arena_alloc() is
+ * aligned for any object, memory from arena_strdup() and arena_strndup()
+ * is not aligned at all.  Requests bigger than a quarter block get a
+ * block of their own.
+ *
+ * A pool hands out objects of one size from an arena and keeps the ones
+ * given back with pool_put() on a free list for the next pool_get().
+ * Resetting or freeing the arena of a pool takes its objects with it;
+ * the pool must then be pool_reset() before it is used again.
+ *
+ * The counters in both are kept up to date and may be read at any time.
+ * Functions that allocate return NULL with errno set on failure.
+ */
+
+struct _arena_block;
+
+struct arena {
+	struct _arena_block	*cur;		/* block being carved up */
+	struct _arena_block	*full;		/* blocks with no room left */
+	size_t			 blocksize;
+	size_t			 nalloc;	/* allocations made */
+	size_t			 inuse;		/* bytes asked for */
+	size_t			 reserved;	/* bytes in blocks */
+	size_t			 peak;		/* most bytes ever in blocks */
+};
+
+struct pool {
+	struct arena		*arena;
+	size_t			 size;		/* of an object */
+	size_t			 align;
+	void			*free;		/* objects given back */
+	size_t			 inuse;		/* objects handed out */
+	size_t			 peak;		/* most ever handed out */
+};
+
+#define	ARENA_BLOCKSIZE	(64 * 1024)
+
+void	 arena_init(struct arena *, size_t);
+void	*arena_alloc(struct arena *, size_t);
+void	*arena_calloc(struct arena *, size_t, size_t);
+char	*arena_strdup(struct arena *, const char *);
+char	*arena_strndup(struct arena *, const char *, size_t);
+void	 arena_reset(struct arena *);
+void	 arena_free(struct arena *);
+
+void	 pool_init(struct pool *, struct arena *, size_t);
+void	*pool_get(struct pool *);
+void	 pool_put(struct pool *, void *);
+void	 pool_reset(struct pool *);
+
+#endif /* !_ARENA_H_ */
@@ -31,6 +31,9 @@
 
 #include <sys/param.h>	/* ALIGN */
 #include <sys/stat.h>
+#ifdef __linux__
+#include <sys/sysmacros.h>	/* makedev */
+#endif
 
 #include <dirent.h>
 #include <errno.h>
@@ -712,6 +715,12 @@ mem1:				saved_errno = errno;
 			p->fts_accpath =
 			    ISSET(FTS_NOCHDIR) ? p->fts_path : p->fts_name;
 			p->fts_info = FTS_NSOK;
+#ifdef DT_DIR
+		} else if ((p->fts_info = fts_dtype(sp->fts_statmask,
+		    sp->fts_options, dp->d_type, p->fts_statp)) != 0) {
+			p->fts_accpath =
+			    ISSET(FTS_NOCHDIR) ? p->fts_path : p->fts_name;
+#endif
 		} else {
 			/* Build a file name for fts_stat to stat. */
 			if (ISSET(FTS_NOCHDIR)) {
@@ -812,16 +821,18 @@ fts_stat(FTS *sp, FTSENT *p, int follow, int dfd)
 	 * fail, set the errno from the stat call.
 	 */
 	if (ISSET(FTS_LOGICAL) || follow) {
-		if (fstatat(dfd, path, sbp, 0)) {
+		if (fts_fstatat(sp->fts_statmask, dfd, path, sbp, 0)) {
 			saved_errno = errno;
-			if (!fstatat(dfd, path, sbp, AT_SYMLINK_NOFOLLOW)) {
+			if (!fts_fstatat(sp->fts_statmask, dfd, path, sbp,
+			    AT_SYMLINK_NOFOLLOW)) {
 				errno = 0;
 				return (FTS_SLNONE);
 			}
 			p->fts_errno = saved_errno;
 			goto err;
 		}
-	} else if (fstatat(dfd, path, sbp, AT_SYMLINK_NOFOLLOW)) {
+	} else if (fts_fstatat(sp->fts_statmask, dfd, path, sbp,
+	    AT_SYMLINK_NOFOLLOW)) {
 		p->fts_errno = errno;
 err:		memset(sbp, 0, sizeof(struct stat));
 		return (FTS_NS);
@@ -863,6 +874,114 @@ err:		memset(sbp, 0, sizeof(struct stat));
 	return (FTS_DEFAULT);
 }
 
+/*
+ * Limit the stat information gathered for the rest of the walk to the
+ * fields in mask (see fts.h), or gather all of it if mask is 0.  Entries
+ * still have whatever type information fts_info needs.
+ */
+int
+fts_statmask(FTS *sp, unsigned int mask)
+{
+	if (mask & ~FTS_ST_ALL) {
+		errno = EINVAL;
+		return (1);
+	}
+	sp->fts_statmask = mask;
+	return (0);
+}
+
+/*
+ * fstatat(2), asking for no more than the fields in mask (all of them if
+ * it is 0) where the system has statx(2).  On network and FUSE file
+ * systems that can save a round trip for attributes that are not wanted,
+ * the times and size in particular.  The fields not asked for are
+ * whatever the system had at hand, which may be 0.
+ */
+int
+fts_fstatat(unsigned int mask, int dfd, const char *path, struct stat *sb,
+    int flag)
+{
+#ifdef STATX_TYPE
+	static int nostatx;
+	struct statx stx;
+
+	if (mask != 0 && !nostatx) {
+		/* directories need their inode for cycle detection */
+		if (statx(dfd, path, flag, mask | FTS_ST_TYPE | FTS_ST_INO,
+		    &stx) == 0) {
+			memset(sb, 0, sizeof(*sb));
+			sb->st_dev = makedev(stx.stx_dev_major,
+			    stx.stx_dev_minor);
+			sb->st_ino = stx.stx_ino;
+			sb->st_mode = stx.stx_mode;
+			sb->st_nlink = stx.stx_nlink;
+			sb->st_uid = stx.stx_uid;
+			sb->st_gid = stx.stx_gid;
+			sb->st_rdev = makedev(stx.stx_rdev_major,
+			    stx.stx_rdev_minor);
+			sb->st_size = stx.stx_size;
+			sb->st_blksize = stx.stx_blksize;
+			sb->st_blocks = stx.stx_blocks;
+			sb->st_atim.tv_sec = stx.stx_atime.tv_sec;
+			sb->st_atim.tv_nsec = stx.stx_atime.tv_nsec;
+			sb->st_mtim.tv_sec = stx.stx_mtime.tv_sec;
+			sb->st_mtim.tv_nsec = stx.stx_mtime.tv_nsec;
+			sb->st_ctim.tv_sec = stx.stx_ctime.tv_sec;
+			sb->st_ctim.tv_nsec = stx.stx_ctime.tv_nsec;
+			return (0);
+		}
+		if (errno != ENOSYS)
+			return (-1);
+		nostatx = 1;
+	}
+#endif
+	return (fstatat(dfd, path, sb, flag));
+}
+
+/*
+ * If all a walk wants of an entry is its type (mask is FTS_ST_TYPE), and
+ * the directory entry has it, work out fts_info from that and set the
+ * type in st_mode.  Directories, and symbolic links that a logical walk
+ * follows, still need a stat.
+ * Return:
+ *	the fts_info value, or 0 if the entry has to be stat(2)ed
+ */
+unsigned short
+fts_dtype(unsigned int mask, int options, int type, struct stat *sbp)
+{
+#ifdef DT_DIR
+	unsigned short info;
+
+	if (mask != FTS_ST_TYPE)
+		return (0);
+	switch (type) {
+	case DT_REG:
+		info = FTS_F;
+		break;
+	case DT_LNK:
+		if (options & FTS_LOGICAL)
+			return (0);
+		info = FTS_SL;
+		break;
+	case DT_FIFO:
+	case DT_CHR:
+	case DT_BLK:
+	case DT_SOCK:
+		info = FTS_DEFAULT;
+		break;
+	default:
+		return (0);
+	}
+	if (sbp != NULL) {
+		memset(sbp, 0, sizeof(*sbp));
+		sbp->st_mode = DTTOIF(type);
+	}
+	return (info);
+#else
+	return (0);
+#endif
+}
+
 static FTSENT *
 fts_sort(FTS *sp, FTSENT *head, int nitems)
 {
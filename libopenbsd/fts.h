@@ -58,6 +58,7 @@ typedef struct {
 #define	FTS_NAMEONLY	0x1000		/* (private) child names only */
 #define	FTS_STOP	0x2000		/* (private) unrecoverable error */
 	int fts_options;		/* fts_open options, global flags */
+	unsigned int fts_statmask;	/* stat fields wanted, 0 for all */
 } FTS;
 
 typedef struct _ftsent {
@@ -113,11 +114,35 @@ typedef struct _ftsent {
 	char fts_name[1];		/* file name */
 } FTSENT;
 
+/*
+ * Stat fields for fts_statmask(); the values are those of statx(2).
+ * A walk that asks for no more than FTS_ST_TYPE takes the file type from
+ * the directory entry where it can, and stats only directories.
+ */
+#define	FTS_ST_TYPE	0x0001		/* st_mode & S_IFMT */
+#define	FTS_ST_MODE	0x0002		/* st_mode & ~S_IFMT */
+#define	FTS_ST_NLINK	0x0004
+#define	FTS_ST_UID	0x0008
+#define	FTS_ST_GID	0x0010
+#define	FTS_ST_ATIME	0x0020
+#define	FTS_ST_MTIME	0x0040
+#define	FTS_ST_CTIME	0x0080
+#define	FTS_ST_INO	0x0100
+#define	FTS_ST_SIZE	0x0200
+#define	FTS_ST_BLOCKS	0x0400
+#define	FTS_ST_ALL	0x07ff
+
 FTSENT	*fts_children(FTS *, int);
 int	 fts_close(FTS *);
 FTS	*fts_open(char * const *, int,
 	    int (*)(const FTSENT **, const FTSENT **));
 FTSENT	*fts_read(FTS *);
 int	 fts_set(FTS *, FTSENT *, int);
+int	 fts_statmask(FTS *, unsigned int);
+
+/* (private) shared with pfts */
+struct stat;
+int	 fts_fstatat(unsigned int, int, const char *, struct stat *, int);
+unsigned short	 fts_dtype(unsigned int, int, int, struct stat *);
 
 #endif /* !_FTS_H_ */
@@ -0,0 +1,295 @@
+/*
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "htab.h"
+#include "htab_private.h"
+
+#include "openbsd.h"
+
+/* What a slot holds ahead of its value. */
+struct htab_slot {
+	uint64_t	 hash;
+	size_t		 len;
+	const char	*key;
+};
+
+/* Batches are hashed, and their groups prefetched, this many at a time. */
+#define	BATCH		16
+
+#define	SLOT(t, i)	((struct htab_slot *)((t)->slots + (i) * (t)->slotsize))
+#define	VALUE(s)	((void *)((s) + 1))
+
+/*
+ * Rebuild the table with room for at least n entries, dropping any
+ * tombstones on the way.
+ */
+static int
+htab_resize(struct htab *t, size_t n)
+{
+	struct htab_slot *s;
+	uint8_t *ctrl;
+	char *slots, *oslots;
+	size_t i, j, ns, onslots;
+
+	for (ns = HT_GROUP; HT_CAPACITY(ns) < n; ns <<= 1)
+		if (ns > SIZE_MAX / 2 / t->slotsize) {
+			errno = ENOMEM;
+			return (-1);
+		}
+	if ((ctrl = malloc(ns)) == NULL)
+		return (-1);
+	if ((slots = reallocarray(NULL, ns, t->slotsize)) == NULL) {
+		free(ctrl);
+		return (-1);
+	}
+	memset(ctrl, HT_EMPTY, ns);
+
+	oslots = t->slots;
+	onslots = t->nslots;
+	for (i = 0; i < onslots; i++) {
+		if (!HT_FULL(t->ctrl[i]))
+			continue;
+		s = (struct htab_slot *)(oslots + i * t->slotsize);
+		j = ht_find_free(ctrl, ns, s->hash);
+		ctrl[j] = t->ctrl[i];
+		memcpy(slots + j * t->slotsize, s, t->slotsize);
+	}
+	free(t->ctrl);
+	free(oslots);
+	t->ctrl = ctrl;
+	t->slots = slots;
+	t->nslots = ns;
+	t->left = HT_CAPACITY(ns) - t->count;
+	return (0);
+}
+
+void
+htab_init(struct htab *t, size_t vsize)
+{
+	memset(t, 0, sizeof(*t));
+	arena_init(&t->keys, 0);
+	t->vsize = vsize;
+	t->slotsize = (sizeof(struct htab_slot) + vsize + 7) & ~(size_t)7;
+}
+
+void
+htab_free(struct htab *t)
+{
+	arena_free(&t->keys);
+	free(t->ctrl);
+	free(t->slots);
+	htab_init(t, t->vsize);
+}
+
+/*
+ * Make sure n more entries can go in without the table being rebuilt.
+ */
+int
+htab_reserve(struct htab *t, size_t n)
+{
+	if (t->left >= n)
+		return (0);
+	if (n > SIZE_MAX - t->count) {
+		errno = ENOMEM;
+		return (-1);
+	}
+	n += t->count;
+	/* Grow by at least half, so that rebuilding stays amortized. */
+	if (n < t->count + t->count / 2)
+		n = t->count + t->count / 2;
+	return (htab_resize(t, n));
+}
+
+static struct htab_slot *
+htab_lookup(struct htab *t, const void *key, size_t len, uint64_t h)
+{
+	struct ht_probe p;
+	struct htab_slot *s;
+	const uint8_t *g;
+	unsigned int m;
+
+	if (t->nslots == 0)
+		return (NULL);
+	for (ht_probe_start(&p, h, t->nslots); ; ht_probe_next(&p)) {
+		g = t->ctrl + p.g;
+		for (m = ht_match(g, HT_H2(h)); m != 0; m &= m - 1) {
+			s = SLOT(t, p.g + __builtin_ctz(m));
+			if (s->hash == h && s->len == len &&
+			    memcmp(s->key, key, len) == 0)
+				return (s);
+		}
+		if (ht_match_empty(g))
+			return (NULL);
+	}
+}
+
+void *
+htab_find(struct htab *t, const void *key, size_t len)
+{
+	struct htab_slot *s;
+
+	s = htab_lookup(t, key, len, htab_hash(key, len));
+	return (s == NULL ? NULL : VALUE(s));
+}
+
+/*
+ * Insert a key whose hash is known into a table known to have room.
+ */
+static void *
+htab_add(struct htab *t, const void *key, size_t len, uint64_t h, int *isnew)
+{
+	struct htab_slot *s;
+	const char *k;
+	size_t i;
+
+	if ((s = htab_lookup(t, key, len, h)) != NULL) {
+		if (isnew != NULL)
+			*isnew = 0;
+		return (VALUE(s));
+	}
+	if ((k = arena_strndup(&t->keys, key, len)) == NULL)
+		return (NULL);
+	i = ht_find_free(t->ctrl, t->nslots, h);
+	if (t->ctrl[i] == HT_EMPTY)
+		t->left--;
+	t->ctrl[i] = HT_H2(h);
+	t->count++;
+	s = SLOT(t, i);
+	s->hash = h;
+	s->len = len;
+	s->key = k;
+	memset(VALUE(s), 0, t->vsize);
+	if (isnew != NULL)
+		*isnew = 1;
+	return (VALUE(s));
+}
+
+/*
+ * Return the value for key, adding it zeroed if key is not there yet.
+ */
+void *
+htab_insert(struct htab *t, const void *key, size_t len, int *isnew)
+{
+	struct htab_slot *s;
+	uint64_t h;
+
+	h = htab_hash(key, len);
+	if (t->left == 0) {
+		if ((s = htab_lookup(t, key, len, h)) != NULL) {
+			if (isnew != NULL)
+				*isnew = 0;
+			return (VALUE(s));
+		}
+		if (htab_reserve(t, 1) == -1)
+			return (NULL);
+	}
+	return (htab_add(t, key, len, h, isnew));
+}
+
+/*
+ * Insert n keys at once, storing a pointer to the value of each in
+ * values.  Keys are hashed a few at a time and the groups they will be
+ * probed in prefetched before any of them is looked at.
+ */
+int
+htab_insertv(struct htab *t, const struct htab_key *keys, size_t n,
+    void **values)
+{
+	uint64_t h[BATCH];
+	size_t i, j, k;
+
+	if (htab_reserve(t, n) == -1)
+		return (-1);
+	for (i = 0; i < n; i += k) {
+		k = n - i < BATCH ? n - i : BATCH;
+		for (j = 0; j < k; j++) {
+			h[j] = htab_hash(keys[i + j].key, keys[i + j].len);
+			__builtin_prefetch(t->ctrl + ((h[j] >> 7) &
+			    (t->nslots - 1) & ~(size_t)(HT_GROUP - 1)));
+		}
+		for (j = 0; j < k; j++)
+			if ((values[i + j] = htab_add(t, keys[i + j].key,
+			    keys[i + j].len, h[j], NULL)) == NULL)
+				return (-1);
+	}
+	return (0);
+}
+
+int
+htab_remove(struct htab *t, const void *key, size_t len)
+{
+	struct htab_slot *s;
+	size_t i;
+
+	if ((s = htab_lookup(t, key, len, htab_hash(key, len))) == NULL)
+		return (0);
+	i = ((char *)s - t->slots) / t->slotsize;
+	if (ht_erase(t->ctrl, i) == HT_EMPTY)
+		t->left++;
+	t->count--;
+	return (1);
+}
+
+/*
+ * Walk the entries: start with *pos set to 0, and each call returns the
+ * next value, or NULL at the end.
+ */
+void *
+htab_next(struct htab *t, size_t *pos, const char **key, size_t *len)
+{
+	struct htab_slot *s;
+
+	for (; *pos < t->nslots; (*pos)++)
+		if (HT_FULL(t->ctrl[*pos])) {
+			s = SLOT(t, (*pos)++);
+			if (key != NULL)
+				*key = s->key;
+			if (len != NULL)
+				*len = s->len;
+			return (VALUE(s));
+		}
+	return (NULL);
+}
+
+size_t
+htab_count(struct htab *t)
+{
+	return (t->count);
+}
+
+uint64_t
+htab_hash(const void *key, size_t len)
+{
+	const unsigned char *p = key;
+	uint64_t h, w;
+
+	h = 0x9e3779b97f4a7c15ULL ^ len;
+	for (; len >= 8; p += 8, len -= 8) {
+		memcpy(&w, p, 8);
+		h = (h ^ w) * 0xff51afd7ed558ccdULL;
+		h ^= h >> 32;
+	}
+	if (len > 0) {
+		w = 0;
+		memcpy(&w, p, len);
+		h = (h ^ w) * 0xff51afd7ed558ccdULL;
+	}
+	return (ht_mix(h));
+}
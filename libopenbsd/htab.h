@@ -0,0 +1,66 @@
+/*
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef	_HTAB_H_
+#define	_HTAB_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "arena.h"
+
+/*
+ * Hash table from byte string keys to fixed size values.
+ *
+ * Unlike ohash, the table owns both: each key is copied, NUL terminated,
+ * into an arena belonging to the table, and each value of vsize bytes
+ * (aligned for any scalar up to 8 bytes) lives in the slot itself.  A
+ * value pointer stays valid until the next insertion; htab_insertv()
+ * makes room for the whole batch first, so all the pointers it returns
+ * are valid together.  The key of a removed entry is only given back by
+ * htab_free().
+ *
+ * Functions that allocate return NULL or -1 with errno set on failure.
+ */
+
+struct htab_key {
+	const void	*key;
+	size_t		 len;
+};
+
+/* private structure. It's there just so you can do a sizeof */
+struct htab {
+	uint8_t			*ctrl;
+	char			*slots;
+	size_t			 slotsize;
+	size_t			 vsize;
+	size_t			 nslots;
+	size_t			 count;
+	size_t			 left;
+	struct arena		 keys;
+};
+
+void	 htab_init(struct htab *, size_t);
+void	 htab_free(struct htab *);
+int	 htab_reserve(struct htab *, size_t);
+void	*htab_find(struct htab *, const void *, size_t);
+void	*htab_insert(struct htab *, const void *, size_t, int *);
+int	 htab_insertv(struct htab *, const struct htab_key *, size_t,
+	    void **);
+int	 htab_remove(struct htab *, const void *, size_t);
+void	*htab_next(struct htab *, size_t *, const char **, size_t *);
+size_t	 htab_count(struct htab *);
+uint64_t htab_hash(const void *, size_t);
+
+#endif /* !_HTAB_H_ */
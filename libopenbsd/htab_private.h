@@ -0,0 +1,181 @@
+/*
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef	_HTAB_PRIVATE_H_
+#define	_HTAB_PRIVATE_H_
+
+/*
+ * Probing shared by htab.c and ohash.c.
+ *
+ * Next to its slots a table keeps one control byte per slot: HT_EMPTY,
+ * HT_DELETED, or for a full slot the low 7 bits of its hash.  Slots are
+ * probed a group of HT_GROUP at a time, and a group is matched against
+ * those 7 bits with a couple of SSE2 instructions (or a few word
+ * operations without SSE2), so that only the slots whose bits match ever
+ * have their keys compared.  A lookup ends at the first group with an
+ * empty slot.  Groups are visited in triangular order, which reaches
+ * every group of a power of two sized table.
+ *
+ * The hash passed in must be well mixed in all its bits.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define	HT_GROUP	16
+#define	HT_EMPTY	0x80
+#define	HT_DELETED	0xfe
+
+#define	HT_FULL(c)	(((c) & 0x80) == 0)
+#define	HT_H2(h)	((uint8_t)((h) & 0x7f))
+
+/* Most entries a table of n slots holds before it grows: 7/8 full. */
+#define	HT_CAPACITY(n)	((n) - (n) / 8)
+
+struct ht_probe {
+	size_t	g;		/* first slot of the group */
+	size_t	mask;		/* number of slots - 1 */
+	size_t	step;
+};
+
+static inline void
+ht_probe_start(struct ht_probe *p, uint64_t h, size_t nslots)
+{
+	p->mask = nslots - 1;
+	p->g = (size_t)(h >> 7) & p->mask & ~(size_t)(HT_GROUP - 1);
+	p->step = 0;
+}
+
+static inline void
+ht_probe_next(struct ht_probe *p)
+{
+	p->step += HT_GROUP;
+	p->g = (p->g + p->step) & p->mask;
+}
+
+#ifdef __SSE2__
+static inline unsigned int
+ht_match(const uint8_t *g, uint8_t h2)
+{
+	__m128i c = _mm_loadu_si128((const __m128i *)g);
+
+	return (_mm_movemask_epi8(_mm_cmpeq_epi8(c, _mm_set1_epi8(h2))));
+}
+
+static inline unsigned int
+ht_match_empty(const uint8_t *g)
+{
+	__m128i c = _mm_loadu_si128((const __m128i *)g);
+
+	return (_mm_movemask_epi8(_mm_cmpeq_epi8(c,
+	    _mm_set1_epi8((char)HT_EMPTY))));
+}
+
+static inline unsigned int
+ht_match_free(const uint8_t *g)
+{
+	return (_mm_movemask_epi8(_mm_loadu_si128((const __m128i *)g)));
+}
+#else
+#define	HT_LSB	0x0101010101010101ULL
+#define	HT_MSB	0x8080808080808080ULL
+
+/* Gather the top bit of each byte of w into an 8 bit mask. */
+static inline unsigned int
+ht_bits(uint64_t w)
+{
+	return ((((w & HT_MSB) >> 7) * 0x0102040810204080ULL) >> 56);
+}
+
+/* May report a slot that does not match; never misses one that does. */
+static inline unsigned int
+ht_match(const uint8_t *g, uint8_t h2)
+{
+	uint64_t lo, hi;
+
+	memcpy(&lo, g, 8);
+	memcpy(&hi, g + 8, 8);
+	lo ^= HT_LSB * h2;
+	hi ^= HT_LSB * h2;
+	return (ht_bits((lo - HT_LSB) & ~lo) |
+	    ht_bits((hi - HT_LSB) & ~hi) << 8);
+}
+
+static inline unsigned int
+ht_match_empty(const uint8_t *g)
+{
+	uint64_t lo, hi;
+
+	memcpy(&lo, g, 8);
+	memcpy(&hi, g + 8, 8);
+	return (ht_bits(lo & ~(lo << 6)) | ht_bits(hi & ~(hi << 6)) << 8);
+}
+
+static inline unsigned int
+ht_match_free(const uint8_t *g)
+{
+	uint64_t lo, hi;
+
+	memcpy(&lo, g, 8);
+	memcpy(&hi, g + 8, 8);
+	return (ht_bits(lo) | ht_bits(hi) << 8);
+}
+#endif
+
+/*
+ * Return the first empty or deleted slot on the probe sequence for h.
+ */
+static inline size_t
+ht_find_free(const uint8_t *ctrl, size_t nslots, uint64_t h)
+{
+	struct ht_probe p;
+	unsigned int m;
+
+	for (ht_probe_start(&p, h, nslots); ; ht_probe_next(&p))
+		if ((m = ht_match_free(ctrl + p.g)) != 0)
+			return (p.g + __builtin_ctz(m));
+}
+
+/*
+ * Empty slot i.  If its group still has an empty slot no lookup has
+ * ever gone past it and the slot can be made empty again; otherwise it
+ * has to stay a tombstone.  Returns the new control byte.
+ */
+static inline uint8_t
+ht_erase(uint8_t *ctrl, size_t i)
+{
+	uint8_t c;
+
+	c = ht_match_empty(ctrl + (i & ~(size_t)(HT_GROUP - 1))) ?
+	    HT_EMPTY : HT_DELETED;
+	ctrl[i] = c;
+	return (c);
+}
+
+/* Murmur3's 64 bit finalizer, to spread a weak hash over all bits. */
+static inline uint64_t
+ht_mix(uint64_t h)
+{
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+	return (h);
+}
+
+#endif /* !_HTAB_PRIVATE_H_ */
@@ -0,0 +1,213 @@
+/*
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Microbenchmark of htab against ohash, built by "make bench" and not
+ * installed.  For each size, n string keys go into a table of each
+ * kind, and then keys are looked up in random order, about half of them
+ * present.  Each table is used the way its callers use it: ohash hashes
+ * NUL terminated keys with ohash_qlookup(), htab is given the lengths.
+ * Times are in ns per insertion or lookup.
+ *
+ * usage: htbench [-l lookups] [size ...]
+ */
+
+#include <err.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "htab.h"
+#include "ohash.h"
+
+#include "openbsd.h"
+
+#define KEYSIZE		24
+
+struct ent {
+	uint32_t	val;
+	char		key[1];
+};
+
+static void	*oh_calloc(size_t, size_t, void *);
+static void	 oh_free(void *, void *);
+static void	*oh_alloc(size_t, void *);
+static double	 now(void);
+static void	 bench(size_t, size_t);
+static void	 usage(void);
+
+static struct ohash_info info = {
+	offsetof(struct ent, key), NULL, oh_calloc, oh_free, oh_alloc
+};
+
+static void *
+oh_calloc(size_t n, size_t s, void *u)
+{
+	return (calloc(n, s));
+}
+
+static void
+oh_free(void *p, void *u)
+{
+	free(p);
+}
+
+static void *
+oh_alloc(size_t s, void *u)
+{
+	return (malloc(s));
+}
+
+static double
+now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ts.tv_sec * 1e9 + ts.tv_nsec);
+}
+
+static void
+bench(size_t n, size_t nlookup)
+{
+	struct ohash oh;
+	struct htab ht, htv;
+	struct htab_key *hk;
+	struct ent *e;
+	const char *end;
+	char *keys;
+	size_t *len, *idx, i, ohits, hhits;
+	void **vals;
+	double t0, t1, t2, t3, t4, t5;
+	unsigned int slot;
+
+	/* keys 0 to n - 1 go in, n to 2n - 1 are misses */
+	if ((keys = reallocarray(NULL, 2 * n, KEYSIZE)) == NULL ||
+	    (len = reallocarray(NULL, 2 * n, sizeof(*len))) == NULL ||
+	    (idx = reallocarray(NULL, nlookup, sizeof(*idx))) == NULL ||
+	    (hk = reallocarray(NULL, n, sizeof(*hk))) == NULL ||
+	    (vals = reallocarray(NULL, n, sizeof(*vals))) == NULL)
+		err(1, NULL);
+	for (i = 0; i < 2 * n; i++) {
+		len[i] = snprintf(keys + i * KEYSIZE, KEYSIZE, "key%zu.%ld",
+		    i, random());
+		if (i < n) {
+			hk[i].key = keys + i * KEYSIZE;
+			hk[i].len = len[i];
+		}
+	}
+	for (i = 0; i < nlookup; i++)
+		idx[i] = random() % (2 * n);
+
+	ohash_init(&oh, 4, &info);
+	htab_init(&ht, sizeof(uint32_t));
+	htab_init(&htv, sizeof(uint32_t));
+
+	t0 = now();
+	for (i = 0; i < n; i++) {
+		slot = ohash_qlookup(&oh, keys + i * KEYSIZE);
+		end = NULL;
+		e = ohash_create_entry(&info, keys + i * KEYSIZE, &end);
+		e->val = i;
+		ohash_insert(&oh, slot, e);
+	}
+	t1 = now();
+	for (i = 0; i < n; i++) {
+		if ((vals[0] = htab_insert(&ht, hk[i].key, hk[i].len,
+		    NULL)) == NULL)
+			err(1, "htab_insert");
+		*(uint32_t *)vals[0] = i;
+	}
+	t2 = now();
+	if (htab_insertv(&htv, hk, n, vals) == -1)
+		err(1, "htab_insertv");
+	for (i = 0; i < n; i++)
+		*(uint32_t *)vals[i] = i;
+	t3 = now();
+	for (ohits = i = 0; i < nlookup; i++)
+		if (ohash_find(&oh,
+		    ohash_qlookup(&oh, keys + idx[i] * KEYSIZE)) != NULL)
+			ohits++;
+	t4 = now();
+	for (hhits = i = 0; i < nlookup; i++)
+		if (htab_find(&ht, keys + idx[i] * KEYSIZE,
+		    len[idx[i]]) != NULL)
+			hhits++;
+	t5 = now();
+	if (ohits != hhits)
+		errx(1, "%zu keys: ohash found %zu, htab %zu", n, ohits,
+		    hhits);
+
+	printf("%10zu %10.1f %10.1f %10.1f %10.1f %10.1f\n", n,
+	    (t1 - t0) / n, (t2 - t1) / n, (t3 - t2) / n,
+	    (t4 - t3) / nlookup, (t5 - t4) / nlookup);
+
+	for (e = ohash_first(&oh, &slot); e != NULL;
+	    e = ohash_next(&oh, &slot))
+		free(e);
+	ohash_delete(&oh);
+	htab_free(&ht);
+	htab_free(&htv);
+	free(keys);
+	free(len);
+	free(idx);
+	free(hk);
+	free(vals);
+}
+
+int
+main(int argc, char *argv[])
+{
+	static char *dflt[] = { "300", "10000", "1000000", NULL };
+	const char *errstr;
+	size_t nlookup = 10000000, n;
+	int ch;
+
+	while ((ch = getopt(argc, argv, "l:")) != -1)
+		switch (ch) {
+		case 'l':
+			nlookup = strtonum(optarg, 1, INT32_MAX, &errstr);
+			if (errstr != NULL)
+				errx(1, "lookups is %s: %s", errstr, optarg);
+			break;
+		default:
+			usage();
+		}
+	argc -= optind;
+	argv += optind;
+	if (argc == 0)
+		argv = dflt;
+
+	srandom(1);
+	printf("%10s %10s %10s %10s %10s %10s\n", "keys", "ohash ins",
+	    "htab ins", "insertv", "ohash find", "htab find");
+	for (; *argv != NULL; argv++) {
+		n = strtonum(*argv, 1, INT32_MAX, &errstr);
+		if (errstr != NULL)
+			errx(1, "size is %s: %s", errstr, *argv);
+		bench(n, nlookup);
+	}
+	return (0);
+}
+
+static void
+usage(void)
+{
+	fprintf(stderr, "usage: htbench [-l lookups] [size ...]\n");
+	exit(1);
+}
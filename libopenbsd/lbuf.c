@@ -0,0 +1,115 @@
+/*
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "lbuf.h"
+
+#include "openbsd.h"
+
+int
+lbuf_init(struct lbuf *lb, int fd, int delim)
+{
+	memset(lb, 0, sizeof(*lb));
+	if ((lb->buf = malloc(LBUF_BUFSIZE + 1)) == NULL)
+		return (-1);
+	lb->size = LBUF_BUFSIZE;
+	lb->fd = fd;
+	lb->delim = delim;
+	return (0);
+}
+
+void
+lbuf_free(struct lbuf *lb)
+{
+	free(lb->buf);
+	lb->buf = NULL;
+	lb->size = lb->off = lb->len = 0;
+}
+
+/*
+ * Read more input behind what is left of the buffer, moving that to the
+ * front first, or growing the buffer if a single line fills it.
+ */
+static int
+lbuf_fill(struct lbuf *lb)
+{
+	ssize_t n;
+	char *p;
+
+	if (lb->off > 0) {
+		memmove(lb->buf, lb->buf + lb->off, lb->len - lb->off);
+		lb->len -= lb->off;
+		lb->off = 0;
+	}
+	if (lb->len == lb->size) {
+		if (lb->size > (SIZE_MAX - 1) / 2) {
+			errno = ENOMEM;
+			return (-1);
+		}
+		if ((p = realloc(lb->buf, lb->size * 2 + 1)) == NULL)
+			return (-1);
+		lb->buf = p;
+		lb->size *= 2;
+	}
+	while ((n = read(lb->fd, lb->buf + lb->len, lb->size - lb->len)) == -1)
+		if (errno != EINTR)
+			return (-1);
+	if (n == 0)
+		lb->eof = 1;
+	lb->len += n;
+	return (0);
+}
+
+char *
+lbuf_next(struct lbuf *lb, size_t *lenp)
+{
+	char *line, *p;
+	size_t scan;
+
+	scan = lb->off;
+	for (;;) {
+		if ((p = memchr(lb->buf + scan, lb->delim,
+		    lb->len - scan)) != NULL) {
+			line = lb->buf + lb->off;
+			*p = '\0';
+			*lenp = p - line;
+			lb->off = p + 1 - lb->buf;
+			lb->delimited = 1;
+			return (line);
+		}
+		if (lb->error)
+			return (NULL);
+		if (lb->eof) {
+			if (lb->off == lb->len)
+				return (NULL);
+			line = lb->buf + lb->off;
+			*lenp = lb->len - lb->off;
+			line[*lenp] = '\0';
+			lb->off = lb->len;
+			lb->delimited = 0;
+			return (line);
+		}
+		/* Nothing up to the end of the buffer is a delimiter. */
+		scan = lb->len - lb->off;
+		if (lbuf_fill(lb) == -1) {
+			lb->error = 1;
+			return (NULL);
+		}
+	}
+}
@@ -0,0 +1,54 @@
+/*
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef	_LBUF_H_
+#define	_LBUF_H_
+
+#include <stddef.h>
+
+/*
+ * Line reader over a file descriptor.
+ *
+ * Input is read(2) in big blocks and lbuf_next() hands out each line in
+ * place, found with memchr(3).  The delimiter, a newline or any other
+ * byte, is overwritten with a NUL and left out of the length; delimited
+ * tells whether it was there at all, which it is not for a last line
+ * cut short.  Lines may be of any length and hold NULs.  A line stays
+ * valid until the next call on the same reader.
+ *
+ * lbuf_next() returns NULL at the end of the input, and also on a read
+ * error, when error is set and so is errno.  lbuf_init() returns -1
+ * with errno set if it cannot get a buffer.
+ */
+
+/* private structure. It's there just so you can do a sizeof */
+struct lbuf {
+	char	*buf;
+	size_t	 size;		/* of buf, less room for a NUL */
+	size_t	 off;		/* of the next line */
+	size_t	 len;		/* of data in buf */
+	int	 fd;
+	int	 delim;
+	int	 eof;
+	int	 error;
+	int	 delimited;	/* the last line had its delimiter */
+};
+
+#define	LBUF_BUFSIZE	(64 * 1024)
+
+int	 lbuf_init(struct lbuf *, int, int);
+char	*lbuf_next(struct lbuf *, size_t *);
+void	 lbuf_free(struct lbuf *);
+
+#endif /* !_LBUF_H_ */
@@ -21,19 +21,25 @@
 #include <string.h>
 #include <limits.h>
 #include "ohash.h"
+#include "htab_private.h"
 
 #include "openbsd.h"
 
+/*
+ * The table is probed the way htab.c probes its own, through the control
+ * bytes of htab_private.h; what ohash calls a slot index is the index of
+ * a record and of its control byte.  Both live in a single block from
+ * the user's calloc: the records, then the control bytes.
+ */
 struct _ohash_record {
 	uint32_t	hv;
 	const char	*p;
 };
 
-#define DELETED		((const char *)h)
 #define NONE		(h->size)
 
 /* Don't bother changing the hash table if the change is small enough.  */
-#define MINSIZE		(1UL << 4)
+#define MINSIZE		HT_GROUP
 #define MINDELETED	4
 
 static void ohash_resize(struct ohash *);
@@ -65,54 +71,48 @@ ohash_delete(struct ohash *h)
 	(h->info.free)(h->t, h->info.data);
 #ifndef NDEBUG
 	h->t = NULL;
+	h->ctrl = NULL;
 #endif
 }
 
+/* The user's hash functions are cheap and weak: spread them out. */
+static uint64_t
+ohash_mix(uint32_t hv)
+{
+	return ht_mix(hv);
+}
+
+/* Rebuild the table at a size where the live entries fill about half. */
 static void
 ohash_resize(struct ohash *h)
 {
 	struct _ohash_record *n;
+	uint8_t *ctrl;
 	size_t ns;
-	unsigned int	j;
-	unsigned int	i, incr;
-
-	if (4 * h->deleted < h->total) {
-		if (h->size >= (UINT_MAX >> 1U))
-			ns = UINT_MAX;
-		else
-			ns = h->size << 1U;
-	} else if (3 * h->deleted > 2 * h->total)
-		ns = h->size >> 1U;
-	else
-		ns = h->size;
-	if (ns < MINSIZE)
-		ns = MINSIZE;
-#ifdef STATS_HASH
-	STAT_HASH_EXPAND++;
-	STAT_HASH_SIZE += ns - h->size;
-#endif
+	unsigned int	i, j;
+
+	for (ns = MINSIZE; HT_CAPACITY(ns) < 2 * (size_t)h->total &&
+	    ns <= (UINT_MAX >> 1U); ns <<= 1)
+		;
 
-	n = (h->info.calloc)(ns, sizeof(struct _ohash_record), h->info.data);
+	n = (h->info.calloc)(ns, sizeof(struct _ohash_record) + 1,
+	    h->info.data);
 	if (!n)
 		return;
+	ctrl = (uint8_t *)(n + ns);
+	memset(ctrl, HT_EMPTY, ns);
 
 	for (j = 0; j < h->size; j++) {
-		if (h->t[j].p != NULL && h->t[j].p != DELETED) {
-			i = h->t[j].hv % ns;
-			incr = ((h->t[j].hv % (ns - 2)) & ~1) + 1;
-			while (n[i].p != NULL) {
-				i += incr;
-				if (i >= ns)
-					i -= ns;
-			}
-			n[i].hv = h->t[j].hv;
-			n[i].p = h->t[j].p;
+		if (HT_FULL(h->ctrl[j])) {
+			i = ht_find_free(ctrl, ns, ohash_mix(h->t[j].hv));
+			ctrl[i] = h->ctrl[j];
+			n[i] = h->t[j];
 		}
 	}
 	(h->info.free)(h->t, h->info.data);
 	h->t = n;
+	h->ctrl = ctrl;
 	h->size = ns;
-	h->total -= h->deleted;
 	h->deleted = 0;
 }
 
@@ -121,14 +121,12 @@ ohash_remove(struct ohash *h, unsigned int i)
 {
 	void		*result = (void *)h->t[i].p;
 
-	if (result == NULL || result == DELETED)
+	if (!HT_FULL(h->ctrl[i]))
 		return NULL;
 
-#ifdef STATS_HASH
-	STAT_HASH_ENTRIES--;
-#endif
-	h->t[i].p = DELETED;
-	h->deleted++;
+	if (ht_erase(h->ctrl, i) == HT_DELETED)
+		h->deleted++;
+	h->total--;
 	if (h->deleted >= MINDELETED && 4 * h->deleted > h->total)
 		ohash_resize(h);
 	return result;
@@ -137,7 +135,7 @@ ohash_remove(struct ohash *h, unsigned int i)
 void *
 ohash_find(struct ohash *h, unsigned int i)
 {
-	if (h->t[i].p == DELETED)
+	if (!HT_FULL(h->ctrl[i]))
 		return NULL;
 	else
 		return (void *)h->t[i].p;
@@ -146,16 +144,13 @@ ohash_find(struct ohash *h, unsigned int i)
 void *
 ohash_insert(struct ohash *h, unsigned int i, void *p)
 {
-#ifdef STATS_HASH
-	STAT_HASH_ENTRIES++;
-#endif
-	if (h->t[i].p == DELETED) {
-		h->deleted--;
-		h->t[i].p = p;
-	} else {
-		h->t[i].p = p;
-		/* Arbitrary resize boundary.  Tweak if not efficient enough.  */
-		if (++h->total * 4 > h->size * 3)
+	h->t[i].p = p;
+	if (!HT_FULL(h->ctrl[i])) {
+		if (h->ctrl[i] == HT_DELETED)
+			h->deleted--;
+		h->ctrl[i] = HT_H2(ohash_mix(h->t[i].hv));
+		/* Keep an empty slot in every probe sequence.  */
+		if (++h->total + h->deleted > HT_CAPACITY(h->size))
 			ohash_resize(h);
 	}
 	return p;
@@ -164,7 +159,7 @@ ohash_insert(struct ohash *h, unsigned int i, void *p)
 unsigned int
 ohash_entries(struct ohash *h)
 {
-	return h->total - h->deleted;
+	return h->total;
 }
 
 void *
@@ -178,7 +173,7 @@ void *
 ohash_next(struct ohash *h, unsigned int *pos)
 {
 	for (; *pos < h->size; (*pos)++)
-		if (h->t[*pos].p != DELETED && h->t[*pos].p != NULL)
+		if (HT_FULL(h->ctrl[*pos]))
 			return (void *)h->t[(*pos)++].p;
 	return NULL;
 }
@@ -189,18 +184,19 @@ ohash_init(struct ohash *h, unsigned int size, struct ohash_info *info)
 	h->size = 1UL << size;
 	if (h->size < MINSIZE)
 		h->size = MINSIZE;
-#ifdef STATS_HASH
-	STAT_HASH_CREATION++;
-	STAT_HASH_SIZE += h->size;
-#endif
 	/* Copy info so that caller may free it.  */
 	h->info.key_offset = info->key_offset;
 	h->info.calloc = info->calloc;
 	h->info.free = info->free;
 	h->info.alloc = info->alloc;
 	h->info.data = info->data;
-	h->t = (h->info.calloc)(h->size, sizeof(struct _ohash_record),
+	h->t = (h->info.calloc)(h->size, sizeof(struct _ohash_record) + 1,
 		    h->info.data);
+	h->ctrl = NULL;
+	if (h->t != NULL) {
+		h->ctrl = (uint8_t *)(h->t + h->size);
+		memset(h->ctrl, HT_EMPTY, h->size);
+	}
 	h->total = h->deleted = 0;
 }
 
@@ -220,96 +216,67 @@ ohash_interval(const char *s, const char **e)
 	return k;
 }
 
+/* Return the slot holding the key, or else the slot where it would go,
+ * with its hash already stored.  */
 unsigned int
 ohash_lookup_interval(struct ohash *h, const char *start, const char *end,
     uint32_t hv)
 {
-	unsigned int	i, incr;
-	unsigned int	empty;
+	struct ht_probe	pr;
+	const uint8_t	*g;
+	const char	*k;
+	uint64_t	x = ohash_mix(hv);
+	unsigned int	i, m, empty;
 
-#ifdef STATS_HASH
-	STAT_HASH_LOOKUP++;
-#endif
 	empty = NONE;
-	i = hv % h->size;
-	incr = ((hv % (h->size-2)) & ~1) + 1;
-	while (h->t[i].p != NULL) {
-#ifdef STATS_HASH
-		STAT_HASH_LENGTH++;
-#endif
-		if (h->t[i].p == DELETED) {
-			if (empty == NONE)
-				empty = i;
-		} else if (h->t[i].hv == hv &&
-		    strncmp(h->t[i].p+h->info.key_offset, start,
-			end - start) == 0 &&
-		    (h->t[i].p+h->info.key_offset)[end-start] == '\0') {
-			if (empty != NONE) {
-				h->t[empty].hv = hv;
-				h->t[empty].p = h->t[i].p;
-				h->t[i].p = DELETED;
-				return empty;
-			} else {
-#ifdef STATS_HASH
-				STAT_HASH_POSITIVE++;
-#endif
+	for (ht_probe_start(&pr, x, h->size); ; ht_probe_next(&pr)) {
+		g = h->ctrl + pr.g;
+		for (m = ht_match(g, HT_H2(x)); m != 0; m &= m - 1) {
+			i = pr.g + __builtin_ctz(m);
+			k = h->t[i].p + h->info.key_offset;
+			if (h->t[i].hv == hv &&
+			    strncmp(k, start, end - start) == 0 &&
+			    k[end - start] == '\0')
 				return i;
-			}
 		}
-		i += incr;
-		if (i >= h->size)
-			i -= h->size;
+		if (empty == NONE && (m = ht_match_free(g)) != 0)
+			empty = pr.g + __builtin_ctz(m);
+		if (ht_match_empty(g))
+			break;
 	}
 
 	/* Found an empty position.  */
-	if (empty != NONE)
-		i = empty;
-	h->t[i].hv = hv;
-	return i;
+	h->t[empty].hv = hv;
+	return empty;
 }
 
 unsigned int
 ohash_lookup_memory(struct ohash *h, const char *k, size_t size, uint32_t hv)
 {
-	unsigned int	i, incr;
-	unsigned int	empty;
+	struct ht_probe	pr;
+	const uint8_t	*g;
+	uint64_t	x = ohash_mix(hv);
+	unsigned int	i, m, empty;
 
-#ifdef STATS_HASH
-	STAT_HASH_LOOKUP++;
-#endif
 	empty = NONE;
-	i = hv % h->size;
-	incr = ((hv % (h->size-2)) & ~1) + 1;
-	while (h->t[i].p != NULL) {
-#ifdef STATS_HASH
-		STAT_HASH_LENGTH++;
-#endif
-		if (h->t[i].p == DELETED) {
-			if (empty == NONE)
-				empty = i;
-		} else if (h->t[i].hv == hv &&
-		    memcmp(h->t[i].p+h->info.key_offset, k, size) == 0) {
-			if (empty != NONE) {
-				h->t[empty].hv = hv;
-				h->t[empty].p = h->t[i].p;
-				h->t[i].p = DELETED;
-				return empty;
-			} else {
-#ifdef STATS_HASH
-				STAT_HASH_POSITIVE++;
-#endif
-			}	return i;
+	for (ht_probe_start(&pr, x, h->size); ; ht_probe_next(&pr)) {
+		g = h->ctrl + pr.g;
+		for (m = ht_match(g, HT_H2(x)); m != 0; m &= m - 1) {
+			i = pr.g + __builtin_ctz(m);
+			if (h->t[i].hv == hv &&
+			    memcmp(h->t[i].p + h->info.key_offset, k,
+			    size) == 0)
+				return i;
 		}
-		i += incr;
-		if (i >= h->size)
-			i -= h->size;
+		if (empty == NONE && (m = ht_match_free(g)) != 0)
+			empty = pr.g + __builtin_ctz(m);
+		if (ht_match_empty(g))
+			break;
 	}
 
 	/* Found an empty position.  */
-	if (empty != NONE)
-		i = empty;
-	h->t[i].hv = hv;
-	return i;
+	h->t[empty].hv = hv;
+	return empty;
 }
 
 unsigned int
@@ -37,6 +37,7 @@ struct _ohash_record;
 /* private structure. It's there just so you can do a sizeof */
 struct ohash {
 	struct _ohash_record 	*t;
+	uint8_t			*ctrl;
 	struct ohash_info 	info;
 	unsigned int 		size;
 	unsigned int 		total;
@@ -191,6 +191,7 @@ extern FTS	*fts_open(char * const *, int,
 			  int(*)(const FTSENT **, const FTSENT **));
 extern FTSENT	*fts_read(FTS *);
 extern int	 fts_set(FTS *, FTSENT *, int);
+extern int	 fts_statmask(FTS *, unsigned int);
 extern char	*getbsize(int *, long *);
 extern mode_t	 getmode(const void *, mode_t);
 extern int	 getopt(int, char * const *, const char *);
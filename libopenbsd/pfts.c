@@ -0,0 +1,967 @@
+/*
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "fts.h"
+#include "openbsd.h"
+#include "pfts.h"
+
+/*
+ * The unit of work is a directory: one thread opens it, reads it, stats
+ * every entry relative to the directory descriptor, sorts the entries and
+ * hangs them off the directory.  Directories waiting to be read are kept
+ * on a stack, so the threads go depth first like the caller does and the
+ * tree read ahead stays narrow.  Whenever the caller needs a directory
+ * that no thread has started on yet, it reads it itself rather than wait;
+ * with no threads at all that is simply a serial walk.
+ *
+ * In ordered mode every directory found is pushed as soon as its parent
+ * has been read, and pfts_read() walks the tree exactly as fts_read()
+ * does, waiting for a directory only when it gets to it.  In unordered
+ * mode a directory is pushed only once the caller has seen it in preorder
+ * and not skipped it, and its entries are returned as soon as it has
+ * been read.  Either way the threads stop once PFTS_AHEAD entries are
+ * waiting for the caller.
+ */
+
+#define	PFTS_MAXTHR	64		/* most reader threads */
+#define	PFTS_AHEAD	65536		/* most entries read ahead */
+
+#define	ISDOT(a)	(a[0] == '.' && (!a[1] || (a[1] == '.' && !a[2])))
+#define	ISSET(opt)	(sp->options & (opt))
+#define	ISDIR(p)	((p)->fts_info == FTS_D || (p)->fts_info == FTS_DC || \
+			    (p)->fts_info == FTS_DOT)
+
+/*
+ * Special case of "/" at the end of the path so that slashes aren't
+ * appended which would cause paths to be written as "....//foo".
+ */
+#define	NAPPEND(p)							\
+	(p->fts_path[p->fts_pathlen - 1] == '/'				\
+	    ? p->fts_pathlen - 1 : p->fts_pathlen)
+
+/* states of a directory */
+#define	PE_NONE		0		/* not asked for */
+#define	PE_QUEUED	1		/* waiting to be read */
+#define	PE_BUSY		2		/* being read */
+#define	PE_DONE		3		/* read, entries are in kids */
+
+struct pent {
+	struct pent	*qnext;		/* stack of directories to read */
+	struct pent	*qprev;
+	struct pent	*dnext;		/* directories read, unordered mode */
+	FTSENT		*kids;		/* entries read, in order */
+	int		 nkids;
+	int		 state;
+	int		 err;		/* errno from reading the directory */
+	int		 pending;	/* entries the caller still has */
+	dev_t		 rootdev;	/* device of the root, for FTS_XDEV */
+	FTSENT		 ent;		/* last, fts_name runs on */
+};
+
+#define	PE(p)	((struct pent *)((char *)(p) - offsetof(struct pent, ent)))
+
+struct _pfts {
+	int		 options;
+	unsigned int	 statmask;	/* stat fields wanted, 0 for all */
+	int		 (*filter)(FTSENT *);	/* entries to keep, or NULL */
+	int		 (*compar)(const FTSENT **, const FTSENT **);
+	FTSENT		*cur;		/* entry last returned */
+	FTSENT		*rootparent;
+	FTSENT		*ready;		/* to return next, unordered mode */
+	FTSENT		*readytail;
+	int		 njobs;		/* directories not yet taken back */
+	u_int64_t	 myfreed;	/* entries freed by the caller */
+
+	pthread_mutex_t	 mtx;		/* everything below */
+	pthread_cond_t	 work;		/* there is a directory to read */
+	pthread_cond_t	 done;		/* a directory has been read */
+	struct pent	*qhead;
+	struct pent	*dlist;
+	u_int64_t	 nbuilt;	/* entries read */
+	u_int64_t	 nfreed;	/* myfreed, as last seen */
+	int		 nstall;	/* threads waiting for the caller */
+	int		 quit;
+	pthread_t	 thr[PFTS_MAXTHR];
+	int		 nthr;
+};
+
+static FTSENT	*pe_alloc(PFTS *, const char *, size_t, const FTSENT *);
+static void	 pe_free(PFTS *, FTSENT *);
+static unsigned short	 pe_stat(PFTS *, FTSENT *, int, int);
+static FTSENT	*pe_sort(PFTS *, FTSENT *, int);
+static void	 pe_load(FTSENT *);
+static void	 pe_build(PFTS *, FTSENT *);
+static void	 pe_finish(PFTS *, struct pent *);
+static void	 pe_push(PFTS *, struct pent *, struct pent *);
+static void	 pe_unlink(PFTS *, struct pent *);
+static void	 pe_discard(PFTS *, FTSENT *);
+static void	 pe_release(PFTS *, FTSENT *);
+static void	 pfts_sync(PFTS *);
+static int	 pfts_xdev(PFTS *, FTSENT *);
+static void	*pfts_reader(void *);
+static FTSENT	*pfts_read_ordered(PFTS *);
+static FTSENT	*pfts_read_unordered(PFTS *);
+
+PFTS *
+pfts_open(char * const *argv, int options,
+    int (*compar)(const FTSENT **, const FTSENT **), int nthreads)
+{
+	PFTS *sp;
+	FTSENT *p, *root = NULL, *prev, *dummy;
+	sigset_t set, oset;
+	int i, nitems;
+
+	/* Options check. */
+	if (options & ~(FTS_OPTIONMASK | PFTS_ORDERED)) {
+		errno = EINVAL;
+		return (NULL);
+	}
+
+	/* At least one path must be specified. */
+	if (*argv == NULL) {
+		errno = EINVAL;
+		return (NULL);
+	}
+
+	if ((sp = calloc(1, sizeof(PFTS))) == NULL)
+		return (NULL);
+	sp->options = options | FTS_NOCHDIR;
+	sp->compar = compar;
+	pthread_mutex_init(&sp->mtx, NULL);
+	pthread_cond_init(&sp->work, NULL);
+	pthread_cond_init(&sp->done, NULL);
+
+	/* Allocate/initialize root's parent. */
+	if ((sp->rootparent = pe_alloc(sp, "", 0, NULL)) == NULL)
+		goto mem;
+	sp->rootparent->fts_level = FTS_ROOTPARENTLEVEL;
+
+	/* Allocate/initialize root(s), as fts_open() does. */
+	for (root = prev = NULL, nitems = 0; *argv; ++argv, ++nitems) {
+		if ((p = pe_alloc(sp, *argv, strlen(*argv), NULL)) == NULL)
+			goto mem;
+		p->fts_level = FTS_ROOTLEVEL;
+		p->fts_parent = sp->rootparent;
+		p->fts_info = pe_stat(sp, p, ISSET(FTS_COMFOLLOW), -1);
+		PE(p)->rootdev = p->fts_dev;
+
+		/* Command-line "." and ".." are real directories. */
+		if (p->fts_info == FTS_DOT)
+			p->fts_info = FTS_D;
+
+		if (compar) {
+			p->fts_link = root;
+			root = p;
+		} else {
+			p->fts_link = NULL;
+			if (root == NULL)
+				root = p;
+			else
+				prev->fts_link = p;
+			prev = p;
+		}
+	}
+	if (compar && nitems > 1)
+		root = pe_sort(sp, root, nitems);
+
+	if (ISSET(PFTS_ORDERED)) {
+		/*
+		 * Make pfts_read() think it has just finished the node
+		 * before the root(s), and start reading the roots.
+		 */
+		if ((dummy = pe_alloc(sp, "", 0, NULL)) == NULL)
+			goto mem;
+		dummy->fts_link = root;
+		dummy->fts_info = FTS_INIT;
+		sp->cur = dummy;
+		PE(sp->rootparent)->kids = root;
+		pe_finish(sp, PE(sp->rootparent));
+		PE(sp->rootparent)->kids = NULL;
+	} else {
+		sp->ready = root;
+		for (p = root; p->fts_link != NULL; p = p->fts_link)
+			;
+		sp->readytail = p;
+		PE(sp->rootparent)->pending = nitems;
+	}
+
+	if (nthreads < 0)
+		nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (nthreads > PFTS_MAXTHR)
+		nthreads = PFTS_MAXTHR;
+
+	/* signals are for the caller's thread */
+	sigfillset(&set);
+	pthread_sigmask(SIG_BLOCK, &set, &oset);
+	for (i = 0; i < nthreads; i++)
+		if (pthread_create(&sp->thr[i], NULL, pfts_reader, sp) != 0)
+			break;
+	pthread_sigmask(SIG_SETMASK, &oset, NULL);
+	sp->nthr = i;
+	return (sp);
+
+mem:	for (p = root; p != NULL; p = prev) {
+		prev = p->fts_link;
+		free(PE(p));
+	}
+	if (sp->rootparent != NULL)
+		free(PE(sp->rootparent));
+	free(sp);
+	return (NULL);
+}
+
+FTSENT *
+pfts_read(PFTS *sp)
+{
+	FTSENT *p;
+	int instr;
+
+	if ((p = sp->cur) != NULL) {
+		/* Save and zero out user instructions. */
+		instr = p->fts_instr;
+		p->fts_instr = FTS_NOINSTR;
+
+		/* Any type of file may be re-visited; re-stat and re-turn. */
+		if (instr == FTS_AGAIN) {
+			p->fts_info = pe_stat(sp, p, 0, -1);
+			return (p);
+		}
+
+		/* Following a symlink. */
+		if (instr == FTS_FOLLOW &&
+		    (p->fts_info == FTS_SL || p->fts_info == FTS_SLNONE)) {
+			p->fts_info = pe_stat(sp, p, 1, -1);
+			return (p);
+		}
+
+		/* If skipped or crossed mount point, do post-order visit. */
+		if (p->fts_info == FTS_D &&
+		    (instr == FTS_SKIP || pfts_xdev(sp, p))) {
+			pe_discard(sp, p);
+			p->fts_info = FTS_DP;
+			return (p);
+		}
+	}
+	return (ISSET(PFTS_ORDERED) ?
+	    pfts_read_ordered(sp) : pfts_read_unordered(sp));
+}
+
+/*
+ * The rest of fts_read(), for ordered mode: sp->cur is not a directory
+ * that is to be skipped.
+ */
+static FTSENT *
+pfts_read_ordered(PFTS *sp)
+{
+	FTSENT *p, *tmp;
+	struct pent *pe;
+
+	if ((p = sp->cur) == NULL)
+		return (NULL);
+
+	/* Directory in pre-order: read it, or wait for it to be read. */
+	if (p->fts_info == FTS_D) {
+		pe = PE(p);
+		pthread_mutex_lock(&sp->mtx);
+		pfts_sync(sp);
+		if (pe->state == PE_NONE || pe->state == PE_QUEUED) {
+			if (pe->state == PE_QUEUED)
+				pe_unlink(sp, pe);
+			pe->state = PE_BUSY;
+			pthread_mutex_unlock(&sp->mtx);
+			pe_build(sp, p);
+			pthread_mutex_lock(&sp->mtx);
+			pe_finish(sp, pe);
+		} else
+			while (pe->state != PE_DONE)
+				pthread_cond_wait(&sp->done, &sp->mtx);
+		pthread_mutex_unlock(&sp->mtx);
+
+		if (pe->err) {
+			p->fts_info = FTS_DNR;
+			p->fts_errno = pe->err;
+			return (p);
+		}
+		if (pe->kids == NULL) {
+			p->fts_info = FTS_DP;
+			return (p);
+		}
+		p = pe->kids;
+		pe->kids = NULL;
+		return (sp->cur = p);
+	}
+
+	/* Move to the next node on this level. */
+next:	tmp = p;
+	if ((p = p->fts_link) != NULL) {
+		pe_release(sp, tmp);
+
+		if (p->fts_level == FTS_ROOTLEVEL) {
+			pe_load(p);
+			return (sp->cur = p);
+		}
+
+		/*
+		 * User may have called pfts_set on the node.  If skipped,
+		 * ignore.
+		 */
+		if (p->fts_instr == FTS_SKIP) {
+			pe_discard(sp, p);
+			goto next;
+		}
+		if (p->fts_instr == FTS_FOLLOW) {
+			p->fts_info = pe_stat(sp, p, 1, -1);
+			p->fts_instr = FTS_NOINSTR;
+		}
+		return (sp->cur = p);
+	}
+
+	/* Move up to the parent node. */
+	p = tmp->fts_parent;
+	pe_release(sp, tmp);
+
+	if (p->fts_level == FTS_ROOTPARENTLEVEL) {
+		/*
+		 * Done; free everything up and set errno to 0 so the user
+		 * can distinguish between error and EOF.
+		 */
+		pe_free(sp, p);
+		sp->rootparent = NULL;
+		errno = 0;
+		return (sp->cur = NULL);
+	}
+	p->fts_info = p->fts_errno ? FTS_ERR : FTS_DP;
+	return (sp->cur = p);
+}
+
+/*
+ * The rest of pfts_read() for unordered mode: give the directory last
+ * returned to the threads, or finish with whatever else it was, then
+ * return the next entry ready.
+ */
+static FTSENT *
+pfts_read_unordered(PFTS *sp)
+{
+	FTSENT *p, *tail;
+	struct pent *pe, *dl;
+
+	if ((p = sp->cur) != NULL) {
+		sp->cur = NULL;
+		if (p->fts_info == FTS_D) {
+			pthread_mutex_lock(&sp->mtx);
+			pe_push(sp, PE(p), PE(p));
+			pthread_cond_signal(&sp->work);
+			pthread_mutex_unlock(&sp->mtx);
+			sp->njobs++;
+		} else
+			pe_release(sp, p);
+	}
+
+	while (sp->ready == NULL) {
+		if (sp->njobs == 0) {
+			if (sp->rootparent != NULL) {
+				pe_free(sp, sp->rootparent);
+				sp->rootparent = NULL;
+			}
+			errno = 0;
+			return (NULL);
+		}
+
+		/*
+		 * Take back the directories that have been read, reading
+		 * one here if there are none yet.
+		 */
+		pthread_mutex_lock(&sp->mtx);
+		pfts_sync(sp);
+		while (sp->dlist == NULL) {
+			if ((pe = sp->qhead) != NULL) {
+				pe_unlink(sp, pe);
+				pe->state = PE_BUSY;
+				pthread_mutex_unlock(&sp->mtx);
+				pe_build(sp, &pe->ent);
+				pthread_mutex_lock(&sp->mtx);
+				pe_finish(sp, pe);
+			} else
+				pthread_cond_wait(&sp->done, &sp->mtx);
+		}
+		dl = sp->dlist;
+		sp->dlist = NULL;
+		pthread_mutex_unlock(&sp->mtx);
+
+		for (; dl != NULL; dl = dl->dnext) {
+			sp->njobs--;
+			p = &dl->ent;
+			if (dl->err) {
+				p->fts_info = FTS_DNR;
+				p->fts_errno = dl->err;
+				tail = p;
+			} else if (dl->kids == NULL) {
+				p->fts_info = FTS_DP;
+				tail = p;
+			} else {
+				p = dl->kids;
+				dl->pending = dl->nkids;
+				dl->kids = NULL;
+				for (tail = p; tail->fts_link != NULL;
+				    tail = tail->fts_link)
+					;
+			}
+			if (sp->ready == NULL)
+				sp->ready = p;
+			else
+				sp->readytail->fts_link = p;
+			sp->readytail = tail;
+			tail->fts_link = NULL;
+		}
+	}
+
+	p = sp->ready;
+	if ((sp->ready = p->fts_link) == NULL)
+		sp->readytail = NULL;
+	p->fts_link = NULL;
+	if (p->fts_level == FTS_ROOTLEVEL)
+		pe_load(p);
+	return (sp->cur = p);
+}
+
+/*
+ * As fts_statmask(): from now on, gather only the stat fields in mask.
+ * Directories the threads have already read keep what they have.
+ */
+int
+pfts_statmask(PFTS *sp, unsigned int mask)
+{
+	if (mask & ~FTS_ST_ALL) {
+		errno = EINVAL;
+		return (1);
+	}
+	sp->statmask = mask;
+	return (0);
+}
+
+/*
+ * From now on, have the threads call filter on every file that is not a
+ * directory as they read it, and drop it unless filter returns non-zero.
+ * Directories read before this are not filtered.
+ */
+int
+pfts_filter(PFTS *sp, int (*filter)(FTSENT *))
+{
+	pthread_mutex_lock(&sp->mtx);
+	sp->filter = filter;
+	pthread_mutex_unlock(&sp->mtx);
+	return (0);
+}
+
+/*
+ * Fts_set takes the stream as an argument although it's not used in this
+ * implementation; it would be necessary if anyone wanted to add global
+ * semantics to fts using fts_set.  An error return is allowed for similar
+ * reasons.
+ */
+int
+pfts_set(PFTS *sp, FTSENT *p, int instr)
+{
+	if (instr && instr != FTS_AGAIN && instr != FTS_FOLLOW &&
+	    instr != FTS_NOINSTR && instr != FTS_SKIP) {
+		errno = EINVAL;
+		return (1);
+	}
+	p->fts_instr = instr;
+	return (0);
+}
+
+int
+pfts_close(PFTS *sp)
+{
+	FTSENT *p;
+	struct pent *pe;
+	int i;
+
+	pthread_mutex_lock(&sp->mtx);
+	sp->quit = 1;
+	pthread_cond_broadcast(&sp->work);
+	pthread_mutex_unlock(&sp->mtx);
+	for (i = 0; i < sp->nthr; i++)
+		pthread_join(sp->thr[i], NULL);
+	sp->nthr = 0;
+
+	/*
+	 * Walk what is left, skipping every directory so nothing more gets
+	 * read.  Directories still waiting are taken as empty.
+	 */
+	if (!ISSET(PFTS_ORDERED))
+		while ((pe = sp->qhead) != NULL) {
+			pe_unlink(sp, pe);
+			pe->state = PE_DONE;
+			pe->dnext = sp->dlist;
+			sp->dlist = pe;
+		}
+	if ((p = sp->cur) != NULL)
+		p->fts_instr = p->fts_info == FTS_D ? FTS_SKIP : FTS_NOINSTR;
+	while ((p = pfts_read(sp)) != NULL)
+		if (p->fts_info == FTS_D)
+			p->fts_instr = FTS_SKIP;
+
+	pthread_mutex_destroy(&sp->mtx);
+	pthread_cond_destroy(&sp->work);
+	pthread_cond_destroy(&sp->done);
+	free(sp);
+	return (0);
+}
+
+/*
+ * Reader thread: read directories off the stack until told to quit,
+ * taking a break whenever the caller has too much to get through.
+ */
+static void *
+pfts_reader(void *arg)
+{
+	PFTS *sp = arg;
+	struct pent *pe;
+
+	pthread_mutex_lock(&sp->mtx);
+	for (;;) {
+		if (sp->quit)
+			break;
+		if (sp->qhead == NULL) {
+			pthread_cond_wait(&sp->work, &sp->mtx);
+			continue;
+		}
+		if (sp->nbuilt - sp->nfreed > PFTS_AHEAD) {
+			sp->nstall++;
+			pthread_cond_wait(&sp->work, &sp->mtx);
+			sp->nstall--;
+			continue;
+		}
+		pe = sp->qhead;
+		pe_unlink(sp, pe);
+		pe->state = PE_BUSY;
+		pthread_mutex_unlock(&sp->mtx);
+
+		pe_build(sp, &pe->ent);
+
+		pthread_mutex_lock(&sp->mtx);
+		pe_finish(sp, pe);
+	}
+	pthread_mutex_unlock(&sp->mtx);
+	return (NULL);
+}
+
+/*
+ * Tell the threads how far the caller has got.  Called with sp->mtx held.
+ */
+static void
+pfts_sync(PFTS *sp)
+{
+	sp->nfreed = sp->myfreed;
+	if (sp->nstall > 0 && sp->nbuilt - sp->nfreed <= PFTS_AHEAD)
+		pthread_cond_broadcast(&sp->work);
+}
+
+/*
+ * Is p a directory on another device than its root, with FTS_XDEV?
+ */
+static int
+pfts_xdev(PFTS *sp, FTSENT *p)
+{
+	return (ISSET(FTS_XDEV) && p->fts_dev != PE(p)->rootdev);
+}
+
+/*
+ * Read the directory cur: allocate and stat an entry for everything in
+ * it, and sort them.  Safe to run on any thread; only cur's own pent is
+ * written.
+ */
+static void
+pe_build(PFTS *sp, FTSENT *cur)
+{
+	struct pent *pe = PE(cur);
+	struct dirent *dp;
+	FTSENT *p, *head, *tail;
+	DIR *dirp;
+	int dfd, level, nitems;
+
+	if ((dfd = open(cur->fts_accpath,
+	    O_RDONLY | O_DIRECTORY | O_CLOEXEC)) == -1) {
+		pe->err = errno;
+		return;
+	}
+	if ((dirp = fdopendir(dfd)) == NULL) {
+		pe->err = errno;
+		(void)close(dfd);
+		return;
+	}
+
+	/*
+	 * fts_level is signed so we must prevent it from wrapping
+	 * around to FTS_ROOTLEVEL and FTS_ROOTPARENTLEVEL.
+	 */
+	level = cur->fts_level;
+	if (level < FTS_MAXLEVEL)
+		level++;
+
+	/* Read the directory, attaching each entry to the `link' pointer. */
+	for (head = tail = NULL, nitems = 0; (dp = readdir(dirp));) {
+		if (!ISSET(FTS_SEEDOT) && ISDOT(dp->d_name))
+			continue;
+
+		if ((p = pe_alloc(sp, dp->d_name, strlen(dp->d_name),
+		    cur)) == NULL) {
+			pe->err = errno;
+			while ((p = head) != NULL) {
+				head = head->fts_link;
+				free(PE(p));
+			}
+			(void)closedir(dirp);
+			return;
+		}
+		p->fts_level = level;
+		p->fts_parent = cur;
+		PE(p)->rootdev = pe->rootdev;
+
+		/*
+		 * With FTS_NOSTAT, only stat what might be a directory; if
+		 * only the type is wanted, take it from d_type if there.
+		 */
+		if (ISSET(FTS_NOSTAT) && ISSET(FTS_PHYSICAL) &&
+		    dp->d_type != DT_DIR && dp->d_type != DT_UNKNOWN)
+			p->fts_info = FTS_NSOK;
+		else if ((p->fts_info = fts_dtype(sp->statmask, sp->options,
+		    dp->d_type, p->fts_statp)) == 0)
+			p->fts_info = pe_stat(sp, p, 0, dfd);
+
+		if (sp->filter != NULL && !ISDIR(p) && !sp->filter(p)) {
+			free(PE(p));
+			continue;
+		}
+
+		/* We walk in directory order so "ls -f" doesn't get upset. */
+		if (head == NULL)
+			head = tail = p;
+		else {
+			tail->fts_link = p;
+			tail = p;
+		}
+		++nitems;
+	}
+	(void)closedir(dirp);
+
+	if (sp->compar && nitems > 1)
+		head = pe_sort(sp, head, nitems);
+	pe->kids = head;
+	pe->nkids = nitems;
+}
+
+/*
+ * A directory has been read.  In ordered mode, push the directories in
+ * it in order, so the first is read next; in unordered mode hand it
+ * back to the caller.  Called with sp->mtx held.
+ */
+static void
+pe_finish(PFTS *sp, struct pent *pe)
+{
+	struct pent *first = NULL, *last = NULL, *kp;
+	FTSENT *p;
+
+	pe->state = PE_DONE;
+	sp->nbuilt += pe->nkids;
+	if (ISSET(PFTS_ORDERED)) {
+		for (p = pe->kids; p != NULL; p = p->fts_link) {
+			if (p->fts_info != FTS_D || pfts_xdev(sp, p))
+				continue;
+			kp = PE(p);
+			kp->qprev = last;
+			kp->qnext = NULL;
+			if (last == NULL)
+				first = kp;
+			else
+				last->qnext = kp;
+			last = kp;
+		}
+		if (first != NULL) {
+			pe_push(sp, first, last);
+			pthread_cond_broadcast(&sp->work);
+		}
+	} else {
+		pe->dnext = sp->dlist;
+		sp->dlist = pe;
+	}
+	pthread_cond_broadcast(&sp->done);
+}
+
+/*
+ * Push the chain of directories first..last onto the stack, first on top.
+ * Called with sp->mtx held.
+ */
+static void
+pe_push(PFTS *sp, struct pent *first, struct pent *last)
+{
+	struct pent *pe;
+
+	for (pe = first;; pe = pe->qnext) {
+		pe->state = PE_QUEUED;
+		if (pe == last)
+			break;
+	}
+	first->qprev = NULL;
+	last->qnext = sp->qhead;
+	if (sp->qhead != NULL)
+		sp->qhead->qprev = last;
+	sp->qhead = first;
+}
+
+/*
+ * Take a directory off the stack.  Called with sp->mtx held.
+ */
+static void
+pe_unlink(PFTS *sp, struct pent *pe)
+{
+	if (pe->qprev != NULL)
+		pe->qprev->qnext = pe->qnext;
+	else
+		sp->qhead = pe->qnext;
+	if (pe->qnext != NULL)
+		pe->qnext->qprev = pe->qprev;
+	pe->qnext = pe->qprev = NULL;
+}
+
+/*
+ * Throw away whatever has been read ahead under p, which the caller is
+ * not going to descend into after all.
+ */
+static void
+pe_discard(PFTS *sp, FTSENT *p)
+{
+	struct pent *pe = PE(p);
+	FTSENT *kid, *next;
+
+	if (pe->state == PE_NONE)
+		return;
+	pthread_mutex_lock(&sp->mtx);
+	if (pe->state == PE_QUEUED)
+		pe_unlink(sp, pe);
+	else
+		while (pe->state == PE_BUSY)
+			pthread_cond_wait(&sp->done, &sp->mtx);
+	pe->state = PE_NONE;
+	pthread_mutex_unlock(&sp->mtx);
+
+	for (kid = pe->kids; kid != NULL; kid = next) {
+		next = kid->fts_link;
+		pe_discard(sp, kid);
+		pe_free(sp, kid);
+	}
+	pe->kids = NULL;
+}
+
+/*
+ * The caller is done with p.  In unordered mode, once it is done with
+ * everything in a directory, that directory is due in postorder.
+ */
+static void
+pe_release(PFTS *sp, FTSENT *p)
+{
+	FTSENT *parent = p->fts_parent;
+
+	pe_discard(sp, p);
+	pe_free(sp, p);
+	if (ISSET(PFTS_ORDERED) || parent == NULL ||
+	    parent->fts_level == FTS_ROOTPARENTLEVEL ||
+	    --PE(parent)->pending > 0)
+		return;
+	parent->fts_info = parent->fts_errno ? FTS_ERR : FTS_DP;
+	parent->fts_link = NULL;
+	if (sp->ready == NULL)
+		sp->ready = parent;
+	else
+		sp->readytail->fts_link = parent;
+	sp->readytail = parent;
+}
+
+/*
+ * Allocate an entry for name in the directory parent, or for the root
+ * path name if parent is NULL.  The file name, path and stat structure
+ * all live in the one chunk.
+ */
+static FTSENT *
+pe_alloc(PFTS *sp, const char *name, size_t namelen, const FTSENT *parent)
+{
+	struct pent *pe;
+	FTSENT *p;
+	size_t len, plen, pathlen;
+
+	plen = parent != NULL ? NAPPEND(parent) : 0;
+	pathlen = parent != NULL ? plen + 1 + namelen : namelen;
+	len = sizeof(struct pent) + namelen + pathlen + 1;
+	if (!ISSET(FTS_NOSTAT))
+		len += sizeof(struct stat) + ALIGNBYTES;
+	if ((pe = calloc(1, len)) == NULL)
+		return (NULL);
+	p = &pe->ent;
+	p->fts_path = p->fts_name + namelen + 1;
+	if (parent != NULL) {
+		memcpy(p->fts_path, parent->fts_path, plen);
+		p->fts_path[plen] = '/';
+		memcpy(p->fts_path + plen + 1, name, namelen);
+	} else
+		memcpy(p->fts_path, name, namelen);
+	p->fts_pathlen = pathlen;
+	p->fts_accpath = p->fts_path;
+	p->fts_instr = FTS_NOINSTR;
+	if (!ISSET(FTS_NOSTAT))
+		p->fts_statp = (struct stat *)ALIGN(p->fts_path + pathlen + 1);
+	memcpy(p->fts_name, name, namelen);
+	p->fts_namelen = namelen;
+	return (p);
+}
+
+/*
+ * As fts_load(): a root is sorted on the path as given, and named after
+ * its last component only once it is returned.
+ */
+static void
+pe_load(FTSENT *p)
+{
+	char *cp;
+	size_t len;
+
+	if ((cp = strrchr(p->fts_name, '/')) != NULL &&
+	    (cp != p->fts_name || cp[1])) {
+		len = strlen(++cp);
+		memmove(p->fts_name, cp, len + 1);
+		p->fts_namelen = len;
+	}
+}
+
+static void
+pe_free(PFTS *sp, FTSENT *p)
+{
+	if (p->fts_level > FTS_ROOTLEVEL)
+		sp->myfreed++;
+	free(PE(p));
+}
+
+/*
+ * As fts_stat(), with the path relative to dfd if it is not -1.
+ */
+static unsigned short
+pe_stat(PFTS *sp, FTSENT *p, int follow, int dfd)
+{
+	FTSENT *t;
+	dev_t dev;
+	ino_t ino;
+	struct stat *sbp, sb;
+	int saved_errno;
+	const char *path;
+
+	if (dfd == -1) {
+		path = p->fts_accpath;
+		dfd = AT_FDCWD;
+	} else
+		path = p->fts_name;
+
+	/* If user needs stat info, stat buffer already allocated. */
+	sbp = ISSET(FTS_NOSTAT) ? &sb : p->fts_statp;
+
+	/*
+	 * If doing a logical walk, or application requested FTS_FOLLOW, do
+	 * a stat(2).  If that fails, check for a non-existent symlink.  If
+	 * fail, set the errno from the stat call.
+	 */
+	if (ISSET(FTS_LOGICAL) || follow) {
+		if (fts_fstatat(sp->statmask, dfd, path, sbp, 0)) {
+			saved_errno = errno;
+			if (!fts_fstatat(sp->statmask, dfd, path, sbp,
+			    AT_SYMLINK_NOFOLLOW)) {
+				errno = 0;
+				return (FTS_SLNONE);
+			}
+			p->fts_errno = saved_errno;
+			goto err;
+		}
+	} else if (fts_fstatat(sp->statmask, dfd, path, sbp,
+	    AT_SYMLINK_NOFOLLOW)) {
+		p->fts_errno = errno;
+err:		memset(sbp, 0, sizeof(struct stat));
+		return (FTS_NS);
+	}
+
+	if (S_ISDIR(sbp->st_mode)) {
+		/*
+		 * Set the device/inode.  Used to find cycles and check for
+		 * crossing mount points.
+		 */
+		dev = p->fts_dev = sbp->st_dev;
+		ino = p->fts_ino = sbp->st_ino;
+		p->fts_nlink = sbp->st_nlink;
+
+		if (ISDOT(p->fts_name))
+			return (FTS_DOT);
+
+		/*
+		 * Cycle detection is done by brute force when the directory
+		 * is first encountered.  The ancestors of an entry are not
+		 * freed before it is, so this is safe on any thread.
+		 */
+		for (t = p->fts_parent;
+		    t->fts_level >= FTS_ROOTLEVEL; t = t->fts_parent)
+			if (ino == t->fts_ino && dev == t->fts_dev) {
+				p->fts_cycle = t;
+				return (FTS_DC);
+			}
+		return (FTS_D);
+	}
+	if (S_ISLNK(sbp->st_mode))
+		return (FTS_SL);
+	if (S_ISREG(sbp->st_mode))
+		return (FTS_F);
+	return (FTS_DEFAULT);
+}
+
+/*
+ * Sort a list of nitems entries with the caller's comparison function.
+ * If unable to sort for memory reasons, return them in their current
+ * order.
+ */
+static FTSENT *
+pe_sort(PFTS *sp, FTSENT *head, int nitems)
+{
+	FTSENT **a, **ap, *p;
+
+	if ((a = reallocarray(NULL, nitems, sizeof(FTSENT *))) == NULL)
+		return (head);
+	for (ap = a, p = head; p; p = p->fts_link)
+		*ap++ = p;
+	qsort(a, nitems, sizeof(FTSENT *),
+	    (int (*)(const void *, const void *))sp->compar);
+	for (head = *(ap = a); --nitems; ++ap)
+		ap[0]->fts_link = ap[1];
+	ap[0]->fts_link = NULL;
+	free(a);
+	return (head);
+}
@@ -0,0 +1,46 @@
+/*
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef	_PFTS_H_
+#define	_PFTS_H_
+
+#include <fts.h>
+
+/*
+ * Parallel file tree walk.  Directories are read, and their entries
+ * stat(2)ed, on a pool of threads, and the caller gets FTSENTs back one at
+ * a time much as from fts_read(3).  The walk never changes directory
+ * (FTS_NOCHDIR is implied), so fts_accpath is always fts_path.
+ *
+ * With PFTS_ORDERED entries come back in exactly the order fts_read()
+ * would return them, the threads reading ahead of the caller.  Without
+ * it they come back as soon as they have been read: a directory is still
+ * returned in preorder before anything in it and in postorder after
+ * everything in it, but siblings and subtrees are interleaved.
+ * FTS_SKIP, FTS_AGAIN and FTS_FOLLOW work in both modes.  Any comparison
+ * or filter function is called from the reader threads.
+ */
+#define	PFTS_ORDERED	0x10000		/* return entries in fts_read() order */
+
+typedef struct _pfts PFTS;
+
+PFTS	*pfts_open(char * const *, int,
+	    int (*)(const FTSENT **, const FTSENT **), int);
+FTSENT	*pfts_read(PFTS *);
+int	 pfts_filter(PFTS *, int (*)(FTSENT *));
+int	 pfts_set(PFTS *, FTSENT *, int);
+int	 pfts_statmask(PFTS *, unsigned int);
+int	 pfts_close(PFTS *);
+
+#endif /* !_PFTS_H_ */
@@ -7,6 +7,8 @@
 #define ZLIB_INTERNAL
 #include "zlib.h"
 
+#define local static
+
 #define BASE 65521UL    /* largest prime smaller than 65536 */
 #define NMAX 5552
 /* NMAX is the largest n such that 255n(n+1)/2 + (n+1)(BASE-1) <= 2^32-1 */
@@ -17,6 +19,17 @@
 #define DO8(buf,i)  DO4(buf,i); DO4(buf,i+4);
 #define DO16(buf)   DO8(buf,0); DO8(buf,8);
 
+/*
+ * On x86-64 with SSSE3, sum 32 bytes per step: psadbw adds the bytes for
+ * the first sum, and pmaddubsw weights them by their distance from the end
+ * of the step for the second.
+ */
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(NO_SIMD)
+#  define SSSE3
+#  include <immintrin.h>
+local uLong adler32_ssse3 OF((uLong adler, const Bytef *buf, uInt len));
+#endif /* __x86_64__ */
+
 /* use NO_DIVIDE if your processor does not do division in hardware */
 #ifdef NO_DIVIDE
 #  define MOD(a) \
@@ -92,6 +105,11 @@ uLong ZEXPORT adler32(adler, buf, len)
         return adler | (sum2 << 16);
     }
 
+#ifdef SSSE3
+    if (len >= 64 && __builtin_cpu_supports("ssse3"))
+        return adler32_ssse3(adler | (sum2 << 16), buf, len);
+#endif /* SSSE3 */
+
     /* do length NMAX blocks -- requires just one modulo operation */
     while (len >= NMAX) {
         len -= NMAX;
@@ -123,6 +141,74 @@ uLong ZEXPORT adler32(adler, buf, len)
     return adler | (sum2 << 16);
 }
 
+#ifdef SSSE3
+/* ========================================================================= */
+__attribute__((__target__("ssse3")))
+local uLong adler32_ssse3(adler, buf, len)
+    uLong adler;
+    const Bytef *buf;
+    uInt len;
+{
+    unsigned long sum1 = adler & 0xffff;
+    unsigned long sum2 = (adler >> 16) & 0xffff;
+    unsigned blocks = len / 32, n;
+    const __m128i tap1 = _mm_setr_epi8(32, 31, 30, 29, 28, 27, 26, 25,
+                                       24, 23, 22, 21, 20, 19, 18, 17);
+    const __m128i tap2 = _mm_setr_epi8(16, 15, 14, 13, 12, 11, 10, 9,
+                                       8, 7, 6, 5, 4, 3, 2, 1);
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i ones = _mm_set1_epi16(1);
+    __m128i v_ps, v_s1, v_s2, bytes1, bytes2;
+
+    len -= blocks * 32;
+    while (blocks) {
+        /* NMAX bounds the steps between modulo operations */
+        n = NMAX / 32;
+        if (n > blocks)
+            n = blocks;
+        blocks -= n;
+
+        v_ps = _mm_set_epi32(0, 0, 0, (int)(sum1 * n));
+        v_s2 = _mm_set_epi32(0, 0, 0, (int)sum2);
+        v_s1 = _mm_setzero_si128();
+        do {
+            bytes1 = _mm_loadu_si128((const __m128i *)buf);
+            bytes2 = _mm_loadu_si128((const __m128i *)(buf + 16));
+            v_ps = _mm_add_epi32(v_ps, v_s1);
+            v_s1 = _mm_add_epi32(v_s1, _mm_sad_epu8(bytes1, zero));
+            v_s2 = _mm_add_epi32(v_s2,
+                _mm_madd_epi16(_mm_maddubs_epi16(bytes1, tap1), ones));
+            v_s1 = _mm_add_epi32(v_s1, _mm_sad_epu8(bytes2, zero));
+            v_s2 = _mm_add_epi32(v_s2,
+                _mm_madd_epi16(_mm_maddubs_epi16(bytes2, tap2), ones));
+            buf += 32;
+        } while (--n);
+        v_s2 = _mm_add_epi32(v_s2, _mm_slli_epi32(v_ps, 5));
+
+        /* add up the lanes */
+        v_s1 = _mm_add_epi32(v_s1,
+            _mm_shuffle_epi32(v_s1, _MM_SHUFFLE(1, 0, 3, 2)));
+        sum1 += (unsigned)_mm_cvtsi128_si32(v_s1);
+        v_s2 = _mm_add_epi32(v_s2,
+            _mm_shuffle_epi32(v_s2, _MM_SHUFFLE(2, 3, 0, 1)));
+        v_s2 = _mm_add_epi32(v_s2,
+            _mm_shuffle_epi32(v_s2, _MM_SHUFFLE(1, 0, 3, 2)));
+        sum2 = (unsigned)_mm_cvtsi128_si32(v_s2);
+        MOD(sum1);
+        MOD(sum2);
+    }
+
+    /* less than 32 bytes left */
+    while (len--) {
+        sum1 += *buf++;
+        sum2 += sum1;
+    }
+    MOD(sum1);
+    MOD(sum2);
+    return sum1 | (sum2 << 16);
+}
+#endif /* SSSE3 */
+
 /* ========================================================================= */
 uLong ZEXPORT adler32_combine(adler1, adler2, len2)
     uLong adler1;
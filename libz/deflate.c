@@ -91,6 +91,17 @@ local uInt longest_match  OF((deflate_state *s, IPos cur_match));
 #endif
 local uInt longest_match_fast OF((deflate_state *s, IPos cur_match));
 
+/* longest_match() can compare eight bytes at a time on little-endian
+ * machines, where the first difference is the lowest set bit.  NO_SIMD
+ * builds the original byte loop, as it does the original crc32 and adler32.
+ */
+#if defined(__GNUC__) && defined(__BYTE_ORDER__) && !defined(UNALIGNED_OK) && \
+    !defined(NO_SIMD)
+#  if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#    define WORD_MATCH
+#  endif
+#endif
+
 #ifdef DEBUG
 local  void check_match OF((deflate_state *s, IPos start, IPos match,
                             int length));
@@ -1130,6 +1141,29 @@ local uInt longest_match(s, cur_match)
         scan += 2, match++;
         Assert(*scan == *match, "match[2]?");
 
+#ifdef WORD_MATCH
+        /* Compare 8 bytes at a time from strstart+3; the lowest set bit
+         * of the difference gives the first byte that does not match.
+         * This finds the same length as the loop below.
+         */
+        scan++, match++;
+        for (;;) {
+            unsigned long long a, b;
+
+            if (scan + 8 > strend) {
+                while (scan < strend && *scan == *match)
+                    scan++, match++;
+                break;
+            }
+            __builtin_memcpy(&a, scan, 8);
+            __builtin_memcpy(&b, match, 8);
+            if (a != b) {
+                scan += __builtin_ctzll(a ^ b) >> 3;
+                break;
+            }
+            scan += 8, match += 8;
+        }
+#else
         /* We check for insufficient lookahead only every 8th comparison;
          * the 256th check will be made at strstart+258.
          */
@@ -1139,6 +1173,7 @@ local uInt longest_match(s, cur_match)
                  *++scan == *++match && *++scan == *++match &&
                  *++scan == *++match && *++scan == *++match &&
                  scan < strend);
+#endif /* WORD_MATCH */
 
         Assert(scan <= s->window+(unsigned)(s->window_size-1), "wild scan");
 
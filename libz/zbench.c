@@ -0,0 +1,203 @@
+/*
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Throughput of crc32, adler32, deflate and inflate, built by "make
+ * bench" twice: zbench against this library, and zbench.ref against the
+ * same sources built with NO_SIMD, which leaves out the vector checksums,
+ * the word at a time match compare and the wide inflate refill.  Run
+ * both on the same input; the check values they print must be the same,
+ * only the speeds may differ.
+ *
+ * The input is the files named, or else 20MB made up of half text-like
+ * data and half random bytes.
+ *
+ * usage: zbench [file ...]
+ */
+
+#include <sys/stat.h>
+
+#include <err.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "zlib.h"
+
+#define DFLTSIZE	(20 * 1024 * 1024)
+#define MINTIME		0.5		/* seconds to repeat each test for */
+
+static unsigned char	*in, *out, *back;
+static size_t		 inlen, outsize;
+
+static double	 now(void);
+static void	 load(char **);
+static void	 synth(void);
+static void	 report(const char *, double, int, const char *);
+static void	 checksums(void);
+static void	 codec(int);
+
+static double
+now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ts.tv_sec + ts.tv_nsec / 1e9);
+}
+
+static void
+load(char **files)
+{
+	struct stat sb;
+	ssize_t n;
+	size_t off;
+	int fd;
+
+	for (; *files != NULL; files++) {
+		if ((fd = open(*files, O_RDONLY)) == -1 ||
+		    fstat(fd, &sb) == -1)
+			err(1, "%s", *files);
+		if ((in = realloc(in, inlen + sb.st_size)) == NULL)
+			err(1, NULL);
+		for (off = 0; off < (size_t)sb.st_size; off += n)
+			if ((n = read(fd, in + inlen + off,
+			    sb.st_size - off)) <= 0)
+				err(1, "%s", *files);
+		inlen += sb.st_size;
+		close(fd);
+	}
+}
+
+/*
+ * Words from a small vocabulary in lines, then random bytes, from a
+ * fixed seed so that every run sees the same input.
+ */
+static void
+synth(void)
+{
+	static const char *words[] = {
+		"static", "int", "return", "if", "else", "for", "while",
+		"struct", "char", "the", "of", "buffer", "length", "(", ")",
+		"{", "}", ";", "=", "+", "*", "NULL", "0", "1", "error"
+	};
+	const char *w;
+	size_t i, len, nwords = sizeof(words) / sizeof(words[0]);
+
+	inlen = DFLTSIZE;
+	if ((in = malloc(inlen)) == NULL)
+		err(1, NULL);
+	srandom(1);
+	for (i = 0; i < inlen / 2; ) {
+		w = random() % 8 == 0 ? "\n\t" : words[random() % nwords];
+		len = strlen(w);
+		if (len > inlen / 2 - i)
+			len = inlen / 2 - i;
+		memcpy(in + i, w, len);
+		i += len;
+		if (i < inlen / 2)
+			in[i++] = ' ';
+	}
+	for (; i < inlen; i++)
+		in[i] = random();
+}
+
+static void
+report(const char *name, double secs, int reps, const char *check)
+{
+	printf("%-12s %9.1f MB/s   %s\n", name,
+	    (double)inlen * reps / secs / 1e6, check);
+}
+
+static void
+checksums(void)
+{
+	char check[32];
+	double t0, t;
+	uLong c = 0;
+	int reps;
+
+	t0 = now();
+	for (reps = 0; (t = now() - t0) < MINTIME; reps++)
+		c = crc32(crc32(0L, Z_NULL, 0), in, inlen);
+	snprintf(check, sizeof(check), "%08lx", c);
+	report("crc32", t, reps, check);
+
+	t0 = now();
+	for (reps = 0; (t = now() - t0) < MINTIME; reps++)
+		c = adler32(adler32(0L, Z_NULL, 0), in, inlen);
+	snprintf(check, sizeof(check), "%08lx", c);
+	report("adler32", t, reps, check);
+}
+
+/*
+ * Compress at level, and then inflate what that gave; the check value
+ * of deflate is the size and crc32 of its output.
+ */
+static void
+codec(int level)
+{
+	char name[32], check[32];
+	double t0, t;
+	uLongf outlen, backlen;
+	int reps;
+
+	t0 = now();
+	for (reps = 0; (t = now() - t0) < MINTIME; reps++) {
+		outlen = outsize;
+		if (compress2(out, &outlen, in, inlen, level) != Z_OK)
+			errx(1, "compress2 -%d failed", level);
+	}
+	snprintf(name, sizeof(name), "deflate -%d", level);
+	snprintf(check, sizeof(check), "%lu %08lx", (u_long)outlen,
+	    crc32(0L, out, outlen));
+	report(name, t, reps, check);
+
+	t0 = now();
+	for (reps = 0; (t = now() - t0) < MINTIME; reps++) {
+		backlen = inlen;
+		if (uncompress(back, &backlen, out, outlen) != Z_OK ||
+		    backlen != inlen)
+			errx(1, "uncompress -%d failed", level);
+	}
+	if (memcmp(back, in, inlen) != 0)
+		errx(1, "inflate -%d: output differs from the input", level);
+	snprintf(name, sizeof(name), "inflate -%d", level);
+	report(name, t, reps, "");
+}
+
+int
+main(int argc, char *argv[])
+{
+	if (argc > 1)
+		load(argv + 1);
+	else
+		synth();
+	if (inlen == 0)
+		errx(1, "no input");
+	outsize = compressBound(inlen);
+	if ((out = malloc(outsize)) == NULL ||
+	    (back = malloc(inlen)) == NULL)
+		err(1, NULL);
+
+	printf("%zu bytes, zlib %s\n", inlen, zlibVersion());
+	checksums();
+	codec(1);
+	codec(6);
+	codec(9);
+	return (0);
+}
@@ -41,6 +41,8 @@
 #include <unistd.h>
 #include <wchar.h>
 
+#include <lbuf.h>
+
 typedef enum {
 	number_all,		/* number all lines */
 	number_nonempty,	/* number non-empty lines */
@@ -235,9 +237,9 @@ main(int argc, char *argv[])
 void
 filter(void)
 {
+	struct lbuf lb;
 	char *buffer;
-	size_t buffersize;
-	ssize_t linelen;
+	size_t linelen;
 	int line;		/* logical line number */
 	int section;		/* logical page section */
 	unsigned int adjblank;	/* adjacent blank lines */
@@ -247,9 +249,9 @@ filter(void)
 	line = startnum;
 	section = BODY;
 
-	buffer = NULL;
-	buffersize = 0;
-	while ((linelen = getline(&buffer, &buffersize, stdin)) > 0) {
+	if (lbuf_init(&lb, fileno(stdin), '\n') == -1)
+		err(EXIT_FAILURE, NULL);
+	while ((buffer = lbuf_next(&lb, &linelen)) != NULL) {
 		for (idx = FOOTER; idx <= NP_LAST; idx++) {
 			/* Does it look like a delimiter? */
 			if (delimlen * (idx + 1) > linelen)
@@ -258,7 +260,7 @@ filter(void)
 			    delimlen) != 0)
 				break;
 			/* Was this the whole line? */
-			if (buffer[delimlen * (idx + 1)] == '\n') {
+			if (delimlen * (idx + 1) == linelen) {
 				section = idx;
 				adjblank = 0;
 				if (restart)
@@ -274,13 +276,13 @@ filter(void)
 			 * the standard expresses an explicit dependency on
 			 * `-b a' etc.
 			 */
-			if (buffer[0] == '\n' && ++adjblank < nblank)
+			if (linelen == 0 && ++adjblank < nblank)
 				donumber = 0;
 			else
 				donumber = 1, adjblank = 0;
 			break;
 		case number_nonempty:
-			donumber = (buffer[0] != '\n');
+			donumber = (linelen != 0);
 			break;
 		case number_none:
 			donumber = 0;
@@ -300,6 +302,8 @@ filter(void)
 			(void)printf("%*s", width, "");
 		}
 		(void)fwrite(buffer, linelen, 1, stdout);
+		if (lb.delimited)
+			(void)putchar('\n');
 
 		if (ferror(stdout))
 			err(EXIT_FAILURE, "output error");
@@ -307,10 +311,10 @@ nextline:
 		;
 	}
 
-	if (ferror(stdin))
+	if (lb.error)
 		err(EXIT_FAILURE, "input error");
 
-	free(buffer);
+	lbuf_free(&lb);
 }
 
 /*
@@ -36,15 +36,20 @@
 #include <sys/types.h>
 #include <err.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
+#include <lbuf.h>
+
 char *delim;
 int delimcnt;
 
+void	done(struct lbuf *);
+struct lbuf *input(char *);
 int	tr(char *);
 __dead void usage(void);
 void	parallel(char **);
@@ -94,19 +99,51 @@ main(int argc, char *argv[])
 
 struct list {
 	SIMPLEQ_ENTRY(list) entries;
-	FILE *fp;
+	struct lbuf *lb;
 	int cnt;
 	char *name;
 };
 
+/* Every "-" reads from the one standard input. */
+struct lbuf stdinbuf;
+
+struct lbuf *
+input(char *p)
+{
+	struct lbuf *lb;
+	int fd;
+
+	if (p[0] == '-' && p[1] == '\0') {
+		if (stdinbuf.buf == NULL &&
+		    lbuf_init(&stdinbuf, STDIN_FILENO, '\n') == -1)
+			err(1, NULL);
+		return (&stdinbuf);
+	}
+	if ((fd = open(p, O_RDONLY)) == -1)
+		return (NULL);
+	if ((lb = malloc(sizeof(*lb))) == NULL ||
+	    lbuf_init(lb, fd, '\n') == -1)
+		err(1, NULL);
+	return (lb);
+}
+
+void
+done(struct lbuf *lb)
+{
+	if (lb == &stdinbuf)
+		return;
+	(void)close(lb->fd);
+	lbuf_free(lb);
+	free(lb);
+}
+
 void
 parallel(char **argv)
 {
 	SIMPLEQ_HEAD(, list) head = SIMPLEQ_HEAD_INITIALIZER(head);
 	struct list *lp;
 	char *line, *p;
-	size_t linesize;
-	ssize_t len;
+	size_t len;
 	int cnt;
 	int opencnt, output;
 	char ch;
@@ -115,43 +152,35 @@ parallel(char **argv)
 		if ((lp = malloc(sizeof(*lp))) == NULL)
 			err(1, NULL);
 
-		if (p[0] == '-' && p[1] == '\0')
-			lp->fp = stdin;
-		else if ((lp->fp = fopen(p, "r")) == NULL)
+		if ((lp->lb = input(p)) == NULL)
 			err(1, "%s", p);
 		lp->cnt = cnt;
 		lp->name = p;
 		SIMPLEQ_INSERT_TAIL(&head, lp, entries);
 	}
 
-	line = NULL;
-	linesize = 0;
-
 	for (opencnt = cnt; opencnt;) {
 		output = 0;
 		SIMPLEQ_FOREACH(lp, &head, entries) {
-			if (lp->fp == NULL) {
+			if (lp->lb == NULL) {
 				if (output && lp->cnt &&
 				    (ch = delim[(lp->cnt - 1) % delimcnt]))
 					putchar(ch);
 				continue;
 			}
-			if ((len = getline(&line, &linesize, lp->fp)) == -1) {
-				if (ferror(lp->fp))
-					err(1, "%s", lp->fp == stdin ?
-					    "getline" : lp->name);
+			if ((line = lbuf_next(lp->lb, &len)) == NULL) {
+				if (lp->lb->error)
+					err(1, "%s", lp->lb == &stdinbuf ?
+					    "stdin" : lp->name);
 				if (--opencnt == 0)
 					break;
-				if (lp->fp != stdin)
-					fclose(lp->fp);
-				lp->fp = NULL;
+				done(lp->lb);
+				lp->lb = NULL;
 				if (output && lp->cnt &&
 				    (ch = delim[(lp->cnt - 1) % delimcnt]))
 					putchar(ch);
 				continue;
 			}
-			if (line[len - 1] == '\n')
-				line[len - 1] = '\0';
 			/*
 			 * make sure that we don't print any delimiters
 			 * unless there's a non-empty file.
@@ -163,50 +192,40 @@ parallel(char **argv)
 						putchar(ch);
 			} else if ((ch = delim[(lp->cnt - 1) % delimcnt]))
 				putchar(ch);
-			fputs(line, stdout);
+			fwrite(line, 1, len, stdout);
 		}
 		if (output)
 			putchar('\n');
 	}
-	free(line);
 }
 
 void
 sequential(char **argv)
 {
-	FILE *fp;
+	struct lbuf *lb;
 	char *line, *p;
-	size_t linesize;
-	ssize_t len;
+	size_t len;
 	int cnt;
 
-	line = NULL;
-	linesize = 0;
 	for (; (p = *argv) != NULL; ++argv) {
-		if (p[0] == '-' && p[1] == '\0')
-			fp = stdin;
-		else if ((fp = fopen(p, "r")) == NULL) {
+		if ((lb = input(p)) == NULL) {
 			warn("%s", p);
 			continue;
 		}
 		cnt = -1;
-		while ((len = getline(&line, &linesize, fp)) != -1) {
-			if (line[len - 1] == '\n')
-				line[len - 1] = '\0';
+		while ((line = lbuf_next(lb, &len)) != NULL) {
 			if (cnt >= 0)
 				putchar(delim[cnt]);
 			if (++cnt == delimcnt)
 				cnt = 0;
-			fputs(line, stdout);
+			fwrite(line, 1, len, stdout);
 		}
-		if (ferror(fp))
-			err(1, "%s", fp == stdin ? "getline" : p);
+		if (lb->error)
+			err(1, "%s", lb == &stdinbuf ? "stdin" : p);
 		if (cnt >= 0)
 			putchar('\n');
-		if (fp != stdin)
-			fclose(fp);
+		done(lb);
 	}
-	free(line);
 }
 
 int
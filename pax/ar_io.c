@@ -337,6 +337,10 @@ ar_close(int in_sig)
 
 	(void)close(arfd);
 
+	/* Likewise let the gzip thread finish the archive */
+	if (!in_sig && zlib_end() == -1)
+		exit_val = 1;
+
 	/* Do not exit before child to ensure data integrity */
 	if (zpid > 0) {
 		waitpid(zpid, &status, 0);
@@ -389,10 +393,12 @@ ar_close(int in_sig)
 		return;
 	}
 
-	if (op_mode == OP_PAX)
+	if (op_mode == OP_PAX) {
 		(void)dprintf(listfd, "%s: %s vol %d, %lu files,"
 		    " %llu bytes read, %llu bytes written.\n",
 		    argv0, frmt->name, arvol-1, flcnt, rdcnt, wrcnt);
+		tab_stats(listfd);
+	}
 #ifndef NOCPIO
 	else if (op_mode == OP_CPIO)
 		(void)dprintf(listfd, "%llu blocks\n",
@@ -1237,7 +1243,9 @@ ar_next(void)
 /*
  * ar_start_gzip()
  * starts the gzip compression/decompression process as a child, using magic
- * to keep the fd the same in the calling function (parent).
+ * to keep the fd the same in the calling function (parent).  gzip itself is
+ * done in-process by a thread (see ar_zlib.c), only the other compressors
+ * are run as programs.
  */
 void
 ar_start_gzip(int fd, const char *path, int wr)
@@ -1245,6 +1253,12 @@ ar_start_gzip(int fd, const char *path, int wr)
 	int fds[2];
 	const char *gzip_flags;
 
+	if (strcmp(path, GZIP_CMD) == 0) {
+		if (zlib_start(fd, wr) == -1)
+			exit(1);
+		return;
+	}
+
 	if (pipe(fds) == -1)
 		err(1, "could not pipe");
 	zpid = fork();
@@ -48,6 +48,8 @@
 #include "extern.h"
 
 static void wr_archive(ARCHD *, int is_app);
+static int wr_select(ARCHD *, int *);
+static int wr_member(ARCHD *, int *, PFBUF *, time_t, int *);
 static int get_arc(void);
 static int next_head(ARCHD *);
 extern sigset_t s_mask;
@@ -201,6 +203,7 @@ extract(void)
 		return;
 
 	now = time(NULL);
+	ex_start(njobs);
 
 	/*
 	 * step through each entry on the archive until the format read routine
@@ -243,6 +246,8 @@ extract(void)
 		 * file AFTER the name mod. In honesty the pax spec is probably
 		 * flawed in this respect.
 		 */
+		if (uflag || Dflag)
+			ex_wait(arcn);
 		if ((uflag || Dflag) &&
 		    cmp_file_times(uflag, Dflag, arcn, NULL)) {
 			(void)rd_skip(arcn->skip + arcn->pad);
@@ -258,11 +263,19 @@ extract(void)
 			/*
 			 * a bad name mod, skip and purge name from link table
 			 */
+			ex_lock();
 			purg_lnk(arcn);
+			ex_unlock();
 			(void)rd_skip(arcn->skip + arcn->pad);
 			continue;
 		}
 
+		/*
+		 * with -J, let any file in the way of this one be written
+		 * first
+		 */
+		ex_wait(arcn);
+
 		/*
 		 * Non standard -Y and -Z flag. When the existing file is
 		 * same age or newer skip
@@ -285,10 +298,12 @@ extract(void)
 		/*
 		 * if required, chdir around.
 		 */
-		if ((arcn->pat != NULL) && (arcn->pat->chdname != NULL))
+		if ((arcn->pat != NULL) && (arcn->pat->chdname != NULL)) {
+			ex_sync();
 			if (chdir(arcn->pat->chdname) != 0)
 				syswarn(1, errno, "Cannot chdir to %s",
 				    arcn->pat->chdname);
+		}
 
 		/*
 		 * all ok, extract this member based on type
@@ -297,16 +312,24 @@ extract(void)
 			/*
 			 * process archive members that are not regular files.
 			 * throw out padding and any data that might follow the
-			 * header (as determined by the format).
+			 * header (as determined by the format). a hard link
+			 * needs its target complete.
 			 */
-			if (PAX_IS_HARDLINK(arcn->type))
+			if (PAX_IS_HARDLINK(arcn->type)) {
+				ex_sync();
 				res = lnk_creat(arcn);
-			else
+			} else {
+				ex_lock();
 				res = node_creat(arcn);
+				ex_unlock();
+			}
 
 			(void)rd_skip(arcn->skip + arcn->pad);
-			if (res < 0)
+			if (res < 0) {
+				ex_lock();
 				purg_lnk(arcn);
+				ex_unlock();
+			}
 
 			if (vflag && vfpart) {
 				(void)putc('\n', listf);
@@ -314,13 +337,31 @@ extract(void)
 			}
 			goto popd;
 		}
+		/*
+		 * with -J, hand small files to the extraction threads
+		 */
+		if (ex_want(arcn)) {
+			res = ex_put(arcn);
+			if (vflag && vfpart) {
+				(void)putc('\n', listf);
+				vfpart = 0;
+			}
+			if (!res)
+				(void)rd_skip(arcn->pad);
+			goto popd;
+		}
+
 		/*
 		 * we have a file with data here. If we can not create it, skip
 		 * over the data and purge the name from hard link table
 		 */
-		if ((fd = file_creat(arcn)) < 0) {
-			(void)rd_skip(arcn->skip + arcn->pad);
+		ex_lock();
+		fd = file_creat(arcn);
+		if (fd < 0)
 			purg_lnk(arcn);
+		ex_unlock();
+		if (fd < 0) {
+			(void)rd_skip(arcn->skip + arcn->pad);
 			goto popd;
 		}
 		/*
@@ -351,6 +392,7 @@ popd:
 	 * all patterns supplied by the user were matched; block off signals
 	 * to avoid chance for multiple entry into the cleanup code.
 	 */
+	ex_end();
 	(void)(*frmt->end_rd)();
 	(void)sigprocmask(SIG_BLOCK, &s_mask, NULL);
 	ar_close(0);
@@ -359,6 +401,163 @@ popd:
 	pat_chk();
 }
 
+/*
+ * wr_select()
+ *	Get the next file to store from the file tree walk, check it against
+ *	the user's selection options, open it and rename it as requested.
+ * Return:
+ *	0 if arcn is ready to store (open on fd when it has data to store),
+ *	1 if the file was skipped, -1 when no more files are to be stored.
+ */
+
+static int
+wr_select(ARCHD *arcn, int *fd)
+{
+	int res;
+
+	if (next_file(arcn) != 0)
+		return(-1);
+
+	/*
+	 * check if this file meets user specified options match.
+	 */
+	if (sel_chk(arcn) != 0)
+		return(1);
+	*fd = -1;
+	if (uflag) {
+		/*
+		 * only archive if this file is newer than a file with
+		 * the same name that is already stored on the archive
+		 */
+		if ((res = chk_ftime(arcn)) < 0)
+			return(-1);
+		if (res > 0) {
+			ftree_skipped_newer(arcn);
+			return(1);
+		}
+	}
+
+	/*
+	 * this file is considered selected now. see if this is a hard
+	 * link to a file already stored
+	 */
+	ftree_sel(arcn);
+	if (frmt->hlk && (chk_lnk(arcn) < 0))
+		return(-1);
+
+	if (PAX_IS_REG(arcn->type) || (arcn->type == PAX_HRG)) {
+		/*
+		 * we will have to read this file. by opening it now we
+		 * can avoid writing a header to the archive for a file
+		 * we were later unable to read (we also purge it from
+		 * the link table).
+		 */
+		if ((*fd = open(arcn->org_name, O_RDONLY, 0)) < 0) {
+			syswarn(1,errno, "Unable to open %s to read",
+				arcn->org_name);
+			purg_lnk(arcn);
+			return(1);
+		}
+	}
+
+	/*
+	 * Now modify the name as requested by the user
+	 */
+	if ((res = mod_name(arcn)) < 0) {
+		/*
+		 * name modification says to skip this file, close the
+		 * file and purge link table entry
+		 */
+		rdfile_close(arcn, fd);
+		purg_lnk(arcn);
+		return(-1);
+	}
+
+	if ((res > 0) || (docrc && (set_crc(arcn, *fd) < 0))) {
+		/*
+		 * unable to obtain the crc we need, close the file,
+		 * purge link table entry
+		 */
+		rdfile_close(arcn, fd);
+		purg_lnk(arcn);
+		return(1);
+	}
+	return(0);
+}
+
+/*
+ * wr_member()
+ *	Store a file picked by wr_select() on the archive, header and data.
+ *	Whatever was read ahead of the file is in pb. wr_one is set once a
+ *	header has been written.
+ * Return:
+ *	0 if ok, -1 if the archive could not be written.
+ */
+
+static int
+wr_member(ARCHD *arcn, int *fd, PFBUF *pb, time_t now, int *wr_one)
+{
+	int res;
+	off_t cnt;
+
+	if (vflag) {
+		if (vflag > 1)
+			ls_list(arcn, now, listf);
+		else {
+			(void)safe_print(arcn->name, listf);
+			vfpart = 1;
+		}
+	}
+	++flcnt;
+
+	/*
+	 * looks safe to store the file, have the format specific
+	 * routine write routine store the file header on the archive
+	 */
+	if ((res = (*frmt->wr)(arcn)) < 0) {
+		rdfile_close(arcn, fd);
+		return(-1);
+	}
+	*wr_one = 1;
+	if (res > 0) {
+		/*
+		 * format write says no file data needs to be stored
+		 * so we are done messing with this file
+		 */
+		if (vflag && vfpart) {
+			(void)putc('\n', listf);
+			vfpart = 0;
+		}
+		rdfile_close(arcn, fd);
+		return(0);
+	}
+
+	/*
+	 * Add file data to the archive, quit on write error. if we
+	 * cannot write the entire file contents to the archive we
+	 * must pad the archive to replace the missing file data
+	 * (otherwise during an extract the file header for the file
+	 * which FOLLOWS this one will not be where we expect it to
+	 * be).
+	 */
+	res = wr_rdfile(arcn, *fd, pb, &cnt);
+	rdfile_close(arcn, fd);
+	if (vflag && vfpart) {
+		(void)putc('\n', listf);
+		vfpart = 0;
+	}
+	if (res < 0)
+		return(-1);
+
+	/*
+	 * pad as required, cnt is number of bytes not written
+	 */
+	if (((cnt > 0) && (wr_skip(cnt) < 0)) ||
+	    ((arcn->pad > 0) && (wr_skip(arcn->pad) < 0)))
+		return(-1);
+	return(0);
+}
+
 /*
  * wr_archive()
  *	Write an archive. used in both creating a new archive and appends on
@@ -369,18 +568,19 @@ static void
 wr_archive(ARCHD *arcn, int is_app)
 {
 	int res;
-	int hlk;
 	int wr_one;
-	off_t cnt;
-	int (*wrf)(ARCHD *);
+	int walked = 0;
 	int fd = -1;
+	int *fdp;
+	ARCHD *ap;
+	PFBUF *pb;
 	time_t now;
 
 	/*
 	 * if this format supports hard link storage, start up the database
 	 * that detects them.
 	 */
-	if (((hlk = frmt->hlk) == 1) && (lnk_start() < 0))
+	if ((frmt->hlk == 1) && (lnk_start() < 0))
 		return;
 
 	/*
@@ -399,8 +599,6 @@ wr_archive(ARCHD *arcn, int is_app)
 	} else if (((*frmt->st_wr)() < 0))
 		return;
 
-	wrf = frmt->wr;
-
 	/*
 	 * When we are doing interactive rename, we store the mapping of names
 	 * so we can fix up hard links files later in the archive.
@@ -411,130 +609,27 @@ wr_archive(ARCHD *arcn, int is_app)
 	now = time(NULL);
 
 	/*
-	 * while there are files to archive, process them one at at time
+	 * while there are files to archive, select and open them in order,
+	 * queueing them up so their contents can be read ahead, and store
+	 * each one on the archive when it reaches the front of the queue.
+	 * Interactive renaming must talk to the user about one file at a
+	 * time, so no read ahead then.
 	 */
-	while (next_file(arcn) == 0) {
-		/*
-		 * check if this file meets user specified options match.
-		 */
-		if (sel_chk(arcn) != 0)
-			continue;
-		fd = -1;
-		if (uflag) {
-			/*
-			 * only archive if this file is newer than a file with
-			 * the same name that is already stored on the archive
-			 */
-			if ((res = chk_ftime(arcn)) < 0)
-				break;
-			if (res > 0) {
-				ftree_skipped_newer(arcn);
-				continue;
-			}
-		}
-
-		/*
-		 * this file is considered selected now. see if this is a hard
-		 * link to a file already stored
-		 */
-		ftree_sel(arcn);
-		if (hlk && (chk_lnk(arcn) < 0))
-			break;
-
-		if (PAX_IS_REG(arcn->type) || (arcn->type == PAX_HRG)) {
-			/*
-			 * we will have to read this file. by opening it now we
-			 * can avoid writing a header to the archive for a file
-			 * we were later unable to read (we also purge it from
-			 * the link table).
-			 */
-			if ((fd = open(arcn->org_name, O_RDONLY, 0)) < 0) {
-				syswarn(1,errno, "Unable to open %s to read",
-					arcn->org_name);
-				purg_lnk(arcn);
-				continue;
-			}
-		}
-
-		/*
-		 * Now modify the name as requested by the user
-		 */
-		if ((res = mod_name(arcn)) < 0) {
-			/*
-			 * name modification says to skip this file, close the
-			 * file and purge link table entry
-			 */
-			rdfile_close(arcn, &fd);
-			purg_lnk(arcn);
-			break;
-		}
-
-		if ((res > 0) || (docrc && (set_crc(arcn, fd) < 0))) {
-			/*
-			 * unable to obtain the crc we need, close the file,
-			 * purge link table entry
-			 */
-			rdfile_close(arcn, &fd);
-			purg_lnk(arcn);
-			continue;
-		}
-
-		if (vflag) {
-			if (vflag > 1)
-				ls_list(arcn, now, listf);
-			else {
-				(void)safe_print(arcn->name, listf);
-				vfpart = 1;
-			}
-		}
-		++flcnt;
-
-		/*
-		 * looks safe to store the file, have the format specific
-		 * routine write routine store the file header on the archive
-		 */
-		if ((res = (*wrf)(arcn)) < 0) {
-			rdfile_close(arcn, &fd);
-			break;
-		}
-		wr_one = 1;
-		if (res > 0) {
-			/*
-			 * format write says no file data needs to be stored
-			 * so we are done messing with this file
-			 */
-			if (vflag && vfpart) {
-				(void)putc('\n', listf);
-				vfpart = 0;
-			}
-			rdfile_close(arcn, &fd);
+	pf_start(iflag);
+	for (;;) {
+		if (!walked && !pf_full()) {
+			if ((res = wr_select(arcn, &fd)) < 0)
+				walked = 1;
+			else if (res == 0)
+				pf_put(arcn, fd);
 			continue;
 		}
-
-		/*
-		 * Add file data to the archive, quit on write error. if we
-		 * cannot write the entire file contents to the archive we
-		 * must pad the archive to replace the missing file data
-		 * (otherwise during an extract the file header for the file
-		 * which FOLLOWS this one will not be where we expect it to
-		 * be).
-		 */
-		res = wr_rdfile(arcn, fd, &cnt);
-		rdfile_close(arcn, &fd);
-		if (vflag && vfpart) {
-			(void)putc('\n', listf);
-			vfpart = 0;
-		}
-		if (res < 0)
+		if ((ap = pf_get(&fdp, &pb)) == NULL)
 			break;
-
-		/*
-		 * pad as required, cnt is number of bytes not written
-		 */
-		if (((cnt > 0) && (wr_skip(cnt) < 0)) ||
-		    ((arcn->pad > 0) && (wr_skip(arcn->pad) < 0)))
+		if (wr_member(ap, fdp, pb, now, &wr_one) < 0)
 			break;
 	}
+	pf_end();
 
 trailer:
 	/*
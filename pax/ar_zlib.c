@@ -0,0 +1,526 @@
+/*
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../libz/zlib.h"
+#include "pax.h"
+#include "extern.h"
+
+/*
+ * In-process gzip for -z.  The archive descriptor is swapped for one end
+ * of a socket pair, so the rest of pax reads and writes it exactly as it
+ * would a pipe to a gzip child, and a thread on the other end inflates
+ * from or deflates to the real archive.
+ *
+ * When writing, the data is cut into blocks that are deflated by a pool
+ * of threads, one per cpu.  Each block is primed with the last 32KB of
+ * the block before it and ends on a byte boundary with a sync flush (the
+ * last one with a final block instead), so the blocks written in order
+ * form a single ordinary gzip member.  The blocks do not depend on the
+ * number of threads, so neither does the archive.
+ */
+
+#define ZL_BLOCKSIZE	(128 * 1024)
+#define ZL_DICTSIZE	(32 * 1024)
+#define ZL_BUFSIZE	(64 * 1024)
+#define ZL_LEVEL	6
+
+struct zl_block {
+	u_char	*in;		/* dictionary followed by the block data */
+	size_t	 dictlen;
+	size_t	 len;
+	u_char	*out;		/* deflated data */
+	size_t	 outlen;
+	size_t	 outsize;
+	u_int32_t crc;		/* crc32 of the block data */
+	int	 last;		/* block finishes the member */
+	int	 done;
+	int	 error;
+};
+
+static pthread_t zl_thr;		/* thread serving the socket */
+static int zl_running;			/* zl_thr was started */
+static int zl_fd = -1;			/* the real archive */
+static int zl_sock = -1;		/* our end of the socket pair */
+static int zl_errno;			/* why the thread gave up */
+static const char *zl_errmsg;
+
+static pthread_mutex_t zl_mtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t zl_work = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t zl_done = PTHREAD_COND_INITIALIZER;
+static pthread_t *zl_wthr;		/* deflate workers */
+static int zl_nwthr;
+static struct zl_block *zl_blk;		/* ring of blocks, by sequence */
+static int zl_nblk;
+static u_int64_t zl_nsent;		/* blocks queued */
+static u_int64_t zl_ntaken;		/* blocks picked up by a worker */
+static u_int64_t zl_nwritten;		/* blocks written out */
+static u_int32_t zl_crc;
+static u_int32_t zl_isize;
+static int zl_quit;
+static int zl_failed;
+
+static void *zl_deflate(void *);
+static void *zl_inflate(void *);
+
+static void
+zl_fail(const char *msg, int error)
+{
+	if (zl_errmsg == NULL) {
+		zl_errmsg = msg;
+		zl_errno = error;
+	}
+	zl_failed = 1;
+}
+
+static int
+zl_writeall(int fd, const void *buf, size_t len, int sock)
+{
+	const u_char *p = buf;
+	ssize_t n;
+
+	while (len > 0) {
+		/* a reader that went away must not take us down with it */
+		if (sock)
+			n = send(fd, p, len, MSG_NOSIGNAL);
+		else
+			n = write(fd, p, len);
+		if (n == -1) {
+			if (errno == EINTR)
+				continue;
+			return (-1);
+		}
+		p += n;
+		len -= n;
+	}
+	return (0);
+}
+
+/*
+ * zlib_start()
+ *	Puts the in-process gzip between pax and the archive open on fd,
+ *	compressing if wr is set and decompressing otherwise.
+ * Return:
+ *	0 if the thread is running, -1 otherwise
+ */
+
+int
+zlib_start(int fd, int wr)
+{
+	sigset_t set, oset;
+	int sv[2];
+
+	zl_errmsg = NULL;
+	zl_errno = 0;
+	zl_failed = 0;
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == -1) {
+		syswarn(1, errno, "Unable to create socket for gzip");
+		return (-1);
+	}
+	if ((zl_fd = dup(fd)) == -1 || dup2(sv[0], fd) == -1) {
+		syswarn(1, errno, "Unable to set up gzip on %s", arcname);
+		if (zl_fd != -1)
+			(void)close(zl_fd);
+		(void)close(sv[0]);
+		(void)close(sv[1]);
+		zl_fd = -1;
+		return (-1);
+	}
+	(void)close(sv[0]);
+	zl_sock = sv[1];
+
+	/* signals are for the main thread, which owns the cleanup */
+	sigfillset(&set);
+	pthread_sigmask(SIG_BLOCK, &set, &oset);
+	errno = pthread_create(&zl_thr, NULL, wr ? zl_deflate : zl_inflate,
+	    NULL);
+	pthread_sigmask(SIG_SETMASK, &oset, NULL);
+	if (errno != 0) {
+		syswarn(1, errno, "Unable to start gzip thread");
+		(void)close(zl_fd);
+		(void)close(zl_sock);
+		zl_fd = zl_sock = -1;
+		return (-1);
+	}
+	zl_running = 1;
+	return (0);
+}
+
+/*
+ * zlib_end()
+ *	Waits for the gzip thread to finish with the archive, which it does
+ *	once pax has closed its end of the socket, and reports any trouble.
+ * Return:
+ *	0 if all went well or no thread was running, -1 otherwise
+ */
+
+int
+zlib_end(void)
+{
+	if (!zl_running)
+		return (0);
+	pthread_join(zl_thr, NULL);
+	zl_running = 0;
+	(void)close(zl_sock);
+	(void)close(zl_fd);
+	zl_sock = zl_fd = -1;
+	if (zl_errmsg == NULL)
+		return (0);
+	if (zl_errno != 0)
+		syswarn(1, zl_errno, "gzip: %s %s", zl_errmsg, arcname);
+	else
+		paxwarn(1, "gzip: %s %s", zl_errmsg, arcname);
+	return (-1);
+}
+
+static void *
+zl_worker(void *arg)
+{
+	struct zl_block *b;
+	z_stream zs;
+	u_char *out;
+	size_t used;
+	int error, r;
+
+	memset(&zs, 0, sizeof(zs));
+	error = deflateInit2(&zs, ZL_LEVEL, Z_DEFLATED, -MAX_WBITS, 8,
+	    Z_DEFAULT_STRATEGY) != Z_OK;
+
+	pthread_mutex_lock(&zl_mtx);
+	for (;;) {
+		while (zl_ntaken == zl_nsent && !zl_quit)
+			pthread_cond_wait(&zl_work, &zl_mtx);
+		if (zl_ntaken == zl_nsent)
+			break;
+		b = &zl_blk[zl_ntaken++ % zl_nblk];
+		pthread_mutex_unlock(&zl_mtx);
+
+		b->error = error;
+		if (!b->error && (deflateReset(&zs) != Z_OK || (b->dictlen &&
+		    deflateSetDictionary(&zs, b->in, b->dictlen) != Z_OK)))
+			b->error = 1;
+		zs.next_in = b->in + b->dictlen;
+		zs.avail_in = b->len;
+		zs.next_out = b->out;
+		zs.avail_out = b->outsize;
+		while (!b->error) {
+			r = deflate(&zs, b->last ? Z_FINISH : Z_SYNC_FLUSH);
+			if (r == Z_STREAM_ERROR)
+				b->error = 1;
+			else if (b->last ? r == Z_STREAM_END :
+			    zs.avail_out != 0)
+				break;
+			else {
+				/* ran out of room, grow the output buffer */
+				used = b->outsize - zs.avail_out;
+				if ((out = reallocarray(b->out, b->outsize,
+				    2)) == NULL) {
+					b->error = 1;
+					break;
+				}
+				b->out = out;
+				b->outsize *= 2;
+				zs.next_out = b->out + used;
+				zs.avail_out = b->outsize - used;
+			}
+		}
+		b->outlen = b->outsize - zs.avail_out;
+		b->crc = crc32(crc32(0L, Z_NULL, 0), b->in + b->dictlen,
+		    b->len);
+
+		pthread_mutex_lock(&zl_mtx);
+		b->done = 1;
+		pthread_cond_broadcast(&zl_done);
+	}
+	pthread_mutex_unlock(&zl_mtx);
+
+	if (!error)
+		(void)deflateEnd(&zs);
+	return (NULL);
+}
+
+/*
+ * Write out deflated blocks in order.  Wait until fewer than ``keep''
+ * blocks are still outstanding.
+ */
+static void
+zl_drain(u_int64_t keep)
+{
+	struct zl_block *b;
+
+	pthread_mutex_lock(&zl_mtx);
+	while (zl_nwritten < zl_nsent) {
+		b = &zl_blk[zl_nwritten % zl_nblk];
+		if (!b->done) {
+			if (zl_nsent - zl_nwritten < keep)
+				break;
+			pthread_cond_wait(&zl_done, &zl_mtx);
+			continue;
+		}
+		pthread_mutex_unlock(&zl_mtx);
+		if (!zl_failed) {
+			if (b->error)
+				zl_fail("out of memory compressing", 0);
+			else if (zl_writeall(zl_fd, b->out, b->outlen, 0) == -1)
+				zl_fail("write error on", errno);
+			else {
+				zl_crc = crc32_combine(zl_crc, b->crc, b->len);
+				zl_isize += b->len;
+			}
+		}
+		pthread_mutex_lock(&zl_mtx);
+		b->done = 0;
+		zl_nwritten++;
+	}
+	pthread_mutex_unlock(&zl_mtx);
+}
+
+/*
+ * Queue the block being filled and start on the next one, priming it
+ * with the tail of this one.
+ */
+static void
+zl_send(int last)
+{
+	struct zl_block *b, *nb;
+
+	b = &zl_blk[zl_nsent % zl_nblk];
+	b->last = last;
+	pthread_mutex_lock(&zl_mtx);
+	zl_nsent++;
+	pthread_cond_signal(&zl_work);
+	pthread_mutex_unlock(&zl_mtx);
+	if (last) {
+		zl_drain(1);
+		return;
+	}
+
+	zl_drain(zl_nblk);
+	nb = &zl_blk[zl_nsent % zl_nblk];
+	nb->dictlen = MINIMUM(b->len, ZL_DICTSIZE);
+	memcpy(nb->in, b->in + b->dictlen + b->len - nb->dictlen,
+	    nb->dictlen);
+	nb->len = 0;
+}
+
+static int
+zl_poolstart(void)
+{
+	long ncpu;
+	int i;
+
+	if ((ncpu = sysconf(_SC_NPROCESSORS_ONLN)) < 1)
+		ncpu = 1;
+	zl_nwthr = ncpu > 64 ? 64 : ncpu;
+	zl_nblk = 2 * zl_nwthr + 1;
+	zl_nsent = zl_ntaken = zl_nwritten = 0;
+	zl_quit = 0;
+	if ((zl_wthr = calloc(zl_nwthr, sizeof(*zl_wthr))) == NULL ||
+	    (zl_blk = calloc(zl_nblk, sizeof(*zl_blk))) == NULL)
+		return (-1);
+	for (i = 0; i < zl_nblk; i++) {
+		zl_blk[i].outsize = ZL_BLOCKSIZE + ZL_BLOCKSIZE / 8;
+		if ((zl_blk[i].in = malloc(ZL_DICTSIZE + ZL_BLOCKSIZE)) ==
+		    NULL || (zl_blk[i].out = malloc(zl_blk[i].outsize)) == NULL)
+			return (-1);
+	}
+	for (i = 0; i < zl_nwthr; i++)
+		if ((errno = pthread_create(&zl_wthr[i], NULL, zl_worker,
+		    NULL)) != 0) {
+			/* make do with the workers we have */
+			zl_nwthr = i;
+			if (i == 0)
+				return (-1);
+			break;
+		}
+	return (0);
+}
+
+static void
+zl_poolend(void)
+{
+	int i;
+
+	pthread_mutex_lock(&zl_mtx);
+	zl_quit = 1;
+	pthread_cond_broadcast(&zl_work);
+	pthread_mutex_unlock(&zl_mtx);
+	if (zl_wthr != NULL)
+		for (i = 0; i < zl_nwthr; i++)
+			pthread_join(zl_wthr[i], NULL);
+	if (zl_blk != NULL)
+		for (i = 0; i < zl_nblk; i++) {
+			free(zl_blk[i].in);
+			free(zl_blk[i].out);
+		}
+	free(zl_blk);
+	free(zl_wthr);
+	zl_blk = NULL;
+	zl_wthr = NULL;
+	zl_nwthr = 0;
+}
+
+static void
+zl_put32(u_char *p, u_int32_t x)
+{
+	p[0] = x;
+	p[1] = x >> 8;
+	p[2] = x >> 16;
+	p[3] = x >> 24;
+}
+
+/*
+ * Compress whatever pax writes to the socket into the archive.  After a
+ * failure the input is still read and thrown away, so that pax never
+ * sees a write on a dead socket.
+ */
+static void *
+zl_deflate(void *arg)
+{
+	/* magic, deflate, no flags, no mtime, no extra flags, unix */
+	static const u_char head[10] = { 0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 3 };
+	struct zl_block *b;
+	u_char buf[ZL_BUFSIZE], tail[8];
+	ssize_t n;
+
+	zl_crc = crc32(0L, Z_NULL, 0);
+	zl_isize = 0;
+	if (zl_poolstart() == -1) {
+		zl_fail("unable to start compressing", errno);
+		zl_poolend();
+		while ((n = read(zl_sock, buf, sizeof(buf))) != 0)
+			if (n == -1 && errno != EINTR)
+				break;
+		return (NULL);
+	}
+	if (zl_writeall(zl_fd, head, sizeof(head), 0) == -1)
+		zl_fail("write error on", errno);
+
+	zl_blk[0].dictlen = zl_blk[0].len = 0;
+	for (;;) {
+		b = &zl_blk[zl_nsent % zl_nblk];
+		if (b->len == ZL_BLOCKSIZE) {
+			if (!zl_failed) {
+				zl_send(0);
+				continue;
+			}
+			b->len = 0;
+		}
+		n = read(zl_sock, b->in + b->dictlen + b->len,
+		    ZL_BLOCKSIZE - b->len);
+		if (n == 0)
+			break;
+		if (n == -1) {
+			if (errno == EINTR)
+				continue;
+			zl_fail("read error on socket for", errno);
+			break;
+		}
+		b->len += n;
+	}
+
+	if (zl_failed)
+		zl_drain(1);
+	else
+		zl_send(1);
+	zl_poolend();
+	if (!zl_failed) {
+		zl_put32(tail, zl_crc);
+		zl_put32(tail + 4, zl_isize);
+		if (zl_writeall(zl_fd, tail, sizeof(tail), 0) == -1)
+			zl_fail("write error on", errno);
+	}
+	return (NULL);
+}
+
+/*
+ * Decompress the archive onto the socket, member after member as gzip
+ * does.  Anything after the last member that is not another gzip header
+ * is ignored.  A reader that closes early (a quick list or extract) just
+ * ends the thread.
+ */
+static void *
+zl_inflate(void *arg)
+{
+	z_stream zs;
+	u_char *in, *out;
+	ssize_t n;
+	int end, r;
+
+	memset(&zs, 0, sizeof(zs));
+	in = malloc(ZL_BUFSIZE);
+	out = malloc(ZL_BUFSIZE);
+	if (in == NULL || out == NULL ||
+	    inflateInit2(&zs, 16 + MAX_WBITS) != Z_OK) {
+		zl_fail("unable to start decompressing", ENOMEM);
+		free(in);
+		free(out);
+		(void)shutdown(zl_sock, SHUT_WR);
+		return (NULL);
+	}
+
+	for (end = 0;;) {
+		if (zs.avail_in == 0) {
+			if ((n = read(zl_fd, in, ZL_BUFSIZE)) == -1) {
+				if (errno == EINTR)
+					continue;
+				zl_fail("read error on", errno);
+				break;
+			}
+			if (n == 0) {
+				if (!end)
+					zl_fail("unexpected end of file in", 0);
+				break;
+			}
+			zs.next_in = in;
+			zs.avail_in = n;
+		}
+		if (end) {
+			if (zs.next_in[0] != 0x1f)
+				break;
+			(void)inflateReset(&zs);
+			end = 0;
+		}
+		zs.next_out = out;
+		zs.avail_out = ZL_BUFSIZE;
+		r = inflate(&zs, Z_NO_FLUSH);
+		if (r != Z_OK && r != Z_STREAM_END) {
+			zl_fail(r == Z_MEM_ERROR ? "out of memory for" :
+			    "invalid compressed data in", 0);
+			break;
+		}
+		if (zl_writeall(zl_sock, out, ZL_BUFSIZE - zs.avail_out,
+		    1) == -1) {
+			if (errno != EPIPE)
+				zl_fail("write error on socket for", errno);
+			break;
+		}
+		if (r == Z_STREAM_END)
+			end = 1;
+	}
+
+	(void)inflateEnd(&zs);
+	free(in);
+	free(out);
+	(void)shutdown(zl_sock, SHUT_WR);
+	return (NULL);
+}
@@ -48,7 +48,6 @@
  * routines which implement archive and file buffering
  */
 
-#define MINFBSZ		512		/* default block size for hole detect */
 #define MAXFLT		10		/* default media read error limit */
 
 /*
@@ -588,24 +587,50 @@ wr_skip(off_t skcnt)
  *	we just detect this case and warn the user. We never create a bad
  *	archive if we can avoid it. Of course trying to archive files that are
  *	active is asking for trouble. It we fail, we pass back how much we
- *	could NOT copy and let the caller deal with it.
+ *	could NOT copy and let the caller deal with it. If pb is not NULL,
+ *	it holds the start of the file, already read from ifd.
  * Return:
  *	0 ok, -1 if archive write failure. a short read of the file returns a
  *	0, but "left" is set to be greater than zero.
  */
 
 int
-wr_rdfile(ARCHD *arcn, int ifd, off_t *left)
+wr_rdfile(ARCHD *arcn, int ifd, PFBUF *pb, off_t *left)
 {
 	int cnt;
 	int res = 0;
+	int more = 1;
 	off_t size = arcn->sb.st_size;
+	off_t done;
 	struct stat sb;
 
+	/*
+	 * copy in what was read ahead, then carry on with the file unless
+	 * the read ahead already ran into its end or an error
+	 */
+	if (pb != NULL) {
+		for (done = 0; done < pb->len; done += cnt) {
+			cnt = bufend - bufpt;
+			if ((cnt <= 0) && ((cnt = buf_flush(blksz)) < 0)) {
+				*left = size;
+				return(-1);
+			}
+			cnt = MINIMUM(cnt, pb->len - done);
+			memcpy(bufpt, pb->buf + done, cnt);
+			size -= cnt;
+			bufpt += cnt;
+		}
+		if (pb->err != 0) {
+			errno = pb->err;
+			res = -1;
+		}
+		more = pb->err == 0 && !pb->eof;
+	}
+
 	/*
 	 * while there are more bytes to write
 	 */
-	while (size > 0) {
+	while (more && size > 0) {
 		cnt = bufend - bufpt;
 		if ((cnt <= 0) && ((cnt = buf_flush(blksz)) < 0)) {
 			*left = size;
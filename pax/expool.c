@@ -0,0 +1,361 @@
+/*
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "pax.h"
+#include "extern.h"
+
+/*
+ * Parallel extraction (-J).  extract() still reads the archive, selects
+ * and renames every member and creates everything that is not a regular
+ * file itself, in archive order.  Regular files of up to EX_MAXFILE bytes
+ * are read into memory and handed to a pool of threads that create,
+ * write and close them.  Larger files are extracted by extract() as
+ * before.
+ *
+ * Ordering is kept where it matters:
+ *  - a member whose name is, is inside of, or contains a file still being
+ *    written waits for the pool to drain first, so later members in the
+ *    archive still replace earlier ones;
+ *  - hard links wait for the pool to drain, so their target is complete;
+ *  - so does any change of directory for -C style patterns.
+ * Directory modes and times are fixed up by proc_dir() at the end, after
+ * the pool has drained, exactly as they are without -J.
+ *
+ * The directory and link tables are shared, so everything that may touch
+ * them (file_creat() once the quick open fails, node_creat(), purging a
+ * failed file) runs under ex_mtx.
+ */
+
+#define EX_MAXFILE	(1024 * 1024)	/* largest file given to the pool */
+
+struct ex_job {
+	ARCHD	arcn;
+	char	*data;			/* contents of the file */
+	int	done;			/* the file has been written */
+	int	failed;			/* the file could not be created */
+};
+
+static pthread_mutex_t ex_mtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t ex_qmtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t ex_work = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t ex_fin = PTHREAD_COND_INITIALIZER;
+static pthread_t *ex_thr;
+static int ex_nthr;			/* 0 when there is no pool */
+static struct ex_job *ex_job;		/* ring of jobs, by sequence */
+static int ex_njob;
+static u_int64_t ex_nput;		/* jobs queued */
+static u_int64_t ex_ntaken;		/* jobs picked up by a thread */
+static u_int64_t ex_nreaped;		/* jobs finished with */
+static int ex_quit;
+
+static void
+ex_run(struct ex_job *j)
+{
+	ARCHD *arcn = &j->arcn;
+	off_t done, size = arcn->sb.st_size;
+	struct stat sb;
+	int fd, res, isem = 1, rem, sz = MINFBSZ;
+
+	if ((fd = open(arcn->name, O_WRONLY | O_CREAT | O_EXCL,
+	    arcn->sb.st_mode & FILEBITS)) < 0) {
+		pthread_mutex_lock(&ex_mtx);
+		fd = file_creat(arcn);
+		pthread_mutex_unlock(&ex_mtx);
+		if (fd < 0) {
+			j->failed = 1;
+			return;
+		}
+	}
+
+	/*
+	 * same as rd_wrfile(), with the data from memory
+	 */
+	if (fstat(fd, &sb) == 0) {
+		if (sb.st_blksize > 0)
+			sz = (int)sb.st_blksize;
+	} else
+		syswarn(0, errno, "Unable to obtain block size for file %s",
+		    arcn->name);
+	rem = sz;
+	for (done = 0; done < size; done += res)
+		if ((res = file_write(fd, j->data + done, size - done, &rem,
+		    &isem, sz, arcn->name)) <= 0)
+			break;
+	if (isem && size > 0)
+		file_flush(fd, arcn->name, isem);
+	file_close(arcn, fd);
+}
+
+static void *
+ex_worker(void *arg)
+{
+	struct ex_job *j;
+
+	pthread_mutex_lock(&ex_qmtx);
+	for (;;) {
+		while (ex_ntaken == ex_nput && !ex_quit)
+			pthread_cond_wait(&ex_work, &ex_qmtx);
+		if (ex_ntaken == ex_nput)
+			break;
+		j = &ex_job[ex_ntaken++ % ex_njob];
+		pthread_mutex_unlock(&ex_qmtx);
+
+		ex_run(j);
+
+		pthread_mutex_lock(&ex_qmtx);
+		j->done = 1;
+		pthread_cond_broadcast(&ex_fin);
+	}
+	pthread_mutex_unlock(&ex_qmtx);
+	return (NULL);
+}
+
+/*
+ * Finish with the oldest job, waiting for it if wait is set.
+ * Return:
+ *	1 if a job was reaped, 0 otherwise
+ */
+static int
+ex_reap(int wait)
+{
+	struct ex_job *j;
+	int done;
+
+	if (ex_nreaped == ex_nput)
+		return (0);
+	j = &ex_job[ex_nreaped % ex_njob];
+	pthread_mutex_lock(&ex_qmtx);
+	while (!j->done && wait)
+		pthread_cond_wait(&ex_fin, &ex_qmtx);
+	done = j->done;
+	pthread_mutex_unlock(&ex_qmtx);
+	if (!done)
+		return (0);
+
+	/* as extract() does when it cannot create a file */
+	if (j->failed) {
+		pthread_mutex_lock(&ex_mtx);
+		purg_lnk(&j->arcn);
+		pthread_mutex_unlock(&ex_mtx);
+	}
+	free(j->data);
+	j->data = NULL;
+	ex_nreaped++;
+	return (1);
+}
+
+/*
+ * Does a member named name have to wait for the file being written as
+ * other?  It does when one is the other or lies inside it, except for a
+ * directory holding other.
+ */
+static int
+ex_clash(const char *name, int type, const char *other)
+{
+	size_t len = strlen(name), olen = strlen(other);
+
+	if (len == olen)
+		return (strcmp(name, other) == 0);
+	if (len < olen)
+		return (type != PAX_DIR && other[len] == '/' &&
+		    strncmp(name, other, len) == 0);
+	return (name[olen] == '/' && strncmp(name, other, olen) == 0);
+}
+
+/*
+ * ex_start()
+ *	start a pool of n threads to extract files with
+ */
+
+void
+ex_start(int n)
+{
+	sigset_t set, oset;
+	int i;
+
+	if (n < 2)
+		return;
+	ex_njob = 2 * n;
+	if ((ex_thr = calloc(n, sizeof(*ex_thr))) == NULL ||
+	    (ex_job = calloc(ex_njob, sizeof(*ex_job))) == NULL) {
+		paxwarn(1, "Unable to allocate memory for -J, extracting "
+		    "one file at a time");
+		free(ex_thr);
+		ex_thr = NULL;
+		return;
+	}
+
+	/* signals are for the main thread, which owns the cleanup */
+	sigfillset(&set);
+	pthread_sigmask(SIG_BLOCK, &set, &oset);
+	for (i = 0; i < n; i++)
+		if (pthread_create(&ex_thr[i], NULL, ex_worker, NULL) != 0)
+			break;
+	pthread_sigmask(SIG_SETMASK, &oset, NULL);
+	if ((ex_nthr = i) == 0) {
+		free(ex_thr);
+		free(ex_job);
+		ex_thr = NULL;
+		ex_job = NULL;
+	}
+}
+
+/*
+ * ex_want()
+ *	should arcn be extracted by the pool?
+ */
+
+int
+ex_want(ARCHD *arcn)
+{
+	return (ex_nthr > 0 && arcn->sb.st_size <= EX_MAXFILE &&
+	    (arcn->pat == NULL || arcn->pat->chdname == NULL));
+}
+
+/*
+ * ex_wait()
+ *	before arcn is looked at or created in the file system, wait for any
+ *	file in the way to be written.
+ */
+
+void
+ex_wait(ARCHD *arcn)
+{
+	u_int64_t i;
+
+	while (ex_reap(0))
+		;
+	for (i = ex_nreaped; i < ex_nput; i++)
+		if (ex_clash(arcn->name, arcn->type,
+		    ex_job[i % ex_njob].arcn.name)) {
+			ex_sync();
+			return;
+		}
+}
+
+/*
+ * ex_sync()
+ *	wait until every file handed to the pool has been written
+ */
+
+void
+ex_sync(void)
+{
+	while (ex_reap(1))
+		;
+}
+
+/*
+ * ex_lock(), ex_unlock()
+ *	bracket changes extract() makes to the file system while the pool
+ *	may be running
+ */
+
+void
+ex_lock(void)
+{
+	if (ex_nthr > 0)
+		pthread_mutex_lock(&ex_mtx);
+}
+
+void
+ex_unlock(void)
+{
+	if (ex_nthr > 0)
+		pthread_mutex_unlock(&ex_mtx);
+}
+
+/*
+ * ex_put()
+ *	read the data of arcn from the archive and queue it to be written.
+ *	The caller has already called ex_wait().
+ * Return:
+ *	0 ok, -1 if the archive could not be read (as rd_wrfile())
+ */
+
+int
+ex_put(ARCHD *arcn)
+{
+	struct ex_job *j;
+	off_t size = arcn->sb.st_size;
+	u_int32_t crc = 0;
+	char *data;
+	off_t i;
+
+	if ((data = malloc(size ? size : 1)) == NULL) {
+		paxwarn(1, "Out of memory extracting %s", arcn->name);
+		return (rd_skip(size) < 0 ? -1 : 0);
+	}
+	if (size > 0 && rd_wrbuf(data, size) != size) {
+		free(data);
+		return (-1);
+	}
+	if (docrc) {
+		for (i = 0; i < size; i++)
+			crc += data[i] & 0xff;
+		if (arcn->crc != crc)
+			paxwarn(1, "Actual crc does not match expected crc %s",
+			    arcn->name);
+	}
+
+	while (ex_nput - ex_nreaped == ex_njob)
+		(void)ex_reap(1);
+	j = &ex_job[ex_nput % ex_njob];
+	memcpy(&j->arcn, arcn, sizeof(j->arcn));
+	j->arcn.org_name = j->arcn.name;
+	j->data = data;
+	j->done = j->failed = 0;
+
+	pthread_mutex_lock(&ex_qmtx);
+	ex_nput++;
+	pthread_cond_signal(&ex_work);
+	pthread_mutex_unlock(&ex_qmtx);
+	return (0);
+}
+
+/*
+ * ex_end()
+ *	write out what is left and stop the pool
+ */
+
+void
+ex_end(void)
+{
+	int i;
+
+	if (ex_nthr == 0)
+		return;
+	ex_sync();
+	pthread_mutex_lock(&ex_qmtx);
+	ex_quit = 1;
+	pthread_cond_broadcast(&ex_work);
+	pthread_mutex_unlock(&ex_qmtx);
+	for (i = 0; i < ex_nthr; i++)
+		pthread_join(ex_thr[i], NULL);
+	free(ex_thr);
+	free(ex_job);
+	ex_thr = NULL;
+	ex_job = NULL;
+	ex_nthr = 0;
+}
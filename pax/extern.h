@@ -68,6 +68,12 @@ void append(void);
 void archive(void);
 void copy(void);
 
+/*
+ * ar_zlib.c
+ */
+int zlib_start(int, int);
+int zlib_end(void);
+
 /*
  * buf_subs.c
  */
@@ -89,7 +95,7 @@ void wr_fin(void);
 int wr_rdbuf(char *, int);
 int rd_wrbuf(char *, int);
 int wr_skip(off_t);
-int wr_rdfile(ARCHD *, int, off_t *);
+int wr_rdfile(ARCHD *, int, PFBUF *, off_t *);
 int rd_wrfile(ARCHD *, int, off_t *);
 void cp_file(ARCHD *, int, int);
 int buf_fill(void);
@@ -118,6 +124,18 @@ int bcpio_rd(ARCHD *, char *);
 off_t bcpio_endrd(void);
 int bcpio_wr(ARCHD *);
 
+/*
+ * expool.c
+ */
+void ex_start(int);
+int ex_want(ARCHD *);
+void ex_wait(ARCHD *);
+void ex_sync(void);
+void ex_lock(void);
+void ex_unlock(void);
+int ex_put(ARCHD *);
+void ex_end(void);
+
 /*
  * file_subs.c
  */
@@ -226,6 +244,7 @@ extern int pids;
 extern int rmleadslash;
 extern int exit_val;
 extern int docrc;
+extern int njobs;
 extern char *dirptr;
 extern char *argv0;
 extern enum op_mode { OP_PAX, OP_TAR, OP_CPIO } op_mode;
@@ -237,6 +256,15 @@ extern int havechd;
 
 void sig_cleanup(int);
 
+/*
+ * prefetch.c
+ */
+void pf_start(int);
+int pf_full(void);
+void pf_put(ARCHD *, int);
+ARCHD *pf_get(int **, PFBUF **);
+void pf_end(void);
+
 /*
  * sel_subs.c
  */
@@ -254,6 +282,7 @@ void purg_lnk(ARCHD *);
 void lnk_end(void);
 int ftime_start(void);
 int chk_ftime(ARCHD *);
+void tab_stats(int);
 int sltab_start(void);
 int sltab_add_sym(const char *_path, const char *_value, mode_t _mode);
 int sltab_add_link(const char *, const struct stat *);
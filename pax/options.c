@@ -151,10 +151,6 @@ static int gzip_id(char *_blk, int _size);
 static int bzip2_id(char *_blk, int _size);
 static int xz_id(char *_blk, int _size);
 
-#define GZIP_CMD	"gzip"		/* command to run as gzip */
-#define COMPRESS_CMD	"compress"	/* command to run as compress */
-#define BZIP2_CMD	"bzip2"		/* command to run as bzip2 */
-
 /*
  *	Format specific routine table
  *	(see pax.h for description of each function)
@@ -298,7 +294,7 @@ pax_options(int argc, char **argv)
 	/*
 	 * process option flags
 	 */
-	while ((c=getopt(argc,argv,"ab:cdf:ijklno:p:rs:tuvwx:zB:DE:G:HLOPT:U:XYZ0"))
+	while ((c=getopt(argc,argv,"ab:cdf:ijklno:p:rs:tuvwx:zB:DE:G:HJ:LOPT:U:XYZ0"))
 	    != -1) {
 		switch (c) {
 		case 'a':
@@ -554,6 +550,18 @@ pax_options(int argc, char **argv)
 			Hflag = 1;
 			flg |= CHF;
 			break;
+		case 'J':
+			/*
+			 * extract files on this many threads. Non standard
+			 * option.
+			 */
+			njobs = strtonum(optarg, 1, INT_MAX, &errstr);
+			if (errstr) {
+				paxwarn(1, "Number of jobs is %s: %s",
+				    errstr, optarg);
+				pax_usage();
+			}
+			break;
 		case 'L':
 			/*
 			 * follow symlinks
@@ -712,6 +720,7 @@ tar_options(int argc, char **argv)
 {
 	int c;
 	int Oflag = 0;
+	const char *errstr;
 	int nincfiles = 0;
 	int incfiles_max = 0;
 	struct incfile {
@@ -729,7 +738,7 @@ tar_options(int argc, char **argv)
 	 * process option flags
 	 */
 	while ((c = getoldopt(argc, argv,
-	    "b:cef:hjmopqruts:vwxzBC:HI:LNOPXZ014578")) != -1) {
+	    "b:cef:hjmopqruts:vwxzBC:HI:J:LNOPXZ014578")) != -1) {
 		switch (c) {
 		case 'b':
 			/*
@@ -878,6 +887,17 @@ tar_options(int argc, char **argv)
 			incfiles[nincfiles - 1].file = optarg;
 			incfiles[nincfiles - 1].dir = chdname;
 			break;
+		case 'J':
+			/*
+			 * extract files on this many threads
+			 */
+			njobs = strtonum(optarg, 1, INT_MAX, &errstr);
+			if (errstr) {
+				paxwarn(1, "Number of jobs is %s: %s",
+				    errstr, optarg);
+				tar_usage();
+			}
+			break;
 		case 'L':
 			/*
 			 * follow symlinks
@@ -1671,8 +1691,9 @@ pax_usage(void)
 	(void)fputs(
 	    "usage: pax [-0cdjnOvz] [-E limit] [-f archive] [-G group] [-s replstr]\n"
 	    "           [-T range] [-U user] [pattern ...]\n"
-	    "       pax -r [-0cDdijknOuvYZz] [-E limit] [-f archive] [-G group] [-o options]\n"
-	    "           [-p string] [-s replstr] [-T range] [-U user] [pattern ...]\n"
+	    "       pax -r [-0cDdijknOuvYZz] [-E limit] [-f archive] [-G group] [-J jobs]\n"
+	    "           [-o options] [-p string] [-s replstr] [-T range] [-U user]\n"
+	    "           [pattern ...]\n"
 	    "       pax -w [-0adHijLOPtuvXz] [-B bytes] [-b blocksize] [-f archive]\n"
 	    "           [-G group] [-o options] [-s replstr] [-T range] [-U user]\n"
 	    "           [-x format] [file ...]\n"
@@ -1691,11 +1712,12 @@ void
 tar_usage(void)
 {
 	(void)fputs(
-	    "usage: tar {crtux}[014578befHhjLmNOoPpqsvwXZz]\n"
-	    "           [blocking-factor | archive | replstr] [-C directory] [-I file]\n"
-	    "           [file ...]\n"
+	    "usage: tar {crtux}[014578befHhJjLmNOoPpqsvwXZz]\n"
+	    "           [blocking-factor | archive | jobs | replstr] [-C directory]\n"
+	    "           [-I file] [file ...]\n"
 	    "       tar {-crtux} [-014578eHhjLmNOoPpqvwXZz] [-b blocking-factor]\n"
-	    "           [-C directory] [-f archive] [-I file] [-s replstr] [file ...]\n",
+	    "           [-C directory] [-f archive] [-I file] [-J jobs] [-s replstr]\n"
+	    "           [file ...]\n",
 	    stderr);
 	exit(1);
 }
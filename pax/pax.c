@@ -89,6 +89,7 @@ int	pids;			/* preserve file uid/gid */
 int	rmleadslash = 0;	/* remove leading '/' from pathnames */
 int	exit_val;		/* exit value */
 int	docrc;			/* check/create file crc */
+int	njobs = 1;		/* files to extract at once */
 char	*dirptr;		/* destination dir in a copy */
 char	*argv0;			/* root of argv[0] */
 enum op_mode op_mode;		/* what program are we acting as? */
@@ -275,8 +276,9 @@ main(int argc, char **argv)
 		    NULL) == -1)
 			err(1, "pledge");
 
-		/* Copy mode, or no gzip -- don't need to fork/exec. */
-		if (gzip_program == NULL || act == COPY) {
+		/* Copy mode, or no external compressor -- no fork/exec. */
+		if (gzip_program == NULL || act == COPY ||
+		    strcmp(gzip_program, GZIP_CMD) == 0) {
 			if (pledge("stdio rpath wpath cpath fattr dpath getpw tape",
 			    NULL) == -1)
 				err(1, "pledge");
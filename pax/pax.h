@@ -239,6 +239,19 @@ typedef struct oplist {
 	struct oplist	*fow;		/* next option */
 } OPLIST;
 
+/*
+ * Read Ahead Buffer
+ *
+ * The start of a file to be archived, read by a prefetch thread while
+ * the members before it are being written (see prefetch.c)
+ */
+typedef struct {
+	char	*buf;			/* data read ahead */
+	off_t	len;			/* bytes in buf */
+	int	err;			/* errno of a failed read, or 0 */
+	int	eof;			/* the file ended early */
+} PFBUF;
+
 /*
  * General Macros
  */
@@ -258,5 +271,10 @@ typedef struct oplist {
 #define OCT		8
 #define _PAX_		1
 #define _TFILE_BASE	"paxXXXXXXXXXX"
+#define MINFBSZ		512	/* default block size for hole detect */
 #define MAX_TIME_T	(sizeof(time_t) == sizeof(long long) ? \
 			    LLONG_MAX : INT_MAX)
+
+#define GZIP_CMD	"gzip"		/* gzip, done in-process with libz */
+#define COMPRESS_CMD	"compress"	/* command to run as compress */
+#define BZIP2_CMD	"bzip2"		/* command to run as bzip2 */
@@ -0,0 +1,241 @@
+/*
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <err.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "pax.h"
+#include "extern.h"
+
+/*
+ * Read ahead for archive creation.  wr_archive() queues the members to
+ * be stored in archive order, each one already selected, opened and
+ * renamed on the main thread, and a few threads read the start of every
+ * queued regular file while the members in front of it are written out.
+ * Only the reading moves off the main thread, so the archive is exactly
+ * what storing one member at a time would produce.
+ */
+
+#define PF_NTHR		4		/* reader threads */
+#define PF_NAHEAD	16		/* members queued ahead of the writer */
+#define PF_BUFSIZE	(256 * 1024)	/* most read ahead of any one file */
+
+struct pf_ent {
+	ARCHD	arcn;
+	char	org_name[PATH_MAX];	/* arcn.org_name points here */
+	int	fd;
+	int	done;			/* read ahead has finished */
+	PFBUF	pb;
+};
+
+static pthread_mutex_t pf_mtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pf_work = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t pf_fin = PTHREAD_COND_INITIALIZER;
+static pthread_t pf_thr[PF_NTHR];
+static int pf_nthr;			/* 0 when nothing is read ahead */
+static struct pf_ent *pf_ent;		/* ring of members, by sequence */
+static int pf_nent;
+static u_int64_t pf_nput;		/* members queued */
+static u_int64_t pf_ntaken;		/* members picked up by a reader */
+static u_int64_t pf_nget;		/* members handed to the writer */
+static int pf_quit;
+
+static void *
+pf_reader(void *arg)
+{
+	struct pf_ent *pe;
+	off_t want;
+	ssize_t n;
+
+	pthread_mutex_lock(&pf_mtx);
+	for (;;) {
+		while (pf_ntaken == pf_nput && !pf_quit)
+			pthread_cond_wait(&pf_work, &pf_mtx);
+		if (pf_quit)
+			break;
+		pe = &pf_ent[pf_ntaken++ % pf_nent];
+		if (pe->done)
+			continue;
+		pthread_mutex_unlock(&pf_mtx);
+
+		want = MINIMUM(pe->arcn.sb.st_size, PF_BUFSIZE);
+		while (pe->pb.len < want) {
+			n = read(pe->fd, pe->pb.buf + pe->pb.len,
+			    want - pe->pb.len);
+			if (n == -1) {
+				if (errno == EINTR)
+					continue;
+				pe->pb.err = errno;
+				break;
+			}
+			if (n == 0) {
+				pe->pb.eof = 1;
+				break;
+			}
+			pe->pb.len += n;
+		}
+
+		pthread_mutex_lock(&pf_mtx);
+		pe->done = 1;
+		pthread_cond_broadcast(&pf_fin);
+	}
+	pthread_mutex_unlock(&pf_mtx);
+	return (NULL);
+}
+
+/*
+ * pf_start()
+ *	set up the queue, with reader threads unless serial is set (the
+ *	members are then handed back one at a time, with nothing read).
+ */
+
+void
+pf_start(int serial)
+{
+	sigset_t set, oset;
+	int i;
+
+	pf_nput = pf_ntaken = pf_nget = 0;
+	pf_quit = 0;
+	pf_nthr = 0;
+	pf_nent = serial ? 1 : PF_NAHEAD;
+	if ((pf_ent = calloc(pf_nent, sizeof(*pf_ent))) == NULL) {
+		paxwarn(1, "Unable to allocate memory for read ahead");
+		pf_nent = 1;
+		if ((pf_ent = calloc(1, sizeof(*pf_ent))) == NULL)
+			err(1, NULL);
+		return;
+	}
+	if (serial)
+		return;
+	for (i = 0; i < pf_nent; i++)
+		if ((pf_ent[i].pb.buf = malloc(PF_BUFSIZE)) == NULL)
+			return;
+
+	/* signals are for the main thread, which owns the cleanup */
+	sigfillset(&set);
+	pthread_sigmask(SIG_BLOCK, &set, &oset);
+	for (i = 0; i < PF_NTHR; i++)
+		if (pthread_create(&pf_thr[i], NULL, pf_reader, NULL) != 0)
+			break;
+	pthread_sigmask(SIG_SETMASK, &oset, NULL);
+	pf_nthr = i;
+}
+
+/*
+ * pf_full()
+ *	the queue has no room for another member
+ */
+
+int
+pf_full(void)
+{
+	return (pf_nput - pf_nget == pf_nent);
+}
+
+/*
+ * pf_put()
+ *	queue a copy of arcn, open on fd (or -1 if there is no data to store)
+ */
+
+void
+pf_put(ARCHD *arcn, int fd)
+{
+	struct pf_ent *pe;
+
+	pe = &pf_ent[pf_nput % pf_nent];
+	memcpy(&pe->arcn, arcn, sizeof(pe->arcn));
+	(void)strlcpy(pe->org_name, arcn->org_name, sizeof(pe->org_name));
+	pe->arcn.org_name = pe->org_name;
+	pe->fd = fd;
+	pe->pb.len = 0;
+	pe->pb.err = pe->pb.eof = 0;
+	pe->done = pf_nthr == 0 || fd < 0 || arcn->sb.st_size == 0;
+
+	pthread_mutex_lock(&pf_mtx);
+	pf_nput++;
+	pthread_cond_signal(&pf_work);
+	pthread_mutex_unlock(&pf_mtx);
+}
+
+/*
+ * pf_get()
+ *	wait for the oldest member to be read ahead and hand it over, along
+ *	with its descriptor and whatever was read.  It stays valid until the
+ *	next pf_put().
+ * Return:
+ *	the member, or NULL when the queue is empty
+ */
+
+ARCHD *
+pf_get(int **fdp, PFBUF **pbp)
+{
+	struct pf_ent *pe;
+
+	if (pf_nget == pf_nput)
+		return (NULL);
+	pe = &pf_ent[pf_nget % pf_nent];
+	pthread_mutex_lock(&pf_mtx);
+	while (!pe->done)
+		pthread_cond_wait(&pf_fin, &pf_mtx);
+	pf_nget++;
+	/*
+	 * Members with nothing to read are handed over without waiting for
+	 * a reader, so the readers can fall behind; move them up, or one
+	 * could pick up a slot that was already put again.
+	 */
+	if (pf_ntaken < pf_nget)
+		pf_ntaken = pf_nget;
+	pthread_mutex_unlock(&pf_mtx);
+	*fdp = &pe->fd;
+	*pbp = &pe->pb;
+	return (&pe->arcn);
+}
+
+/*
+ * pf_end()
+ *	stop the readers and close any members that were queued but will not
+ *	be stored.
+ */
+
+void
+pf_end(void)
+{
+	struct pf_ent *pe;
+	int i;
+
+	pthread_mutex_lock(&pf_mtx);
+	pf_quit = 1;
+	pthread_cond_broadcast(&pf_work);
+	pthread_mutex_unlock(&pf_mtx);
+	for (i = 0; i < pf_nthr; i++)
+		pthread_join(pf_thr[i], NULL);
+	for (; pf_nget < pf_nput; pf_nget++) {
+		pe = &pf_ent[pf_nget % pf_nent];
+		rdfile_close(&pe->arcn, &pe->fd);
+	}
+	for (i = 0; i < pf_nent; i++)
+		free(pf_ent[i].pb.buf);
+	free(pf_ent);
+	pf_ent = NULL;
+	pf_nthr = 0;
+}
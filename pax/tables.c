@@ -45,6 +45,8 @@
 #include <string.h>
 #include <unistd.h>
 
+#include <arena.h>
+
 #include "pax.h"
 #include "extern.h"
 
@@ -68,29 +70,34 @@
  */
 
 /*
- * Hash Table Sizes MUST BE PRIME, if set too small performance suffers.
- * Probably safe to expect 500000 inodes per tape. Assuming good key
- * distribution (inodes) chains of under 50 long (worst case) is ok.
+ * The hard link and file time tables can get HUGE (a backup of snapshots
+ * with deduplicating links easily has tens of millions), so they are open
+ * addressed with linear probing and double in size whenever they get half
+ * full. Their sizes MUST BE A POWER OF 2 and are only where they start.
+ * The other (chained) hash table sizes MUST BE PRIME, if set too small
+ * performance suffers.
  */
-#define L_TAB_SZ	2503		/* hard link hash table size */
-#define F_TAB_SZ	50503		/* file time hash table size */
+#define L_TAB_SZ	1024		/* initial hard link table size */
+#define F_TAB_SZ	4096		/* initial file time table size */
 #define N_TAB_SZ	541		/* interactive rename hash table */
 #define D_TAB_SZ	317		/* unique device mapping table */
 #define A_TAB_SZ	317		/* ftree dir access time reset table */
 #define SL_TAB_SZ	317		/* escape symlink tables */
 #define MAXKEYLEN	64		/* max number of chars for hash */
 #define DIRP_SIZE	64		/* initial size of created dir table */
+#define LN_CLASS	16		/* hard link name pool granularity */
+#define LN_POOLS	((PAXPATHLEN + LN_CLASS) / LN_CLASS)
 
 /*
- * file hard link structure (hashed by dev/ino and chained) used to find the
- * hard links in a file system or with some archive formats (cpio)
+ * file hard link structure (hashed by dev/ino, stored in the table itself)
+ * used to find the hard links in a file system or with some archive formats
+ * (cpio). A slot with a NULL name is free.
  */
 typedef struct hrdlnk {
 	ino_t		ino;	/* files inode number */
 	char		*name;	/* name of first file seen with this ino/dev */
 	dev_t		dev;	/* files device number */
 	u_long		nlink;	/* expected link count */
-	struct hrdlnk	*fow;
 } HRDLNK;
 
 /*
@@ -107,8 +114,8 @@ typedef struct hrdlnk {
 typedef struct ftm {
 	off_t		seek;		/* location in scratch file */
 	struct timespec	mtim;		/* files last modification time */
-	struct ftm	*fow;
-	int		namelen;	/* file name length */
+	u_int32_t	hash;		/* hash of the whole file name */
+	int		namelen;	/* file name length, 0 if slot is free */
 } FTM;
 
 /*
@@ -191,11 +198,21 @@ typedef struct dirdata {
 	u_int16_t frc_mode;	/* do we force mode settings? */
 } DIRDATA;
 
-static HRDLNK **ltab = NULL;	/* hard link table for detecting hard links */
-static FTM **ftab = NULL;	/* file time table for updating arch */
+/*
+ * open addressed tables: the mask is the size - 1, cnt the slots in use
+ * and max the most ever in use. The lookup counts, slots probed and
+ * longest probe are for tab_stats().
+ */
+static HRDLNK *ltab = NULL;	/* hard link table for detecting hard links */
+static size_t lmask, lcnt, lmax;
+static u_int64_t lfinds, lprobes, llongest;
+static FTM *ftab = NULL;	/* file time table for updating arch */
+static size_t fmask, fcnt;
+static u_int64_t ffinds, fprobes, flongest;
 static NAMT **ntab = NULL;	/* interactive rename storage table */
 #ifndef NOCPIO
 static DEVT **dtab = NULL;	/* device/inode mapping tables */
+static struct arena darena;	/* DEVT and DLIST nodes, never freed */
 #endif
 static ATDIR **atab = NULL;	/* file tree directory time reset table */
 static DIRDATA *dirp = NULL;	/* storage for setting created dir time/mode */
@@ -203,6 +220,14 @@ static size_t dirsize;		/* size of dirp table */
 static size_t dircnt = 0;	/* entries in dir time/mode storage */
 static int ffd = -1;		/* tmp file for file time table name storage */
 
+/*
+ * hard link names come from pools of LN_CLASS byte size classes, so a
+ * name given back when all the links to a file were seen is reused by
+ * one of about the same length, and all of them go at once in lnk_end()
+ */
+static struct arena larena;
+static struct pool lpool[LN_POOLS];
+
 /*
  * hard link table routines
  *
@@ -219,6 +244,139 @@ static int ffd = -1;		/* tmp file for file time table name storage */
  * can be detected by the archive format.
  */
 
+/*
+ * lnk_hash()
+ *	mix the device and inode numbers into a 64 bit hash, so file systems
+ *	handing out inode numbers in runs (or with the same low bits on
+ *	several devices) still spread over the whole table.
+ */
+
+static u_int64_t
+lnk_hash(dev_t dev, ino_t ino)
+{
+	u_int64_t h;
+
+	h = (u_int64_t)ino ^ ((u_int64_t)dev * 0x9e3779b97f4a7c15ULL);
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+	return(h);
+}
+
+/*
+ * lnk_name()
+ *	copy a hard link name into its size class pool
+ */
+
+static char *
+lnk_name(const char *name)
+{
+	size_t len;
+	char *p;
+
+	len = strlen(name) + 1;
+	if ((len - 1) / LN_CLASS >= LN_POOLS)
+		return(NULL);
+	if ((p = pool_get(&lpool[(len - 1) / LN_CLASS])) != NULL)
+		memcpy(p, name, len);
+	return(p);
+}
+
+static void
+lnk_name_free(char *name)
+{
+	pool_put(&lpool[strlen(name) / LN_CLASS], name);
+}
+
+/*
+ * lnk_find()
+ *	find the slot holding dev/ino, or the free slot it would go in
+ */
+
+static HRDLNK *
+lnk_find(dev_t dev, ino_t ino)
+{
+	HRDLNK *pt;
+	size_t indx, n;
+
+	indx = lnk_hash(dev, ino) & lmask;
+	for (n = 1;; n++) {
+		pt = &ltab[indx];
+		if (pt->name == NULL ||
+		    (pt->ino == ino && pt->dev == dev))
+			break;
+		indx = (indx + 1) & lmask;
+	}
+	lfinds++;
+	lprobes += n;
+	if (n > llongest)
+		llongest = n;
+	return(pt);
+}
+
+/*
+ * lnk_grow()
+ *	double the size of the hard link table
+ * Return:
+ *	0 if ok, -1 if out of memory (the table is left as it was)
+ */
+
+static int
+lnk_grow(void)
+{
+	HRDLNK *otab = ltab;
+	size_t i, indx, osize = lmask + 1;
+
+	if ((ltab = calloc(osize * 2, sizeof(HRDLNK))) == NULL) {
+		ltab = otab;
+		return(-1);
+	}
+	lmask = osize * 2 - 1;
+	for (i = 0; i < osize; i++) {
+		if (otab[i].name == NULL)
+			continue;
+		indx = lnk_hash(otab[i].dev, otab[i].ino) & lmask;
+		while (ltab[indx].name != NULL)
+			indx = (indx + 1) & lmask;
+		ltab[indx] = otab[i];
+	}
+	free(otab);
+	return(0);
+}
+
+/*
+ * lnk_del()
+ *	free the entry in slot pt. Later entries of the same probe sequence
+ *	are moved up into the hole, so lookups never need a deleted marker.
+ */
+
+static void
+lnk_del(HRDLNK *pt)
+{
+	size_t hole, indx, home;
+
+	lnk_name_free(pt->name);
+	hole = indx = pt - ltab;
+	for (;;) {
+		indx = (indx + 1) & lmask;
+		if (ltab[indx].name == NULL)
+			break;
+		/*
+		 * the entry can fill the hole unless its home slot lies
+		 * (cyclically) after the hole and at or before itself
+		 */
+		home = lnk_hash(ltab[indx].dev, ltab[indx].ino) & lmask;
+		if (((indx - home) & lmask) >= ((indx - hole) & lmask)) {
+			ltab[hole] = ltab[indx];
+			hole = indx;
+		}
+	}
+	ltab[hole].name = NULL;
+	--lcnt;
+}
+
 /*
  * lnk_start
  *	Creates the hard link table.
@@ -229,12 +387,18 @@ static int ffd = -1;		/* tmp file for file time table name storage */
 int
 lnk_start(void)
 {
+	size_t i;
+
 	if (ltab != NULL)
 		return(0);
-	if ((ltab = calloc(L_TAB_SZ, sizeof(HRDLNK *))) == NULL) {
+	if ((ltab = calloc(L_TAB_SZ, sizeof(HRDLNK))) == NULL) {
 		paxwarn(1, "Cannot allocate memory for hard link table");
 		return(-1);
 	}
+	lmask = L_TAB_SZ - 1;
+	arena_init(&larena, 0);
+	for (i = 0; i < LN_POOLS; i++)
+		pool_init(&lpool[i], &larena, (i + 1) * LN_CLASS);
 	return(0);
 }
 
@@ -254,8 +418,6 @@ int
 chk_lnk(ARCHD *arcn)
 {
 	HRDLNK *pt;
-	HRDLNK **ppt;
-	u_int indx;
 
 	if (ltab == NULL)
 		return(-1);
@@ -266,66 +428,49 @@ chk_lnk(ARCHD *arcn)
 		return(0);
 
 	/*
-	 * hash inode number and look for this file
+	 * hash inode and device number and look for this file
 	 */
-	indx = ((unsigned)arcn->sb.st_ino) % L_TAB_SZ;
-	if ((pt = ltab[indx]) != NULL) {
+	pt = lnk_find(arcn->sb.st_dev, arcn->sb.st_ino);
+	if (pt->name != NULL) {
 		/*
-		 * its hash chain in not empty, walk down looking for it
+		 * found a link. set the node type and copy in the
+		 * name of the file it is to link to. we need to
+		 * handle hardlinks to regular files differently than
+		 * other links.
 		 */
-		ppt = &(ltab[indx]);
-		while (pt != NULL) {
-			if ((pt->ino == arcn->sb.st_ino) &&
-			    (pt->dev == arcn->sb.st_dev))
-				break;
-			ppt = &(pt->fow);
-			pt = pt->fow;
-		}
+		arcn->ln_nlen = strlcpy(arcn->ln_name, pt->name,
+			sizeof(arcn->ln_name));
+		/* XXX truncate? */
+		if ((size_t)arcn->nlen >= sizeof(arcn->name))
+			arcn->nlen = sizeof(arcn->name) - 1;
+		if (arcn->type == PAX_REG)
+			arcn->type = PAX_HRG;
+		else
+			arcn->type = PAX_HLK;
 
-		if (pt != NULL) {
-			/*
-			 * found a link. set the node type and copy in the
-			 * name of the file it is to link to. we need to
-			 * handle hardlinks to regular files differently than
-			 * other links.
-			 */
-			arcn->ln_nlen = strlcpy(arcn->ln_name, pt->name,
-				sizeof(arcn->ln_name));
-			/* XXX truncate? */
-			if ((size_t)arcn->nlen >= sizeof(arcn->name))
-				arcn->nlen = sizeof(arcn->name) - 1;
-			if (arcn->type == PAX_REG)
-				arcn->type = PAX_HRG;
-			else
-				arcn->type = PAX_HLK;
-
-			/*
-			 * if we have found all the links to this file, remove
-			 * it from the database
-			 */
-			if (--pt->nlink <= 1) {
-				*ppt = pt->fow;
-				free(pt->name);
-				free(pt);
-			}
-			return(1);
-		}
+		/*
+		 * if we have found all the links to this file, remove
+		 * it from the database
+		 */
+		if (--pt->nlink <= 1)
+			lnk_del(pt);
+		return(1);
 	}
 
 	/*
 	 * we never saw this file before. It has links so we add it to the
-	 * front of this hash chain
+	 * table, making room first if it is getting full. If the table
+	 * cannot grow we keep filling it while there is any room left.
 	 */
-	if ((pt = malloc(sizeof(HRDLNK))) != NULL) {
-		if ((pt->name = strdup(arcn->name)) != NULL) {
-			pt->dev = arcn->sb.st_dev;
-			pt->ino = arcn->sb.st_ino;
-			pt->nlink = arcn->sb.st_nlink;
-			pt->fow = ltab[indx];
-			ltab[indx] = pt;
-			return(0);
-		}
-		free(pt);
+	if (lcnt + 1 > (lmask + 1) / 2 && lnk_grow() == 0)
+		pt = lnk_find(arcn->sb.st_dev, arcn->sb.st_ino);
+	if (lcnt < lmask && (pt->name = lnk_name(arcn->name)) != NULL) {
+		pt->dev = arcn->sb.st_dev;
+		pt->ino = arcn->sb.st_ino;
+		pt->nlink = arcn->sb.st_nlink;
+		if (++lcnt > lmax)
+			lmax = lcnt;
+		return(0);
 	}
 
 	paxwarn(1, "Hard link table out of memory");
@@ -343,8 +488,6 @@ void
 purg_lnk(ARCHD *arcn)
 {
 	HRDLNK *pt;
-	HRDLNK **ppt;
-	u_int indx;
 
 	if (ltab == NULL)
 		return;
@@ -356,33 +499,11 @@ purg_lnk(ARCHD *arcn)
 		return;
 
 	/*
-	 * find the hash chain for this inode value, if empty return
-	 */
-	indx = ((unsigned)arcn->sb.st_ino) % L_TAB_SZ;
-	if ((pt = ltab[indx]) == NULL)
-		return;
-
-	/*
-	 * walk down the list looking for the inode/dev pair, unlink and
-	 * free if found
+	 * look for the inode/dev pair, remove and free it if found
 	 */
-	ppt = &(ltab[indx]);
-	while (pt != NULL) {
-		if ((pt->ino == arcn->sb.st_ino) &&
-		    (pt->dev == arcn->sb.st_dev))
-			break;
-		ppt = &(pt->fow);
-		pt = pt->fow;
-	}
-	if (pt == NULL)
-		return;
-
-	/*
-	 * remove and free it
-	 */
-	*ppt = pt->fow;
-	free(pt->name);
-	free(pt);
+	pt = lnk_find(arcn->sb.st_dev, arcn->sb.st_ino);
+	if (pt->name != NULL)
+		lnk_del(pt);
 }
 
 /*
@@ -396,29 +517,17 @@ purg_lnk(ARCHD *arcn)
 void
 lnk_end(void)
 {
-	int i;
-	HRDLNK *pt;
-	HRDLNK *ppt;
+	size_t i;
 
 	if (ltab == NULL)
 		return;
 
-	for (i = 0; i < L_TAB_SZ; ++i) {
-		if (ltab[i] == NULL)
-			continue;
-		pt = ltab[i];
-		ltab[i] = NULL;
-
-		/*
-		 * free up each entry on this chain
-		 */
-		while (pt != NULL) {
-			ppt = pt;
-			pt = ppt->fow;
-			free(ppt->name);
-			free(ppt);
-		}
-	}
+	for (i = 0; i <= lmask; ++i)
+		ltab[i].name = NULL;
+	arena_reset(&larena);
+	for (i = 0; i < LN_POOLS; i++)
+		pool_reset(&lpool[i]);
+	lcnt = 0;
 }
 
 /*
@@ -458,10 +567,11 @@ ftime_start(void)
 
 	if (ftab != NULL)
 		return(0);
-	if ((ftab = calloc(F_TAB_SZ, sizeof(FTM *))) == NULL) {
+	if ((ftab = calloc(F_TAB_SZ, sizeof(FTM))) == NULL) {
 		paxwarn(1, "Cannot allocate memory for file time table");
 		return(-1);
 	}
+	fmask = F_TAB_SZ - 1;
 
 	/*
 	 * get random name and create temporary scratch file, unlink name
@@ -478,6 +588,55 @@ ftime_start(void)
 	return(0);
 }
 
+/*
+ * ftime_hash()
+ *	hash a whole file name (FNV-1a). Unlike st_hash() it is not reduced
+ *	to a table size, so it can be kept and used again when the table
+ *	grows, and to skip reading names that cannot match.
+ */
+
+static u_int32_t
+ftime_hash(const char *name, int len)
+{
+	u_int32_t h = 2166136261U;
+
+	while (len-- > 0) {
+		h ^= (u_char)*name++;
+		h *= 16777619;
+	}
+	return(h);
+}
+
+/*
+ * ftime_grow()
+ *	double the size of the file time table
+ * Return:
+ *	0 if ok, -1 if out of memory (the table is left as it was)
+ */
+
+static int
+ftime_grow(void)
+{
+	FTM *otab = ftab;
+	size_t i, indx, osize = fmask + 1;
+
+	if ((ftab = calloc(osize * 2, sizeof(FTM))) == NULL) {
+		ftab = otab;
+		return(-1);
+	}
+	fmask = osize * 2 - 1;
+	for (i = 0; i < osize; i++) {
+		if (otab[i].namelen == 0)
+			continue;
+		indx = otab[i].hash & fmask;
+		while (ftab[indx].namelen != 0)
+			indx = (indx + 1) & fmask;
+		ftab[indx] = otab[i];
+	}
+	free(otab);
+	return(0);
+}
+
 /*
  * chk_ftime()
  *	looks up entry in file time hash table. If not found, the file is
@@ -495,88 +654,92 @@ chk_ftime(ARCHD *arcn)
 {
 	FTM *pt;
 	int namelen;
-	u_int indx;
+	size_t indx, n;
+	u_int32_t hash;
 	char ckname[PAXPATHLEN+1];
 
 	/*
-	 * no info, go ahead and add to archive
+	 * no info (or no name to keep), go ahead and add to archive
 	 */
-	if (ftab == NULL)
+	if (ftab == NULL || arcn->nlen == 0)
 		return(0);
 
 	/*
 	 * hash the pathname and look up in table
 	 */
 	namelen = arcn->nlen;
-	indx = st_hash(arcn->name, namelen, F_TAB_SZ);
-	if ((pt = ftab[indx]) != NULL) {
+	hash = ftime_hash(arcn->name, namelen);
+	ffinds++;
+	for (indx = hash & fmask, n = 1; (pt = &ftab[indx])->namelen != 0;
+	    indx = (indx + 1) & fmask, n++) {
+		fprobes++;
+		if (n > flongest)
+			flongest = n;
 		/*
-		 * the hash chain is not empty, walk down looking for match
-		 * only read up the path names if the lengths match, speeds
-		 * up the search a lot
+		 * only read up the path names if the hashes and lengths
+		 * match, speeds up the search a lot
 		 */
-		while (pt != NULL) {
-			if (pt->namelen == namelen) {
-				/*
-				 * potential match, have to read the name
-				 * from the scratch file.
-				 */
-				if (lseek(ffd,pt->seek,SEEK_SET) != pt->seek) {
-					syswarn(1, errno,
-					    "Failed ftime table seek");
-					return(-1);
-				}
-				if (read(ffd, ckname, namelen) != namelen) {
-					syswarn(1, errno,
-					    "Failed ftime table read");
-					return(-1);
-				}
-
-				/*
-				 * if the names match, we are done
-				 */
-				if (!strncmp(ckname, arcn->name, namelen))
-					break;
-			}
+		if (pt->hash != hash || pt->namelen != namelen)
+			continue;
 
-			/*
-			 * try the next entry on the chain
-			 */
-			pt = pt->fow;
+		/*
+		 * potential match, have to read the name from the scratch
+		 * file.
+		 */
+		if (lseek(ffd, pt->seek, SEEK_SET) != pt->seek) {
+			syswarn(1, errno, "Failed ftime table seek");
+			return(-1);
+		}
+		if (read(ffd, ckname, namelen) != namelen) {
+			syswarn(1, errno, "Failed ftime table read");
+			return(-1);
 		}
 
-		if (pt != NULL) {
-			/*
-			 * found the file, compare the times, save the newer
-			 */
-			if (timespeccmp(&arcn->sb.st_mtim, &pt->mtim, >)) {
-				/*
-				 * file is newer
-				 */
-				pt->mtim = arcn->sb.st_mtim;
-				return(0);
-			}
+		/*
+		 * if the names match, we are done
+		 */
+		if (strncmp(ckname, arcn->name, namelen) != 0)
+			continue;
+
+		/*
+		 * found the file, compare the times, save the newer
+		 */
+		if (timespeccmp(&arcn->sb.st_mtim, &pt->mtim, >)) {
 			/*
-			 * file is older
+			 * file is newer
 			 */
-			return(1);
+			pt->mtim = arcn->sb.st_mtim;
+			return(0);
 		}
+		/*
+		 * file is older
+		 */
+		return(1);
 	}
 
 	/*
-	 * not in table, add it
+	 * not in table, add it, making room first if it is getting full
 	 */
-	if ((pt = malloc(sizeof(FTM))) != NULL) {
+	fprobes++;
+	if (n > flongest)
+		flongest = n;
+	if (fcnt + 1 > (fmask + 1) / 2 && ftime_grow() == 0) {
+		indx = hash & fmask;
+		while (ftab[indx].namelen != 0)
+			indx = (indx + 1) & fmask;
+		pt = &ftab[indx];
+	}
+	if (fcnt < fmask) {
 		/*
 		 * add the name at the end of the scratch file, saving the
-		 * offset. add the file to the head of the hash chain
+		 * offset.
 		 */
 		if ((pt->seek = lseek(ffd, 0, SEEK_END)) >= 0) {
 			if (write(ffd, arcn->name, namelen) == namelen) {
 				pt->mtim = arcn->sb.st_mtim;
+				pt->hash = hash;
 				pt->namelen = namelen;
-				pt->fow = ftab[indx];
-				ftab[indx] = pt;
+				++fcnt;
 				return(0);
 			}
 			syswarn(1, errno, "Failed write to file time table");
@@ -585,11 +748,39 @@ chk_ftime(ARCHD *arcn)
 	} else
 		paxwarn(1, "File time table ran out of memory");
 
-	if (pt != NULL)
-		free(pt);
 	return(-1);
 }
 
+static void
+tab_stat1(int fd, const char *what, size_t size, size_t cnt, size_t max,
+    u_int64_t finds, u_int64_t probes, u_int64_t longest, size_t mem)
+{
+	(void)dprintf(fd, "%s: %s table: %zu entries (%zu most), %zu slots,"
+	    " %llu lookups, %.2f probes average, %llu longest, %zu KB\n",
+	    argv0, what, cnt, max, size, (unsigned long long)finds,
+	    finds ? (double)probes / finds : 0.0,
+	    (unsigned long long)longest, mem / 1024);
+}
+
+/*
+ * tab_stats()
+ *	print the size of the hard link and file time tables, how long their
+ *	probe sequences were and how much memory they take (part of the -v
+ *	summary)
+ */
+
+void
+tab_stats(int fd)
+{
+	if (ltab != NULL && lfinds > 0)
+		tab_stat1(fd, "hard link", lmask + 1, lcnt, lmax, lfinds,
+		    lprobes, llongest, (lmask + 1) * sizeof(HRDLNK) +
+		    larena.reserved);
+	if (ftab != NULL && ffinds > 0)
+		tab_stat1(fd, "file time", fmask + 1, fcnt, fcnt, ffinds,
+		    fprobes, flongest, (fmask + 1) * sizeof(FTM));
+}
+
 /*
  * escaping (absolute or w/"..") symlink table routines
  *
@@ -1131,6 +1322,7 @@ dev_start(void)
 		paxwarn(1, "Cannot allocate memory for device mapping table");
 		return(-1);
 	}
+	arena_init(&darena, 0);
 	return(0);
 }
 
@@ -1200,7 +1392,7 @@ chk_dev(dev_t dev, int add)
 	 * chain. Note we do not assign remaps values here, so the pt->list
 	 * list must be NULL.
 	 */
-	if ((pt = malloc(sizeof(DEVT))) == NULL) {
+	if ((pt = arena_alloc(&darena, sizeof(DEVT))) == NULL) {
 		paxwarn(1, "Device map table out of memory");
 		return(NULL);
 	}
@@ -1292,7 +1484,7 @@ map_dev(ARCHD *arcn, u_long dev_mask, u_long ino_mask)
 		 * same device number.
 		 */
 		if (!trc_dev && (trunc_bits != 0)) {
-			if ((dpt = malloc(sizeof(DLIST))) == NULL)
+			if ((dpt = arena_alloc(&darena, sizeof(DLIST))) == NULL)
 				goto bad;
 			dpt->trunc_bits = 0;
 			dpt->dev = arcn->sb.st_dev;
@@ -1319,7 +1511,8 @@ map_dev(ARCHD *arcn, u_long dev_mask, u_long ino_mask)
 		break;
 	}
 
-	if ((lastdev <= 0) || ((dpt = malloc(sizeof(DLIST))) == NULL))
+	if ((lastdev <= 0) ||
+	    ((dpt = arena_alloc(&darena, sizeof(DLIST))) == NULL))
 		goto bad;
 
 	/*
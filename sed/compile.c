@@ -61,12 +61,14 @@ static char	 *compile_addr(char *, struct s_addr *);
 static char	 *compile_ccl(char **, char *);
 static char	 *compile_delimited(char *, char *);
 static char	 *compile_flags(char *, struct s_subst *);
-static char	 *compile_re(char *, regex_t **);
+static char	 *compile_re(char *, struct s_regex **);
+static void	  compile_repl(struct s_subst *);
 static char	 *compile_subst(char *, struct s_subst *);
 static char	 *compile_text(void);
 static char	 *compile_tr(char *, char **);
 static struct s_command
 		**compile_stream(struct s_command **);
+static void	  classify_re(struct s_regex *, const char *);
 static char	 *duptoeol(char *, char *, char **);
 static void	  enterlabel(struct s_command *);
 static struct s_command
@@ -439,7 +441,7 @@ compile_ccl(char **sp, char *t)
  * Cflags are passed to regcomp.
  */
 static char *
-compile_re(char *p, regex_t **repp)
+compile_re(char *p, struct s_regex **repp)
 {
 	int eval;
 	char *re;
@@ -451,15 +453,65 @@ compile_re(char *p, regex_t **repp)
 		free(re);
 		return (p);
 	}
-	*repp = xmalloc(sizeof(regex_t));
-	if (p && (eval = regcomp(*repp, re, Eflag ? REG_EXTENDED : 0)) != 0)
-		error(COMPILE, "RE error: %s", strregerror(eval, *repp));
-	if (maxnsub < (*repp)->re_nsub)
-		maxnsub = (*repp)->re_nsub;
+	*repp = xmalloc(sizeof(struct s_regex));
+	if (p && (eval = regcomp(&(*repp)->preg, re,
+	    Eflag ? REG_EXTENDED : 0)) != 0)
+		error(COMPILE, "RE error: %s",
+		    strregerror(eval, &(*repp)->preg));
+	if (maxnsub < (*repp)->preg.re_nsub)
+		maxnsub = (*repp)->preg.re_nsub;
+	if (p)
+		classify_re(*repp, re);
 	free(re);
 	return (p);
 }
 
+/*
+ * Decide whether a regular expression is a plain string, optionally
+ * anchored by a leading ^ or a trailing $, and if so keep the string
+ * so that process can match it without regexec().  Anything that is
+ * not obviously literal is left to regexec().
+ */
+static void
+classify_re(struct s_regex *rep, const char *re)
+{
+	const char *special, *escaped;
+	char *d;
+
+	/* Characters special in the RE, and those that may be escaped. */
+	special = Eflag ? ".[\\()*+?{|^$" : ".[\\*^$";
+	escaped = Eflag ? ".[]\\()*+?{}|^$" : ".[]\\*^$";
+
+	rep->type = RT_GENERAL;
+	rep->bol = rep->eol = 0;
+	rep->lit = d = xmalloc(strlen(re) + 1);
+	if (*re == '^') {
+		rep->bol = 1;
+		re++;
+	}
+	for (; *re != '\0'; re++) {
+		if (re[0] == '\\') {
+			if (re[1] == '\0' || strchr(escaped, re[1]) == NULL)
+				goto general;
+			*d++ = *++re;
+		} else if (re[0] == '$' && re[1] == '\0')
+			rep->eol = 1;
+		else if (strchr(special, re[0]) != NULL)
+			goto general;
+		else
+			*d++ = *re;
+	}
+	*d = '\0';
+	rep->litlen = d - rep->lit;
+	rep->type = rep->bol || rep->eol ? RT_ANCHORED : RT_LITERAL;
+	return;
+
+general:
+	free(rep->lit);
+	rep->lit = NULL;
+	rep->litlen = 0;
+}
+
 /*
  * Compile the substitution string of a regular expression and set res to
  * point to a saved copy of it.  Nsub is the number of parenthesized regular
@@ -518,7 +570,7 @@ compile_subst(char *p, struct s_subst *s)
 					*sp++ = '\\';
 					ref = *p - '0';
 					if (s->re != NULL &&
-					    ref > s->re->re_nsub)
+					    ref > s->re->preg.re_nsub)
 						error(COMPILE,
 "\\%c not defined in the RE", *p);
 					if (s->maxbref < ref)
@@ -530,6 +582,7 @@ compile_subst(char *p, struct s_subst *s)
 				*sp++ = '\0';
 				size += sp - op;
 				s->new = xrealloc(text, size);
+				compile_repl(s);
 				return (p);
 			} else if (*p == '\n') {
 				error(COMPILE,
@@ -542,6 +595,43 @@ compile_subst(char *p, struct s_subst *s)
 	error(COMPILE, "unterminated substitute in regular expression");
 }
 
+/*
+ * If the replacement text of an s command does not depend on what was
+ * matched, expand it once here so that substitute() can copy it in
+ * directly.  This follows the escape rules of regsub() in process.c;
+ * an & can only be expanded for a literal regular expression.
+ */
+static void
+compile_repl(struct s_subst *s)
+{
+	char c, *src, *dst;
+
+	s->cnew = NULL;
+	s->cnewlen = 0;
+	if (s->maxbref > 0)
+		return;
+	for (src = s->new; *src != '\0'; src++)
+		if (*src == '&' && (s->re == NULL || s->re->type == RT_GENERAL))
+			return;
+		else if (*src == '\\' && *++src == '\0')
+			break;
+
+	dst = s->cnew = xmalloc(strlen(s->new) + 1 +
+	    (s->re != NULL ? strlen(s->new) * s->re->litlen : 0));
+	for (src = s->new; (c = *src++) != '\0';) {
+		if (c == '&') {
+			memcpy(dst, s->re->lit, s->re->litlen);
+			dst += s->re->litlen;
+			continue;
+		}
+		if (c == '\\' && (*src == '\\' || *src == '&'))
+			c = *src++;
+		*dst++ = c;
+	}
+	*dst = '\0';
+	s->cnewlen = dst - s->cnew;
+}
+
 /*
  * Compile the flags of the s command
  */
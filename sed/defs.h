@@ -43,6 +43,28 @@ enum e_atype {
 	AT_LAST,				/* Last line */
 };
 
+/*
+ * Classes of regular expressions, determined when they are compiled
+ */
+enum e_rtype {
+	RT_GENERAL,				/* Needs regexec() */
+	RT_LITERAL,				/* Plain string */
+	RT_ANCHORED,				/* Plain string with ^ and/or $ */
+};
+
+/*
+ * Compiled regular expression.  Literal and anchored-literal patterns
+ * are matched with memmem()/memcmp() instead of regexec().
+ */
+struct s_regex {
+	regex_t preg;				/* As compiled by regcomp() */
+	enum e_rtype type;			/* Class of the expression */
+	int bol;				/* Anchored at start of space */
+	int eol;				/* Anchored at end of space */
+	char *lit;				/* Literal text if not general */
+	size_t litlen;				/* Length of literal text */
+};
+
 /*
  * Format of an address
  */
@@ -50,7 +72,7 @@ struct s_addr {
 	enum e_atype type;			/* Address type */
 	union {
 		u_long l;			/* Line number */
-		regex_t *r;			/* Regular expression */
+		struct s_regex *r;		/* Regular expression */
 	} u;
 };
 
@@ -62,10 +84,12 @@ struct s_subst {
 	int p;					/* True if p flag */
 	char *wfile;				/* NULL if no wfile */
 	int wfd;				/* Cached file descriptor */
-	regex_t *re;				/* Regular expression */
+	struct s_regex *re;			/* Regular expression */
 	u_int maxbref;				/* Largest backreference. */
 	u_long linenum;				/* Line number. */
 	char *new;				/* Replacement text */
+	char *cnew;				/* Expanded constant replacement */
+	size_t cnewlen;				/* Length of cnew */
 };
 
 
@@ -40,7 +40,7 @@ extern regmatch_t *match;
 extern size_t maxnsub;
 extern u_long linenum;
 extern size_t appendnum;
-extern int Eflag, aflag, eflag, nflag;
+extern int Eflag, aflag, eflag, nflag, uflag;
 extern int pledge_wpath, pledge_rpath;
 extern const char *fname, *outfname;
 extern FILE *infile, *outfile;
@@ -54,6 +54,8 @@ void	warning(const char *, ...);
 int	 mf_fgets(SPACE *, enum e_spflag);
 int	 lastline(void);
 void	 finish_file(void);
+void	 oflush(void);
+void	 ownspace(SPACE *);
 void	 process(void);
 void	 resetstate(void);
 char	*strregerror(int, regex_t *);
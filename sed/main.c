@@ -36,6 +36,7 @@
 #include <sys/types.h>
 #include <sys/ioctl.h>
 #include <sys/stat.h>
+#include <sys/wait.h>
 
 #include <ctype.h>
 #include <errno.h>
@@ -84,7 +85,23 @@ static struct s_flist *files, **fl_nextp = &files;
 FILE *infile;			/* Current input file */
 FILE *outfile;			/* Current output file */
 
-int Eflag, aflag, eflag, nflag;
+/*
+ * Input is read from infile in large blocks rather than through stdio.
+ * mf_fgets() lets the pattern space point straight into the block until
+ * it is changed, and output of such a line is queued without a copy, so
+ * fillbuf() flushes output and detaches the space before it reuses the
+ * block.
+ */
+#define	INBUFSIZE	(64 * 1024)
+
+static char *inbuf;		/* Input block */
+static size_t inbufsize;	/* Allocated size of inbuf */
+static size_t inoff;		/* Start of unread data in inbuf */
+static size_t inlen;		/* End of valid data in inbuf */
+static int ineof;		/* End of file seen on infile */
+static SPACE *inspace;		/* Space that may point into inbuf */
+
+int Eflag, aflag, eflag, nflag, uflag;
 static int rval;	/* Exit status */
 
 /*
@@ -101,6 +118,9 @@ u_long linenum;
 
 static void add_compunit(enum e_cut, char *);
 static void add_file(char *);
+static int crossfile(struct s_command *, struct s_command *);
+static size_t fillbuf(void);
+static void inplace_jobs(int);
 static int next_files_have_lines(void);
 
 int termwidth;
@@ -111,12 +131,14 @@ int
 main(int argc, char *argv[])
 {
 	struct winsize win;
-	int c, fflag;
+	int c, fflag, nfiles, njobs;
+	const char *errstr;
 	char *p;
 
 	fflag = 0;
+	njobs = 1;
 	inplace = NULL;
-	while ((c = getopt(argc, argv, "Eae:f:i::nru")) != -1)
+	while ((c = getopt(argc, argv, "Eae:f:i::j:nru")) != -1)
 		switch (c) {
 		case 'E':
 		case 'r':
@@ -136,22 +158,32 @@ main(int argc, char *argv[])
 		case 'i':
 			inplace = optarg ? optarg : "";
 			break;
+		case 'j':
+			njobs = strtonum(optarg, 1, INT_MAX, &errstr);
+			if (errstr != NULL)
+				error(FATAL, "number of jobs is %s: %s",
+				    errstr, optarg);
+			break;
 		case 'n':
 			nflag = 1;
 			break;
 		case 'u':
-			setvbuf(stdout, NULL, _IOLBF, 0);
+			uflag = 1;
 			break;
 		default:
 		case '?':
 			(void)fprintf(stderr,
-			    "usage: sed [-aEnru] [-i[extension]] command [file ...]\n"
-			    "       sed [-aEnru] [-e command] [-f command_file] [-i[extension]] [file ...]\n");
+			    "usage: sed [-aEnru] [-i[extension]] [-j jobs] command [file ...]\n"
+			    "       sed [-aEnru] [-e command] [-f command_file] [-i[extension]]\n"
+			    "           [-j jobs] [file ...]\n");
 			exit(1);
 		}
 	argc -= optind;
 	argv += optind;
 
+	if (isatty(STDOUT_FILENO))
+		uflag = 1;
+
 	termwidth = 0;
 	if ((p = getenv("COLUMNS")) != NULL)
 		termwidth = strtonum(p, 0, INT_MAX, NULL);
@@ -165,7 +197,11 @@ main(int argc, char *argv[])
 	else
 		termwidth -= 8;
 
-	if (inplace != NULL) {
+	if (inplace != NULL && njobs > 1) {
+		if (pledge("stdio rpath wpath cpath fattr chown proc",
+		    NULL) == -1)
+			error(FATAL, "pledge: %s", strerror(errno));
+	} else if (inplace != NULL) {
 		if (pledge("stdio rpath wpath cpath fattr chown", NULL) == -1)
 			error(FATAL, "pledge: %s", strerror(errno));
 	} else {
@@ -187,8 +223,11 @@ main(int argc, char *argv[])
 			if (pledge("stdio rpath", NULL) == -1)
 				error(FATAL, "pledge: %s", strerror(errno));
 		}
-		for (; *argv; argv++)
+		for (nfiles = 0; *argv; argv++, nfiles++)
 			add_file(*argv);
+		if (inplace != NULL && njobs > 1 && nfiles > 1 &&
+		    !crossfile(prog, NULL))
+			inplace_jobs(njobs < nfiles ? njobs : nfiles);
 	} else {
 		if (!pledge_wpath && !pledge_rpath) {
 			if (pledge("stdio", NULL) == -1)
@@ -203,6 +242,7 @@ main(int argc, char *argv[])
 		add_file(NULL);
 	}
 	process();
+	oflush();
 	cfclose(prog, NULL);
 	if (fclose(stdout))
 		error(FATAL, "stdout: %s", strerror(errno));
@@ -314,7 +354,10 @@ void
 finish_file(void)
 {
 	if (infile != NULL) {
+		oflush();
 		fclose(infile);
+		inoff = inlen = 0;
+		ineof = 0;
 		if (*oldfname != '\0') {
 			if (rename(fname, oldfname) != 0) {
 				warning("rename()");
@@ -342,11 +385,17 @@ int
 mf_fgets(SPACE *sp, enum e_spflag spflag)
 {
 	struct stat sb;
-	size_t len;
-	char *p;
-	int c, fd;
+	size_t len, scan;
+	char *p, *q;
+	int fd;
 	static int firstfile;
 
+	/* The old line is being replaced; no need to keep it. */
+	if (spflag == REPLACE && sp->space != sp->back) {
+		sp->space = sp->back;
+		sp->len = 0;
+	}
+
 	if (infile == NULL) {
 		/* stdin? */
 		if (files->fname == NULL) {
@@ -362,10 +411,8 @@ mf_fgets(SPACE *sp, enum e_spflag spflag)
 	}
 
 	for (;;) {
-		if (infile != NULL && (c = getc(infile)) != EOF) {
-			(void)ungetc(c, infile);
+		if (infile != NULL && (inoff < inlen || fillbuf() > 0))
 			break;
-		}
 		/* If we are here then either eof or no files are open yet */
 		if (infile == stdin) {
 			sp->len = 0;
@@ -427,28 +474,156 @@ mf_fgets(SPACE *sp, enum e_spflag spflag)
 	 * We are here only when infile is open and we still have something
 	 * to read from it.
 	 *
-	 * Use fgetln so that we can handle essentially infinite input data.
-	 * Can't use the pointer into the stdio buffer as the process space
-	 * because the ungetc() can cause it to move.
+	 * Read more of the file until the block holds a whole line, so that
+	 * we can handle essentially infinite input data.
 	 */
-	p = fgetln(infile, &len);
-	if (ferror(infile))
-		error(FATAL, "%s: %s", fname, strerror(errno ? errno : EIO));
-	if (len != 0 && p[len - 1] == '\n') {
-		sp->append_newline = 1;
-		len--;
-	} else if (!lastline()) {
+	for (scan = 0;;) {
+		if ((q = memchr(inbuf + inoff + scan, '\n',
+		    inlen - inoff - scan)) != NULL)
+			break;
+		scan = inlen - inoff;
+		if (fillbuf() == 0)
+			break;
+	}
+	p = inbuf + inoff;
+	if (q != NULL) {
+		len = q - p;
+		inoff += len + 1;
 		sp->append_newline = 1;
 	} else {
-		sp->append_newline = 0;
+		len = inlen - inoff;
+		q = p + len;		/* fillbuf() leaves room for the NUL */
+		inoff += len;
+		sp->append_newline = !lastline();
 	}
-	cspace(sp, p, len, spflag);
+
+	/*
+	 * The newline is not needed any more; terminate the line in place
+	 * so the pattern space can simply point at it.
+	 */
+	*q = '\0';
+	if (spflag == REPLACE) {
+		sp->space = p;
+		sp->len = len;
+		inspace = sp;
+	} else
+		cspace(sp, p, len, spflag);
 
 	linenum++;
 
 	return (1);
 }
 
+/*
+ * Read more of infile into inbuf, after the data not yet consumed.
+ * Returns the number of bytes read, 0 at end of file.
+ */
+static size_t
+fillbuf(void)
+{
+	ssize_t n;
+
+	if (ineof)
+		return (0);
+
+	/* Nothing may point into the consumed part of inbuf after this. */
+	oflush();
+	if (inspace != NULL) {
+		ownspace(inspace);
+		inspace = NULL;
+	}
+
+	if (inoff > 0) {
+		memmove(inbuf, inbuf + inoff, inlen - inoff);
+		inlen -= inoff;
+		inoff = 0;
+	}
+	if (inlen + 1 >= inbufsize) {
+		inbufsize = inbufsize ? inbufsize * 2 : INBUFSIZE;
+		inbuf = xrealloc(inbuf, inbufsize);
+	}
+	while ((n = read(fileno(infile), inbuf + inlen,
+	    inbufsize - inlen - 1)) == -1)
+		if (errno != EINTR)
+			error(FATAL, "%s: %s", fname, strerror(errno));
+	if (n == 0)
+		ineof = 1;
+	inlen += n;
+	return (n);
+}
+
+/*
+ * Return true if the commands keep state that outlives the file being
+ * edited: q stops the whole run, and w files are shared by all files.
+ */
+static int
+crossfile(struct s_command *cp, struct s_command *end)
+{
+
+	for (; cp != end; cp = cp->next)
+		switch (cp->code) {
+		case 'q':
+		case 'w':
+			return (1);
+		case 's':
+			if (cp->u.s->wfile != NULL)
+				return (1);
+			break;
+		case '{':
+			if (crossfile(cp->u.c, cp->next))
+				return (1);
+			break;
+		}
+	return (0);
+}
+
+/*
+ * With -i every file is a separate editing session: line numbers, the
+ * hold space and ranges are reset between files.  So the files can be
+ * shared out among njobs worker processes, each taking every njobs'th
+ * file and keeping its own copy of the editing state.  Only the workers
+ * return from here; the parent waits for them and exits.
+ */
+static void
+inplace_jobs(int njobs)
+{
+	struct s_flist *fp, **fpp;
+	int i, n, status;
+	pid_t pid;
+
+	for (i = 0; i < njobs; i++) {
+		switch (pid = fork()) {
+		case -1:
+			error(FATAL, "fork: %s", strerror(errno));
+		case 0:
+			for (n = 0, fpp = &files; (fp = *fpp) != NULL; n++) {
+				if (n % njobs == i)
+					fpp = &fp->next;
+				else {
+					*fpp = fp->next;
+					free(fp);
+				}
+			}
+			fl_nextp = fpp;
+			if (pledge("stdio rpath wpath cpath fattr chown",
+			    NULL) == -1)
+				error(FATAL, "pledge: %s", strerror(errno));
+			return;
+		}
+	}
+
+	for (;;) {
+		if (wait(&status) == -1) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+			rval = 1;
+	}
+	exit(rval);
+}
+
 /*
  * Add a compilation unit to the linked list
  */
@@ -510,18 +685,9 @@ next_files_have_lines()
 int
 lastline(void)
 {
-	int ch;
-
-	if (feof(infile)) {
-		return !(
-		    (inplace == NULL) &&
-		    next_files_have_lines());
-	}
-	if ((ch = getc(infile)) == EOF) {
-		return !(
-		    (inplace == NULL) &&
-		    next_files_have_lines());
-	}
-	ungetc(ch, infile);
-	return (0);
+	if (inoff < inlen || fillbuf() > 0)
+		return (0);
+	return !(
+	    (inplace == NULL) &&
+	    next_files_have_lines());
 }
@@ -61,8 +61,11 @@ static SPACE HS, PS, SS;
 static inline int	 applies(struct s_command *);
 static void		 flush_appends(void);
 static void		 lputs(char *);
-static inline int	 regexec_e(regex_t *, const char *, int, int, size_t,
-			     size_t);
+static void		 owrite(const char *, size_t, int);
+static int		 litexec(struct s_regex *, const char *, int, int,
+			     size_t, size_t);
+static inline int	 regexec_e(struct s_regex *, const char *, int, int,
+			     size_t, size_t);
 static void		 regsub(SPACE *, char *, char *);
 static int		 substitute(struct s_command *);
 
@@ -73,13 +76,27 @@ size_t appendnum;		/* Size of appends array. */
 static int lastaddr;		/* Set by applies if last address of a range. */
 static int sdone;		/* If any substitutes since last line input. */
 				/* Iov structure for 'w' commands. */
-static regex_t *defpreg;
+static struct s_regex *defpreg;
 size_t maxnsub;
 regmatch_t *match;
 
+/*
+ * Output is gathered into an iovec array and written with writev().
+ * Text that stays put until the next flush (script text, and a pattern
+ * space that still points into the input block) is referenced in place;
+ * anything else is copied into obuf first.
+ */
+#define	OBUFSIZE	(64 * 1024)
+#define	NOIOV		512
+
+static struct iovec oiov[NOIOV];
+static int oiovcnt;
+static char obuf[OBUFSIZE];
+static size_t obuflen;
+
 #define OUT() do {\
-	fwrite(ps, 1, psl, outfile);\
-	if (psanl) fputc('\n', outfile);\
+	owrite(ps, psl, PS.space != PS.back);\
+	if (psanl) owrite("\n", 1, 1);\
 } while (0)
 
 void
@@ -88,7 +105,7 @@ process(void)
 	struct s_command *cp;
 	SPACE tspace;
 	size_t len, oldpsl;
-	char *p;
+	char *p, nbuf[32];
 
 	for (linenum = 0; mf_fgets(&PS, REPLACE);) {
 		pd = 0;
@@ -123,7 +140,7 @@ redirect:
 				pd = 1;
 				psl = 0;
 				if (cp->a2 == NULL || lastaddr || lastline())
-					(void)fprintf(outfile, "%s", cp->t);
+					owrite(cp->t, strlen(cp->t), 1);
 				break;
 			case 'd':
 				pd = 1;
@@ -137,7 +154,10 @@ redirect:
 					goto new;
 				} else {
 					psl -= (p + 1) - ps;
-					memmove(ps, p + 1, psl);
+					if (PS.space != PS.back)
+						PS.space = p + 1;
+					else
+						memmove(ps, p + 1, psl);
 					goto top;
 				}
 			case 'g':
@@ -155,7 +175,7 @@ redirect:
 				cspace(&HS, ps, psl, 0);
 				break;
 			case 'i':
-				(void)fprintf(outfile, "%s", cp->t);
+				owrite(cp->t, strlen(cp->t), 1);
 				break;
 			case 'l':
 				lputs(ps);
@@ -164,15 +184,19 @@ redirect:
 				if (!nflag && !pd)
 					OUT();
 				flush_appends();
-				if (!mf_fgets(&PS, REPLACE))
+				if (!mf_fgets(&PS, REPLACE)) {
+					oflush();
 					exit(0);
+				}
 				pd = 0;
 				break;
 			case 'N':
 				flush_appends();
 				cspace(&PS, "\n", 1, 0);
-				if (!mf_fgets(&PS, 0))
+				if (!mf_fgets(&PS, 0)) {
+					oflush();
 					exit(0);
+				}
 				break;
 			case 'p':
 				if (pd)
@@ -234,6 +258,7 @@ redirect:
 					    cp->t, strerror(errno));
 				break;
 			case 'x':
+				ownspace(&PS);
 				if (hs == NULL)
 					cspace(&HS, "", 0, REPLACE);
 				tspace = PS;
@@ -244,6 +269,7 @@ redirect:
 			case 'y':
 				if (pd || psl == 0)
 					break;
+				ownspace(&PS);
 				for (p = ps, len = psl; len--; ++p)
 					*p = cp->u.y[(unsigned char)*p];
 				break;
@@ -251,7 +277,8 @@ redirect:
 			case '}':
 				break;
 			case '=':
-				(void)fprintf(outfile, "%lu\n", linenum);
+				len = snprintf(nbuf, sizeof(nbuf), "%lu\n", linenum);
+				owrite(nbuf, len, 0);
 			}
 			cp = cp->next;
 		} /* for all cp */
@@ -259,6 +286,8 @@ redirect:
 new:		if (!nflag && !pd)
 			OUT();
 		flush_appends();
+		if (uflag && outfile == stdout)
+			oflush();
 	} /* for all lines */
 }
 
@@ -335,7 +364,7 @@ static int
 substitute(struct s_command *cp)
 {
 	SPACE tspace;
-	regex_t *re;
+	struct s_regex *re;
 	regoff_t slen;
 	int n, lastempty;
 	regoff_t le = 0;
@@ -344,7 +373,8 @@ substitute(struct s_command *cp)
 	s = ps;
 	re = cp->u.s->re;
 	if (re == NULL) {
-		if (defpreg != NULL && cp->u.s->maxbref > defpreg->re_nsub) {
+		if (defpreg != NULL &&
+		    cp->u.s->maxbref > defpreg->preg.re_nsub) {
 			linenum = cp->u.s->linenum;
 			error(COMPILE, "\\%d not defined in the RE",
 			    cp->u.s->maxbref);
@@ -368,7 +398,11 @@ substitute(struct s_command *cp)
 		    match[0].rm_so != match[0].rm_eo) {
 			if (n <= 1) {
 				/* Want this match: append replacement. */
-				regsub(&SS, ps, cp->u.s->new);
+				if (cp->u.s->cnew != NULL)
+					cspace(&SS, cp->u.s->cnew,
+					    cp->u.s->cnewlen, APPEND);
+				else
+					regsub(&SS, ps, cp->u.s->new);
 				if (n == 1)
 					n = -1;
 			} else {
@@ -453,8 +487,7 @@ flush_appends(void)
 	for (idx = 0; idx < appendx; idx++)
 		switch (appends[idx].type) {
 		case AP_STRING:
-			fwrite(appends[idx].s, sizeof(char), appends[idx].len,
-			    outfile);
+			owrite(appends[idx].s, appends[idx].len, 1);
 			break;
 		case AP_FILE:
 			/*
@@ -468,12 +501,10 @@ flush_appends(void)
 			if ((f = fopen(appends[idx].s, "r")) == NULL)
 				break;
 			while ((count = fread(buf, sizeof(char), sizeof(buf), f)))
-				(void)fwrite(buf, sizeof(char), count, outfile);
+				owrite(buf, count, 0);
 			(void)fclose(f);
 			break;
 		}
-	if (ferror(outfile))
-		error(FATAL, "%s: %s", outfname, strerror(errno ? errno : EIO));
 	appendx = sdone = 0;
 }
 
@@ -483,41 +514,141 @@ lputs(char *s)
 	int count;
 	extern int termwidth;
 	const char *escapes;
-	char *p;
+	char *p, obuf[4];
 
 	for (count = 0; *s; ++s) {
 		if (count >= termwidth) {
-			(void)fprintf(outfile, "\\\n");
+			owrite("\\\n", 2, 1);
 			count = 0;
 		}
 		if (isascii((unsigned char)*s) && isprint((unsigned char)*s)
 		    && *s != '\\') {
-			(void)fputc(*s, outfile);
+			owrite(s, 1, 0);
 			count++;
 		} else if (*s == '\n') {
-			(void)fputc('$', outfile);
-			(void)fputc('\n', outfile);
+			owrite("$\n", 2, 1);
 			count = 0;
 		} else {
 			escapes = "\\\a\b\f\r\t\v";
-			(void)fputc('\\', outfile);
+			owrite("\\", 1, 1);
 			if ((p = strchr(escapes, *s))) {
-				(void)fputc("\\abfrtv"[p - escapes], outfile);
+				owrite(&"\\abfrtv"[p - escapes], 1, 1);
 				count += 2;
 			} else {
-				(void)fprintf(outfile, "%03o", *(u_char *)s);
+				(void)snprintf(obuf, sizeof(obuf), "%03o",
+				    *(u_char *)s);
+				owrite(obuf, 3, 0);
 				count += 4;
 			}
 		}
 	}
-	(void)fputc('$', outfile);
-	(void)fputc('\n', outfile);
-	if (ferror(outfile))
-		error(FATAL, "%s: %s", outfname, strerror(errno ? errno : EIO));
+	owrite("$\n", 2, 1);
+}
+
+/*
+ * Queue len bytes at p for output.  If stable is set the bytes are known
+ * not to change before the next oflush() and are not copied.
+ */
+static void
+owrite(const char *p, size_t len, int stable)
+{
+	struct iovec *iov;
+
+	if (len == 0)
+		return;
+	if (oiovcnt == NOIOV)
+		oflush();
+	if (!stable) {
+		if (len > OBUFSIZE - obuflen)
+			oflush();
+		if (len > OBUFSIZE) {
+			oiov[0].iov_base = (void *)p;
+			oiov[0].iov_len = len;
+			oiovcnt = 1;
+			oflush();
+			return;
+		}
+		memcpy(obuf + obuflen, p, len);
+		p = obuf + obuflen;
+		obuflen += len;
+	}
+	iov = oiovcnt > 0 ? &oiov[oiovcnt - 1] : NULL;
+	if (iov != NULL && (char *)iov->iov_base + iov->iov_len == p)
+		iov->iov_len += len;
+	else {
+		oiov[oiovcnt].iov_base = (void *)p;
+		oiov[oiovcnt].iov_len = len;
+		oiovcnt++;
+	}
+}
+
+/*
+ * Write out everything queued by owrite().
+ */
+void
+oflush(void)
+{
+	struct iovec *iov;
+	ssize_t n;
+	int cnt;
+
+	for (iov = oiov, cnt = oiovcnt; cnt > 0;) {
+		if ((n = writev(fileno(outfile), iov, cnt)) == -1) {
+			if (errno == EINTR)
+				continue;
+			error(FATAL, "%s: %s", outfname, strerror(errno));
+		}
+		for (; cnt > 0 && (size_t)n >= iov->iov_len; iov++, cnt--)
+			n -= iov->iov_len;
+		if (cnt > 0) {
+			iov->iov_base = (char *)iov->iov_base + n;
+			iov->iov_len -= n;
+		}
+	}
+	oiovcnt = 0;
+	obuflen = 0;
+}
+
+/*
+ * Match a literal or anchored-literal expression against string[start,
+ * stop), setting match[] as regexec() would have.
+ */
+static int
+litexec(struct s_regex *preg, const char *string, int eflags,
+    int nomatch, size_t start, size_t stop)
+{
+	const char *p;
+	size_t i;
+
+	if (stop - start < preg->litlen)
+		return (0);
+	if (preg->bol) {
+		if (eflags & REG_NOTBOL)
+			return (0);
+		if (preg->eol && stop - start != preg->litlen)
+			return (0);
+		p = string + start;
+		if (memcmp(p, preg->lit, preg->litlen) != 0)
+			return (0);
+	} else if (preg->eol) {
+		p = string + stop - preg->litlen;
+		if (memcmp(p, preg->lit, preg->litlen) != 0)
+			return (0);
+	} else if ((p = memmem(string + start, stop - start,
+	    preg->lit, preg->litlen)) == NULL)
+		return (0);
+
+	if (!nomatch) {
+		match[0].rm_so = p - string;
+		match[0].rm_eo = match[0].rm_so + preg->litlen;
+		for (i = 1; i <= maxnsub; i++)
+			match[i].rm_so = match[i].rm_eo = -1;
+	}
+	return (1);
 }
 
 static inline int
-regexec_e(regex_t *preg, const char *string, int eflags,
+regexec_e(struct s_regex *preg, const char *string, int eflags,
     int nomatch, size_t start, size_t stop)
 {
 	int eval;
@@ -528,11 +659,14 @@ regexec_e(regex_t *preg, const char *string, int eflags,
 	} else
 		defpreg = preg;
 
+	if (defpreg->type != RT_GENERAL)
+		return (litexec(defpreg, string, eflags, nomatch, start, stop));
+
 	/* Set anchors */
 	match[0].rm_so = start;
 	match[0].rm_eo = stop;
 
-	eval = regexec(defpreg, string,
+	eval = regexec(&defpreg->preg, string,
 	    nomatch ? 0 : maxnsub + 1, match, eflags | REG_STARTEND);
 	switch (eval) {
 	case 0:
@@ -540,7 +674,7 @@ regexec_e(regex_t *preg, const char *string, int eflags,
 	case REG_NOMATCH:
 		return (0);
 	}
-	error(FATAL, "RE error: %s", strregerror(eval, defpreg));
+	error(FATAL, "RE error: %s", strregerror(eval, &defpreg->preg));
 }
 
 /*
@@ -597,6 +731,14 @@ cspace(SPACE *sp, const char *p, size_t len, enum e_spflag spflag)
 {
 	size_t tlen;
 
+	/* A space borrowed from the input block is copied before changing. */
+	if (sp->space != sp->back) {
+		if (spflag == REPLACE)
+			sp->space = sp->back;
+		else
+			ownspace(sp);
+	}
+
 	/* Make sure SPACE has enough memory and ramp up quickly. */
 	tlen = sp->len + len + 1;
 	if (tlen > sp->blen) {
@@ -613,6 +755,29 @@ cspace(SPACE *sp, const char *p, size_t len, enum e_spflag spflag)
 	sp->space[sp->len += len] = '\0';
 }
 
+/*
+ * ownspace --
+ *	A space filled by mf_fgets() may point into the input block rather
+ *	than its own backing memory.  Copy it into the backing memory so
+ *	that it can be modified, or outlive the next read.
+ */
+void
+ownspace(SPACE *sp)
+{
+	size_t newlen;
+
+	if (sp->space == sp->back)
+		return;
+	if (sp->len + 1 > sp->blen) {
+		newlen = sp->len + 1 + 1024;
+		sp->back = xrealloc(sp->back, newlen);
+		sp->blen = newlen;
+	}
+	memcpy(sp->back, sp->space, sp->len);
+	sp->back[sp->len] = '\0';
+	sp->space = sp->back;
+}
+
 /*
  * Close all cached opened files and report any errors
  */
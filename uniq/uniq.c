@@ -36,6 +36,7 @@
 #include <ctype.h>
 #include <err.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <limits.h>
 #include <locale.h>
 #include <stdio.h>
@@ -45,13 +46,19 @@
 #include <wchar.h>
 #include <wctype.h>
 
-#define	MAXLINELEN	(8 * 1024)
+#include <lbuf.h>
 
 int cflag, dflag, iflag, uflag;
 int numchars, numfields, repeats;
 
+/* The line the next is compared against, copied out of the input. */
+char	*prevline;
+size_t	 prevlen, prevsize;
+int	 prevnl;
+
 FILE	*file(char *, char *);
-void	 show(FILE *, char *);
+void	 keep(char *, size_t, int);
+void	 show(FILE *, char *, size_t, int);
 char	*skip(char *);
 void	 obsolete(char *[]);
 __dead void	usage(void);
@@ -59,10 +66,12 @@ __dead void	usage(void);
 int
 main(int argc, char *argv[])
 {
+	struct lbuf lb;
 	char *t1, *t2;
-	FILE *ifp = NULL, *ofp = NULL;
-	int ch;
-	char *prevline, *thisline;
+	FILE *ofp = NULL;
+	int ch, ifd = STDIN_FILENO;
+	char *thisline;
+	size_t thislen;
 
 	setlocale(LC_CTYPE, "");
 
@@ -115,16 +124,14 @@ main(int argc, char *argv[])
 
 	switch (argc) {
 	case 0:
-		ifp = stdin;
 		ofp = stdout;
 		break;
 	case 1:
-		ifp = file(argv[0], "r");
-		ofp = stdout;
-		break;
 	case 2:
-		ifp = file(argv[0], "r");
-		ofp = file(argv[1], "w");
+		if (strcmp(argv[0], "-") != 0 &&
+		    (ifd = open(argv[0], O_RDONLY)) == -1)
+			err(1, "%s", argv[0]);
+		ofp = argc == 2 ? file(argv[1], "w") : stdout;
 		break;
 	default:
 		usage();
@@ -133,15 +140,14 @@ main(int argc, char *argv[])
 	if (pledge("stdio", NULL) == -1)
 		err(1, "pledge");
 
-	prevline = malloc(MAXLINELEN);
-	thisline = malloc(MAXLINELEN);
-	if (prevline == NULL || thisline == NULL)
-		err(1, "malloc");
+	if (lbuf_init(&lb, ifd, '\n') == -1)
+		err(1, NULL);
 
-	if (fgets(prevline, MAXLINELEN, ifp) == NULL)
-		exit(0);
+	if ((thisline = lbuf_next(&lb, &thislen)) == NULL)
+		goto done;
+	keep(thisline, thislen, lb.delimited);
 
-	while (fgets(thisline, MAXLINELEN, ifp)) {
+	while ((thisline = lbuf_next(&lb, &thislen)) != NULL) {
 		/* If requested get the chosen fields + character offsets. */
 		if (numfields || numchars) {
 			t1 = skip(thisline);
@@ -151,33 +157,60 @@ main(int argc, char *argv[])
 			t2 = prevline;
 		}
 
-		/* If different, print; set previous to new value. */
-		if ((iflag ? strcasecmp : strcmp)(t1, t2)) {
-			show(ofp, prevline);
-			t1 = prevline;
-			prevline = thisline;
-			thisline = t1;
+		/*
+		 * If different, print; set previous to new value.  A last
+		 * line without its newline differs from one with it.
+		 */
+		if ((iflag ? strcasecmp : strcmp)(t1, t2) ||
+		    lb.delimited != prevnl) {
+			show(ofp, prevline, prevlen, prevnl);
+			keep(thisline, thislen, lb.delimited);
 			repeats = 0;
 		} else
 			++repeats;
 	}
-	show(ofp, prevline);
+	show(ofp, prevline, prevlen, prevnl);
+done:
+	if (lb.error)
+		err(1, "%s", argc > 0 ? argv[0] : "stdin");
 	exit(0);
 }
 
+/*
+ * keep --
+ *	Copy a line out of the input buffer to compare the next ones
+ *	against.
+ */
+void
+keep(char *str, size_t len, int nl)
+{
+	char *p;
+
+	if (len >= prevsize) {
+		if ((p = realloc(prevline, len + 1)) == NULL)
+			err(1, NULL);
+		prevline = p;
+		prevsize = len + 1;
+	}
+	memcpy(prevline, str, len + 1);
+	prevlen = len;
+	prevnl = nl;
+}
+
 /*
  * show --
  *	Output a line depending on the flags and number of repetitions
  *	of the line.
  */
 void
-show(FILE *ofp, char *str)
+show(FILE *ofp, char *str, size_t len, int nl)
 {
 	if ((dflag && repeats) || (uflag && !repeats)) {
 		if (cflag)
-			(void)fprintf(ofp, "%4d %s", repeats + 1, str);
-		else
-			(void)fprintf(ofp, "%s", str);
+			(void)fprintf(ofp, "%4d ", repeats + 1);
+		(void)fwrite(str, 1, len, ofp);
+		if (nl)
+			(void)putc('\n', ofp);
 	}
 }
 
@@ -35,6 +35,7 @@
  * $xMach: xargs.c,v 1.6 2002/02/23 05:27:47 tim Exp $
  */
 
+#include <sys/stat.h>
 #include <sys/wait.h>
 
 #include <ctype.h>
@@ -46,6 +47,7 @@
 #include <paths.h>
 #include <regex.h>
 #include <signal.h>
+#include <spawn.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -54,22 +56,63 @@
 
 #include "pathnames.h"
 
+#define	MINIMUM(a, b)	(((a) < (b)) ? (a) : (b))
+
+static char	*balance(void);
+static void	endjob(pid_t);
+static void	flushjobs(void);
+static int	nextch(void);
 static void	parse_input(int, char *[]);
 static void	prerun(int, char *[]);
 static int	prompt(void);
 static void	run(char **);
+static int	spawn(char **, pid_t *, int, int);
+static int	spill(void);
+static void	startjob(pid_t, int, int);
 static void	usage(void);
 void		strnsubst(char **, const char *, const char *, size_t);
 static void	waitchildren(const char *, int);
 
 static char **av, **bxp, **ep, **endxp, **xp;
-static char *argp, *bbp, *ebp, *inpline, *p, *replstr;
+static char *argp, *bal, *bbp, *ebp, *inpline, *p, *replstr;
 static const char *eofstr;
 static int count, insingle, indouble, oflag, pflag, tflag, Rflag, rval, zflag;
 static int cnt, Iflag, jfound, Lflag, wasquoted, xflag, runeof = 1;
-static int curprocs, maxprocs;
+static int curprocs, maxprocs, bflag, gflag, kflag;
 static size_t inpsize;
 
+/*
+ * Standard input is read a block at a time.  insize is its size when
+ * it is a regular file and -1 otherwise; -b uses it to tell how much
+ * input is left, or else reads ahead until it knows.  share is then the
+ * buffer space each of the last commands gets, or -1 until they start.
+ */
+#define INBLOCK	(64 * 1024)
+static char *inbuf;
+static size_t inpos, inlen, inbufsize;
+static off_t insize = -1, share = -1;
+static int ineof;
+
+/*
+ * The last utility looked up in PATH and where it was found, so that
+ * each invocation does not search PATH again.
+ */
+static char *cmdname, *cmdpath;
+static int infd = -1;
+
+/*
+ * With -g or -k each command writes into a pair of spill files, which
+ * are copied to our standard output and error once it is done.  The
+ * table is kept in the order the commands were started.
+ */
+struct job {
+	pid_t	 pid;		/* 0 once the command has been reaped */
+	int	 out;		/* spill file for standard output */
+	int	 err;		/* spill file for standard error */
+};
+static struct job *jobs;
+static size_t njobs, jobsize;
+
 extern char **environ;
 
 int
@@ -105,7 +148,7 @@ main(int argc, char *argv[])
 	if ((arg_max = sysconf(_SC_ARG_MAX)) == -1)
 		errx(1, "sysconf(_SC_ARG_MAX) failed");
 
-	if (pledge("stdio rpath proc exec", NULL) == -1)
+	if (pledge("stdio rpath wpath cpath proc exec", NULL) == -1)
 		err(1, "pledge");
 
 	nline = arg_max - 4 * 1024;
@@ -114,11 +157,17 @@ main(int argc, char *argv[])
 		nline -= strlen(*ep++) + 1 + sizeof(*ep);
 	}
 	maxprocs = 1;
-	while ((ch = getopt(argc, argv, "0E:I:J:L:n:oP:pR:rs:tx")) != -1)
+	while ((ch = getopt(argc, argv, "0bE:gI:J:kL:n:oP:pR:rs:tx")) != -1)
 		switch (ch) {
+		case 'b':
+			bflag = 1;
+			break;
 		case 'E':
 			eofstr = optarg;
 			break;
+		case 'g':
+			gflag = 1;
+			break;
 		case 'I':
 			Jflag = 0;
 			Iflag = 1;
@@ -130,6 +179,9 @@ main(int argc, char *argv[])
 			Jflag = 1;
 			replstr = optarg;
 			break;
+		case 'k':
+			gflag = kflag = 1;
+			break;
 		case 'L':
 			Lflag = strtonum(optarg, 0, INT_MAX, &errstr);
 			if (errstr)
@@ -187,11 +239,23 @@ main(int argc, char *argv[])
 		Rflag = 5;
 	if (xflag && !nflag)
 		usage();
-	if (Iflag || Lflag)
+	if (Iflag || Lflag) {
 		xflag = 1;
+		bflag = 0;
+	}
 	if (replstr != NULL && *replstr == '\0')
 		errx(1, "replstr may not be empty");
 
+	if (!gflag && pledge("stdio rpath proc exec", NULL) == -1)
+		err(1, "pledge");
+
+	if (bflag) {
+		struct stat sb;
+
+		if (fstat(STDIN_FILENO, &sb) == 0 && S_ISREG(sb.st_mode))
+			insize = sb.st_size;
+	}
+
 	/*
 	 * Allocate pointers for the utility name, the utility arguments,
 	 * the maximum arguments to be read from stdin and the trailing
@@ -244,6 +308,10 @@ main(int argc, char *argv[])
 	if ((bbp = malloc((size_t)(nline + 1))) == NULL)
 		err(1, NULL);
 	ebp = (argp = p = bbp) + nline - 1;
+	if ((inbuf = malloc(INBLOCK)) == NULL)
+		err(1, NULL);
+	inbufsize = INBLOCK;
+	bal = balance();
 	for (;;)
 		parse_input(argc, argv);
 }
@@ -254,9 +322,26 @@ parse_input(int argc, char *argv[])
 	int hasblank = 0;
 	static int hadblank = 0;
 	int ch, foundeof = 0;
-	char **avj;
+	char **avj, *e;
+	size_t n;
+
+	ch = nextch();
+
+	/*
+	 * With -0 nothing but NUL is special, so copy the rest of the
+	 * argument straight out of the input buffer.
+	 */
+	if (zflag && ch != EOF && ch != '\0' && p < ebp) {
+		*p++ = ch;
+		n = MINIMUM(inlen - inpos, (size_t)(ebp - p));
+		if ((e = memchr(inbuf + inpos, '\0', n)) != NULL)
+			n = e - (inbuf + inpos);
+		memcpy(p, inbuf + inpos, n);
+		p += n;
+		inpos += n;
+		return;
+	}
 
-	ch = getchar();
 	if (isblank(ch)) {
 		/* Quotes escape tabs and spaces. */
 		if (insingle || indouble)
@@ -346,7 +431,7 @@ arg2:
 		 * of input lines, as specified by -L is the same as
 		 * maxing out on arguments.
 		 */
-		if (xp == endxp || p > ebp || ch == EOF ||
+		if (xp == endxp || p > ebp || p > bal || ch == EOF ||
 		    (Lflag <= count && xflag) || foundeof) {
 			if (xflag && xp != endxp && p > ebp)
 				errx(1, "insufficient space for arguments");
@@ -362,6 +447,7 @@ arg2:
 			p = bbp;
 			xp = bxp;
 			count = 0;
+			bal = balance();
 		}
 		argp = p;
 		wasquoted = 0;
@@ -382,7 +468,7 @@ arg2:
 		if (zflag)
 			goto addch;
 		/* Backslash escapes anything, is escaped by quotes. */
-		if (!insingle && !indouble && (ch = getchar()) == EOF)
+		if (!insingle && !indouble && (ch = nextch()) == EOF)
 			errx(1, "backslash at EOF");
 		/* FALLTHROUGH */
 	default:
@@ -408,11 +494,96 @@ addch:		if (p < ebp) {
 		memmove(bbp, argp, (size_t)cnt);
 		p = (argp = bbp) + cnt;
 		*p++ = ch;
+		bal = balance();
 		break;
 	}
 	hadblank = hasblank;
 }
 
+/*
+ * Read another block of standard input onto the end of the buffer,
+ * making room by moving what is left of it to the front, or by growing
+ * it.  Returns -1 if it cannot be grown.
+ */
+static int
+readin(void)
+{
+	size_t size;
+	ssize_t n;
+	char *nb;
+
+	if (inpos == inlen)
+		inpos = inlen = 0;
+	if (inbufsize - inlen < INBLOCK && inpos > 0) {
+		memmove(inbuf, inbuf + inpos, inlen - inpos);
+		inlen -= inpos;
+		inpos = 0;
+	}
+	if (inbufsize - inlen < INBLOCK) {
+		for (size = inbufsize * 2; size - inlen < INBLOCK; size *= 2)
+			;
+		if ((nb = realloc(inbuf, size)) == NULL)
+			return (-1);
+		inbuf = nb;
+		inbufsize = size;
+	}
+	while ((n = read(STDIN_FILENO, inbuf + inlen,
+	    inbufsize - inlen)) == -1)
+		if (errno != EINTR)
+			err(1, "stdin");
+	if (n == 0)
+		ineof = 1;
+	inlen += n;
+	return (0);
+}
+
+static int
+nextch(void)
+{
+	if (inpos == inlen) {
+		if (ineof)
+			return (EOF);
+		(void)readin();
+		if (inpos == inlen)
+			return (EOF);
+	}
+	return ((unsigned char)inbuf[inpos++]);
+}
+
+/*
+ * Return the end of the buffer space the next command may use.  With
+ * -b, once the input left is less than maxprocs full command lines, it
+ * is split into maxprocs equal shares, one for each of the remaining
+ * commands, so that they finish at about the same time.  Input that is
+ * not a regular file is read ahead that far to see where it ends.
+ */
+static char *
+balance(void)
+{
+	off_t full, left, off;
+
+	if (!bflag || maxprocs == 1)
+		return (ebp);
+	if (share == -1) {
+		full = (off_t)maxprocs * (ebp - bbp);
+		left = inlen - inpos;
+		if (insize != -1 && !ineof) {
+			if ((off = lseek(STDIN_FILENO, 0, SEEK_CUR)) == -1)
+				return (ebp);
+			left += insize - off;
+		} else
+			while (!ineof && left < full) {
+				if (readin() == -1)
+					return (ebp);
+				left = inlen - inpos;
+			}
+		if (left >= full)
+			return (ebp);
+		share = (left + maxprocs - 1) / maxprocs;
+	}
+	return (bbp + share);
+}
+
 /*
  * Do things necessary before run()'ing, such as -I substitution,
  * and then call run().
@@ -498,7 +669,7 @@ static void
 run(char **argv)
 {
 	pid_t pid;
-	int fd;
+	int error, ofd, efd;
 	char **avec;
 
 	/*
@@ -532,33 +703,235 @@ run(char **argv)
 		(void)fflush(stderr);
 	}
 exec:
-	switch (pid = vfork()) {
-	case -1:
-		err(1, "vfork");
-	case 0:
+	if (infd == -1) {
 		if (oflag) {
-			if ((fd = open(_PATH_TTY, O_RDONLY)) == -1) {
+			if ((infd = open(_PATH_TTY, O_RDONLY | O_CLOEXEC)) ==
+			    -1) {
 				warn("can't open /dev/tty");
-				_exit(1);
-			}
-		} else {
-			fd = open(_PATH_DEVNULL, O_RDONLY);
-		}
-		if (fd > STDIN_FILENO) {
-			if (dup2(fd, STDIN_FILENO) != 0) {
-				warn("can't dup2 to stdin");
-				_exit(1);
+				rval = 123;
+				return;
 			}
-			close(fd);
-		}
-		execvp(argv[0], argv);
+		} else
+			infd = open(_PATH_DEVNULL, O_RDONLY | O_CLOEXEC);
+	}
+	ofd = efd = -1;
+	if (gflag) {
+		ofd = spill();
+		efd = spill();
+	}
+	if ((error = spawn(argv, &pid, ofd, efd)) != 0) {
+		errno = error;
 		warn("%s", argv[0]);
-		_exit(errno == ENOENT ? 127 : 126);
+		flushjobs();
+		exit(error == ENOENT ? 127 : 126);
 	}
+	if (gflag)
+		startjob(pid, ofd, efd);
 	curprocs++;
 	waitchildren(*argv, 0);
 }
 
+/*
+ * Find name in PATH the way execvp(3) would, or return NULL to leave
+ * it to posix_spawnp(3) to fail with the right error.
+ */
+static char *
+lookup(const char *name)
+{
+	char *dirs, *dir, *path, buf[PATH_MAX];
+	struct stat sb;
+
+	if ((path = getenv("PATH")) == NULL || *path == '\0')
+		path = _PATH_DEFPATH;
+	if ((dirs = path = strdup(path)) == NULL)
+		err(1, NULL);
+	while ((dir = strsep(&dirs, ":")) != NULL) {
+		if (snprintf(buf, sizeof(buf), "%s/%s", *dir ? dir : ".",
+		    name) >= sizeof(buf))
+			continue;
+		if (access(buf, X_OK) == 0 && stat(buf, &sb) == 0 &&
+		    S_ISREG(sb.st_mode)) {
+			free(path);
+			if ((path = strdup(buf)) == NULL)
+				err(1, NULL);
+			return (path);
+		}
+	}
+	free(path);
+	return (NULL);
+}
+
+/*
+ * Start the utility with its standard input on infd and, with -g, its
+ * output in the spill files.  PATH is searched once per utility name
+ * rather than on every invocation.
+ */
+static int
+spawn(char **argv, pid_t *pid, int ofd, int efd)
+{
+	posix_spawn_file_actions_t fa;
+	char **sh;
+	int error, n;
+
+	if (strchr(argv[0], '/') == NULL &&
+	    (cmdname == NULL || strcmp(cmdname, argv[0]) != 0)) {
+		free(cmdname);
+		free(cmdpath);
+		if ((cmdname = strdup(argv[0])) == NULL)
+			err(1, NULL);
+		cmdpath = lookup(cmdname);
+	}
+
+	if ((error = posix_spawn_file_actions_init(&fa)) != 0)
+		errc(1, error, "posix_spawn_file_actions_init");
+	if ((infd != -1 &&
+	    (error = posix_spawn_file_actions_adddup2(&fa, infd,
+	    STDIN_FILENO)) != 0) ||
+	    (ofd != -1 &&
+	    (error = posix_spawn_file_actions_adddup2(&fa, ofd,
+	    STDOUT_FILENO)) != 0) ||
+	    (efd != -1 &&
+	    (error = posix_spawn_file_actions_adddup2(&fa, efd,
+	    STDERR_FILENO)) != 0))
+		errc(1, error, "posix_spawn_file_actions_adddup2");
+
+	if (strchr(argv[0], '/') != NULL)
+		error = posix_spawn(pid, argv[0], &fa, NULL, argv, environ);
+	else if (cmdpath != NULL)
+		error = posix_spawn(pid, cmdpath, &fa, NULL, argv, environ);
+	else
+		error = posix_spawnp(pid, argv[0], &fa, NULL, argv, environ);
+
+	/* Like execvp(3), hand a file without a #! line to the shell. */
+	if (error == ENOEXEC) {
+		for (n = 0; argv[n] != NULL; n++)
+			;
+		if ((sh = reallocarray(NULL, n + 2, sizeof(*sh))) == NULL)
+			err(1, NULL);
+		sh[0] = "sh";
+		sh[1] = strchr(argv[0], '/') != NULL || cmdpath == NULL ?
+		    argv[0] : cmdpath;
+		memcpy(sh + 2, argv + 1, n * sizeof(*sh));
+		error = posix_spawn(pid, _PATH_BSHELL, &fa, NULL, sh, environ);
+		free(sh);
+	}
+	posix_spawn_file_actions_destroy(&fa);
+	return (error);
+}
+
+/*
+ * Create an unlinked temporary file to hold the output of a command,
+ * in TMPDIR or else _PATH_TMP.
+ */
+static int
+spill(void)
+{
+	static const char *tmpdir;
+	char path[PATH_MAX];
+	int fd;
+
+	if (tmpdir == NULL &&
+	    ((tmpdir = getenv("TMPDIR")) == NULL || *tmpdir == '\0'))
+		tmpdir = _PATH_TMP;
+	if (snprintf(path, sizeof(path), "%s/xargs.XXXXXXXXXX", tmpdir) >=
+	    sizeof(path))
+		errc(1, ENAMETOOLONG, "%s", tmpdir);
+	if ((fd = mkstemp(path)) == -1)
+		err(1, "%s", path);
+	(void)unlink(path);
+	if (fcntl(fd, F_SETFD, FD_CLOEXEC) == -1)
+		err(1, "fcntl");
+	return (fd);
+}
+
+static void
+startjob(pid_t pid, int ofd, int efd)
+{
+	struct job *j;
+	size_t n;
+
+	if (njobs == jobsize) {
+		n = jobsize ? jobsize * 2 : 16;
+		if ((j = reallocarray(jobs, n, sizeof(*j))) == NULL)
+			err(1, NULL);
+		jobs = j;
+		jobsize = n;
+	}
+	j = &jobs[njobs++];
+	j->pid = pid;
+	j->out = ofd;
+	j->err = efd;
+}
+
+static void
+copyout(int from, int to)
+{
+	static char buf[64 * 1024];
+	ssize_t nr, nw, off;
+
+	if (lseek(from, 0, SEEK_SET) == -1)
+		err(1, "lseek");
+	while ((nr = read(from, buf, sizeof(buf))) > 0)
+		for (off = 0; off < nr; off += nw)
+			if ((nw = write(to, buf + off, nr - off)) == -1)
+				err(1, "write");
+	if (nr == -1)
+		err(1, "read");
+	close(from);
+}
+
+/*
+ * Write out the output of a finished command in one piece and give
+ * its slot back.
+ */
+static void
+emitjob(size_t i)
+{
+	copyout(jobs[i].out, STDOUT_FILENO);
+	copyout(jobs[i].err, STDERR_FILENO);
+	memmove(&jobs[i], &jobs[i + 1], (njobs - i - 1) * sizeof(*jobs));
+	njobs--;
+	curprocs--;
+}
+
+/*
+ * A command has exited.  With -g its output goes out right away; with
+ * -k it waits for every command started before it, and keeps its slot
+ * until then so that at most maxprocs spill files are ever held.
+ */
+static void
+endjob(pid_t pid)
+{
+	size_t i;
+
+	for (i = 0; i < njobs; i++)
+		if (jobs[i].pid == pid)
+			break;
+	if (i == njobs)
+		return;
+	jobs[i].pid = 0;
+	if (!kflag)
+		emitjob(i);
+	else
+		while (njobs > 0 && jobs[0].pid == 0)
+			emitjob(0);
+}
+
+/*
+ * We are about to exit early: write out every command in the order
+ * they were started, waiting for those still running, as their spill
+ * files would be lost otherwise.
+ */
+static void
+flushjobs(void)
+{
+	while (njobs > 0) {
+		if (jobs[0].pid != 0)
+			(void)waitpid(jobs[0].pid, NULL, 0);
+		emitjob(0);
+	}
+}
+
 static void
 waitchildren(const char *name, int waitall)
 {
@@ -567,7 +940,10 @@ waitchildren(const char *name, int waitall)
 
 	while ((pid = waitpid(-1, &status, !waitall && curprocs < maxprocs ?
 	    WNOHANG : 0)) > 0) {
-		curprocs--;
+		if (gflag)
+			endjob(pid);
+		else
+			curprocs--;
 		/*
 		 * According to POSIX, we have to exit if the utility exits
 		 * with a 255 status, or is interrupted by a signal.
@@ -577,15 +953,18 @@ waitchildren(const char *name, int waitall)
 		 */
 		if (WIFEXITED(status)) {
 			if (WEXITSTATUS(status) == 255) {
+				flushjobs();
 				warnx("%s exited with status 255", name);
 				exit(124);
 			} else if (WEXITSTATUS(status) == 127 ||
 			    WEXITSTATUS(status) == 126) {
+				flushjobs();
 				exit(WEXITSTATUS(status));
 			} else if (WEXITSTATUS(status) != 0) {
 				rval = 123;
 			}
 		} else if (WIFSIGNALED(status)) {
+			flushjobs();
 			if (WTERMSIG(status) != SIGPIPE) {
 				warnx("%s terminated by signal %d",
 				    name, WTERMSIG(status));
@@ -629,8 +1008,8 @@ static void
 usage(void)
 {
 	fprintf(stderr,
-"usage: xargs [-0oprt] [-E eofstr] [-I replstr [-R replacements]] [-J replstr]\n"
-"             [-L number] [-n number [-x]] [-P maxprocs] [-s size]\n"
-"             [utility [argument ...]]\n");
+"usage: xargs [-0bgkoprt] [-E eofstr] [-I replstr [-R replacements]]\n"
+"             [-J replstr] [-L number] [-n number [-x]] [-P maxprocs]\n"
+"             [-s size] [utility [argument ...]]\n");
 	exit(1);
 }